@@ -1,26 +1,51 @@
 #include "CandleConnection.h"
 
-#include <QMessageBox>
+#include <QDebug>
+#include <QMutexLocker>
 #include <QTcpSocket>
-#include <QThread>
 
 CandleConnection::CandleConnection(QObject* p)
     : QObject(p)
-    , m_connImpl(nullptr)
-{}
+    , m_outgoing(CONNECTIONQUEUESIZE)
+    , m_incoming(CONNECTIONQUEUESIZE)
+    , m_connType(CONN_NA)
+    , m_tcpPort(0)
+    , m_baudrate(0)
+    , m_bufferLength(127)
+{
+    m_responseEnds << "ok";
+
+    m_worker = new CandleConnectionWorker(this);
+    m_worker->moveToThread(&m_thread);
+
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_worker, &CandleConnectionWorker::readyRead, this, &CandleConnection::onWorkerReadyRead, Qt::QueuedConnection);
+    connect(m_worker, &CandleConnectionWorker::error, this, &CandleConnection::error, Qt::QueuedConnection);
+
+    m_thread.setObjectName("CandleConnection");
+    m_thread.start();
+}
+
+CandleConnection::~CandleConnection() {
+    if(isOpen())
+        close();
+
+    m_thread.quit();
+    m_thread.wait();
+}
 
 bool CandleConnection::openPort() {
 
     qDebug() << "CandleConnection::openPort(), type:" << m_connType;
 
-    if(m_connType == CONN_SERIAL) {
-        return openSerial();
-    } else
-    if(m_connType == CONN_TCPIP) {
-        return openTcpIp();
-    }
+    if(isOpen())
+        close();
 
-    return false;
+    // Settings are read by worker while GUI thread is blocked
+    bool rc = false;
+    QMetaObject::invokeMethod(m_worker, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, rc));
+
+    return rc;
 }
 
 int CandleConnection::write(const QByteArray& arr) {
@@ -35,37 +60,126 @@ int CandleConnection::write(const QString& str) {
 int CandleConnection::write(const char* data, int len) {
     if(!isOpen())
         return -1;
-    return m_connImpl->write(data, len);
+    post(CandleConnectionItem::ITEM_IMMEDIATE, QByteArray(data, len));
+    return len;
 }
 
-bool CandleConnection::canReadLine() {
-    bool rc = false;
-    if(m_connType == CONN_SERIAL) {
-        rc = static_cast<QSerialPort*>(m_connImpl)->canReadLine();
-    } else
-    if(m_connType == CONN_TCPIP) {
-        rc = static_cast<QTcpSocket*>(m_connImpl)->canReadLine();
+void CandleConnection::sendCommand(const QByteArray& command) {
+    if(!isOpen())
+        return;
+    post(CandleConnectionItem::ITEM_COUNTED, command);
+}
+
+void CandleConnection::clearCommands() {
+    if(!isOpen())
+        return;
+    post(CandleConnectionItem::ITEM_CLEAR, QByteArray());
+}
+
+// Items keep their order, worker is woken once per batch
+void CandleConnection::post(CandleConnectionItem::Type type, const QByteArray& data) {
+    CandleConnectionItem item;
+    item.type = type;
+    item.data = data;
+
+    while(!m_outgoing.push(item)) {
+        QMetaObject::invokeMethod(m_worker, "processOutgoing", Qt::QueuedConnection);
+        QThread::yieldCurrentThread();
     }
-    return rc;
+
+    if(m_writePending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(m_worker, "processOutgoing", Qt::QueuedConnection);
+}
+
+bool CandleConnection::canReadLine() {
+    return !m_incoming.isEmpty();
 }
+
 QByteArray CandleConnection::readLine() {
-    if(m_connType == CONN_SERIAL) {
-        return static_cast<QSerialPort*>(m_connImpl)->readLine(1024);
-    } else
-    if(m_connType == CONN_TCPIP) {
-        return static_cast<QTcpSocket*>(m_connImpl)->readLine(1024);
-    }
-    return "";
+    QByteArray line;
+    m_incoming.pop(line);
+
+    // Worker has lines which didn't fit, queue has room now
+    if(m_readStalled.testAndSetOrdered(1, 0))
+        QMetaObject::invokeMethod(m_worker, "flushReceived", Qt::QueuedConnection);
+
+    return line;
 }
 
 bool CandleConnection::isOpen() {
-    return (m_connImpl != nullptr && m_connImpl->isOpen());
+    return m_open.loadAcquire() != 0;
+}
+
+void CandleConnection::close() {
+
+    QMetaObject::invokeMethod(m_worker, "close", Qt::BlockingQueuedConnection);
+
+    // Drop lines received before close
+    QByteArray line;
+    while(m_incoming.pop(line));
+}
+
+QString CandleConnection::errorString() {
+    QMutexLocker locker(&m_errorMutex);
+    return m_errorString;
+}
+
+// Flag is reset before handler drains queue, so lines pushed meanwhile are notified again
+void CandleConnection::onWorkerReadyRead() {
+    m_readPending.storeRelease(0);
+    emit readyRead();
+}
+
+void CandleConnection::registerReadHandler(QObject* obj, const char* method) {
+    connect(this, SIGNAL(readyRead()), obj, method);
+}
+
+void CandleConnection::registerErrorHandler(QObject* obj, const char* method) {
+    connect(this, SIGNAL(error(int)), obj, method);
 }
 
-bool CandleConnection::openSerial() {
+CandleConnectionWorker::CandleConnectionWorker(CandleConnection* connection)
+    : m_connection(connection)
+    , m_device(nullptr)
+    , m_bufferLength(0)
+    , m_pendingOffset(0)
+    , m_pendingLengths(CONNECTIONQUEUESIZE)
+    , m_sentLengths(CONNECTIONQUEUESIZE)
+    , m_sentLength(0)
+    , m_received(CONNECTIONQUEUESIZE)
+{}
+
+bool CandleConnectionWorker::open() {
+
+    m_bufferLength = m_connection->m_bufferLength;
+    m_responseEnds = m_connection->m_responseEnds;
 
-    m_connImpl = new QSerialPort(parent());
-    auto conn = static_cast<QSerialPort*>(m_connImpl);
+    bool rc = false;
+    if(m_connection->m_connType == CandleConnection::CONN_SERIAL) {
+        rc = openSerial();
+    } else
+    if(m_connection->m_connType == CandleConnection::CONN_TCPIP) {
+        rc = openTcpIp();
+    }
+
+    if(!rc && m_device) {
+        {
+            QMutexLocker locker(&m_connection->m_errorMutex);
+            m_connection->m_errorString = m_device->errorString();
+        }
+        delete m_device;
+        m_device = nullptr;
+    }
+
+    m_connection->m_open.storeRelease(rc);
+
+    return rc;
+}
+
+bool CandleConnectionWorker::openSerial() {
+
+    m_device = new QSerialPort(this);
+    auto conn = static_cast<QSerialPort*>(m_device);
 
     // Setup serial port
     conn->setParity(QSerialPort::NoParity);
@@ -73,23 +187,24 @@ bool CandleConnection::openSerial() {
     conn->setFlowControl(QSerialPort::NoFlowControl);
     conn->setStopBits(QSerialPort::OneStop);
 
-    conn->setPortName(m_serialPort);
-    conn->setBaudRate(m_baudrate);
+    conn->setPortName(m_connection->m_serialPort);
+    conn->setBaudRate(m_connection->m_baudrate);
+
+    connect(conn, &QIODevice::readyRead, this, &CandleConnectionWorker::onReadyRead);
+    connect(conn, &QSerialPort::errorOccurred, this, &CandleConnectionWorker::onSerialError);
 
     return conn->open(QIODevice::ReadWrite);
 }
 
-bool CandleConnection::openTcpIp() {
-    m_connImpl = new QTcpSocket(parent());
-    auto conn = static_cast<QTcpSocket*>(m_connImpl);
-
-//    connect(conn, &QIODevice::readyRead, this, &CandleConnection::tcpReadyRead);
-    connect(conn, SIGNAL(readyRead()), parent(), SLOT(onCommReadyRead()), Qt::QueuedConnection);
+bool CandleConnectionWorker::openTcpIp() {
+    m_device = new QTcpSocket(this);
+    auto conn = static_cast<QTcpSocket*>(m_device);
 
-    connect(conn, &QAbstractSocket::errorOccurred, this, &CandleConnection::tcpConnError);
+    connect(conn, &QIODevice::readyRead, this, &CandleConnectionWorker::onReadyRead);
+    connect(conn, &QAbstractSocket::errorOccurred, this, &CandleConnectionWorker::onTcpError);
 
-    qDebug() << "CandleConnection::openTcpIp() connecting to:" << m_tcpHost << ":" << m_tcpPort;
-    conn->connectToHost(m_tcpHost, m_tcpPort, QIODevice::ReadWrite, QAbstractSocket::IPv4Protocol);
+    qDebug() << "CandleConnection::openTcpIp() connecting to:" << m_connection->m_tcpHost << ":" << m_connection->m_tcpPort;
+    conn->connectToHost(m_connection->m_tcpHost, m_connection->m_tcpPort, QIODevice::ReadWrite, QAbstractSocket::IPv4Protocol);
 
     if (!conn->waitForConnected(1000)) {
         qDebug() << "Connection timeout" << conn->error() <<  conn->errorString();
@@ -98,42 +213,186 @@ bool CandleConnection::openTcpIp() {
     qDebug() << "CandleConnection::openTcpIp() connection state:" << conn->state();
 
     if(conn->state() != QAbstractSocket::ConnectedState) {
-        m_connImpl->close();
-        delete m_connImpl;
-        m_connImpl =  nullptr;
+        m_device->close();
         return false;
     }
 
     return true;
 }
 
-void CandleConnection::close() {
+void CandleConnectionWorker::close() {
 
-    if(m_connType == CONN_SERIAL) {
-        closeSerial();
-    } else
-    if(m_connType == CONN_TCPIP) {
-        closeTcpIp();
+    m_connection->m_open.storeRelease(0);
+
+    if(m_device) {
+        m_device->close();
+        delete m_device;
+        m_device = nullptr;
+    }
+
+    // Drop not yet sent & unacknowledged commands
+    m_connection->m_writePending.storeRelease(0);
+    CandleConnectionItem item;
+    while(m_connection->m_outgoing.pop(item));
+
+    clearPending();
+    m_sentLengths.clear();
+    m_sentLength = 0;
+    m_received.clear();
+    m_connection->m_readStalled.storeRelease(0);
+}
+
+void CandleConnectionWorker::processOutgoing() {
+
+    m_connection->m_writePending.storeRelease(0);
+
+    CandleConnectionItem item;
+    while(m_connection->m_outgoing.pop(item)) {
+        switch(item.type) {
+        case CandleConnectionItem::ITEM_IMMEDIATE:
+            if(m_device)
+                m_device->write(item.data);
+            break;
+        case CandleConnectionItem::ITEM_COUNTED:
+            appendPending(item.data);
+            break;
+        case CandleConnectionItem::ITEM_CLEAR:
+            clearPending();
+            m_sentLengths.clear();
+            m_sentLength = 0;
+            break;
+        }
     }
 
-    m_connImpl->close();
-    delete m_connImpl;
-    m_connImpl = nullptr;
+    sendPending();
+    flushReceived();
 }
 
-void CandleConnection::closeSerial() {
+// Item may hold several '\r' terminated commands
+void CandleConnectionWorker::appendPending(const QByteArray& data) {
+    int from = 0;
+
+    while(from < data.length()) {
+        int end = data.indexOf('\r', from);
+        end = end < 0 ? data.length() : end + 1;
+
+        if(!m_pendingLengths.append(end - from)) {
+            qWarning() << "pending commands overflow, dropped:" << data.length() - from << "bytes";
+            break;
+        }
+        from = end;
+    }
+
+    m_pendingData.append(data.constData(), from);
 }
 
-void CandleConnection::closeTcpIp() {
+void CandleConnectionWorker::clearPending() {
+    m_pendingData.clear();
+    m_pendingOffset = 0;
+    m_pendingLengths.clear();
+}
+
+// Character-counting flow control, commands fitting controller's buffer are written at once
+void CandleConnectionWorker::sendPending() {
+    if(!m_device)
+        return;
+
+    int length = 0;
 
+    while(!m_pendingLengths.isEmpty() && !m_sentLengths.isFull()
+          && (m_sentLength + m_pendingLengths.first() <= m_bufferLength || m_sentLengths.isEmpty())) {
+        int command = m_pendingLengths.takeFirst();
+
+        m_sentLengths.append(command);
+        m_sentLength += command;
+        length += command;
+    }
+
+    if(length == 0)
+        return;
+
+    m_device->write(m_pendingData.constData() + m_pendingOffset, length);
+    m_pendingOffset += length;
+
+    // Written bytes are dropped when they make most of buffer
+    if(m_pendingLengths.isEmpty()) {
+        clearPending();
+    } else if(m_pendingOffset > m_pendingData.length() / 2) {
+        m_pendingData.remove(0, m_pendingOffset);
+        m_pendingOffset = 0;
+    }
 }
 
-QString CandleConnection::errorString() {
-   return m_connImpl->errorString();
+void CandleConnectionWorker::onReadyRead() {
+    readLines();
+    sendPending();
+    flushReceived();
 }
 
-void CandleConnection::tcpConnError(QAbstractSocket::SocketError socketError) {
-    auto conn = static_cast<QTcpSocket*>(m_connImpl);
+// Lines are left in device while received lines buffer is full, they're read when GUI takes lines
+void CandleConnectionWorker::readLines() {
+    while(m_device && !m_received.isFull() && m_device->canReadLine()) {
+        QByteArray line = m_device->readLine(1024);
+        QByteArray data = line.trimmed();
+
+        // Status reports aren't command responses
+        if(!data.startsWith('<') && isResponseEnd(data) && !m_sentLengths.isEmpty())
+            m_sentLength -= m_sentLengths.takeFirst();
+
+        m_received.append(line);
+    }
+}
+
+bool CandleConnectionWorker::isResponseEnd(const QByteArray& data) {
+    foreach (const QByteArray& end, m_responseEnds) {
+        if(data.contains(end))
+            return true;
+    }
+    return false;
+}
+
+// GUI is notified once until it drains queue. If queue is full, GUI wakes worker on next line taken,
+// flag is set before last push attempt so line taken in between isn't missed.
+void CandleConnectionWorker::flushReceived() {
+    bool pushed = false;
+
+    while(!m_received.isEmpty()) {
+        if(!m_connection->m_incoming.push(m_received.first())) {
+            m_connection->m_readStalled.storeRelease(1);
+            if(!m_connection->m_incoming.push(m_received.first()))
+                break;
+        }
+        m_received.takeFirst();
+        pushed = true;
+
+        if(m_received.isEmpty() && m_device && m_device->canReadLine()) {
+            readLines();
+            sendPending();
+        }
+    }
+
+    if(pushed && m_connection->m_readPending.testAndSetOrdered(0, 1))
+        emit readyRead();
+}
+
+void CandleConnectionWorker::onSerialError(QSerialPort::SerialPortError serialError) {
+    if(serialError == QSerialPort::NoError)
+        return;
+
+    {
+        QMutexLocker locker(&m_connection->m_errorMutex);
+        m_connection->m_errorString = m_device ? m_device->errorString() : QString();
+    }
+
+    emit error(serialError);
+}
+
+void CandleConnectionWorker::onTcpError(QAbstractSocket::SocketError socketError) {
+
+    {
+        QMutexLocker locker(&m_connection->m_errorMutex);
+        m_connection->m_errorString = m_device ? m_device->errorString() : QString();
+    }
 
     switch (socketError) {
     case QAbstractSocket::RemoteHostClosedError:
@@ -149,16 +408,6 @@ void CandleConnection::tcpConnError(QAbstractSocket::SocketError socketError) {
                                     "settings are correct.");
         break;
     default:
-        qDebug() << tr("The following error occurred: %1.") << conn->errorString();
+        qDebug() << tr("The following error occurred: %1.") << m_device->errorString();
     }
 }
-
-void CandleConnection::tcpReadyRead() {
-    qDebug() << "CandleConnection::tcpReadyRead()";
-}
-
-void CandleConnection::registerReadHandler(QObject* obj, const char* method) {
-}
-
-void CandleConnection::registerErrorHandler(QObject* obj, const char* method) {
-}
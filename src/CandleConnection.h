@@ -4,14 +4,37 @@
 #include <QObject>
 #include <QtSerialPort/QSerialPort>
 #include <QAbstractSocket>
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInt>
 
+#include "utils/spscqueue.h"
+#include "utils/ringbuffer.h"
+
+// Max outgoing items, counted commands & received lines in flight between GUI & I/O threads
+#define CONNECTIONQUEUESIZE 4096
+
+class CandleConnectionWorker;
+
+// Outgoing item of I/O thread
+struct CandleConnectionItem {
+    typedef enum {ITEM_IMMEDIATE, ITEM_COUNTED, ITEM_CLEAR} Type;
+
+    Type type;
+    QByteArray data;
+};
+
+// Controller link. Device lives in dedicated I/O thread, GUI thread talks to it through lock-free queues only.
+// Counted commands are fed to controller by I/O thread as soon as controller's receive buffer has room for them,
+// so streaming keeps going while GUI event loop is busy.
 class CandleConnection : public QObject
 {
-//    Q_OBJECT
+    Q_OBJECT
 public:
     typedef enum {CONN_NA, CONN_SERIAL, CONN_TCPIP} Type;
 public:
     CandleConnection(QObject *parent=nullptr);
+    ~CandleConnection();
     void setConnType(Type connType)
     {m_connType = connType;}
     void setPortName(const QString& sPort)
@@ -30,10 +53,21 @@ public:
     {m_tcpHost = h;}
     uint16_t tcpPort()
     {return m_tcpPort;}
+    // Controller's receive buffer size & responses acknowledging counted command, applied on openPort()
+    void setBufferLength(int length)
+    {m_bufferLength = length;}
+    void setResponseEnds(const QList<QByteArray>& ends)
+    {m_responseEnds = ends;}
     bool openPort();
+    // Written immediately, real-time commands
     int write(const char* data, int len);
     int write(const QByteArray& arr);
     int write(const QString& str);
+    // Written by character-counting flow control, one or more '\r' terminated commands.
+    // Commands not yet acknowledged are limited to CONNECTIONQUEUESIZE, senders keep them in send-ahead window.
+    void sendCommand(const QByteArray& command);
+    // Drops counted commands not yet acknowledged, controller's buffer is assumed empty (reset)
+    void clearCommands();
     bool canReadLine();
     QByteArray readLine();
     bool isOpen();
@@ -41,21 +75,83 @@ public:
     void registerReadHandler(QObject* obj, const char* method);
     void registerErrorHandler(QObject* obj, const char* method);
     QString errorString();
-private:
-    bool openSerial();
-    bool openTcpIp();
-    void closeSerial();
-    void closeTcpIp();
 signals:
-    void tcpReadyRead();
-    void tcpConnError(QAbstractSocket::SocketError socketError);
+    void readyRead();
+    void error(int error);
+private slots:
+    void onWorkerReadyRead();
+private:
+    void post(CandleConnectionItem::Type type, const QByteArray& data);
 private:
-    QIODevice* m_connImpl;
+    friend class CandleConnectionWorker;
+
+    QThread m_thread;
+    CandleConnectionWorker* m_worker;
+
+    // GUI -> I/O thread
+    SpscQueue<CandleConnectionItem> m_outgoing;
+    QAtomicInt m_writePending;
+    // I/O thread -> GUI
+    SpscQueue<QByteArray> m_incoming;
+    QAtomicInt m_readPending;
+    // Worker waits for room in incoming queue
+    QAtomicInt m_readStalled;
+
+    QAtomicInt m_open;
+    QMutex m_errorMutex;
+    QString m_errorString;
+
     Type m_connType;
     uint16_t m_tcpPort;
     QString  m_tcpHost;
     QString  m_serialPort;
     int m_baudrate;
+    int m_bufferLength;
+    QList<QByteArray> m_responseEnds;
+};
+
+// Owns device, runs in I/O thread
+class CandleConnectionWorker : public QObject
+{
+    Q_OBJECT
+public:
+    CandleConnectionWorker(CandleConnection* connection);
+public slots:
+    bool open();
+    void close();
+    void processOutgoing();
+    void flushReceived();
+signals:
+    void readyRead();
+    void error(int error);
+private slots:
+    void onReadyRead();
+    void onSerialError(QSerialPort::SerialPortError serialError);
+    void onTcpError(QAbstractSocket::SocketError socketError);
+private:
+    bool openSerial();
+    bool openTcpIp();
+    void readLines();
+    void appendPending(const QByteArray& data);
+    void clearPending();
+    void sendPending();
+    bool isResponseEnd(const QByteArray& data);
+private:
+    CandleConnection* m_connection;
+    QIODevice* m_device;
+
+    int m_bufferLength;
+    QList<QByteArray> m_responseEnds;
+
+    // Counted commands waiting for room in controller's buffer, written part of data is skipped by offset
+    QByteArray m_pendingData;
+    int m_pendingOffset;
+    RingBuffer<int> m_pendingLengths;
+    // Lengths of commands in controller's buffer
+    RingBuffer<int> m_sentLengths;
+    int m_sentLength;
+    // Lines not fitting full incoming queue, device isn't read while it's full
+    RingBuffer<QByteArray> m_received;
 };
 
 #endif // CANDLECONNECTION_H
@@ -0,0 +1,51 @@
+#include "CommandBuffer.h"
+#include "SendStream.h"
+
+CommandBuffer::CommandBuffer(int windowLength)
+    : m_commands(windowLength)
+    , m_windowLength(windowLength)
+    , m_bufferLength(0)
+{}
+
+bool CommandBuffer::append(const CommandAttributes& ca)
+{
+    if (!m_commands.append(ca)) return false;
+
+    m_bufferLength += ca.length;
+
+    return true;
+}
+
+CommandAttributes CommandBuffer::takeFirst()
+{
+    CommandAttributes ca = m_commands.takeFirst();
+    m_bufferLength -= ca.length;
+
+    return ca;
+}
+
+void CommandBuffer::clear()
+{
+    m_commands.clear();
+    m_bufferLength = 0;
+}
+
+int CommandBuffer::appendStream(const SendStream& stream, int index, int stopFlags)
+{
+    while (index < stream.count()
+           && fits(stream.length(index))
+           && !(!m_commands.isEmpty() && (m_commands.last().flags & stopFlags))) {
+        CommandAttributes ca;
+
+        ca.streamIndex = index;
+        ca.length = stream.length(index);
+        ca.consoleIndex = -1;
+        ca.tableIndex = index;
+        ca.flags = stream.flags(index);
+
+        append(ca);
+        index++;
+    }
+
+    return index;
+}
@@ -0,0 +1,77 @@
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <QString>
+
+#include "utils/ringbuffer.h"
+
+class SendStream;
+
+struct CommandAttributes {
+    int length;
+    int consoleIndex;
+    int tableIndex;
+    // SendStream flags of command
+    int flags;
+    // Program command index in send stream, its text isn't stored; -1 for other commands
+    int streamIndex = -1;
+    QString command;
+};
+
+struct CommandQueue {
+    QString command;
+    int tableIndex;
+    bool showInConsole;
+};
+
+// Commands handed to controller ahead of its acknowledgements, in sending order.
+// Total length is counted on append & take, so send-ahead window check is O(1).
+// Every command takes at least one byte of window, so window length bounds commands count.
+class CommandBuffer
+{
+public:
+    explicit CommandBuffer(int windowLength);
+
+    int windowLength() const
+    {return m_windowLength;}
+    // Total length of commands
+    int bufferLength() const
+    {return m_bufferLength;}
+    bool fits(int length) const
+    {return !m_commands.isFull() && m_bufferLength + length <= m_windowLength;}
+
+    bool append(const CommandAttributes& ca);
+    CommandAttributes takeFirst();
+    void clear();
+
+    // Appends stream commands starting from index while they fit window & last command has none of stopFlags.
+    // Returns index past last appended command, appended commands aren't shown in console.
+    int appendStream(const SendStream& stream, int index, int stopFlags);
+
+    int count() const
+    {return m_commands.count();}
+    int length() const
+    {return m_commands.count();}
+    bool isEmpty() const
+    {return m_commands.isEmpty();}
+
+    CommandAttributes& operator[](int i)
+    {return m_commands[i];}
+    const CommandAttributes& at(int i) const
+    {return m_commands.at(i);}
+    CommandAttributes& first()
+    {return m_commands.first();}
+    const CommandAttributes& first() const
+    {return m_commands.first();}
+    CommandAttributes& last()
+    {return m_commands.last();}
+    const CommandAttributes& last() const
+    {return m_commands.last();}
+
+private:
+    RingBuffer<CommandAttributes> m_commands;
+    int m_windowLength;
+    int m_bufferLength;
+};
+
+#endif // COMMANDBUFFER_H
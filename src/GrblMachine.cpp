@@ -55,6 +55,9 @@ GrblMachine::GrblMachine(frmMain* frm, Ui::frmMain* ui, CandleConnection& connec
                       << "palette(text)"
                       << "white"
                       << "black";
+
+    // Responses acknowledging sent command, same as dataIsEnd()
+    m_connection.setResponseEnds(QList<QByteArray>() << "ok" << "error");
 }
 
 bool GrblMachine::dataIsReset(QString data) {
@@ -71,7 +74,11 @@ void GrblMachine::sendCommand(const QString &command, int tableIndex, bool showI
 void GrblMachine::onReadyRead()
 {
     while (m_connection.canReadLine()) {
-        QString data = m_connection.readLine().trimmed();
+        QByteArray line = m_connection.readLine().trimmed();
+
+        // Status reports are parsed from raw bytes
+        bool statusReport = line.startsWith('<');
+        QString data = statusReport ? QString() : QString::fromLatin1(line);
 
         // Filter prereset responses
         if (m_reseting) {
@@ -84,147 +91,121 @@ void GrblMachine::onReadyRead()
         }
 
         // Status response
-        if (data[0] == '<') {
-            int status = UNKNOWN;
-
-            m_statusReceived = true;
+        if (statusReport) {
+            GrblStatusParser::parse(line.constData(), line.length(), &m_machineStatus);
 
-            // Update machine coordinates
-            static QRegExp mpx("MPos:([^,]*),([^,]*),([^,^>^|]*)");
-            if (mpx.indexIn(data) != -1) {
-                m_ui->txtMPosX->setText(mpx.cap(1));
-                m_ui->txtMPosY->setText(mpx.cap(2));
-                m_ui->txtMPosZ->setText(mpx.cap(3));
-            }
+            // Positions, overridings, feed/spindle & buffer, displayed by main form
+            MachineState &state = m_frm->machineState();
+            state.update(m_machineStatus);
 
-            // Status
-            static QRegExp stx("<([^,^>^|]*)");
-            if (stx.indexIn(data) != -1) {
-                status = m_status.indexOf(stx.cap(1));
+            int status = m_machineStatus.state;
 
-                // Undetermined status
-                if (status == -1) status = 0;
+            m_statusReceived = true;
 
-                // Update status
-                if (status != m_lastGrblStatus) {
-                    m_ui->txtStatus->setText(m_statusCaptions[status]);
-                    m_ui->txtStatus->setStyleSheet(QString("background-color: %1; color: %2;")
-                                                 .arg(m_statusBackColors[status]).arg(m_statusForeColors[status]));
-                }
+            // Update status
+            if (status != m_lastGrblStatus) {
+                m_ui->txtStatus->setText(m_statusCaptions[status]);
+                m_ui->txtStatus->setStyleSheet(QString("background-color: %1; color: %2;")
+                                             .arg(m_statusBackColors[status]).arg(m_statusForeColors[status]));
+            }
 
-                // Update controls
-                m_ui->cmdRestoreOrigin->setEnabled(status == IDLE);
-                m_ui->cmdSafePosition->setEnabled(status == IDLE);
-                m_ui->cmdZeroXY->setEnabled(status == IDLE);
-                m_ui->cmdZeroZ->setEnabled(status == IDLE);
-                m_ui->chkTestMode->setEnabled(status != RUN && !m_processingFile);
-                m_ui->chkTestMode->setChecked(status == CHECK);
-                m_ui->cmdFilePause->setChecked(status == HOLD0 || status == HOLD1 || status == QUEUE);
-                m_ui->cmdSpindle->setEnabled(!m_processingFile || status == HOLD0);
+            // Update controls
+            m_ui->cmdRestoreOrigin->setEnabled(status == IDLE);
+            m_ui->cmdSafePosition->setEnabled(status == IDLE);
+            m_ui->cmdZeroXY->setEnabled(status == IDLE);
+            m_ui->cmdZeroZ->setEnabled(status == IDLE);
+            m_ui->chkTestMode->setEnabled(status != RUN && !m_processingFile);
+            m_ui->chkTestMode->setChecked(status == CHECK);
+            m_ui->cmdFilePause->setChecked(status == HOLD0 || status == HOLD1 || status == QUEUE);
+            m_ui->cmdSpindle->setEnabled(!m_processingFile || status == HOLD0);
 #ifdef WINDOWS
-                if (QSysInfo::windowsVersion() >= QSysInfo::WV_WINDOWS7) {
-                    if (m_taskBarProgress) m_taskBarProgress->setPaused(status == HOLD0 || status == HOLD1 || status == QUEUE);
-                }
+            if (QSysInfo::windowsVersion() >= QSysInfo::WV_WINDOWS7) {
+                if (m_taskBarProgress) m_taskBarProgress->setPaused(status == HOLD0 || status == HOLD1 || status == QUEUE);
+            }
 #endif
 
-                // Update "elapsed time" timer
-                if (m_processingFile) {
-                    QTime time(0, 0, 0);
-                    int elapsed = m_frm->startTime().elapsed();
-                    m_ui->glwVisualizer->setSpendTime(time.addMSecs(elapsed));
-                }
+            // Update "elapsed time" timer
+            if (m_processingFile) {
+                QTime time(0, 0, 0);
+                int elapsed = m_frm->startTime().elapsed();
+                m_ui->glwVisualizer->setSpendTime(time.addMSecs(elapsed));
+            }
 
-                // Test for job complete
-                if (m_processingFile && m_transferCompleted &&
-                        ((status == IDLE && m_lastGrblStatus == RUN) || status == CHECK)) {
-                    qDebug() << "job completed:" << m_fileCommandIndex << m_frm->currentModel()->rowCount() - 1;
-
-                    // Shadow last segment
-                    GcodeViewParse *parser = m_frm->currentDrawer()->viewParser();
-                    QList<LineSegment*> list = parser->getLineSegmentList();
-                    if (m_lastDrawnLineIndex < list.count()) {
-                        list[m_lastDrawnLineIndex]->setDrawn(true);
-                        m_frm->currentDrawer()->update(QList<int>() << m_lastDrawnLineIndex);
-                    }
+            // Test for job complete
+            if (m_processingFile && m_transferCompleted &&
+                    ((status == IDLE && m_lastGrblStatus == RUN) || status == CHECK)) {
+                qDebug() << "job completed:" << m_fileCommandIndex << m_frm->currentModel()->rowCount() - 1;
 
-                    // Update state
-                    m_processingFile = false;
-                    m_fileProcessedCommandIndex = 0;
-                    m_lastDrawnLineIndex = 0;
-                    m_storedParserStatus.clear();
+                // Shadow last segment
+                GcodeViewParse *parser = m_frm->currentDrawer()->viewParser();
+                LineSegmentStore *list = parser->getLines();
+                if (m_lastDrawnLineIndex < list->count()) {
+                    list->setDrawn(m_lastDrawnLineIndex, true);
+                    m_frm->currentDrawer()->update(QList<int>() << m_lastDrawnLineIndex);
+                }
 
-                    m_frm->updateControlsState();
+                // Update state
+                m_processingFile = false;
+                m_fileProcessedCommandIndex = 0;
+                m_lastDrawnLineIndex = 0;
+                m_storedParserStatus.clear();
 
-                    qApp->beep();
+                m_frm->updateControlsState();
 
-                    m_frm->timerStateQuery().stop();
-                    m_frm->timerConnection().stop();
+                qApp->beep();
 
-                    QMessageBox::information((QWidget*)m_frm, qApp->applicationDisplayName(), tr("Job done.\nTime elapsed: %1")
-                                             .arg(m_ui->glwVisualizer->spendTime().toString("hh:mm:ss")));
+                m_frm->timerStateQuery().stop();
+                m_frm->timerConnection().stop();
 
-                    m_frm->timerStateQuery().setInterval(m_frm->settings()->queryStateTime());
-                    m_frm->timerConnection().start();
-                    m_frm->timerStateQuery().start();
-                }
+                QMessageBox::information((QWidget*)m_frm, qApp->applicationDisplayName(), tr("Job done.\nTime elapsed: %1")
+                                         .arg(m_ui->glwVisualizer->spendTime().toString("hh:mm:ss")));
 
-                // Store status
-                if (status != m_lastGrblStatus) m_lastGrblStatus = status;
-
-                // Abort
-                static double x = sNan;
-                static double y = sNan;
-                static double z = sNan;
-
-                if (m_aborting) {
-                    switch (status) {
-                    case IDLE: // Idle
-                        if (!m_processingFile && m_resetCompleted) {
-                            m_aborting = false;
-                            restoreOffsets();
-                            restoreParserState();
-                            return;
-                        }
-                        break;
-                    case HOLD0: // Hold
-                    case HOLD1:
-                    case QUEUE:
-                        if (!m_reseting && compareCoordinates(x, y, z)) {
-                            x = sNan;
-                            y = sNan;
-                            z = sNan;
-                            machineReset();
-                        } else {
-                            x = m_ui->txtMPosX->text().toDouble();
-                            y = m_ui->txtMPosY->text().toDouble();
-                            z = m_ui->txtMPosZ->text().toDouble();
-                        }
-                        break;
-                    }
-                }
+                m_frm->timerStateQuery().setInterval(m_frm->settings()->queryStateTime());
+                m_frm->timerConnection().start();
+                m_frm->timerStateQuery().start();
             }
 
-            // Store work offset
-            static QVector3D workOffset;
-            static QRegExp wpx("WCO:([^,]*),([^,]*),([^,^>^|]*)");
-
-            if (wpx.indexIn(data) != -1)
-            {
-                workOffset = QVector3D(wpx.cap(1).toDouble(), wpx.cap(2).toDouble(), wpx.cap(3).toDouble());
+            // Store status
+            if (status != m_lastGrblStatus) m_lastGrblStatus = status;
+
+            // Abort
+            static double x = sNan;
+            static double y = sNan;
+            static double z = sNan;
+
+            if (m_aborting) {
+                switch (status) {
+                case IDLE: // Idle
+                    if (!m_processingFile && m_resetCompleted) {
+                        m_aborting = false;
+                        restoreOffsets();
+                        restoreParserState();
+                        return;
+                    }
+                    break;
+                case HOLD0: // Hold
+                case HOLD1:
+                case QUEUE:
+                    if (!m_reseting && compareCoordinates(x, y, z)) {
+                        x = sNan;
+                        y = sNan;
+                        z = sNan;
+                        machineReset();
+                    } else {
+                        x = state.machinePosition(0);
+                        y = state.machinePosition(1);
+                        z = state.machinePosition(2);
+                    }
+                    break;
+                }
             }
 
-            // Update work coordinates
-            int prec = m_frm->settings()->units() == 0 ? 3 : 4;
-            m_ui->txtWPosX->setText(QString::number(m_ui->txtMPosX->text().toDouble() - workOffset.x(), 'f', prec));
-            m_ui->txtWPosY->setText(QString::number(m_ui->txtMPosY->text().toDouble() - workOffset.y(), 'f', prec));
-            m_ui->txtWPosZ->setText(QString::number(m_ui->txtMPosZ->text().toDouble() - workOffset.z(), 'f', prec));
-
             // Update tool position
             QVector3D toolPosition;
             if (!(status == CHECK && m_fileProcessedCommandIndex < m_frm->currentModel()->rowCount() - 1)) {
-                toolPosition = QVector3D(toMetric(m_ui->txtWPosX->text().toDouble()),
-                                         toMetric(m_ui->txtWPosY->text().toDouble()),
-                                         toMetric(m_ui->txtWPosZ->text().toDouble()));
+                toolPosition = QVector3D(toMetric(state.workPosition(0)),
+                                         toMetric(state.workPosition(1)),
+                                         toMetric(state.workPosition(2)));
                 m_frm->toolDrawer().setToolPosition(m_frm->codeDrawer()->getIgnoreZ() ? QVector3D(toolPosition.x(), toolPosition.y(), 0) : toolPosition);
             }
 
@@ -236,12 +217,12 @@ void GrblMachine::onReadyRead()
                 bool toolOntoolpath = false;
 
                 QList<int> drawnLines;
-                QList<LineSegment*> list = parser->getLineSegmentList();
+                LineSegmentStore *list = parser->getLines();
 
-                for (int i = m_lastDrawnLineIndex; i < list.count()
-                     && list.at(i)->getLineNumber()
+                for (int i = m_lastDrawnLineIndex; i < list->count()
+                     && list->getLineNumber(i)
                      <= (m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileProcessedCommandIndex, 4)).toInt() + 1); i++) {
-                    if (list.at(i)->contains(toolPosition)) {
+                    if (list->contains(i, toolPosition)) {
                         toolOntoolpath = true;
                         m_lastDrawnLineIndex = i;
                         break;
@@ -251,24 +232,23 @@ void GrblMachine::onReadyRead()
 
                 if (toolOntoolpath) {
                     foreach (int i, drawnLines) {
-                        list.at(i)->setDrawn(true);
+                        list->setDrawn(i, true);
                     }
                     if (!drawnLines.isEmpty()) m_frm->currentDrawer()->update(drawnLines);
-                } else if (m_lastDrawnLineIndex < list.count()) {
-                    qDebug() << "tool missed:" << list.at(m_lastDrawnLineIndex)->getLineNumber()
+                } else if (m_lastDrawnLineIndex < list->count()) {
+                    qDebug() << "tool missed:" << list->getLineNumber(m_lastDrawnLineIndex)
                              << m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileProcessedCommandIndex, 4)).toInt()
                              << m_fileProcessedCommandIndex;
                 }
             }
 
             // Get overridings
-            static QRegExp ov("Ov:([^,]*),([^,]*),([^,^>^|]*)");
-            if (ov.indexIn(data) != -1)
+            if (m_machineStatus.fields & MachineStatus::Overrides)
             {
-                m_frm->updateOverride(m_ui->slbFeedOverride, ov.cap(1).toInt(), 0x91);
-                m_frm->updateOverride(m_ui->slbSpindleOverride, ov.cap(3).toInt(), 0x9a);
+                m_frm->updateOverride(m_ui->slbFeedOverride, state.feedOverride(), 0x91);
+                m_frm->updateOverride(m_ui->slbSpindleOverride, state.spindleOverride(), 0x9a);
 
-                int rapid = ov.cap(2).toInt();
+                int rapid = state.rapidOverride();
                 m_ui->slbRapidOverride->setCurrentValue(rapid);
 
                 int target = m_ui->slbRapidOverride->isChecked() ? m_ui->slbRapidOverride->value() : 100;
@@ -285,39 +265,24 @@ void GrblMachine::onReadyRead()
                     break;
                 }
 
-                // Update pins state
-                QString pinState;
-                static QRegExp pn("Pn:([^|^>]*)");
-                if (pn.indexIn(data) != -1) {
-                    pinState.append(QString(tr("PS: %1")).arg(pn.cap(1)));
-                }
+                // Pins & accessories are reported along with overridings, missing ones are off
+                const char *pins = m_machineStatus.fields & MachineStatus::Pins ? m_machineStatus.pins : "";
+                int accessories = m_machineStatus.fields & MachineStatus::Accessories ? m_machineStatus.accessories : 0;
+
+                state.setPins(pins, accessories);
 
                 // Process spindle state
-                static QRegExp as("A:([^,^>^|]+)");
-                if (as.indexIn(data) != -1) {
-                    QString state = as.cap(1);
-                    m_spindleCW = state.contains("S");
-                    if (state.contains("S") || state.contains("C")) {
+                if (accessories != m_lastAccessories) {
+                    m_lastAccessories = accessories;
+                    m_spindleCW = accessories & MachineStatus::SpindleCW;
+                    if (accessories & (MachineStatus::SpindleCW | MachineStatus::SpindleCCW)) {
                         m_frm->timerToolAnimation().start(25, this);
                         m_ui->cmdSpindle->setChecked(true);
                     } else {
                         m_frm->timerToolAnimation().stop();
                         m_ui->cmdSpindle->setChecked(false);
                     }
-
-                    if (!pinState.isEmpty()) pinState.append(" / ");
-                    pinState.append(QString(tr("AS: %1")).arg(as.cap(1)));
-                } else {
-                    m_frm->timerToolAnimation().stop();
-                    m_ui->cmdSpindle->setChecked(false);
                 }
-                m_ui->glwVisualizer->setPinState(pinState);
-            }
-
-            // Get feed/spindle values
-            static QRegExp fs("FS:([^,]*),([^,^|^>]*)");
-            if (fs.indexIn(data) != -1) {
-                m_ui->glwVisualizer->setSpeedState((QString(tr("F/S: %1 / %2")).arg(fs.cap(1)).arg(fs.cap(2))));
             }
 
         } else if (data.length() > 0) {
@@ -400,13 +365,12 @@ void GrblMachine::onReadyRead()
                     }
 
                     // Clear command buffer on "M2" & "M30" command (old firmwares)
-                    if ((ca.command.contains("M2") || ca.command.contains("M30")) && response.contains("ok") && !response.contains("[Pgm End]")) {
-                        m_commands.clear();
-                        m_queue.clear();
+                    if ((ca.flags & SendStream::ProgramEnd) && response.contains("ok") && !response.contains("[Pgm End]")) {
+                        clearCommands();
                     }
 
                     // Process probing on heightmap mode only from table commands
-                    if (ca.command.contains("G38.2") && m_frm->heightMapMode() && ca.tableIndex > -1) {
+                    if ((ca.flags & SendStream::Probe) && m_frm->heightMapMode() && ca.tableIndex > -1) {
                         // Get probe Z coordinate
                         // "[PRB:0.000,0.000,0.000:0];ok"
                         QRegExp rx(".*PRB:([^,]*),([^,]*),([^]^:]*)");
@@ -444,7 +408,7 @@ void GrblMachine::onReadyRead()
                     }
 
                     // Add response to console
-                    if (tb.isValid() && tb.text() == ca.command) {
+                    if (tb.isValid() && tb.text() == commandText(ca)) {
 
                         bool scrolledDown = m_ui->txtConsole->verticalScrollBar()->value() == m_ui->txtConsole->verticalScrollBar()->maximum();
 
@@ -467,7 +431,7 @@ void GrblMachine::onReadyRead()
                     // Check queue
                     if (m_queue.length() > 0) {
                         CommandQueue cq = m_queue.takeFirst();
-                        while ((bufferLength() + cq.command.length() + 1) <= BUFFERLENGTH) {
+                        while ((bufferLength() + cq.command.length() + 1) <= SENDAHEADLENGTH) {
                             sendCommand(cq.command, cq.tableIndex, cq.showInConsole);
                             if (m_queue.isEmpty())
                                 break;
@@ -504,7 +468,7 @@ void GrblMachine::onReadyRead()
 
                         if (ca.tableIndex > -1 && response.toUpper().contains("ERROR") && !m_frm->settings()->ignoreErrors()) {
                             errors.append(QString::number(ca.tableIndex + 1) + ": "
-                                          + ca.command
+                                          + commandText(ca)
                                           + " < " + response + "\n");
 
                             m_frm->senderErrorBox()->setText(tr("Error message(s) received:\n") + errors);
@@ -530,7 +494,7 @@ void GrblMachine::onReadyRead()
 
                         // Check transfer complete (last row always blank, last command row = rowcount - 2)
                         if (m_fileProcessedCommandIndex == m_frm->currentModel()->rowCount() - 2
-                                || ca.command.contains(QRegExp("M0*2|M30"))) m_transferCompleted = true;
+                                || (ca.flags & SendStream::ProgramEnd)) m_transferCompleted = true;
                         // Send next program commands
                         else
                             if(!m_fileEndSent
@@ -538,39 +502,39 @@ void GrblMachine::onReadyRead()
                                 sendNextFileCommands();
                     }
 
-                    // Scroll to first line on "M30" command
-                    if (ca.command.contains("M30"))
+                    // Scroll to first line on "M2" & "M30" command
+                    if (ca.flags & SendStream::ProgramEnd)
                         m_ui->tblProgram->setCurrentIndex(m_frm->currentModel()->index(0, 1));
 
                     // Toolpath shadowing on check mode
                     if (m_statusCaptions.indexOf(m_ui->txtStatus->text()) == CHECK) {
                         GcodeViewParse *parser = m_frm->currentDrawer()->viewParser();
-                        QList<LineSegment*> list = parser->getLineSegmentList();
+                        LineSegmentStore *list = parser->getLines();
 
                         if (!m_transferCompleted && m_fileProcessedCommandIndex < m_frm->currentModel()->rowCount() - 1) {
                             int i;
                             QList<int> drawnLines;
 
-                            for (i = m_lastDrawnLineIndex; i < list.count()
-                                 && list.at(i)->getLineNumber()
+                            for (i = m_lastDrawnLineIndex; i < list->count()
+                                 && list->getLineNumber(i)
                                  <= (m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileProcessedCommandIndex, 4)).toInt()); i++) {
                                 drawnLines << i;
                             }
 
-                            if (!drawnLines.isEmpty() && (i < list.count())) {
+                            if (!drawnLines.isEmpty() && (i < list->count())) {
                                 m_lastDrawnLineIndex = i;
-                                QVector3D vec = list.at(i)->getEnd();
+                                QVector3D vec = list->getEnd(i);
                                 m_frm->toolDrawer().setToolPosition(vec);
                             }
 
                             foreach (int i, drawnLines) {
-                                list.at(i)->setDrawn(true);
+                                list->setDrawn(i, true);
                             }
                             if (!drawnLines.isEmpty()) m_frm->currentDrawer()->update(drawnLines);
                         } else {
-                            foreach (LineSegment* s, list) {
-                                if (!qIsNaN(s->getEnd().length())) {
-                                    m_frm->toolDrawer().setToolPosition(s->getEnd());
+                            for (int i = 0; i < list->count(); i++) {
+                                if (!qIsNaN(list->getEnd(i).length())) {
+                                    m_frm->toolDrawer().setToolPosition(list->getEnd(i));
                                     break;
                                 }
                             }
@@ -601,8 +565,7 @@ void GrblMachine::onReadyRead()
                     m_updateParserStatus = true;
                     m_statusReceived = true;
 
-                    m_commands.clear();
-                    m_queue.clear();
+                    clearCommands();
 
                     m_frm->updateControlsState();
                 }
@@ -717,11 +680,11 @@ void GrblMachine::machineReset()
     m_resetCompleted = false;
     m_updateSpindleSpeed = true;
     m_lastGrblStatus = -1;
+    m_lastAccessories = -1;
     m_statusReceived = true;
 
     // Drop all remaining commands in buffer
-    m_commands.clear();
-    m_queue.clear();
+    clearCommands();
 
     // Prepare reset response catch
     CommandAttributes ca;
@@ -729,6 +692,7 @@ void GrblMachine::machineReset()
     if (m_frm->settings()->showUICommands()) m_ui->txtConsole->appendPlainText(ca.command);
     ca.consoleIndex = m_frm->settings()->showUICommands() ? m_ui->txtConsole->blockCount() - 1 : -1;
     ca.tableIndex = -1;
+    ca.flags = 0;
     ca.length = ca.command.length() + 1;
     m_commands.append(ca);
 
@@ -799,40 +763,34 @@ void GrblMachine::storeOffsets()
 void GrblMachine::restoreOffsets()
 {
     // Still have pre-reset working position
-    sendCommand(QString("G21G53G90X%1Y%2Z%3").arg(toMetric(m_ui->txtMPosX->text().toDouble()))
-                                       .arg(toMetric(m_ui->txtMPosY->text().toDouble()))
-                                       .arg(toMetric(m_ui->txtMPosZ->text().toDouble())), -1, m_frm->settings()->showUICommands());
-    sendCommand(QString("G21G92X%1Y%2Z%3").arg(toMetric(m_ui->txtWPosX->text().toDouble()))
-                                       .arg(toMetric(m_ui->txtWPosY->text().toDouble()))
-                                       .arg(toMetric(m_ui->txtWPosZ->text().toDouble())), -1, m_frm->settings()->showUICommands());
+    const MachineState &state = m_frm->machineState();
+
+    sendCommand(QString("G21G53G90X%1Y%2Z%3").arg(toMetric(state.machinePosition(0)))
+                                       .arg(toMetric(state.machinePosition(1)))
+                                       .arg(toMetric(state.machinePosition(2))), -1, m_frm->settings()->showUICommands());
+    sendCommand(QString("G21G92X%1Y%2Z%3").arg(toMetric(state.workPosition(0)))
+                                       .arg(toMetric(state.workPosition(1)))
+                                       .arg(toMetric(state.workPosition(2))), -1, m_frm->settings()->showUICommands());
 }
 
 void GrblMachine::sendNextFileCommands() {
-    if (m_queue.length() > 0) return;
-
-    QString command = feedOverride(m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileCommandIndex, 1)).toString());
-
-    while ((bufferLength() + command.length() + 1) <= BUFFERLENGTH
-           && m_fileCommandIndex < m_frm->currentModel()->rowCount() - 1
-           && !(!m_commands.isEmpty()
-           && m_commands.last().command.contains(QRegExp("M0*2|M30")))) {
-        m_frm->currentModel()->setData(m_frm->currentModel()->index(m_fileCommandIndex, 2), GCodeItem::Sent);
-        sendCommand(command, m_fileCommandIndex, m_frm->settings()->showProgramCommands());
-        m_fileCommandIndex++;
-        command = feedOverride(m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileCommandIndex, 1)).toString());
-    }
+    if (m_queue.length() > 0 || !m_resetCompleted) return;
+
+    sendFileCommands(SendStream::ProgramEnd);
 }
 
 void GrblMachine::restoreOrigin()
 {
     // Restore offset
+    const MachineState &state = m_frm->machineState();
+
     sendCommand(QString("G21"), -1, m_frm->settings()->showUICommands());
-    sendCommand(QString("G53G90G0X%1Y%2Z%3").arg(toMetric(m_ui->txtMPosX->text().toDouble()))
-                                            .arg(toMetric(m_ui->txtMPosY->text().toDouble()))
-                                            .arg(toMetric(m_ui->txtMPosZ->text().toDouble())), -1, m_frm->settings()->showUICommands());
-    sendCommand(QString("G92X%1Y%2Z%3").arg(toMetric(m_ui->txtMPosX->text().toDouble()) - m_storedX)
-                                        .arg(toMetric(m_ui->txtMPosY->text().toDouble()) - m_storedY)
-                                        .arg(toMetric(m_ui->txtMPosZ->text().toDouble()) - m_storedZ), -1, m_frm->settings()->showUICommands());
+    sendCommand(QString("G53G90G0X%1Y%2Z%3").arg(toMetric(state.machinePosition(0)))
+                                            .arg(toMetric(state.machinePosition(1)))
+                                            .arg(toMetric(state.machinePosition(2))), -1, m_frm->settings()->showUICommands());
+    sendCommand(QString("G92X%1Y%2Z%3").arg(toMetric(state.machinePosition(0)) - m_storedX)
+                                        .arg(toMetric(state.machinePosition(1)) - m_storedY)
+                                        .arg(toMetric(state.machinePosition(2)) - m_storedZ), -1, m_frm->settings()->showUICommands());
 
     // Move tool
     if (m_frm->settings()->moveOnRestore()) {
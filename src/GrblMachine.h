@@ -8,10 +8,13 @@
 #include "tables/heightmaptablemodel.h"
 
 #include "Machine.h"
+#include "GrblStatusParser.h"
 
 class GrblMachine : public Machine
 {
-    enum {UNKNOWN=0, IDLE, ALARM, RUN, HOME, HOLD0, HOLD1, QUEUE, CHECK, DOOR, JOG} Status;
+    enum {UNKNOWN=MachineStatus::Unknown, IDLE=MachineStatus::Idle, ALARM=MachineStatus::Alarm, RUN=MachineStatus::Run,
+          HOME=MachineStatus::Home, HOLD0=MachineStatus::Hold0, HOLD1=MachineStatus::Hold1, QUEUE=MachineStatus::Queue,
+          CHECK=MachineStatus::Check, DOOR=MachineStatus::Door, JOG=MachineStatus::Jog} Status;
 public:
     GrblMachine(frmMain *frm, Ui::frmMain *m_ui, CandleConnection& connection);
 
@@ -45,6 +48,9 @@ public:
 
 private:
     int m_lastGrblStatus;
+    // Last status report, spindle state of it
+    MachineStatus m_machineStatus;
+    int m_lastAccessories = -1;
     bool m_reseting = false;
     bool m_resetCompleted = true;
 };
@@ -0,0 +1,204 @@
+#include <QtGlobal>
+#include <string.h>
+
+#include "GrblStatusParser.h"
+
+static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+MachineStatus::MachineStatus()
+{
+    fields = 0;
+    state = Unknown;
+
+    for (int i = 0; i < 3; i++) {
+        mpos[i] = 0;
+        wpos[i] = 0;
+        wco[i] = 0;
+    }
+
+    feedOverride = 100;
+    rapidOverride = 100;
+    spindleOverride = 100;
+
+    feed = 0;
+    spindleSpeed = 0;
+
+    pins[0] = 0;
+    accessories = 0;
+
+    plannerBlocks = 0;
+    rxBytes = 0;
+    lineNumber = 0;
+}
+
+bool GrblStatusParser::parse(const char *data, int length, MachineStatus *status)
+{
+    const char *p = data;
+    const char *end = data + length;
+
+    if (p == end || *p != '<') return false;
+    p++;
+    if (end[-1] == '>') end--;
+
+    status->fields = 0;
+
+    // State, substate is kept for holds only
+    const char *name = p;
+    while (p < end && *p != '|' && *p != ',' && *p != ':') p++;
+    int nameLength = p - name;
+
+    int substate = -1;
+    if (p < end && *p == ':') {
+        p++;
+        if (p < end && *p >= '0' && *p <= '9') substate = *p++ - '0';
+    }
+
+    if (equals(name, nameLength, "Idle")) status->state = MachineStatus::Idle;
+    else if (equals(name, nameLength, "Run")) status->state = MachineStatus::Run;
+    else if (equals(name, nameLength, "Hold")) status->state = substate == 1 ? MachineStatus::Hold1 : MachineStatus::Hold0;
+    else if (equals(name, nameLength, "Jog")) status->state = MachineStatus::Jog;
+    else if (equals(name, nameLength, "Alarm")) status->state = MachineStatus::Alarm;
+    else if (equals(name, nameLength, "Door")) status->state = MachineStatus::Door;
+    else if (equals(name, nameLength, "Check")) status->state = MachineStatus::Check;
+    else if (equals(name, nameLength, "Home")) status->state = MachineStatus::Home;
+    else if (equals(name, nameLength, "Queue")) status->state = MachineStatus::Queue;
+    else status->state = MachineStatus::Unknown;
+
+    // Fields are separated by '|' in 1.1, by ',' in 0.9 which uses it in values too
+    char separator = p < end && *p == ',' ? ',' : '|';
+
+    while (p < end) {
+        if (*p == separator || *p == '|') {
+            p++;
+            continue;
+        }
+
+        name = p;
+        while (p < end && *p != ':' && *p != '|') p++;
+        nameLength = p - name;
+
+        if (p == end || *p != ':') continue;
+        p++;
+
+        double values[3];
+
+        if (equals(name, nameLength, "MPos")) {
+            if (parseNumbers(p, end, status->mpos, 3) == 3) status->fields |= MachineStatus::MPos;
+        } else if (equals(name, nameLength, "WPos")) {
+            if (parseNumbers(p, end, status->wpos, 3) == 3) status->fields |= MachineStatus::WPos;
+        } else if (equals(name, nameLength, "WCO")) {
+            if (parseNumbers(p, end, status->wco, 3) == 3) status->fields |= MachineStatus::Wco;
+        } else if (equals(name, nameLength, "Ov")) {
+            if (parseNumbers(p, end, values, 3) == 3) {
+                status->feedOverride = values[0];
+                status->rapidOverride = values[1];
+                status->spindleOverride = values[2];
+                status->fields |= MachineStatus::Overrides;
+            }
+        } else if (equals(name, nameLength, "FS")) {
+            if (parseNumbers(p, end, values, 2) == 2) {
+                status->feed = values[0];
+                status->spindleSpeed = values[1];
+                status->fields |= MachineStatus::FeedSpindle;
+            }
+        } else if (equals(name, nameLength, "F")) {
+            if (parseNumbers(p, end, values, 1) == 1) {
+                status->feed = values[0];
+                status->fields |= MachineStatus::FeedSpindle;
+            }
+        } else if (equals(name, nameLength, "Bf")) {
+            if (parseNumbers(p, end, values, 2) == 2) {
+                status->plannerBlocks = values[0];
+                status->rxBytes = values[1];
+                status->fields |= MachineStatus::Buffer;
+            }
+        } else if (equals(name, nameLength, "Ln")) {
+            if (parseNumbers(p, end, values, 1) == 1) {
+                status->lineNumber = values[0];
+                status->fields |= MachineStatus::LineNumber;
+            }
+        } else if (equals(name, nameLength, "Pn")) {
+            int count = 0;
+            while (p < end && *p != '|' && *p != ',') {
+                if (count < (int)sizeof(status->pins) - 1) status->pins[count++] = *p;
+                p++;
+            }
+            status->pins[count] = 0;
+            status->fields |= MachineStatus::Pins;
+        } else if (equals(name, nameLength, "A")) {
+            status->accessories = 0;
+            while (p < end && *p != '|' && *p != ',') {
+                switch (*p++) {
+                case 'S': status->accessories |= MachineStatus::SpindleCW; break;
+                case 'C': status->accessories |= MachineStatus::SpindleCCW; break;
+                case 'F': status->accessories |= MachineStatus::Flood; break;
+                case 'M': status->accessories |= MachineStatus::Mist; break;
+                }
+            }
+            status->fields |= MachineStatus::Accessories;
+        }
+
+        // Rest of unknown or malformed field
+        while (p < end && *p != separator && *p != '|') p++;
+    }
+
+    return true;
+}
+
+// Decimal number w/o exponent
+bool GrblStatusParser::parseNumber(const char *&p, const char *end, double *value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    qint64 mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    int skipped = 0;
+    bool point = false;
+
+    while (p < end) {
+        if (*p >= '0' && *p <= '9') {
+            if (digits < 18) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+                if (point) scale++;
+            } else if (!point) {
+                // Integer part is out of powers table, not a Grbl number
+                if (++skipped > 18) return false;
+            }
+        } else if (*p == '.' && !point) {
+            point = true;
+        } else {
+            break;
+        }
+        p++;
+    }
+
+    if (digits == 0) return false;
+
+    double result = skipped ? mantissa * powers[skipped] : mantissa / powers[scale];
+    *value = negative ? -result : result;
+
+    return true;
+}
+
+// Comma separated numbers, returns count of parsed ones
+int GrblStatusParser::parseNumbers(const char *&p, const char *end, double *values, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            if (p == end || *p != ',') return i;
+            p++;
+        }
+        if (!parseNumber(p, end, &values[i])) return i;
+    }
+
+    return count;
+}
+
+bool GrblStatusParser::equals(const char *p, int length, const char *name)
+{
+    return (int)strlen(name) == length && memcmp(p, name, length) == 0;
+}
@@ -0,0 +1,64 @@
+#ifndef GRBLSTATUSPARSER_H
+#define GRBLSTATUSPARSER_H
+
+// Typed Grbl status report. Values of fields missing in report are kept.
+struct MachineStatus
+{
+    // Same order as machine's status captions
+    enum State {Unknown = 0, Idle, Alarm, Run, Home, Hold0, Hold1, Queue, Check, Door, Jog};
+
+    // Fields present in last report
+    enum Field {
+        MPos = 0x1,
+        WPos = 0x2,
+        Wco = 0x4,
+        Overrides = 0x8,
+        FeedSpindle = 0x10,
+        Pins = 0x20,
+        Accessories = 0x40,
+        Buffer = 0x80,
+        LineNumber = 0x100
+    };
+
+    enum Accessory {SpindleCW = 0x1, SpindleCCW = 0x2, Flood = 0x4, Mist = 0x8};
+
+    MachineStatus();
+
+    int fields;
+    State state;
+
+    double mpos[3];
+    double wpos[3];
+    double wco[3];
+
+    int feedOverride;
+    int rapidOverride;
+    int spindleOverride;
+
+    double feed;
+    double spindleSpeed;
+
+    // Pin letters, null terminated
+    char pins[16];
+    int accessories;
+
+    int plannerBlocks;
+    int rxBytes;
+    int lineNumber;
+};
+
+// Single pass parser of Grbl 1.1 ('|' separated) & 0.9 (',' separated) status reports.
+// Works on raw bytes, doesn't allocate & doesn't depend on locale.
+class GrblStatusParser
+{
+public:
+    // Report w/o line terminator. Returns false if it isn't status report.
+    static bool parse(const char *data, int length, MachineStatus *status);
+
+private:
+    static bool parseNumber(const char *&p, const char *end, double *value);
+    static int parseNumbers(const char *&p, const char *end, double *values, int count);
+    static bool equals(const char *p, int length, const char *name);
+};
+
+#endif // GRBLSTATUSPARSER_H
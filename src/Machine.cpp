@@ -7,6 +7,8 @@ Machine::Machine(frmMain *frm, Ui::frmMain *ui, CandleConnection& connection)
     : m_frm(frm)
     , m_ui(ui)
     , m_connection(connection)
+    , m_commands(SENDAHEADLENGTH)
+    , m_queue(QUEUELENGTH)
 {}
 
 void Machine::init(){
@@ -22,9 +24,11 @@ double Machine::toMetric(double value)
 
 bool Machine::compareCoordinates(double x, double y, double z)
 {
-    return m_ui->txtMPosX->text().toDouble() == x &&
-            m_ui->txtMPosY->text().toDouble() == y &&
-            m_ui->txtMPosZ->text().toDouble() == z;
+    const MachineState &state = m_frm->machineState();
+
+    return state.machinePosition(0) == x &&
+            state.machinePosition(1) == y &&
+            state.machinePosition(2) == z;
 }
 
 
@@ -37,7 +41,7 @@ void Machine::sendCommand(const QString& cmd, int tableIndex, bool showInConsole
     qDebug() << "+++ command:" << command;
 
     // Commands queue
-    if ((bufferLength() + command.length() + 1) > BUFFERLENGTH) {
+    if (!m_commands.fits(command.length() + 1)) {
         qDebug() << "+++ queue:" << command;
 
         CommandQueue cq;
@@ -46,7 +50,10 @@ void Machine::sendCommand(const QString& cmd, int tableIndex, bool showInConsole
         cq.tableIndex = tableIndex;
         cq.showInConsole = showInConsole;
 
-        m_queue.append(cq);
+        if (!m_queue.append(cq)) {
+            qDebug() << "+++ queue is full:" << command;
+            m_ui->txtConsole->appendPlainText(tr("Commands queue is full, command dropped: ") + command);
+        }
         return;
     }
 
@@ -61,38 +68,79 @@ void Machine::sendCommand(const QString& cmd, int tableIndex, bool showInConsole
         ca.consoleIndex = -1;
     }
 
+    int speed = 0;
+
     ca.command = command;
     ca.length = command.length() + 1;
     ca.tableIndex = tableIndex;
+    ca.flags = SendStream::commandFlags(command, &speed);
 
     m_commands.append(ca);
 
     // Processing spindle speed only from g-code program
-    QRegExp s("[Ss]0*(\\d+)");
-    if (s.indexIn(command) != -1 && ca.tableIndex > -2) {
-        int speed = s.cap(1).toInt();
+    if ((ca.flags & SendStream::Spindle) && ca.tableIndex > -2) {
         if (m_ui->slbSpindle->value() != speed) {
             m_ui->slbSpindle->setValue(speed);
         }
     }
 
     // Set M2 & M30 commands sent flag
-    if (command.contains(QRegExp("M0*2|M30"))) {
+    if (ca.flags & SendStream::ProgramEnd) {
         m_fileEndSent = true;
     }
 
-    m_connection.write((command + "\r").toLatin1());
+    m_connection.sendCommand((command + "\r").toLatin1());
 }
 
-int Machine::bufferLength()
+// Next program commands are written as single span of send stream while they fit send-ahead window.
+// Table states & spindle speed are updated once per batch.
+void Machine::sendFileCommands(int stopFlags)
 {
-    int length = 0;
+    if (!m_connection.isOpen()) return;
+
+    int first = m_fileCommandIndex;
+    m_fileCommandIndex = m_commands.appendStream(m_sendStream, first, stopFlags);
 
-    foreach (CommandAttributes ca, m_commands) {
-        length += ca.length;
+    if (m_fileCommandIndex == first) return;
+
+    m_connection.sendCommand(m_sendStream.span(first, m_fileCommandIndex));
+    m_frm->currentModel()->setStates(first, m_fileCommandIndex, GCodeItem::Sent);
+
+    bool showInConsole = m_frm->settings()->showProgramCommands();
+    int speed = -1;
+
+    for (int i = first; i < m_fileCommandIndex; i++) {
+        if (showInConsole) {
+            m_ui->txtConsole->appendPlainText(m_sendStream.command(i));
+            m_commands[m_commands.count() - m_fileCommandIndex + i].consoleIndex = m_ui->txtConsole->blockCount() - 1;
+        }
+
+        if (m_sendStream.flags(i) & SendStream::Spindle) speed = m_sendStream.spindleSpeed(i);
+        if (m_sendStream.flags(i) & SendStream::ProgramEnd) m_fileEndSent = true;
     }
 
-    return length;
+    if (speed != -1 && m_ui->slbSpindle->value() != speed) {
+        m_ui->slbSpindle->setValue(speed);
+    }
+}
+
+int Machine::bufferLength()
+{
+    return m_commands.bufferLength();
+}
+
+// Program commands text is built only when needed for display
+QString Machine::commandText(const CommandAttributes& ca) const
+{
+    return ca.streamIndex >= 0 ? m_sendStream.command(ca.streamIndex) : ca.command;
+}
+
+// Drop sent & queued commands, controller's buffer is empty
+void Machine::clearCommands()
+{
+    m_commands.clear();
+    m_queue.clear();
+    m_connection.clearCommands();
 }
 
 QString Machine::feedOverride(QString command)
@@ -128,8 +176,7 @@ void Machine::onTimerStateQuery(){}
 
 void Machine::clear() {
   if (m_queue.length() > 0) {
-      m_commands.clear();
-      m_queue.clear();
+      clearCommands();
   }
 }
 
@@ -139,6 +186,8 @@ void Machine::fileCmdIndex(int cmdIndex) {
 }
 
 void Machine::startFile() {
+    m_sendStream.build(m_frm->currentModel());
+
     m_transferCompleted = false;
     m_processingFile = true;
     m_fileEndSent = false;
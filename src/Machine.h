@@ -6,19 +6,8 @@
 #include <QVector3D>
 
 #include "CandleConnection.h"
-
-struct CommandAttributes {
-    int length;
-    int consoleIndex;
-    int tableIndex;
-    QString command;
-};
-
-struct CommandQueue {
-    QString command;
-    int tableIndex;
-    bool showInConsole;
-};
+#include "CommandBuffer.h"
+#include "SendStream.h"
 
 namespace Ui {
 class frmMain;
@@ -88,10 +77,17 @@ protected:
     double toMetric(double value);
     bool compareCoordinates(double x, double y, double z);
     int bufferLength();
+    QString commandText(const CommandAttributes& ca) const;
+    void clearCommands();
+    void sendFileCommands(int stopFlags);
     QString feedOverride(QString command);
 
 protected:
-    const int BUFFERLENGTH = 127;
+    // Commands handed to I/O thread ahead of controller's acknowledgements,
+    // controller's receive buffer is counted by connection's I/O thread
+    const int SENDAHEADLENGTH = 4096;
+    // Commands waiting for room in send-ahead window
+    const int QUEUELENGTH = 1024;
 
     frmMain *m_frm;
     Ui::frmMain *m_ui;
@@ -102,8 +98,12 @@ protected:
     QStringList m_statusBackColors;
     QStringList m_statusForeColors;
 
-    QList<CommandAttributes> m_commands;
-    QList<CommandQueue> m_queue;
+    // Sent commands waiting for response & commands waiting for room
+    CommandBuffer m_commands;
+    RingBuffer<CommandQueue> m_queue;
+
+    // Program being sent
+    SendStream m_sendStream;
 
     // Flags
     bool m_settingZeroXY = false;
@@ -0,0 +1,131 @@
+#include "MachineState.h"
+
+MachineState::MachineState(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(MACHINESTATEINTERVAL);
+
+    connect(&m_timer, &QTimer::timeout, this, &MachineState::onTimer);
+}
+
+void MachineState::update(const MachineStatus& status)
+{
+    const double *wco = status.fields & MachineStatus::Wco ? status.wco : m_wco;
+
+    if ((status.fields & MachineStatus::MPos) && (status.fields & MachineStatus::WPos)) {
+        // Grbl 0.9 reports both, offset follows from them
+        double offset[3];
+        for (int i = 0; i < 3; i++) offset[i] = status.mpos[i] - status.wpos[i];
+        if (setPosition(status.mpos, offset)) changed(MachineStatus::MPos);
+    } else if (status.fields & MachineStatus::MPos) {
+        if (setPosition(status.mpos, wco)) changed(MachineStatus::MPos);
+    } else if (status.fields & MachineStatus::WPos) {
+        double mpos[3];
+        for (int i = 0; i < 3; i++) mpos[i] = status.wpos[i] + wco[i];
+        if (setPosition(mpos, wco)) changed(MachineStatus::MPos);
+    } else if (status.fields & MachineStatus::Wco) {
+        if (setPosition(m_mpos, wco)) changed(MachineStatus::MPos);
+    }
+
+    if (status.fields & MachineStatus::Overrides)
+        setOverrides(status.feedOverride, status.rapidOverride, status.spindleOverride);
+
+    if (status.fields & MachineStatus::FeedSpindle)
+        setFeedSpindle(status.feed, status.spindleSpeed);
+
+    if (status.fields & MachineStatus::Buffer)
+        setBuffer(status.plannerBlocks, status.rxBytes);
+}
+
+void MachineState::setMachinePosition(double x, double y, double z)
+{
+    double mpos[3] = {x, y, z};
+    if (setPosition(mpos, m_wco)) changed(MachineStatus::MPos);
+}
+
+void MachineState::setWorkOffset(double x, double y, double z)
+{
+    double wco[3] = {x, y, z};
+    if (setPosition(m_mpos, wco)) changed(MachineStatus::MPos);
+}
+
+void MachineState::setOverrides(int feed, int rapid, int spindle)
+{
+    if (feed == m_feedOverride && rapid == m_rapidOverride && spindle == m_spindleOverride)
+        return;
+
+    m_feedOverride = feed;
+    m_rapidOverride = rapid;
+    m_spindleOverride = spindle;
+    changed(MachineStatus::Overrides);
+}
+
+void MachineState::setFeedSpindle(double feed, double spindleSpeed)
+{
+    if (feed == m_feed && spindleSpeed == m_spindleSpeed)
+        return;
+
+    m_feed = feed;
+    m_spindleSpeed = spindleSpeed;
+    changed(MachineStatus::FeedSpindle);
+}
+
+void MachineState::setPins(const char *pins, int accessories)
+{
+    if (accessories == m_accessories && m_pins == pins)
+        return;
+
+    m_pins = pins;
+    m_accessories = accessories;
+    changed(MachineStatus::Pins);
+}
+
+void MachineState::setBuffer(int plannerBlocks, int rxBytes)
+{
+    if (plannerBlocks == m_plannerBlocks && rxBytes == m_rxBytes)
+        return;
+
+    m_plannerBlocks = plannerBlocks;
+    m_rxBytes = rxBytes;
+    changed(MachineStatus::Buffer);
+}
+
+// Values may alias members
+bool MachineState::setPosition(const double *mpos, const double *wco)
+{
+    bool changed = false;
+
+    for (int i = 0; i < 3; i++) {
+        double m = mpos[i];
+        double o = wco[i];
+
+        if (m != m_mpos[i] || o != m_wco[i]) {
+            m_mpos[i] = m;
+            m_wco[i] = o;
+            m_wpos[i] = m - o;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void MachineState::changed(int fields)
+{
+    m_changed |= fields;
+    if (!m_timer.isActive())
+        m_timer.start();
+}
+
+void MachineState::onTimer()
+{
+    int fields = m_changed;
+    m_changed = 0;
+
+    if (fields & MachineStatus::MPos) emit positionChanged();
+    if (fields & MachineStatus::Overrides) emit overridesChanged();
+    if (fields & MachineStatus::FeedSpindle) emit feedSpindleChanged();
+    if (fields & MachineStatus::Pins) emit pinsChanged();
+    if (fields & MachineStatus::Buffer) emit bufferChanged();
+}
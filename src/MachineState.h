@@ -0,0 +1,96 @@
+#ifndef MACHINESTATE_H
+#define MACHINESTATE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QTimer>
+
+#include "GrblStatusParser.h"
+
+// Min time between change notifications, ms
+#define MACHINESTATEINTERVAL 40
+
+// Numeric machine state shared by drivers & UI. Drivers update it from received responses
+// w/o any text formatting, UI is notified of changed groups at most once per MACHINESTATEINTERVAL.
+class MachineState : public QObject
+{
+    Q_OBJECT
+public:
+    MachineState(QObject *parent = nullptr);
+
+    // Grbl status report, fields missing in report are kept
+    void update(const MachineStatus& status);
+
+    // Work position follows machine position & work offset
+    void setMachinePosition(double x, double y, double z);
+    void setWorkOffset(double x, double y, double z);
+    void setOverrides(int feed, int rapid, int spindle);
+    void setFeedSpindle(double feed, double spindleSpeed);
+    // Pin letters & MachineStatus::Accessory flags
+    void setPins(const char *pins, int accessories);
+    // Free planner blocks & receive buffer bytes
+    void setBuffer(int plannerBlocks, int rxBytes);
+
+    double machinePosition(int axis) const
+    {return m_mpos[axis];}
+    double workPosition(int axis) const
+    {return m_wpos[axis];}
+    double workOffset(int axis) const
+    {return m_wco[axis];}
+    int feedOverride() const
+    {return m_feedOverride;}
+    int rapidOverride() const
+    {return m_rapidOverride;}
+    int spindleOverride() const
+    {return m_spindleOverride;}
+    double feed() const
+    {return m_feed;}
+    double spindleSpeed() const
+    {return m_spindleSpeed;}
+    const QByteArray& pins() const
+    {return m_pins;}
+    int accessories() const
+    {return m_accessories;}
+    int plannerBlocks() const
+    {return m_plannerBlocks;}
+    int rxBytes() const
+    {return m_rxBytes;}
+
+signals:
+    void positionChanged();
+    void overridesChanged();
+    void feedSpindleChanged();
+    void pinsChanged();
+    void bufferChanged();
+
+private slots:
+    void onTimer();
+
+private:
+    // MachineStatus::Field flags of changed groups
+    void changed(int fields);
+    bool setPosition(const double *mpos, const double *wco);
+
+private:
+    QTimer m_timer;
+    int m_changed = 0;
+
+    double m_mpos[3] = {0, 0, 0};
+    double m_wpos[3] = {0, 0, 0};
+    double m_wco[3] = {0, 0, 0};
+
+    int m_feedOverride = 100;
+    int m_rapidOverride = 100;
+    int m_spindleOverride = 100;
+
+    double m_feed = 0;
+    double m_spindleSpeed = 0;
+
+    QByteArray m_pins;
+    int m_accessories = 0;
+
+    int m_plannerBlocks = 0;
+    int m_rxBytes = 0;
+};
+
+#endif // MACHINESTATE_H
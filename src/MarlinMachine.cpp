@@ -61,6 +61,9 @@ MarlinMachine::MarlinMachine(frmMain* frm, Ui::frmMain* ui, CandleConnection& co
                       << "black"
                       << "black"
                       << "white";
+
+    // Responses acknowledging sent command, same as dataIsCmdResponse()
+    m_connection.setResponseEnds(QList<QByteArray>() << "ok");
 }
 
 void MarlinMachine::endOfRunProc()
@@ -72,9 +75,9 @@ void MarlinMachine::endOfRunProc()
 
         // Shadow last segment
         GcodeViewParse *parser = m_frm->currentDrawer()->viewParser();
-        QList<LineSegment*> list = parser->getLineSegmentList();
-        if (m_lastDrawnLineIndex < list.count()) {
-            list[m_lastDrawnLineIndex]->setDrawn(true);
+        LineSegmentStore *list = parser->getLines();
+        if (m_lastDrawnLineIndex < list->count()) {
+            list->setDrawn(m_lastDrawnLineIndex, true);
             m_frm->currentDrawer()->update(QList<int>() << m_lastDrawnLineIndex);
         }
 
@@ -162,7 +165,7 @@ void MarlinMachine::parseResponse(const QString& data) {
     // Leveling status
     // Process probing on heightmap mode only from table commands
     if(!m_commands.isEmpty()
-        && m_commands.first().command.contains("G29")
+        && (m_commands.first().flags & SendStream::Probe)
         && m_frm->heightMapMode()
         && m_commands.first().tableIndex > -1) {
 
@@ -191,9 +194,7 @@ void MarlinMachine::parseResponse(const QString& data) {
     } else
     if (mpx.indexIn(data) != -1) {
         qDebug() << "+++ X:Y:Z: " << mpx.cap(1) << ", " << mpx.cap(2) << ", " << mpx.cap(3);
-        m_ui->txtMPosX->setText(mpx.cap(1));
-        m_ui->txtMPosY->setText(mpx.cap(2));
-        m_ui->txtMPosZ->setText(mpx.cap(3));
+        m_frm->machineState().setMachinePosition(mpx.cap(1).toDouble(), mpx.cap(2).toDouble(), mpx.cap(3).toDouble());
     } else
     // TMC driver status
     if (tmcs.indexIn(data) != -1) {
@@ -267,13 +268,12 @@ void MarlinMachine::onReadyRead(){
                         m_homing = false;
 
                     // Clear command buffer on "M2" & "M30" command (old firmwares)
-                    if (ca.command.contains("M400") && response.contains("ok") && !response.contains("[Pgm End]")) {
-                        m_commands.clear();
-                        m_queue.clear();
+                    if ((ca.flags & SendStream::Wait) && response.contains("ok") && !response.contains("[Pgm End]")) {
+                        clearCommands();
                     }
 
                     // Add response to console
-                    if (tb.isValid() && tb.text() == ca.command) {
+                    if (tb.isValid() && tb.text() == commandText(ca)) {
 
                         bool scrolledDown = m_ui->txtConsole->verticalScrollBar()->value() == m_ui->txtConsole->verticalScrollBar()->maximum();
 
@@ -296,7 +296,7 @@ void MarlinMachine::onReadyRead(){
                     // Check queue
                     if (m_queue.length() > 0) {
                         CommandQueue cq = m_queue.takeFirst();
-                        while ((bufferLength() + cq.command.length() + 1) <= BUFFERLENGTH) {
+                        while ((bufferLength() + cq.command.length() + 1) <= SENDAHEADLENGTH) {
                             sendCommand(cq.command, cq.tableIndex, cq.showInConsole);
                             if (m_queue.isEmpty())
                                 break;
@@ -322,38 +322,27 @@ void MarlinMachine::onReadyRead(){
                         }
 
                         GcodeViewParse *parser = m_frm->currentDrawer()->viewParser();
-                        QList<LineSegment*> list = parser->getLineSegmentList();
-
-                        // Store work offset
-                        static QVector3D workOffset;
+                        LineSegmentStore *list = parser->getLines();
 
                         //m_lastDrawnLineIndex = m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileProcessedCommandIndex, 4)).toInt();
                         m_lastDrawnLineIndex = m_fileProcessedCommandIndex;
 
-                        if (m_lastDrawnLineIndex < list.size()) {
-
-                            auto vec = list.at(m_lastDrawnLineIndex)->getStart();
+                        if (m_lastDrawnLineIndex < list->count()) {
 
-                            m_ui->txtMPosX->setText(QString::number(vec.x(), 'f', 3));
-                            m_ui->txtMPosY->setText(QString::number(vec.y(), 'f', 3));
-                            m_ui->txtMPosZ->setText(QString::number(vec.z(), 'f', 3));
+                            auto vec = list->getStart(m_lastDrawnLineIndex);
 
-                            workOffset = QVector3D(0.0, 0.0, 0.0);
-
-                            // Update work coordinates
-                            int prec = m_frm->settings()->units() == 0 ? 3 : 4;
-                            m_ui->txtWPosX->setText(QString::number(m_ui->txtMPosX->text().toDouble() - workOffset.x(), 'f', prec));
-                            m_ui->txtWPosY->setText(QString::number(m_ui->txtMPosY->text().toDouble() - workOffset.y(), 'f', prec));
-                            m_ui->txtWPosZ->setText(QString::number(m_ui->txtMPosZ->text().toDouble() - workOffset.z(), 'f', prec));
+                            // No work offset, work coordinates follow machine ones
+                            m_frm->machineState().setMachinePosition(vec.x(), vec.y(), vec.z());
 
                         }
 
                         // Update tool position
                         QVector3D toolPosition;
                         if (m_lastDrawnLineIndex < m_frm->currentModel()->rowCount() - 1) {
-                            toolPosition = QVector3D(toMetric(m_ui->txtWPosX->text().toDouble()),
-                                                     toMetric(m_ui->txtWPosY->text().toDouble()),
-                                                     toMetric(m_ui->txtWPosZ->text().toDouble()));
+                            const MachineState &state = m_frm->machineState();
+                            toolPosition = QVector3D(toMetric(state.workPosition(0)),
+                                                     toMetric(state.workPosition(1)),
+                                                     toMetric(state.workPosition(2)));
                             m_frm->toolDrawer().setToolPosition(m_frm->codeDrawer()->getIgnoreZ() ? QVector3D(toolPosition.x(), toolPosition.y(), 0) : toolPosition);
                         }
 
@@ -362,10 +351,10 @@ void MarlinMachine::onReadyRead(){
 
                             QList<int> drawnLines;
 
-                            for (int i = m_lastDrawnLineIndex; i < list.count()
-                                 && list.at(i)->getLineNumber()
+                            for (int i = m_lastDrawnLineIndex; i < list->count()
+                                 && list->getLineNumber(i)
                                  <= (m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileProcessedCommandIndex, 4)).toInt() + 1); i++) {
-                                if (list.at(i)->contains(toolPosition)) {
+                                if (list->contains(i, toolPosition)) {
                                     toolOntoolpath = true;
                                     m_lastDrawnLineIndex = i;
                                     break;
@@ -375,13 +364,13 @@ void MarlinMachine::onReadyRead(){
 
                             if (toolOntoolpath) {
                                 foreach (int i, drawnLines) {
-                                    list.at(i)->setDrawn(true);
+                                    list->setDrawn(i, true);
                                 }
                                 if (!drawnLines.isEmpty())
                                     m_frm->currentDrawer()->update(drawnLines);
                             } else
-                                if (m_lastDrawnLineIndex < list.count()) {
-                                    qDebug() << "tool missed:" << list.at(m_lastDrawnLineIndex)->getLineNumber()
+                                if (m_lastDrawnLineIndex < list->count()) {
+                                    qDebug() << "tool missed:" << list->getLineNumber(m_lastDrawnLineIndex)
                                              << m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileProcessedCommandIndex, 4)).toInt()
                                              << m_fileProcessedCommandIndex;
                             }
@@ -399,7 +388,7 @@ void MarlinMachine::onReadyRead(){
 
                         if (ca.tableIndex > -1 && response.toUpper().contains("ERROR") && !m_frm->settings()->ignoreErrors()) {
                             errors.append(QString::number(ca.tableIndex + 1) + ": "
-                                          + ca.command
+                                          + commandText(ca)
                                           + " < " + response + "\n");
 
                             m_frm->senderErrorBox()->setText(tr("Error message(s) received:\n") + errors);
@@ -427,7 +416,7 @@ void MarlinMachine::onReadyRead(){
 
                         // Check transfer complete (last row always blank, last command row = rowcount - 2)
                         if (m_fileProcessedCommandIndex == m_frm->currentModel()->rowCount() - 2
-                            || ca.command.contains(QRegExp("M400"))) {
+                            || (ca.flags & SendStream::Wait)) {
                                 m_transferCompleted = true;
                                 endOfRunProc();
                         }
@@ -440,8 +429,8 @@ void MarlinMachine::onReadyRead(){
                             }
                     }
 
-                    // Scroll to first line on "M30" command
-                    if (ca.command.contains("M30"))
+                    // Scroll to first line on "M2" & "M30" command
+                    if (ca.flags & SendStream::ProgramEnd)
                         m_ui->tblProgram->setCurrentIndex(m_frm->currentModel()->index(0, 1));
 
                     response.clear();
@@ -465,17 +454,7 @@ void MarlinMachine::onReadyRead(){
 void MarlinMachine::sendNextFileCommands() {
     if (m_queue.length() > 0) return;
 
-    QString command = feedOverride(m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileCommandIndex, 1)).toString());
-
-    while ((bufferLength() + command.length() + 1) <= BUFFERLENGTH
-           && m_fileCommandIndex < m_frm->currentModel()->rowCount() - 1
-           && !(!m_commands.isEmpty()
-           && m_commands.last().command.contains("M400"))) {
-        m_frm->currentModel()->setData(m_frm->currentModel()->index(m_fileCommandIndex, 2), GCodeItem::Sent);
-        sendCommand(command, m_fileCommandIndex, m_frm->settings()->showProgramCommands());
-        m_fileCommandIndex++;
-        command = feedOverride(m_frm->currentModel()->data(m_frm->currentModel()->index(m_fileCommandIndex, 1)).toString());
-    }
+    sendFileCommands(SendStream::Wait);
 }
 
 bool MarlinMachine::dataIsCmdResponse(QString data) {
@@ -0,0 +1,73 @@
+#include <QRegExp>
+
+#include "SendStream.h"
+#include "tables/gcodetablemodel.h"
+
+SendStream::SendStream()
+{
+    clear();
+}
+
+void SendStream::build(const GCodeTableModel *model)
+{
+    clear();
+
+    int count = qMax(model->rowCount() - 1, 0);
+
+    m_offsets.reserve(count + 1);
+    m_flags.reserve(count);
+    m_speeds.reserve(count);
+
+    for (int i = 0; i < count; i++) {
+        QString command = model->command(i).toUpper();
+        int speed = 0;
+
+        m_data.append(command.toLatin1());
+        m_data.append('\r');
+        m_offsets.append(m_data.length());
+        m_flags.append(commandFlags(command, &speed));
+        m_speeds.append(speed);
+    }
+}
+
+void SendStream::clear()
+{
+    m_data.clear();
+    m_offsets.clear();
+    m_offsets.append(0);
+    m_flags.clear();
+    m_speeds.clear();
+}
+
+QString SendStream::command(int index) const
+{
+    return QString::fromLatin1(m_data.constData() + m_offsets.at(index), length(index) - 1);
+}
+
+QByteArray SendStream::span(int first, int last) const
+{
+    return m_data.mid(m_offsets.at(first), m_offsets.at(last) - m_offsets.at(first));
+}
+
+// Regular expressions are evaluated only for commands having corresponding letters
+int SendStream::commandFlags(const QString& command, int *spindleSpeed)
+{
+    static QRegExp s("[Ss]0*(\\d+)");
+    static QRegExp end("M0*(?:2|30)(?![\\d.])");
+
+    int flags = 0;
+
+    if (command.contains('S', Qt::CaseInsensitive) && s.indexIn(command) != -1) {
+        flags |= Spindle;
+        if (spindleSpeed) *spindleSpeed = s.cap(1).toInt();
+    }
+
+    if (command.contains('M')) {
+        if (end.indexIn(command) != -1) flags |= ProgramEnd;
+        if (command.contains("M400")) flags |= Wait;
+    }
+
+    if (command.contains("G38.2") || command.contains("G29")) flags |= Probe;
+
+    return flags;
+}
@@ -0,0 +1,52 @@
+#ifndef SENDSTREAM_H
+#define SENDSTREAM_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class GCodeTableModel;
+
+// Program commands pre-rendered for sending: uppercased, Latin-1 encoded & '\r' terminated,
+// stored back to back in one buffer with per-command offsets & flags.
+// Commands of consecutive rows are sent as single span of the buffer.
+class SendStream
+{
+public:
+    enum Flag {
+        Spindle = 1,        // S word
+        ProgramEnd = 2,     // M2, M30
+        Probe = 4,          // G38.2, G29
+        Wait = 8            // M400
+    };
+
+    SendStream();
+
+    // Commands of all model rows but trailing blank one
+    void build(const GCodeTableModel *model);
+    void clear();
+
+    int count() const
+    {return m_offsets.count() - 1;}
+    // Bytes with terminator
+    int length(int index) const
+    {return m_offsets.at(index + 1) - m_offsets.at(index);}
+    int flags(int index) const
+    {return m_flags.at(index);}
+    int spindleSpeed(int index) const
+    {return m_speeds.at(index);}
+    // Command text w/o terminator
+    QString command(int index) const;
+    // Commands [first, last)
+    QByteArray span(int first, int last) const;
+
+    static int commandFlags(const QString& command, int *spindleSpeed = nullptr);
+
+private:
+    QByteArray m_data;
+    QVector<int> m_offsets;
+    QVector<char> m_flags;
+    QVector<int> m_speeds;
+};
+
+#endif // SENDSTREAM_H
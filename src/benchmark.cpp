@@ -0,0 +1,1212 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFunctions>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QFile>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <QTimer>
+#include <QRegExp>
+#include <QScopedPointer>
+#include <QThreadPool>
+#include <QRandomGenerator>
+#include "benchmark.h"
+#include "CandleConnection.h"
+#include "CommandBuffer.h"
+#include "SendStream.h"
+#include "GrblStatusParser.h"
+#include "parser/gcodefilereader.h"
+#include "parser/gcodepreprocessorutils.h"
+#include "parser/gcodetokenizer.h"
+#include "parser/gcodeparsethread.h"
+#include "parser/gcodeviewparse.h"
+#include "drawers/gcodedrawer.h"
+#include "drawers/tooldrawer.h"
+#include "drawers/heightmapgriddrawer.h"
+#include "drawers/heightmapinterpolationdrawer.h"
+#include "drawers/heightmapborderdrawer.h"
+#include "drawers/geometrybuffer.h"
+#include "tables/heightmaptablemodel.h"
+#include "tables/gcodetablemodel.h"
+#include "utils/interpolation.h"
+
+// Camera elevation while orbiting, degrees
+#define BENCHMARKELEVATION 30
+// Heightmap probe points & interpolation points per axis
+#define BENCHMARKGRIDPOINTS 10
+#define BENCHMARKINTERPOLATIONPOINTS 100
+// Commands handed to sender ahead of acknowledgements, bytes, as machine does
+#define BENCHMARKSENDAHEAD 4096
+// Streaming is aborted if controller doesn't respond, ms
+#define BENCHMARKSTREAMTIMEOUT 10000
+
+// Benchmark modes, selected by "--<name> <file>" option
+struct BenchmarkMode
+{
+    const char *name;
+    const char *description;
+    // Mode option value, NULL if mode needs no input file
+    const char *valueName;
+    Benchmark *(*create)();
+};
+
+template <class T> static Benchmark *createBenchmark()
+{
+    return new T();
+}
+
+static const BenchmarkMode benchmarkModes[] = {
+    { "benchmark", "Visualizer benchmark, G-code file.", "file", createBenchmark<VisualizerBenchmark> },
+    { "stream", "Streaming benchmark, G-code file.", "file", createBenchmark<StreamBenchmark> },
+    { "status-benchmark", "Status report parser benchmark, captured reports file.", "file", createBenchmark<StatusBenchmark> },
+    { "tokenizer-benchmark", "G-code tokenizer benchmark, G-code file.", "file", createBenchmark<TokenizerBenchmark> },
+    { "arc-benchmark", "Arc expansion benchmark, G-code file.", "file", createBenchmark<ArcBenchmark> },
+    { "arc-check", "Arc kernel accuracy check on random arcs.", NULL, createBenchmark<ArcCheckBenchmark> },
+};
+
+Benchmark::Benchmark()
+{
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+void Benchmark::setFileName(const QString &fileName)
+{
+    m_fileName = fileName;
+}
+
+void Benchmark::setOutputFileName(const QString &outputFileName)
+{
+    m_outputFileName = outputFileName;
+}
+
+// Report is printed to stdout if output file name is empty
+int Benchmark::run()
+{
+    QJsonObject report;
+    if (!m_fileName.isEmpty()) report["file"] = m_fileName;
+
+    if (!measure(report)) return 1;
+
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if (m_outputFileName.isEmpty()) {
+        QTextStream(stdout) << json;
+    } else {
+        QFile file(m_outputFileName);
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qCritical() << "can't write results:" << m_outputFileName;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int Benchmark::exec(const QStringList &arguments)
+{
+    const BenchmarkMode *mode = NULL;
+    for (const BenchmarkMode &m : benchmarkModes) {
+        if (arguments.contains(QString("--") + m.name)) {
+            mode = &m;
+            break;
+        }
+    }
+
+    if (!mode) return -1;
+
+    QScopedPointer<Benchmark> benchmark(mode->create());
+
+    QCommandLineParser parser;
+    parser.addOption(mode->valueName ? QCommandLineOption(mode->name, mode->description, mode->valueName)
+                                     : QCommandLineOption(mode->name, mode->description));
+    parser.addOption(QCommandLineOption("output", "Write results to file instead of stdout.", "file"));
+    benchmark->addOptions(parser);
+
+    if (!parser.parse(arguments)) {
+        qCritical() << parser.errorText();
+        QTextStream(stderr) << parser.helpText();
+        return 1;
+    }
+
+    if (mode->valueName) benchmark->setFileName(parser.value(mode->name));
+    benchmark->setOutputFileName(parser.value("output"));
+    benchmark->setOptions(parser);
+
+    return benchmark->run();
+}
+
+void Benchmark::addOptions(QCommandLineParser &parser)
+{
+    Q_UNUSED(parser)
+}
+
+void Benchmark::setOptions(const QCommandLineParser &parser)
+{
+    Q_UNUSED(parser)
+}
+
+VisualizerBenchmark::VisualizerBenchmark()
+{
+    m_frames = 360;
+    m_viewport = QSize(1280, 720);
+}
+
+void VisualizerBenchmark::setFrames(int frames)
+{
+    m_frames = qMax(frames, 1);
+}
+
+void VisualizerBenchmark::setViewport(const QSize &viewport)
+{
+    m_viewport = viewport;
+}
+
+void VisualizerBenchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("frames", "Frames to draw.", "count"));
+    parser.addOption(QCommandLineOption("size", "Viewport size.", "width>x<height"));
+}
+
+void VisualizerBenchmark::setOptions(const QCommandLineParser &parser)
+{
+    if (parser.isSet("frames")) setFrames(parser.value("frames").toInt());
+    if (parser.isSet("size")) {
+        QStringList size = parser.value("size").split('x');
+        if (size.count() == 2) setViewport(QSize(size.at(0).toInt(), size.at(1).toInt()));
+    }
+}
+
+// First frame uploads all geometry, it's reported separately from following frames statistics
+bool VisualizerBenchmark::measure(QJsonObject &report)
+{
+    GcodeFileReader reader;
+    if (!reader.open(m_fileName)) {
+        qCritical() << "can't open file:" << m_fileName;
+        return false;
+    }
+
+    // Offscreen context
+    QSurfaceFormat format;
+    format.setDepthBufferSize(24);
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create()) {
+        qCritical() << "can't create GL context";
+        return false;
+    }
+
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if (!context.makeCurrent(&surface)) {
+        qCritical() << "can't make GL context current";
+        return false;
+    }
+
+    QOpenGLFunctions *f = context.functions();
+
+    QOpenGLFramebufferObject fbo(m_viewport, QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo.bind();
+    f->glViewport(0, 0, m_viewport.width(), m_viewport.height());
+
+    QOpenGLShaderProgram program;
+    program.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vshader.glsl");
+    program.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fshader.glsl");
+    if (!program.link()) {
+        qCritical() << "can't link shader program";
+        return false;
+    }
+
+    // Parse program, same as on file opening
+    QElapsedTimer parseTime;
+    parseTime.start();
+
+    GcodeViewParse parser;
+    GcodeParseThread parseThread;
+    parseThread.setReader(&reader);
+
+    QEventLoop loop;
+    QObject::connect(&parseThread, &GcodeParseThread::chunkReady, &loop, [&] (GcodeParseChunk chunk) {
+        parser.appendLines(chunk.segments);
+        parser.appendCheckpoint(chunk.checkpoint);
+    });
+    QObject::connect(&parseThread, &QThread::finished, &loop, &QEventLoop::quit);
+
+    parseThread.start();
+    loop.exec();
+    parseThread.wait();
+
+    double parseMs = parseTime.nsecsElapsed() / 1e6;
+    LineSegmentStore *list = parser.getLines();
+
+    // Drawers
+    GcodeDrawer codeDrawer;
+    codeDrawer.setViewParser(&parser);
+    codeDrawer.update();
+
+    ToolDrawer toolDrawer;
+    toolDrawer.setToolPosition(QVector3D(0, 0, 0));
+
+    QVector3D min = codeDrawer.getMinimumExtremes();
+    QVector3D max = codeDrawer.getMaximumExtremes();
+    if (qIsNaN(min.length()) || qIsNaN(max.length())) min = max = QVector3D(0, 0, 0);
+
+    QRectF borderRect(min.x(), min.y(), max.x() - min.x(), max.y() - min.y());
+
+    HeightMapBorderDrawer borderDrawer;
+    borderDrawer.setBorderRect(borderRect);
+
+    // Synthetic probe results
+    HeightMapTableModel heightMapModel;
+    heightMapModel.resize(BENCHMARKGRIDPOINTS, BENCHMARKGRIDPOINTS);
+    for (int i = 0; i < BENCHMARKGRIDPOINTS; i++) {
+        for (int j = 0; j < BENCHMARKGRIDPOINTS; j++) {
+            heightMapModel.setData(heightMapModel.index(i, j), 0.5 * sin(i * 0.7) * cos(j * 0.5), Qt::UserRole);
+        }
+    }
+
+    HeightMapGridDrawer gridDrawer;
+    gridDrawer.setModel(&heightMapModel);
+    gridDrawer.setBorderRect(borderRect);
+    gridDrawer.setGridSize(QPointF(BENCHMARKGRIDPOINTS, BENCHMARKGRIDPOINTS));
+    gridDrawer.setZBottom(-1);
+    gridDrawer.setZTop(1);
+
+    QVector<QVector<double>> interpolationData;
+    for (int i = 0; i < BENCHMARKINTERPOLATIONPOINTS; i++) {
+        QVector<double> row;
+        for (int j = 0; j < BENCHMARKINTERPOLATIONPOINTS; j++) {
+            double x = borderRect.width() * j / (BENCHMARKINTERPOLATIONPOINTS - 1) + borderRect.x();
+            double y = borderRect.height() * i / (BENCHMARKINTERPOLATIONPOINTS - 1) + borderRect.y();
+            row.append(Interpolation::bicubicInterpolate(borderRect, &heightMapModel, x, y));
+        }
+        interpolationData.append(row);
+    }
+
+    HeightMapInterpolationDrawer interpolationDrawer;
+    interpolationDrawer.setBorderRect(borderRect);
+    interpolationDrawer.setData(&interpolationData);
+
+    QList<ShaderDrawable*> drawables;
+    drawables << &codeDrawer << &toolDrawer << &borderDrawer << &gridDrawer << &interpolationDrawer;
+
+    // Camera fitting toolpath, as in visualizer
+    QVector3D size = max - min;
+    double distance = qMax(size.y() / 2 / 0.25 * 1.3 + size.z() / 2,
+                           size.x() / 2 / 0.25 * 1.3 / ((double)m_viewport.width() / m_viewport.height()) + size.z() / 2);
+    if (distance == 0) distance = 200;
+
+    QVector3D center((max.x() + min.x()) / 2, (max.z() + min.z()) / 2, -(max.y() + min.y()) / 2);
+
+    QMatrix4x4 projection;
+    double aspect = (double)m_viewport.width() / m_viewport.height();
+    projection.frustum(-0.5 * aspect, 0.5 * aspect, -0.5, 0.5, 2, distance * 2);
+
+    // Frames
+    int lastLine = list->isEmpty() ? 0 : list->getLineNumber(list->count() - 1);
+    int drawnSegments = 0;
+
+    QVector<double> cpuTimes;
+    QVector<double> frameTimes;
+    qint64 uploadedFrames = 0;
+    qint64 uploadedFirst = 0;
+    QJsonObject vertices;
+
+    for (int frame = 0; frame <= m_frames; frame++) {
+        QElapsedTimer timer;
+        timer.start();
+        qint64 uploaded = GeometryBuffer::uploadedBytes();
+
+        // Shadow toolpath by progress, following tool
+        QList<int> indexes;
+        if (frame > 0) {
+            int progressLine = (qint64)lastLine * frame / m_frames;
+            while (drawnSegments < list->count() && list->getLineNumber(drawnSegments) <= progressLine) {
+                list->setDrawn(drawnSegments, true);
+                indexes.append(drawnSegments++);
+            }
+            if (!indexes.isEmpty()) {
+                codeDrawer.update(indexes);
+                if (!qIsNaN(list->getEnd(indexes.last()).length())) toolDrawer.setToolPosition(list->getEnd(indexes.last()));
+            }
+        }
+
+        QMatrix4x4 view = viewMatrix(center, distance, BENCHMARKELEVATION, 360.0 * frame / m_frames);
+
+        f->glClearColor(1.0, 1.0, 1.0, 1.0);
+        f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        f->glEnable(GL_DEPTH_TEST);
+#ifndef GLES
+        f->glEnable(GL_PROGRAM_POINT_SIZE);
+#endif
+
+        program.bind();
+        program.setUniformValue("mvp_matrix", projection * view);
+        program.setUniformValue("mv_matrix", view);
+
+        // Toolpath states are updated at once instead of by visualizer timer
+        foreach (ShaderDrawable *drawable, drawables) {
+            if (drawable->needsUpdateGeometry() || (drawable == &codeDrawer && !indexes.isEmpty())) {
+                drawable->updateGeometry(&program);
+            }
+        }
+
+        foreach (ShaderDrawable *drawable, drawables) {
+            drawable->setViewProjection(projection * view, m_viewport);
+            drawable->draw(&program);
+        }
+
+        program.release();
+
+        double cpuTime = timer.nsecsElapsed() / 1e6;
+        f->glFinish();
+        double frameTime = timer.nsecsElapsed() / 1e6;
+
+        cpuTimes.append(cpuTime);
+        frameTimes.append(frameTime);
+
+        if (frame == 0) {
+            uploadedFirst = GeometryBuffer::uploadedBytes() - uploaded;
+
+            vertices["toolpath"] = codeDrawer.getVertexCount();
+            vertices["tool"] = toolDrawer.getVertexCount();
+            vertices["heightmap"] = borderDrawer.getVertexCount() + gridDrawer.getVertexCount()
+                    + interpolationDrawer.getVertexCount();
+        } else {
+            uploadedFrames += GeometryBuffer::uploadedBytes() - uploaded;
+        }
+    }
+
+    fbo.release();
+
+    // Report
+    QVector<double> cpu = cpuTimes.mid(1);
+    QVector<double> frames = frameTimes.mid(1);
+
+    QJsonObject cpuReport;
+    cpuReport["first"] = cpuTimes.first();
+    cpuReport["p50"] = percentile(cpu, 50);
+    cpuReport["p99"] = percentile(cpu, 99);
+    cpuReport["max"] = percentile(cpu, 100);
+
+    QJsonObject frameReport;
+    frameReport["first"] = frameTimes.first();
+    frameReport["p50"] = percentile(frames, 50);
+    frameReport["p99"] = percentile(frames, 99);
+    frameReport["max"] = percentile(frames, 100);
+
+    QJsonObject uploadReport;
+    uploadReport["first"] = uploadedFirst;
+    uploadReport["frames"] = uploadedFrames;
+    uploadReport["perFrame"] = (double)uploadedFrames / m_frames;
+
+    report["renderer"] = QString((const char*)f->glGetString(GL_RENDERER));
+    report["viewport"] = QJsonArray() << m_viewport.width() << m_viewport.height();
+    report["frames"] = m_frames;
+    report["lines"] = reader.lineCount();
+    report["segments"] = list->count();
+    report["parseMs"] = parseMs;
+    report["vertices"] = vertices;
+    report["uploadBytes"] = uploadReport;
+    report["cpuMs"] = cpuReport;
+    report["frameMs"] = frameReport;
+
+    return true;
+}
+
+// Orbit camera as in visualizer view, center is in view coordinates
+QMatrix4x4 VisualizerBenchmark::viewMatrix(const QVector3D &center, double distance, double xRot, double yRot)
+{
+    double angY = M_PI / 180 * yRot;
+    double angX = M_PI / 180 * xRot;
+
+    QVector3D eye(distance * cos(angX) * sin(angY) + center.x(), distance * sin(angX) + center.y(),
+                  distance * cos(angX) * cos(angY) + center.z());
+
+    QMatrix4x4 view;
+    view.lookAt(eye, center, QVector3D(0, 1, 0));
+    view.rotate(-90, 1.0, 0.0, 0.0);
+
+    return view;
+}
+
+// Nearest rank percentile
+double VisualizerBenchmark::percentile(QVector<double> values, double p)
+{
+    if (values.isEmpty()) return 0;
+
+    std::sort(values.begin(), values.end());
+    int rank = qBound(1, (int)ceil(p / 100 * values.count()), values.count());
+
+    return values.at(rank - 1);
+}
+
+StreamBenchmark::StreamBenchmark()
+{
+    m_host = "127.0.0.1";
+    m_port = 8888;
+    m_bufferLength = 127;
+    m_repeats = 100;
+}
+
+void StreamBenchmark::setHost(const QString &host)
+{
+    m_host = host;
+}
+
+void StreamBenchmark::setPort(int port)
+{
+    m_port = port;
+}
+
+void StreamBenchmark::setBufferLength(int bufferLength)
+{
+    m_bufferLength = qMax(bufferLength, 1);
+}
+
+void StreamBenchmark::setRepeats(int repeats)
+{
+    m_repeats = qMax(repeats, 1);
+}
+
+void StreamBenchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("host", "Controller host.", "host"));
+    parser.addOption(QCommandLineOption("port", "Controller port.", "port"));
+    parser.addOption(QCommandLineOption("buffer", "Controller buffer length.", "bytes"));
+    parser.addOption(QCommandLineOption("repeats", "Times to pass program through sender core alone.", "count"));
+}
+
+void StreamBenchmark::setOptions(const QCommandLineParser &parser)
+{
+    if (parser.isSet("host")) setHost(parser.value("host"));
+    if (parser.isSet("port")) setPort(parser.value("port").toInt());
+    if (parser.isSet("buffer")) setBufferLength(parser.value("buffer").toInt());
+    if (parser.isSet("repeats")) setRepeats(parser.value("repeats").toInt());
+}
+
+// Program is sent by machine's sender core: send stream spans appended to command buffer while they fit
+// send-ahead window, commands are taken from buffer by responses
+bool StreamBenchmark::measure(QJsonObject &report)
+{
+    GcodeFileReader reader;
+    if (!reader.open(m_fileName)) {
+        qCritical() << "can't open file:" << m_fileName;
+        return false;
+    }
+
+    // Program table as filled on file opening, with trailing blank row
+    GCodeTableModel model;
+    GcodeTokenizer tokenizer;
+    const char *lineData;
+    int lineLength;
+
+    model.setReader(&reader);
+    model.reserve(reader.lineCount());
+
+    for (int i = 0; i < reader.lineCount(); i++) {
+        reader.trimmedLine(i, &lineData, &lineLength);
+        if (lineLength == 0) continue;
+
+        tokenizer.tokenize(lineData, lineLength);
+        if (tokenizer.hasCode()) model.appendSourceRow(i, model.rowCount());
+    }
+    model.insertRow(model.rowCount());
+
+    SendStream stream;
+    stream.build(&model);
+
+    int count = stream.count();
+    qint64 bytes = count > 0 ? stream.span(0, count).length() : 0;
+
+    // Sender core alone, each response is taken at once
+    CommandBuffer core(BENCHMARKSENDAHEAD);
+    qint64 coreBytes = 0;
+
+    QElapsedTimer time;
+    time.start();
+
+    for (int r = 0; r < m_repeats; r++) {
+        int index = 0;
+
+        do {
+            int first = index;
+            index = core.appendStream(stream, index, SendStream::ProgramEnd);
+
+            if (index > first) {
+                coreBytes += stream.span(first, index).length();
+            } else if (core.isEmpty() && index < count) {
+                qCritical() << "command exceeds send-ahead window:" << stream.command(index);
+                return false;
+            }
+
+            if (!core.isEmpty()) core.takeFirst();
+        } while (index < count || !core.isEmpty());
+    }
+
+    double coreMs = time.nsecsElapsed() / 1e6;
+
+    if (coreBytes != bytes * m_repeats) {
+        qCritical() << "sender core lost commands, bytes:" << coreBytes << "of" << bytes * m_repeats;
+        return false;
+    }
+
+    // Streaming to controller
+    CandleConnection connection;
+    connection.setConnType(CandleConnection::CONN_TCPIP);
+    connection.setTcpHost(m_host);
+    connection.setTcpPort(m_port);
+    connection.setBufferLength(m_bufferLength);
+    connection.setResponseEnds(QList<QByteArray>() << "ok" << "error");
+
+    if (!connection.openPort()) {
+        qCritical() << "can't connect:" << m_host << m_port << connection.errorString();
+        return false;
+    }
+
+    CommandBuffer commands(BENCHMARKSENDAHEAD);
+    int sent = 0;
+    int acknowledged = 0;
+    int errors = 0;
+
+    QEventLoop loop;
+    QTimer watchdog;
+    watchdog.setSingleShot(true);
+    watchdog.setInterval(BENCHMARKSTREAMTIMEOUT);
+    QObject::connect(&watchdog, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+    auto feed = [&] {
+        int first = sent;
+        sent = commands.appendStream(stream, sent, SendStream::ProgramEnd);
+        if (sent > first) connection.sendCommand(stream.span(first, sent));
+    };
+
+    QObject::connect(&connection, &CandleConnection::readyRead, &loop, [&] {
+        while (connection.canReadLine()) {
+            QByteArray data = connection.readLine().trimmed();
+            bool error = data.contains("error");
+
+            if (data.startsWith('<') || !(data.contains("ok") || error) || commands.isEmpty()) continue;
+
+            if (error) errors++;
+            commands.takeFirst();
+            acknowledged++;
+        }
+
+        if (acknowledged == count) {
+            loop.quit();
+            return;
+        }
+
+        feed();
+        watchdog.start();
+    });
+
+    time.restart();
+
+    feed();
+    watchdog.start();
+    if (count > 0) loop.exec();
+
+    double ms = time.nsecsElapsed() / 1e6;
+
+    connection.close();
+
+    if (acknowledged < count) {
+        qCritical() << "controller response timeout, acknowledged:" << acknowledged << "of" << count;
+        return false;
+    }
+
+    report["host"] = m_host;
+    report["port"] = m_port;
+    report["bufferLength"] = m_bufferLength;
+    report["lines"] = count;
+    report["bytes"] = bytes;
+    report["errors"] = errors;
+    report["ms"] = ms;
+    report["linesPerSecond"] = ms > 0 ? count * 1000.0 / ms : 0;
+    report["bytesPerSecond"] = ms > 0 ? bytes * 1000.0 / ms : 0;
+    report["coreRepeats"] = m_repeats;
+    report["coreMs"] = coreMs;
+    report["coreNsPerLine"] = count > 0 ? coreMs * 1e6 / ((double)count * m_repeats) : 0;
+
+    return true;
+}
+
+StatusBenchmark::StatusBenchmark()
+{
+    m_repeats = 10000;
+}
+
+void StatusBenchmark::setRepeats(int repeats)
+{
+    m_repeats = qMax(repeats, 1);
+}
+
+void StatusBenchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("repeats", "Times to parse each report.", "count"));
+}
+
+void StatusBenchmark::setOptions(const QCommandLineParser &parser)
+{
+    if (parser.isSet("repeats")) setRepeats(parser.value("repeats").toInt());
+}
+
+bool StatusBenchmark::measure(QJsonObject &report)
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "can't open file:" << m_fileName;
+        return false;
+    }
+
+    QVector<QByteArray> reports;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.startsWith('<')) reports.append(line);
+    }
+
+    if (reports.isEmpty()) {
+        qCritical() << "no status reports:" << m_fileName;
+        return false;
+    }
+
+    MachineStatus status;
+    int parsed = 0;
+    double checksum = 0;
+
+    QElapsedTimer time;
+    time.start();
+
+    for (int r = 0; r < m_repeats; r++) {
+        foreach (const QByteArray &line, reports) {
+            if (GrblStatusParser::parse(line.constData(), line.length(), &status)) parsed++;
+            checksum += status.mpos[0] + status.feed;
+        }
+    }
+
+    double parserMs = time.nsecsElapsed() / 1e6;
+
+    // Chain of expressions matched against decoded report, as done before
+    QRegExp mpx("MPos:([^,]*),([^,]*),([^,^>^|]*)");
+    QRegExp stx("<([^,^>^|]*)");
+    QRegExp wpx("WCO:([^,]*),([^,]*),([^,^>^|]*)");
+    QRegExp ov("Ov:([^,]*),([^,]*),([^,^>^|]*)");
+    QRegExp pn("Pn:([^|^>]*)");
+    QRegExp as("A:([^,^>^|]+)");
+    QRegExp fs("FS:([^,]*),([^,^|^>]*)");
+    double regexpChecksum = 0;
+
+    time.restart();
+
+    for (int r = 0; r < m_repeats; r++) {
+        foreach (const QByteArray &line, reports) {
+            QString data = QString::fromLatin1(line);
+
+            if (mpx.indexIn(data) != -1) regexpChecksum += mpx.cap(1).toDouble() + mpx.cap(2).toDouble() + mpx.cap(3).toDouble();
+            if (stx.indexIn(data) != -1) regexpChecksum += stx.cap(1).length();
+            if (wpx.indexIn(data) != -1) regexpChecksum += wpx.cap(1).toDouble() + wpx.cap(2).toDouble() + wpx.cap(3).toDouble();
+            if (ov.indexIn(data) != -1) regexpChecksum += ov.cap(1).toInt() + ov.cap(2).toInt() + ov.cap(3).toInt();
+            if (pn.indexIn(data) != -1) regexpChecksum += pn.cap(1).length();
+            if (as.indexIn(data) != -1) regexpChecksum += as.cap(1).length();
+            if (fs.indexIn(data) != -1) regexpChecksum += fs.cap(1).toDouble() + fs.cap(2).toDouble();
+        }
+    }
+
+    double regexpMs = time.nsecsElapsed() / 1e6;
+    double count = (double)reports.count() * m_repeats;
+
+    report["reports"] = reports.count();
+    report["repeats"] = m_repeats;
+    report["parsed"] = parsed;
+    report["checksum"] = checksum + regexpChecksum;
+    report["parserMs"] = parserMs;
+    report["parserNsPerReport"] = parserMs * 1e6 / count;
+    report["regexpMs"] = regexpMs;
+    report["regexpNsPerReport"] = regexpMs * 1e6 / count;
+    report["speedup"] = parserMs > 0 ? regexpMs / parserMs : 0;
+
+    return true;
+}
+
+TokenizerBenchmark::TokenizerBenchmark()
+{
+    m_repeats = 10;
+}
+
+void TokenizerBenchmark::setRepeats(int repeats)
+{
+    m_repeats = qMax(repeats, 1);
+}
+
+void TokenizerBenchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("repeats", "Times to split each line.", "count"));
+}
+
+void TokenizerBenchmark::setOptions(const QCommandLineParser &parser)
+{
+    if (parser.isSet("repeats")) setRepeats(parser.value("repeats").toInt());
+}
+
+// Both paths start from file line & read feed word, as parser does for each command
+bool TokenizerBenchmark::measure(QJsonObject &report)
+{
+    GcodeFileReader reader;
+    if (!reader.open(m_fileName)) {
+        qCritical() << "can't open file:" << m_fileName;
+        return false;
+    }
+
+    int lines = reader.lineCount();
+    if (lines == 0) {
+        qCritical() << "no lines:" << m_fileName;
+        return false;
+    }
+
+    GcodeTokenizer tokenizer;
+    const char *lineData;
+    int lineLength;
+    qint64 words = 0;
+    double checksum = 0;
+
+    QElapsedTimer time;
+    time.start();
+
+    for (int r = 0; r < m_repeats; r++) {
+        for (int i = 0; i < lines; i++) {
+            reader.trimmedLine(i, &lineData, &lineLength);
+            words += tokenizer.tokenize(lineData, lineLength);
+
+            double feed = tokenizer.value('F');
+            if (!qIsNaN(feed)) checksum += feed;
+        }
+    }
+
+    double tokenizerMs = time.nsecsElapsed() / 1e6;
+    qint64 regexpWords = 0;
+    double regexpChecksum = 0;
+
+    time.restart();
+
+    for (int r = 0; r < m_repeats; r++) {
+        for (int i = 0; i < lines; i++) {
+            QString stripped = GcodePreprocessorUtils::removeComment(reader.trimmedLineString(i));
+            QStringList args = GcodePreprocessorUtils::splitCommand(stripped);
+            regexpWords += args.count();
+
+            double feed = GcodePreprocessorUtils::parseCoord(args, 'F');
+            if (!qIsNaN(feed)) regexpChecksum += feed;
+        }
+    }
+
+    double regexpMs = time.nsecsElapsed() / 1e6;
+    double count = (double)lines * m_repeats;
+
+    report["lines"] = lines;
+    report["repeats"] = m_repeats;
+    report["words"] = words / m_repeats;
+    report["regexpWords"] = regexpWords / m_repeats;
+    report["checksum"] = checksum + regexpChecksum;
+    report["tokenizerMs"] = tokenizerMs;
+    report["tokenizerNsPerLine"] = tokenizerMs * 1e6 / count;
+    report["regexpMs"] = regexpMs;
+    report["regexpNsPerLine"] = regexpMs * 1e6 / count;
+    report["speedup"] = tokenizerMs > 0 ? regexpMs / tokenizerMs : 0;
+
+    return true;
+}
+
+ArcBenchmark::ArcBenchmark()
+{
+    m_threads << 1 << 4 << 16;
+    m_repeats = 10;
+    m_arcPrecision = 0.1;
+}
+
+void ArcBenchmark::setThreads(const QList<int> &threads)
+{
+    m_threads.clear();
+    foreach (int count, threads) if (count > 0) m_threads.append(count);
+    if (m_threads.isEmpty()) m_threads << 1;
+}
+
+void ArcBenchmark::setRepeats(int repeats)
+{
+    m_repeats = qMax(repeats, 1);
+}
+
+void ArcBenchmark::setArcPrecision(double arcPrecision)
+{
+    if (arcPrecision > 0) m_arcPrecision = arcPrecision;
+}
+
+void ArcBenchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("threads", "Comma separated thread pool sizes.", "counts"));
+    parser.addOption(QCommandLineOption("repeats", "Times to build segments.", "count"));
+    parser.addOption(QCommandLineOption("precision", "Arc precision.", "mm"));
+}
+
+void ArcBenchmark::setOptions(const QCommandLineParser &parser)
+{
+    if (parser.isSet("threads")) {
+        QList<int> threads;
+        foreach (const QString &count, parser.value("threads").split(',')) threads.append(count.toInt());
+        setThreads(threads);
+    }
+    if (parser.isSet("repeats")) setRepeats(parser.value("repeats").toInt());
+    if (parser.isSet("precision")) setArcPrecision(parser.value("precision").toDouble());
+}
+
+static bool sameLines(const LineSegmentStore &a, const LineSegmentStore &b)
+{
+    if (a.count() != b.count() || a.starts() != b.starts() || a.ends() != b.ends()) return false;
+
+    for (int i = 0; i < a.count(); i++) {
+        if (a.getLineNumber(i) != b.getLineNumber(i) || a.flags(i) != b.flags(i)) return false;
+    }
+
+    return true;
+}
+
+// Arc points as generated before parallel expansion: angle functions & plane restoring matrix
+// for every point, appended to own list of each arc
+static QList<QVector3D> legacyArcPoints(const ArcExpansion &arc)
+{
+    QMatrix4x4 m;
+    m.setToIdentity();
+    switch (arc.plane) {
+    case PointSegment::XY:
+        break;
+    case PointSegment::ZX:
+        m.rotate(-90, 1.0, 0.0, 0.0);
+        break;
+    case PointSegment::YZ:
+        m.rotate(90, 0.0, 1.0, 0.0);
+        break;
+    }
+
+    QVector3D lineEnd(arc.end.x(), arc.end.y(), arc.start.z());
+    QList<QVector3D> segments;
+    double angle;
+
+    double zIncrement = (arc.end.z() - arc.start.z()) / arc.numPoints;
+    for (int i = 1; i < arc.numPoints; i++) {
+        if (arc.clockwise) {
+            angle = (arc.startAngle - i * arc.sweep / arc.numPoints);
+        } else {
+            angle = (arc.startAngle + i * arc.sweep / arc.numPoints);
+        }
+
+        if (angle >= M_PI * 2) {
+            angle = angle - M_PI * 2;
+        }
+
+        lineEnd.setX(cos(angle) * arc.radius + arc.center.x());
+        lineEnd.setY(sin(angle) * arc.radius + arc.center.y());
+        lineEnd.setZ(lineEnd.z() + zIncrement);
+
+        segments.append(m * lineEnd);
+    }
+
+    segments.append(m * arc.end);
+
+    return segments;
+}
+
+// Line segments built as before parallel expansion, arcs are expanded one by one in program order
+static void buildLinesLegacy(const GcodeParser *gp, double arcPrecision, LineSegmentChunk *chunk)
+{
+    const QVector<PointSegment> &points = gp->getPointSegments();
+    QVector3D start;
+    QVector3D end;
+    int currentLine = 0;
+
+    chunk->firstLineNumber = points.isEmpty() ? -1 : points.first().getLineNumber();
+    chunk->lineIndexes.resize(points.count());
+
+    for (int i = 0; i < points.count(); i++) {
+        const PointSegment &ps = points.at(i);
+
+        end = ps.metricPoint();
+
+        if (i > 0) {
+            int slot = qMax(ps.getLineNumber() - chunk->firstLineNumber, 0);
+            if (slot >= chunk->lineIndexes.count()) chunk->lineIndexes.resize(slot + 1);
+            QList<int> &indexes = chunk->lineIndexes[slot];
+
+            int flags = (ps.isFastTraverse() ? LineSegmentStore::FastTraverse : 0)
+                    | (ps.isZMovement() ? LineSegmentStore::ZMovement : 0)
+                    | (ps.isMetric() ? LineSegmentStore::Metric : 0)
+                    | (ps.isAbsolute() ? LineSegmentStore::Absolute : 0);
+
+            if (ps.isArc()) {
+                const ArcProperties &arc = gp->getArcProperties(ps);
+                double scale = ps.isMetric() ? 1.0 : 25.4;
+                ArcExpansion expansion;
+
+                flags |= LineSegmentStore::Arc | (arc.isClockwise ? LineSegmentStore::Clockwise : 0)
+                        | LineSegmentStore::planeFlags(ps.plane());
+
+                if (GcodePreprocessorUtils::prepareArc(ps.plane(), start, end, arc.center * scale, arc.isClockwise,
+                                                       arc.radius * scale, 0.1, arcPrecision, false, &expansion)) {
+                    QList<QVector3D> arcPoints = legacyArcPoints(expansion);
+                    QVector3D startPoint = start;
+
+                    foreach (QVector3D nextPoint, arcPoints) {
+                        if (nextPoint == startPoint) continue;
+                        indexes.append(chunk->lines.append(startPoint, nextPoint, currentLine, flags,
+                                                           ps.getSpeed(), ps.getSpindleSpeed(), ps.getDwell()));
+                        startPoint = nextPoint;
+                    }
+                    currentLine++;
+                }
+            } else {
+                indexes.append(chunk->lines.append(start, end, currentLine++, flags,
+                                                   ps.getSpeed(), ps.getSpindleSpeed(), ps.getDwell()));
+            }
+        }
+        start = end;
+    }
+}
+
+// Speedups are relative to expansion as it was done before, single thread pool size result is
+// the reference output for the others
+bool ArcBenchmark::measure(QJsonObject &report)
+{
+    GcodeFileReader reader;
+    if (!reader.open(m_fileName)) {
+        qCritical() << "can't open file:" << m_fileName;
+        return false;
+    }
+
+    GcodeParser gp;
+    GcodeTokenizer tokenizer;
+    const char *lineData;
+    int lineLength;
+
+    for (int i = 0; i < reader.lineCount(); i++) {
+        reader.trimmedLine(i, &lineData, &lineLength);
+        if (lineLength == 0) continue;
+
+        tokenizer.tokenize(lineData, lineLength);
+        if (tokenizer.hasCode()) gp.addCommand(tokenizer);
+    }
+
+    int points = gp.getPointSegments().count();
+    QThreadPool *pool = QThreadPool::globalInstance();
+    int maxThreadCount = pool->maxThreadCount();
+
+    LineSegmentChunk reference;
+    GcodeViewParse vp;
+    pool->setMaxThreadCount(1);
+    vp.buildLines(&gp, 0, points, m_arcPrecision, false, &reference);
+
+    double legacyMs = 0;
+    int legacySegments = 0;
+
+    for (int r = 0; r < m_repeats; r++) {
+        LineSegmentChunk chunk;
+
+        QElapsedTimer time;
+        time.start();
+
+        buildLinesLegacy(&gp, m_arcPrecision, &chunk);
+
+        legacyMs += time.nsecsElapsed() / 1e6;
+        legacySegments = chunk.lines.count();
+    }
+
+    legacyMs /= m_repeats;
+
+    QJsonArray runs;
+    bool identical = true;
+
+    foreach (int threads, m_threads) {
+        pool->setMaxThreadCount(threads);
+
+        double ms = 0;
+        bool same = true;
+
+        for (int r = 0; r < m_repeats; r++) {
+            LineSegmentChunk chunk;
+            vp.setCurrentLine(0);
+
+            QElapsedTimer time;
+            time.start();
+
+            vp.buildLines(&gp, 0, points, m_arcPrecision, false, &chunk);
+
+            ms += time.nsecsElapsed() / 1e6;
+            same = same && sameLines(chunk.lines, reference.lines);
+        }
+
+        ms /= m_repeats;
+        identical = identical && same;
+
+        QJsonObject run;
+        run["threads"] = threads;
+        run["ms"] = ms;
+        run["speedup"] = ms > 0 ? legacyMs / ms : 0;
+        run["identical"] = same;
+        runs.append(run);
+    }
+
+    pool->setMaxThreadCount(maxThreadCount);
+
+    report["points"] = points;
+    report["segments"] = reference.lines.count();
+    report["legacyMs"] = legacyMs;
+    report["legacySegments"] = legacySegments;
+    report["arcPrecision"] = m_arcPrecision;
+    report["repeats"] = m_repeats;
+    report["idealThreadCount"] = QThread::idealThreadCount();
+    report["runs"] = runs;
+    report["identical"] = identical;
+
+    if (!identical) qCritical() << "parallel arc expansion differs from serial one";
+
+    return identical;
+}
+
+ArcCheckBenchmark::ArcCheckBenchmark()
+{
+    m_arcs = 2000;
+    m_arcPrecision = 0.1;
+    m_seed = 1;
+}
+
+void ArcCheckBenchmark::setArcs(int arcs)
+{
+    m_arcs = qMax(arcs, 1);
+}
+
+void ArcCheckBenchmark::setArcPrecision(double arcPrecision)
+{
+    if (arcPrecision > 0) m_arcPrecision = arcPrecision;
+}
+
+void ArcCheckBenchmark::setSeed(quint32 seed)
+{
+    m_seed = seed;
+}
+
+void ArcCheckBenchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("arcs", "Random arcs count.", "count"));
+    parser.addOption(QCommandLineOption("precision", "Arc precision.", "mm"));
+    parser.addOption(QCommandLineOption("seed", "Random generator seed.", "seed"));
+}
+
+void ArcCheckBenchmark::setOptions(const QCommandLineParser &parser)
+{
+    if (parser.isSet("arcs")) setArcs(parser.value("arcs").toInt());
+    if (parser.isSet("precision")) setArcPrecision(parser.value("precision").toDouble());
+    if (parser.isSet("seed")) setSeed(parser.value("seed").toUInt());
+}
+
+// Arcs of random plane, direction, center, radius & helix height, up to full circle
+bool ArcCheckBenchmark::measure(QJsonObject &report)
+{
+    QRandomGenerator random(m_seed);
+    QVector<ArcExpansion> arcs;
+    QVector<int> offsets;
+    int total = 0;
+
+    arcs.reserve(m_arcs);
+    offsets.reserve(m_arcs);
+
+    while (arcs.count() < m_arcs) {
+        PointSegment::planes plane = (PointSegment::planes)random.bounded(3);
+        double radius = exp(log(0.01) + random.generateDouble() * (log(1000.0) - log(0.01)));
+        double startAngle = random.generateDouble() * 2 * M_PI;
+        double endAngle = random.generateDouble() * 2 * M_PI;
+        QVector3D center(random.generateDouble() * 2000 - 1000, random.generateDouble() * 2000 - 1000,
+                         random.generateDouble() * 200 - 100);
+        double height = random.generateDouble() * 20 - 10;
+
+        // Points are generated in arc plane & rotated to it's axes, as parser sees them
+        QMatrix4x4 m;
+        switch (plane) {
+        case PointSegment::XY:
+            break;
+        case PointSegment::ZX:
+            m.rotate(90, 1.0, 0.0, 0.0);
+            break;
+        case PointSegment::YZ:
+            m.rotate(-90, 0.0, 1.0, 0.0);
+            break;
+        }
+        QMatrix4x4 inverted = m.inverted();
+
+        QVector3D start = center + QVector3D(cos(startAngle) * radius, sin(startAngle) * radius, 0);
+        QVector3D end = center + QVector3D(cos(endAngle) * radius, sin(endAngle) * radius, height);
+
+        ArcExpansion arc;
+        if (!GcodePreprocessorUtils::prepareArc(plane, inverted * start, inverted * end, inverted * center,
+                                                random.bounded(2), radius, 0.1, m_arcPrecision, false, &arc)) continue;
+
+        arcs.append(arc);
+        offsets.append(total);
+        total += arc.count;
+    }
+
+    QVector<float> points(total * 3);
+    QVector<float> reference(total * 3);
+
+    QElapsedTimer time;
+    time.start();
+
+    for (int i = 0; i < arcs.count(); i++) GcodePreprocessorUtils::generateArcPoints(arcs.at(i), points.data() + offsets.at(i) * 3);
+
+    double kernelMs = time.nsecsElapsed() / 1e6;
+
+    time.restart();
+
+    for (int i = 0; i < arcs.count(); i++) GcodePreprocessorUtils::generateArcPointsReference(arcs.at(i), reference.data() + offsets.at(i) * 3);
+
+    double referenceMs = time.nsecsElapsed() / 1e6;
+
+    double maxDeviation = 0;
+    int failed = 0;
+
+    for (int i = 0; i < total; i++) {
+        const float *p = points.constData() + i * 3;
+        const float *r = reference.constData() + i * 3;
+        double deviation = QVector3D(p[0] - r[0], p[1] - r[1], p[2] - r[2]).length();
+
+        if (qIsNaN(deviation) || deviation > m_arcPrecision) failed++;
+        if (!qIsNaN(deviation)) maxDeviation = qMax(maxDeviation, deviation);
+    }
+
+    report["arcs"] = arcs.count();
+    report["points"] = total;
+    report["seed"] = (qint64)m_seed;
+    report["arcPrecision"] = m_arcPrecision;
+    report["maxDeviation"] = maxDeviation;
+    report["failedPoints"] = failed;
+    report["kernelMs"] = kernelMs;
+    report["referenceMs"] = referenceMs;
+    report["speedup"] = kernelMs > 0 ? referenceMs / kernelMs : 0;
+
+    if (failed > 0) qCritical() << "arc kernel deviates from reference more than arc precision, points:" << failed;
+
+    return failed == 0;
+}
@@ -0,0 +1,182 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QSize>
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QJsonObject>
+#include <QCommandLineParser>
+
+// Headless benchmark base.
+// Mode is selected by "--<mode> [<file>]" command line option, mode specific options are added by
+// subclasses. Results are printed as JSON or written to file given by "--output <file>".
+class Benchmark
+{
+public:
+    Benchmark();
+    virtual ~Benchmark();
+
+    void setFileName(const QString &fileName);
+    void setOutputFileName(const QString &outputFileName);
+
+    // Returns process exit code
+    int run();
+
+    // Runs benchmark mode given in arguments, returns process exit code or -1 if no mode is given
+    static int exec(const QStringList &arguments);
+
+protected:
+    QString m_fileName;
+
+    virtual void addOptions(QCommandLineParser &parser);
+    virtual void setOptions(const QCommandLineParser &parser);
+
+    // Fills report, returns false on failure
+    virtual bool measure(QJsonObject &report) = 0;
+
+private:
+    QString m_outputFileName;
+};
+
+// Headless visualizer benchmark: --benchmark <file> [--frames <count>] [--size <width>x<height>]
+// Program is parsed by background parser and drawn with toolpath, tool & heightmap drawers to offscreen
+// framebuffer, while camera orbits the toolpath and it's shadowed by simulated progress.
+// W/o GPU run with QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1.
+class VisualizerBenchmark : public Benchmark
+{
+public:
+    VisualizerBenchmark();
+
+    void setFrames(int frames);
+    void setViewport(const QSize &viewport);
+
+protected:
+    void addOptions(QCommandLineParser &parser);
+    void setOptions(const QCommandLineParser &parser);
+    bool measure(QJsonObject &report);
+
+private:
+    int m_frames;
+    QSize m_viewport;
+
+    static QMatrix4x4 viewMatrix(const QVector3D &center, double distance, double xRot, double yRot);
+    static double percentile(QVector<double> values, double p);
+};
+
+// Streaming benchmark: --stream <file> [--host <host>] [--port <port>] [--buffer <bytes>] [--repeats <count>]
+// Program is streamed by machine's sender core & character-counting connection to TCP controller,
+// e.g. TestTcpServer simulator, as fast as acknowledgements allow. Sender core alone is measured too.
+class StreamBenchmark : public Benchmark
+{
+public:
+    StreamBenchmark();
+
+    void setHost(const QString &host);
+    void setPort(int port);
+    void setBufferLength(int bufferLength);
+    void setRepeats(int repeats);
+
+protected:
+    void addOptions(QCommandLineParser &parser);
+    void setOptions(const QCommandLineParser &parser);
+    bool measure(QJsonObject &report);
+
+private:
+    QString m_host;
+    int m_port;
+    int m_bufferLength;
+    int m_repeats;
+};
+
+// Status report parser benchmark: --status-benchmark <file> [--repeats <count>]
+// Captured Grbl status reports are parsed repeatedly by GrblStatusParser & by regular expressions
+// used before it, for comparison.
+class StatusBenchmark : public Benchmark
+{
+public:
+    StatusBenchmark();
+
+    void setRepeats(int repeats);
+
+protected:
+    void addOptions(QCommandLineParser &parser);
+    void setOptions(const QCommandLineParser &parser);
+    bool measure(QJsonObject &report);
+
+private:
+    int m_repeats;
+};
+
+// G-code tokenizer benchmark: --tokenizer-benchmark <file> [--repeats <count>]
+// Program lines are split to words by GcodeTokenizer & by comment stripping and splitting with
+// regular expressions used before it, for comparison.
+class TokenizerBenchmark : public Benchmark
+{
+public:
+    TokenizerBenchmark();
+
+    void setRepeats(int repeats);
+
+protected:
+    void addOptions(QCommandLineParser &parser);
+    void setOptions(const QCommandLineParser &parser);
+    bool measure(QJsonObject &report);
+
+private:
+    int m_repeats;
+};
+
+// Arc expansion benchmark: --arc-benchmark <file> [--threads <counts>] [--repeats <count>] [--precision <mm>]
+// Program line segments are built with thread pool limited to each of given threads counts & compared
+// with building them as before, arc by arc to own points lists. Segments are checked to be identical
+// to ones built by single thread. Fails if they differ.
+class ArcBenchmark : public Benchmark
+{
+public:
+    ArcBenchmark();
+
+    void setThreads(const QList<int> &threads);
+    void setRepeats(int repeats);
+    void setArcPrecision(double arcPrecision);
+
+protected:
+    void addOptions(QCommandLineParser &parser);
+    void setOptions(const QCommandLineParser &parser);
+    bool measure(QJsonObject &report);
+
+private:
+    QList<int> m_threads;
+    int m_repeats;
+    double m_arcPrecision;
+};
+
+// Arc kernel accuracy check: --arc-check [--arcs <count>] [--precision <mm>] [--seed <seed>]
+// Random arcs are expanded by selected vectorized kernel & by scalar reference one.
+// Fails if any point deviates from reference more than arc precision.
+class ArcCheckBenchmark : public Benchmark
+{
+public:
+    ArcCheckBenchmark();
+
+    void setArcs(int arcs);
+    void setArcPrecision(double arcPrecision);
+    void setSeed(quint32 seed);
+
+protected:
+    void addOptions(QCommandLineParser &parser);
+    void setOptions(const QCommandLineParser &parser);
+    bool measure(QJsonObject &report);
+
+private:
+    int m_arcs;
+    double m_arcPrecision;
+    quint32 m_seed;
+};
+
+#endif // BENCHMARK_H
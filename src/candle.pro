@@ -40,6 +40,11 @@ TRANSLATIONS += translations/candle_en.ts translations/candle_ru.ts translations
 
 SOURCES += main.cpp\
     CandleConnection.cpp \
+    SendStream.cpp \
+    CommandBuffer.cpp \
+    GrblStatusParser.cpp \
+    MachineState.cpp \
+    benchmark.cpp \
     GrblMachine.cpp \
     Machine.cpp \
     MarlinMachine.cpp \
@@ -47,17 +52,27 @@ SOURCES += main.cpp\
     frmsettings.cpp \
     frmabout.cpp \
     drawers/gcodedrawer.cpp \
+    drawers/arcbatches.cpp \
+    drawers/geometrybuffer.cpp \
     drawers/heightmapborderdrawer.cpp \
     drawers/heightmapgriddrawer.cpp \
     drawers/heightmapinterpolationdrawer.cpp \
+    drawers/linetiles.cpp \
     drawers/origindrawer.cpp \
+    drawers/polylinesimplifier.cpp \
+    drawers/rastertiles.cpp \
+    drawers/segmentindex.cpp \
     drawers/shaderdrawable.cpp \
     drawers/tooldrawer.cpp \
     parser/arcproperties.cpp \
+    parser/gcodefilereader.cpp \
+    parser/gcodeparsecache.cpp \
+    parser/gcodeparsethread.cpp \
     parser/gcodeparser.cpp \
     parser/gcodepreprocessorutils.cpp \
+    parser/gcodetokenizer.cpp \
     parser/gcodeviewparse.cpp \
-    parser/linesegment.cpp \
+    parser/linesegmentstore.cpp \
     parser/pointsegment.cpp \
     tables/gcodetablemodel.cpp \
     tables/heightmaptablemodel.cpp \
@@ -75,28 +90,45 @@ SOURCES += main.cpp\
 
 HEADERS  += frmmain.h \
     CandleConnection.h \
+    SendStream.h \
+    CommandBuffer.h \
+    GrblStatusParser.h \
+    MachineState.h \
+    benchmark.h \
     GrblMachine.h \
     Machine.h \
     MarlinMachine.h \
     frmsettings.h \
     frmabout.h \
     drawers/gcodedrawer.h \
+    drawers/arcbatches.h \
+    drawers/geometrybuffer.h \
     drawers/heightmapborderdrawer.h \
     drawers/heightmapgriddrawer.h \
     drawers/heightmapinterpolationdrawer.h \
+    drawers/linetiles.h \
     drawers/origindrawer.h \
+    drawers/polylinesimplifier.h \
+    drawers/rastertiles.h \
+    drawers/segmentindex.h \
     drawers/shaderdrawable.h \
     drawers/tooldrawer.h \
     parser/arcproperties.h \
+    parser/gcodefilereader.h \
+    parser/gcodeparsecache.h \
+    parser/gcodeparsethread.h \
     parser/gcodeparser.h \
     parser/gcodepreprocessorutils.h \
+    parser/gcodetokenizer.h \
     parser/gcodeviewparse.h \
-    parser/linesegment.h \
+    parser/linesegmentstore.h \
     parser/pointsegment.h \
     tables/gcodetablemodel.h \
     tables/heightmaptablemodel.h \
     utils/interpolation.h \
     utils/util.h \
+    utils/spscqueue.h \
+    utils/ringbuffer.h \
     widgets/colorpicker.h \
     widgets/combobox.h \
     widgets/groupbox.h \
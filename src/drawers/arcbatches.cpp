@@ -0,0 +1,166 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <algorithm>
+#include <cmath>
+#include "arcbatches.h"
+#include "linetiles.h"
+
+#define ARCHANDLESHIFT 24
+
+ArcBatches::ArcBatches()
+{
+    clear();
+}
+
+int ArcBatches::append(const ArcVertexData &arc, const ArcStateData &state, int source)
+{
+    // Segments needed grow as sweep & square root of radius at fixed chordal error
+    double key = fabs(arc.sweep) * sqrt(arc.radius);
+    int index = qBound(0, (int)ceil(log2(qMax(key, 1e-6) / ARCBATCHKEY)), ARCBATCHES - 1);
+    Batch &batch = m_batches[index];
+
+    // Bounds are only grown, stay conservative on truncation
+    double extent = arc.radius + fabs(arc.dz);
+    QVector3D min = arc.center - QVector3D(extent, extent, extent);
+    QVector3D max = arc.center + QVector3D(extent, extent, extent);
+
+    if (batch.arcs.isEmpty() && batch.maxKey == 0) {
+        batch.min = min;
+        batch.max = max;
+    } else {
+        batch.min = QVector3D(qMin(batch.min.x(), min.x()), qMin(batch.min.y(), min.y()), qMin(batch.min.z(), min.z()));
+        batch.max = QVector3D(qMax(batch.max.x(), max.x()), qMax(batch.max.y(), max.y()), qMax(batch.max.z(), max.z()));
+    }
+    batch.maxKey = qMax(batch.maxKey, key);
+
+    batch.arcs.append(arc);
+    batch.states.append(state);
+    batch.sources.append(source);
+
+    int slot = batch.arcs.count() - 1;
+    batch.arcsFirst = qMin(batch.arcsFirst, slot);
+    batch.statesFirst = qMin(batch.statesFirst, slot);
+    batch.statesLast = qMax(batch.statesLast, slot + 1);
+
+    return index << ARCHANDLESHIFT | slot;
+}
+
+void ArcBatches::truncate(int source)
+{
+    for (int i = 0; i < ARCBATCHES; i++) {
+        Batch &batch = m_batches[i];
+        int count = std::lower_bound(batch.sources.constBegin(), batch.sources.constEnd(), source)
+                - batch.sources.constBegin();
+
+        batch.arcs.resize(count);
+        batch.states.resize(count);
+        batch.sources.resize(count);
+        batch.arcsFirst = qMin(batch.arcsFirst, count);
+        batch.statesLast = qMin(batch.statesLast, count);
+    }
+}
+
+void ArcBatches::clear()
+{
+    for (int i = 0; i < ARCBATCHES; i++) {
+        Batch &batch = m_batches[i];
+        batch.arcs.clear();
+        batch.states.clear();
+        batch.sources.clear();
+        batch.min = batch.max = QVector3D();
+        batch.maxKey = 0;
+        batch.arcsFirst = 0;
+        batch.statesFirst = batch.statesLast = 0;
+    }
+}
+
+bool ArcBatches::isEmpty() const
+{
+    return count() == 0;
+}
+
+int ArcBatches::count() const
+{
+    int count = 0;
+    for (int i = 0; i < ARCBATCHES; i++) count += m_batches[i].arcs.count();
+
+    return count;
+}
+
+void ArcBatches::setState(int handle, const ArcStateData &state)
+{
+    Batch &batch = m_batches[handle >> ARCHANDLESHIFT];
+    int slot = handle & ((1 << ARCHANDLESHIFT) - 1);
+
+    ArcStateData &current = batch.states[slot];
+    if (current.head == state.head && current.tail == state.tail && current.split == state.split) return;
+
+    current = state;
+    if (batch.statesFirst >= batch.statesLast) {
+        batch.statesFirst = slot;
+        batch.statesLast = slot + 1;
+    } else {
+        batch.statesFirst = qMin(batch.statesFirst, slot);
+        batch.statesLast = qMax(batch.statesLast, slot + 1);
+    }
+}
+
+const QVector<ArcVertexData> &ArcBatches::arcs(int batch) const
+{
+    return m_batches[batch].arcs;
+}
+
+const QVector<ArcStateData> &ArcBatches::states(int batch) const
+{
+    return m_batches[batch].states;
+}
+
+void ArcBatches::takeChanges(int batch, int *arcsFirst, int *statesFirst, int *statesLast)
+{
+    Batch &b = m_batches[batch];
+
+    *arcsFirst = b.arcsFirst;
+    *statesFirst = b.statesFirst;
+    *statesLast = b.statesLast;
+
+    b.arcsFirst = b.arcs.count();
+    b.statesFirst = b.statesLast = 0;
+}
+
+// Segments count for chordal error e at pixel scale s is about key * sqrt(s / 8e)
+int ArcBatches::level(int batch, const QMatrix4x4 &matrix, const QSize &viewport) const
+{
+    const Batch &b = m_batches[batch];
+    if (viewport.isEmpty()) return ARCMAXLEVEL;
+
+    double scale = LineTiles::pixelScale(matrix, viewport, b.min, b.max);
+    if (scale < 0) return ARCMAXLEVEL;
+
+    double segments = b.maxKey * sqrt(scale / (8 * ARCPIXELERROR));
+
+    return qBound(1, (int)ceil(log2(qMax(segments, 1.0))), ARCMAXLEVEL);
+}
+
+QVector<float> ArcBatches::strips()
+{
+    QVector<float> strips;
+    strips.reserve(stripFirst(ARCMAXLEVEL + 1));
+
+    for (int level = 0; level <= ARCMAXLEVEL; level++) {
+        int segments = 1 << level;
+        for (int i = 0; i <= segments; i++) strips.append((float)i / segments);
+    }
+
+    return strips;
+}
+
+int ArcBatches::stripFirst(int level)
+{
+    return (1 << level) - 1 + level;
+}
+
+int ArcBatches::stripCount(int level)
+{
+    return (1 << level) + 1;
+}
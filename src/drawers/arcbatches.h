@@ -0,0 +1,67 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef ARCBATCHES_H
+#define ARCBATCHES_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QSize>
+#include "shaderdrawable.h"
+
+// Batch of arc with key |sweep| * sqrt(radius) up to ARCBATCHKEY * 2 ^ batch, last batch is unbounded
+#define ARCBATCHKEY 0.125
+// Strips of 2 ^ level segments, level is selected per batch by chordal error on screen, pixels
+#define ARCMAXLEVEL 10
+#define ARCPIXELERROR 0.5
+
+// Arc primitives grouped to batches of similar tessellation needs.
+// Batches are drawn as instanced line strips, arcs of batch are ordered by source.
+// Arc handle is batch index in high byte & arc index in batch.
+class ArcBatches
+{
+public:
+    ArcBatches();
+
+    int append(const ArcVertexData &arc, const ArcStateData &state, int source);
+    // Removes arcs of sources starting from source
+    void truncate(int source);
+    void clear();
+    bool isEmpty() const;
+    int count() const;
+
+    void setState(int handle, const ArcStateData &state);
+
+    const QVector<ArcVertexData> &arcs(int batch) const;
+    const QVector<ArcStateData> &states(int batch) const;
+
+    // Arcs [arcsFirst, count) & states [statesFirst, statesLast) of batch changed since last call
+    void takeChanges(int batch, int *arcsFirst, int *statesFirst, int *statesLast);
+
+    // Strip level drawing arcs of batch within allowed error in view
+    int level(int batch, const QMatrix4x4 &matrix, const QSize &viewport) const;
+
+    // Strips parameters of all levels, level by level
+    static QVector<float> strips();
+    static int stripFirst(int level);
+    static int stripCount(int level);
+
+private:
+    struct Batch
+    {
+        QVector<ArcVertexData> arcs;
+        QVector<ArcStateData> states;
+        QVector<int> sources;
+        QVector3D min;
+        QVector3D max;
+        double maxKey;
+        int arcsFirst;
+        int statesFirst;
+        int statesLast;
+    };
+
+    Batch m_batches[ARCBATCHES];
+};
+
+#endif // ARCBATCHES_H
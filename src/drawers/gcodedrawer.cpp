@@ -1,11 +1,59 @@
 // This file is a part of "Candle" application.
 // Copyright 2015-2016 Hayrullin Denis Ravilevich
 
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSet>
+#include <algorithm>
+#include <cmath>
 #include "gcodedrawer.h"
+#include "polylinesimplifier.h"
+
+// Vertex index flag of rapid segments, drawn dashed from separate vertex array
+#define DASHEDVERTEX 0x40000000
+// Vertex index flag of segments drawn as arc primitive, index is arc handle
+#define ARCVERTEX 0x20000000
+// Tessellated arcs shorter than this are kept as lines
+#define ARCMINSEGMENTS 3
+// Allowed deviation of tessellation points from fitted arc
+#define ARCFITTOLERANCE 0.001
+// Segments per simplification task
+#define SIMPLIFYSEGMENTS 16384
+
+// Finds simplification breaks of segments range
+class SegmentSimplifyTask : public QRunnable
+{
+public:
+    SegmentSimplifyTask(const GcodeDrawer *drawer, const LineSegmentStore *list, int first, int last, char *breaks,
+                        QSemaphore *done) :
+        m_drawer(drawer), m_list(list), m_first(first), m_last(last), m_breaks(breaks), m_done(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        m_drawer->simplifyChunk(m_list, m_first, m_last, m_breaks);
+        if (m_done) m_done->release();
+    }
+
+private:
+    const GcodeDrawer *m_drawer;
+    const LineSegmentStore *m_list;
+    int m_first;
+    int m_last;
+    char *m_breaks;
+    QSemaphore *m_done;
+};
 
 GcodeDrawer::GcodeDrawer() : QObject()
 {   
     m_geometryUpdated = false;
+    m_simplify = false;
+    m_simplifyPrecision = 0;
+    m_spliceFirst = -1;
+    m_spliceInserted = 0;
     m_pointSize = 6;
     m_ignoreZ = false;
     m_grayscaleSegments = false;
@@ -13,15 +61,29 @@ GcodeDrawer::GcodeDrawer() : QObject()
     m_grayscaleMin = 0;
     m_grayscaleMax = 255;
     m_drawMode = GcodeDrawer::Vectors;
+    m_rasterMemoryLimit = RASTERMEMORYLIMIT;
+    m_segmentIndexPending = false;
+
+    updatePalette();
+    setLineTiles(true);
 
+    // Started by segments update, stays idle otherwise
+    m_timerVertexUpdate.setSingleShot(true);
+    m_timerVertexUpdate.setInterval(100);
     connect(&m_timerVertexUpdate, SIGNAL(timeout()), SLOT(onTimerVertexUpdate()));
-    m_timerVertexUpdate.start(100);
+    connect(&m_segmentIndexThread, SIGNAL(finished()), SLOT(onSegmentIndexFinished()));
+}
+
+GcodeDrawer::~GcodeDrawer()
+{
+    m_segmentIndexThread.wait();
 }
 
 void GcodeDrawer::update()
 {
     m_indexes.clear();
     m_geometryUpdated = false;
+    m_spliceFirst = -1;
     ShaderDrawable::update();
 }
 
@@ -29,12 +91,34 @@ void GcodeDrawer::update(QList<int> indexes)
 {
     // Store segments to update
     m_indexes += indexes;
+    if (!m_timerVertexUpdate.isActive()) m_timerVertexUpdate.start();
+}
+
+// Segments [first, first + removed) of view parser were replaced by 'inserted' segments,
+// vertices of the range are rebuilt on next geometry update
+void GcodeDrawer::update(int first, int removed, int inserted)
+{
+    // Pending splice is extended by segments appended after it
+    if (m_spliceFirst >= 0 && removed == 0 && first == m_spliceFirst + m_spliceInserted && m_indexes.isEmpty()) {
+        m_spliceInserted += inserted;
+        return;
+    }
+
+    if (!m_geometryUpdated || m_drawMode != GcodeDrawer::Vectors || m_spliceFirst >= 0 || !m_indexes.isEmpty()) {
+        update();
+        return;
+    }
+
+    m_spliceFirst = first;
+    m_spliceInserted = inserted;
+    ShaderDrawable::update();
 }
 
 bool GcodeDrawer::updateData()
 {
     switch (m_drawMode) {
     case GcodeDrawer::Vectors:
+        if (m_spliceFirst >= 0) return spliceVectors();
         if (m_indexes.isEmpty()) return prepareVectors(); else return updateVectors();
     case GcodeDrawer::Raster:
         if (m_indexes.isEmpty()) return prepareRaster(); else return updateRaster();
@@ -45,8 +129,10 @@ bool GcodeDrawer::prepareVectors()
 {
     qDebug() << "preparing vectors" << this;
 
-    QList<LineSegment*> *list = m_viewParser->getLines();
-    VertexData vertex;
+    LineSegmentStore *list = m_viewParser->getLines();
+    PaletteVertexData vertex;
+    vertex.brightness = 255;
+    vertex.reserved[0] = vertex.reserved[1] = 0;
 
     qDebug() << "lines count" << list->count();
 
@@ -54,6 +140,13 @@ bool GcodeDrawer::prepareVectors()
     m_lines.clear();
     m_points.clear();
     m_triangles.clear();
+    m_paletteLines.clear();
+    m_dashedLines.clear();
+    m_dashedStarts.clear();
+    m_paletteLineStates.clear();
+    m_dashedLineStates.clear();
+    m_palettePoints.clear();
+    clearArcs();
 
     // Delete texture on mode change
     if (m_texture) {
@@ -61,259 +154,699 @@ bool GcodeDrawer::prepareVectors()
         delete m_texture;
         m_texture = NULL;
     }
+    m_textures.clear();
+    m_rasterTiles.clear();
 
-    bool drawFirstPoint = true;
-    for (int i = 0; i < list->count(); i++) {
+    for (int i = 0; i < list->count(); i++) list->setVertexIndex(i, -1);
 
-        if (qIsNaN(list->at(i)->getEnd().z())) {
-            continue;
-        }
+    // Draw first toolpath point
+    int first = firstPointIndex(list);
+    if (first < list->count()) {
+        vertex.color = StartColor;
+        vertex.position = list->getEnd(first);
+        if (m_ignoreZ) vertex.position.setZ(0);
+        m_palettePoints.append(vertex);
+    }
 
-        // Find first point of toolpath
-        if (drawFirstPoint) {
+    appendArcs(list, first + 1, list->count());
 
-            if (qIsNaN(list->at(i)->getEnd().x()) || qIsNaN(list->at(i)->getEnd().y())) continue;
+    QVector<char> breaks = simplifySegments(list, first + 1, list->count());
+    appendVectors(list, first + 1, list->count(), breaks, m_paletteLines, m_paletteLineStates, 0);
+    appendVectors(list, first + 1, list->count(), breaks, m_dashedLines, m_dashedLineStates, 0, &m_dashedStarts);
+    appendEndPoint(list);
 
-            // Draw first toolpath point
-            vertex.color = Util::colorToVector(m_colorStart);
-            vertex.position = list->at(i)->getEnd();
-            if (m_ignoreZ) vertex.position.setZ(0);
-            vertex.start = QVector3D(sNan, sNan, m_pointSize);
-            m_points.append(vertex);
+    qDebug() << "vertices count" << m_paletteLines.count() << m_dashedLines.count();
 
-            drawFirstPoint = false;
+    updateSegmentIndex();
+
+    m_geometryUpdated = true;
+    m_spliceFirst = -1;
+    m_indexes.clear();
+    return true;
+}
+
+// Builds vertices of solid segments [first, last), or of rapid segments if line starts are requested.
+// Segments between simplification breaks share vertex pair. Vertex indexes are stored starting from vertexBase.
+void GcodeDrawer::appendVectors(LineSegmentStore *list, int first, int last, const QVector<char> &breaks,
+                                QVector<PaletteVertexData> &vertices, QVector<quint8> &states, int vertexBase,
+                                QVector<QVector3D> *starts)
+{
+    PaletteVertexData vertex;
+    vertex.reserved[0] = vertex.reserved[1] = 0;
+    int flag = starts ? DASHEDVERTEX : 0;
+
+    for (int i = first; i < last; i++) {
+
+        if (list->isFastTraverse(i) != (starts != NULL) || arcHandle(list, i) >= 0) continue;
+
+        if (qIsNaN(list->getEnd(i).z())) {
+            list->setVertexIndex(i, -1);
             continue;
         }
 
-        // Prepare vertices
-        if (list->at(i)->isFastTraverse()) vertex.start = list->at(i)->getStart();
-        else vertex.start = QVector3D(sNan, sNan, sNan);
-
-        // Simplify geometry
+        // Merge simplified segments, runs never join segments of other kind
         int j = i;
-        if (m_simplify && i < list->count() - 1) {
-            QVector3D start = list->at(i)->getEnd() - list->at(i)->getStart();
-            QVector3D next;
-            double length = start.length();
-            bool straight = false;
-
-            do {
-                list->at(i)->setVertexIndex(m_lines.count()); // Store vertex index
-                i++;
-                if (i < list->count() - 1) {
-                    next = list->at(i)->getEnd() - list->at(i)->getStart();
-                    length += next.length();
-//                    straight = start.crossProduct(start.normalized(), next.normalized()).length() < 0.025;
-                }
-            // Split short & straight lines
-            } while ((length < m_simplifyPrecision || straight) && i < list->count()
-                     && getSegmentType(list->at(i)) == getSegmentType(list->at(j)));
-            i--;
-        } else {
-            list->at(i)->setVertexIndex(m_lines.count()); // Store vertex index
+        list->setVertexIndex(i, (vertexBase + vertices.count()) | flag); // Store vertex index
+        if (!breaks.isEmpty()) {
+            while (i < last - 1 && !breaks.at(i + 1 - first)) list->setVertexIndex(++i, (vertexBase + vertices.count()) | flag);
         }
 
         // Set color
-        vertex.color = getSegmentColorVector(list->at(i));
+        setSegmentPalette(list, i, &vertex);
+        quint8 state = getSegmentState(list, i);
+        states.append(state);
+        states.append(state);
 
         // Line start
-        vertex.position = list->at(j)->getStart();
+        vertex.position = list->getStart(j);
         if (m_ignoreZ) vertex.position.setZ(0);
-        m_lines.append(vertex);
+        vertices.append(vertex);
 
         // Line end
-        vertex.position = list->at(i)->getEnd();
+        vertex.position = list->getEnd(i);
         if (m_ignoreZ) vertex.position.setZ(0);
-        m_lines.append(vertex);
-
-        // Draw last toolpath point
-        if (i == list->count() - 1) {
-            vertex.color = Util::colorToVector(m_colorEnd);
-            vertex.position = list->at(i)->getEnd();
-            if (m_ignoreZ) vertex.position.setZ(0);
-            vertex.start = QVector3D(sNan, sNan, m_pointSize);
-            m_points.append(vertex);
+        vertices.append(vertex);
+
+        // Dashes are drawn from line start
+        if (starts) {
+            starts->append(list->getStart(j));
+            starts->append(list->getStart(j));
         }
     }
-    m_geometryUpdated = true;
-    m_indexes.clear();
+}
+
+// Replaces tessellated arcs of segments [first, last) by arc primitives if supported,
+// segments of arc store its handle. Arcs must be appended in segments order.
+void GcodeDrawer::appendArcs(LineSegmentStore *list, int first, int last)
+{
+    if (!arcsSupported()) return;
+
+    ArcVertexData arc;
+    ArcStateData state;
+
+    int i = first;
+    while (i < last) {
+        if (!list->isArc(i) || list->isFastTraverse(i)) {
+            i++;
+            continue;
+        }
+
+        // Segments of same program line
+        int e = i + 1;
+        while (e < last && list->isArc(e) && list->getLineNumber(e) == list->getLineNumber(i)) e++;
+
+        if (e - i >= ARCMINSEGMENTS && fitArc(list, i, e, &arc)) {
+            getArcState(list, i, e, &state);
+            int handle = appendArc(arc, state, i) | ARCVERTEX;
+            for (int j = i; j < e; j++) list->setVertexIndex(j, handle);
+        }
+
+        i = e;
+    }
+}
+
+static inline const QVector3D &arcPoint(const LineSegmentStore *list, int first, int index)
+{
+    return index == 0 ? list->getStart(first) : list->getEnd(first + index - 1);
+}
+
+// Angle step from angle to next one, shorter than half turn
+static inline double arcAngleStep(double angle, double next)
+{
+    double step = next - angle;
+    if (step > M_PI) step -= 2 * M_PI;
+    if (step <= -M_PI) step += 2 * M_PI;
+
+    return step;
+}
+
+// Fits circular helix to points of segments [first, last), center is found by three points.
+// Fails if points deviate from it, e.g. after height map is applied.
+bool GcodeDrawer::fitArc(const LineSegmentStore *list, int first, int last, ArcVertexData *arc) const
+{
+    // Plane axes u, v & normal
+    static const int axes[3][3] = { { 0, 1, 2 }, { 2, 0, 1 }, { 1, 2, 0 } };
+
+    int plane = list->plane(first);
+    if (plane < PointSegment::XY || plane > PointSegment::YZ || (m_ignoreZ && plane != PointSegment::XY)) return false;
+
+    const int *axis = axes[plane];
+    int count = last - first;
+
+    PaletteVertexData palette;
+    PaletteVertexData next;
+    setSegmentPalette(list, first, &palette);
+
+    for (int i = 0; i <= count; i++) {
+        const QVector3D &p = arcPoint(list, first, i);
+        if (qIsNaN(p.x()) || qIsNaN(p.y()) || qIsNaN(p.z())) return false;
+
+        if (i > 0) {
+            setSegmentPalette(list, first + i - 1, &next);
+            if (next.color != palette.color || next.brightness != palette.brightness) return false;
+        }
+    }
+
+    const QVector3D &p0 = arcPoint(list, first, 0);
+    const QVector3D &p1 = arcPoint(list, first, count / 3);
+    const QVector3D &p2 = arcPoint(list, first, count * 2 / 3);
+
+    double bu = p1[axis[0]] - p0[axis[0]];
+    double bv = p1[axis[1]] - p0[axis[1]];
+    double cu = p2[axis[0]] - p0[axis[0]];
+    double cv = p2[axis[1]] - p0[axis[1]];
+    double d = 2 * (bu * cv - bv * cu);
+    if (fabs(d) < 1e-12) return false;
+
+    double centerU = p0[axis[0]] + (cv * (bu * bu + bv * bv) - bv * (cu * cu + cv * cv)) / d;
+    double centerV = p0[axis[1]] + (bu * (cu * cu + cv * cv) - cu * (bu * bu + bv * bv)) / d;
+    double radius = hypot(p0[axis[0]] - centerU, p0[axis[1]] - centerV);
+
+    // Sweep is sum of point angle steps, all of the same direction
+    double start = atan2(p0[axis[1]] - centerV, p0[axis[0]] - centerU);
+    double angle = start;
+    double sweep = 0;
+
+    for (int i = 1; i <= count; i++) {
+        const QVector3D &p = arcPoint(list, first, i);
+        double u = p[axis[0]] - centerU;
+        double v = p[axis[1]] - centerV;
+        if (fabs(hypot(u, v) - radius) > ARCFITTOLERANCE) return false;
+
+        double next = atan2(v, u);
+        double step = arcAngleStep(angle, next);
+        if (step == 0 || (sweep != 0 && (step > 0) != (sweep > 0))) return false;
+
+        sweep += step;
+        angle = next;
+    }
+
+    // Helix travel is linear by angle
+    double n0 = m_ignoreZ ? 0 : p0[axis[2]];
+    double dz = m_ignoreZ ? 0 : arcPoint(list, first, count)[axis[2]] - n0;
+
+    if (dz != 0) {
+        angle = start;
+        double swept = 0;
+
+        for (int i = 1; i < count; i++) {
+            const QVector3D &p = arcPoint(list, first, i);
+            double next = atan2(p[axis[1]] - centerV, p[axis[0]] - centerU);
+
+            swept += arcAngleStep(angle, next);
+            angle = next;
+            if (fabs(p[axis[2]] - n0 - dz * swept / sweep) > ARCFITTOLERANCE) return false;
+        }
+    }
+
+    arc->center[axis[0]] = centerU;
+    arc->center[axis[1]] = centerV;
+    arc->center[axis[2]] = n0;
+    arc->radius = radius;
+    arc->start = start;
+    arc->sweep = sweep;
+    arc->dz = dz;
+    arc->color = palette.color;
+    arc->brightness = palette.brightness;
+    arc->plane = plane;
+    arc->reserved = 0;
+
     return true;
 }
 
-bool GcodeDrawer::updateVectors()
+// Arc is drawn by state of first segment up to first segment of other state, by state of last one after it
+void GcodeDrawer::getArcState(const LineSegmentStore *list, int first, int last, ArcStateData *state)
 {
-    // Update vertices
-    QList<LineSegment*> *list = m_viewParser->getLines();
+    state->head = getSegmentState(list, first);
+    state->tail = getSegmentState(list, last - 1);
+    state->reserved = 0;
 
-    // Map buffer
-    VertexData *data = (VertexData*)m_vbo.map(QOpenGLBuffer::WriteOnly);
+    int split = first + 1;
+    while (split < last && getSegmentState(list, split) == state->head) split++;
+    state->split = qRound(255.0 * (split - first) / (last - first));
+}
 
-    // Update vertices for each line segment
-    int vertexIndex;
-    foreach (int i, m_indexes) {
-        // Update vertex pair
-        if (i < 0 || i > list->count() - 1) continue;
-        vertexIndex = list->at(i)->vertexIndex();
-        if (vertexIndex >= 0) {
-            // Update vertex array            
-            if (data) {
-                data[vertexIndex].color = getSegmentColorVector(list->at(i));
-                data[vertexIndex + 1].color = data[vertexIndex].color;
-            } else {
-                m_lines[vertexIndex].color = getSegmentColorVector(list->at(i));
-                m_lines[vertexIndex + 1].color = m_lines.at(vertexIndex).color;
+void GcodeDrawer::updateArcState(const LineSegmentStore *list, int index)
+{
+    int handle = list->vertexIndex(index);
+    int first = index;
+    int last = index + 1;
+
+    while (first > 0 && list->vertexIndex(first - 1) == handle) first--;
+    while (last < list->count() && list->vertexIndex(last) == handle) last++;
+
+    ArcStateData state;
+    getArcState(list, first, last, &state);
+    setArcState(handle & ~ARCVERTEX, state);
+}
+
+// Arc handle of segment drawn as arc primitive, -1 for others
+int GcodeDrawer::arcHandle(const LineSegmentStore *list, int index) const
+{
+    int vertexIndex = list->vertexIndex(index);
+
+    return vertexIndex >= 0 && (vertexIndex & ARCVERTEX) ? vertexIndex & ~ARCVERTEX : -1;
+}
+
+// Simplification breaks of segments [first, last), segment with break starts new vertex pair.
+// Empty if simplification is off. Chunks are processed in parallel, last one by calling thread.
+QVector<char> GcodeDrawer::simplifySegments(const LineSegmentStore *list, int first, int last) const
+{
+    QVector<char> breaks;
+    if (!m_simplify || first >= last) return breaks;
+
+    breaks.fill(0, last - first);
+    char *data = breaks.data();
+
+    int chunks = (last - first + SIMPLIFYSEGMENTS - 1) / SIMPLIFYSEGMENTS;
+    QSemaphore done;
+    QList<SegmentSimplifyTask*> tasks;
+
+    for (int c = 0; c < chunks; c++) {
+        int chunkFirst = first + c * SIMPLIFYSEGMENTS;
+        int chunkLast = qMin(last, chunkFirst + SIMPLIFYSEGMENTS);
+
+        if (c < chunks - 1) {
+            tasks.append(new SegmentSimplifyTask(this, list, chunkFirst, chunkLast, data + chunkFirst - first, &done));
+            QThreadPool::globalInstance()->start(tasks.last());
+        } else {
+            simplifyChunk(list, chunkFirst, chunkLast, data + chunkFirst - first);
+        }
+    }
+
+    done.acquire(tasks.count());
+    qDeleteAll(tasks);
+
+    return breaks;
+}
+
+// Runs of connected segments of same type & color are simplified within chordal tolerance,
+// breaks are set at run starts & kept polyline points. Chunk start is always a break.
+void GcodeDrawer::simplifyChunk(const LineSegmentStore *list, int first, int last, char *breaks) const
+{
+    PolylineSimplifier simplifier;
+    QVector<QVector3D> points;
+    QVector<int> kept;
+    PaletteVertexData palette;
+    PaletteVertexData next;
+
+    int s = first;
+    while (s < last) {
+        breaks[s - first] = 1;
+
+        // Arc primitives & undefined segments are never merged
+        const QVector3D &start = list->getStart(s);
+        if (qIsNaN(list->getEnd(s).z()) || qIsNaN(start.x()) || qIsNaN(start.y()) || qIsNaN(start.z())
+                || arcHandle(list, s) >= 0) {
+            s++;
+            continue;
+        }
+
+        // Find run end
+        int type = getSegmentType(list, s);
+        setSegmentPalette(list, s, &palette);
+
+        int e = s + 1;
+        while (e < last) {
+            if (qIsNaN(list->getEnd(e).z()) || list->getStart(e) != list->getEnd(e - 1)
+                    || getSegmentType(list, e) != type || arcHandle(list, e) >= 0) break;
+            if (m_grayscaleSegments) {
+                setSegmentPalette(list, e, &next);
+                if (next.color != palette.color || next.brightness != palette.brightness) break;
             }
+            e++;
+        }
+
+        if (e - s > 1) {
+            points.resize(0);
+            points.append(start);
+            for (int i = s; i < e; i++) points.append(list->getEnd(i));
+
+            kept.resize(points.count());
+            for (int i = 0; i < kept.count(); i++) kept[i] = i;
+
+            simplifier.simplify(points.constData(), kept, m_simplifyPrecision);
+
+            // Inner kept points start new segments
+            for (int i = 1; i < kept.count() - 1; i++) breaks[s + kept.at(i) - first] = 1;
         }
+
+        s = e;
     }
+}
 
-    m_indexes.clear();
-    if (data) m_vbo.unmap();
-    return !data;
+// Draw last toolpath point
+void GcodeDrawer::appendEndPoint(LineSegmentStore *list)
+{
+    int last = list->count() - 1;
+    if (last < 0 || list->vertexIndex(last) < 0) return;
+
+    PaletteVertexData vertex;
+    vertex.color = EndColor;
+    vertex.brightness = 255;
+    vertex.reserved[0] = vertex.reserved[1] = 0;
+    vertex.position = list->getEnd(last);
+    if (m_ignoreZ) vertex.position.setZ(0);
+    m_palettePoints.append(vertex);
 }
 
-bool GcodeDrawer::prepareRaster()
+// First segment with defined end, drawn as toolpath start point
+int GcodeDrawer::firstPointIndex(const LineSegmentStore *list) const
 {
-    const int maxImageSize = 8192;
+    int first = 0;
+    for (; first < list->count(); first++) {
+        const QVector3D &end = list->getEnd(first);
+        if (!qIsNaN(end.x()) && !qIsNaN(end.y()) && !qIsNaN(end.z())) break;
+    }
 
-    qDebug() << "preparing raster" << this;
+    return first;
+}
 
-    // Generate image
-    QImage image;
-    qDebug() << "image info" << m_viewParser->getResolution() << m_viewParser->getMinLength();
+// Vertex index of segment in solid lines, -1 for rapid & not drawn segments
+int GcodeDrawer::solidVertexIndex(const LineSegmentStore *list, int index) const
+{
+    int vertexIndex = list->vertexIndex(index);
 
-    if (m_viewParser->getResolution().width() <= maxImageSize && m_viewParser->getResolution().height() <= maxImageSize)
-    {
-        image = QImage(m_viewParser->getResolution(), QImage::Format_RGB888);
-        image.fill(Qt::white);
+    return vertexIndex >= 0 && !(vertexIndex & (DASHEDVERTEX | ARCVERTEX)) ? vertexIndex : -1;
+}
+
+bool GcodeDrawer::spliceVectors()
+{
+    LineSegmentStore *list = m_viewParser->getLines();
+    int first = qMin(m_spliceFirst, list->count());
+    int last = qMin(m_spliceFirst + m_spliceInserted, list->count());
+
+    m_spliceFirst = -1;
+
+    // Extend range back to the start of previous drawn segments group
+    int vertexFirst = -1;
+    while (first > 0 && vertexFirst < 0) vertexFirst = solidVertexIndex(list, --first);
+    while (first > 0 && solidVertexIndex(list, first - 1) == vertexFirst) first--;
+
+    // Toolpath start changed
+    if (vertexFirst < 0) return prepareVectors();
+
+    // Extend range forward to the end of next drawn segments group
+    int vertexLast = -1;
+    while (last < list->count() && vertexLast < 0) vertexLast = solidVertexIndex(list, last++);
+    while (last < list->count() && solidVertexIndex(list, last) == vertexLast) last++;
+    vertexLast = vertexLast < 0 ? m_paletteLines.count() : vertexLast + 2;
+
+    for (int i = first; i < last; i++) if (!list->isFastTraverse(i)) list->setVertexIndex(i, -1);
+
+    // Arcs of batch are ordered by segments, following arcs are rebuilt too
+    for (int i = last; i < list->count(); i++) if (arcHandle(list, i) >= 0) list->setVertexIndex(i, -1);
+    truncateArcs(first);
+    appendArcs(list, first, list->count());
+
+    QVector<PaletteVertexData> vertices;
+    QVector<quint8> states;
+    appendVectors(list, first, last, simplifySegments(list, first, last), vertices, states, vertexFirst);
+
+    // Replace vertices, shift following indexes
+    int delta = vertices.count() - (vertexLast - vertexFirst);
+
+    if (delta == 0) {
+        std::copy(vertices.constBegin(), vertices.constEnd(), m_paletteLines.begin() + vertexFirst);
+        std::copy(states.constBegin(), states.constEnd(), m_paletteLineStates.begin() + vertexFirst);
+        invalidatePaletteLines(vertexFirst, vertexLast);
+    } else if (vertexLast == m_paletteLines.count()) {
+        // Toolpath tail, appended in place
+        m_paletteLines.resize(vertexFirst);
+        m_paletteLines += vertices;
+        m_paletteLineStates.resize(vertexFirst);
+        m_paletteLineStates += states;
+        invalidatePaletteLines(vertexFirst);
+    } else {
+        QVector<PaletteVertexData> lines = m_paletteLines.mid(0, vertexFirst);
+        lines += vertices;
+        lines += m_paletteLines.mid(vertexLast);
+        m_paletteLines = lines;
+
+        QVector<quint8> lineStates = m_paletteLineStates.mid(0, vertexFirst);
+        lineStates += states;
+        lineStates += m_paletteLineStates.mid(vertexLast);
+        m_paletteLineStates = lineStates;
+
+        for (int i = last; i < list->count(); i++) {
+            int vertexIndex = solidVertexIndex(list, i);
+            if (vertexIndex >= 0) list->setVertexIndex(i, vertexIndex + delta);
+        }
+        invalidatePaletteLines(vertexFirst);
+    }
 
-        QList<LineSegment*> *list = m_viewParser->getLines();
-        qDebug() << "lines count" << list->count();
+    // Rapid segments are few, rebuilt from the last group preceding splice on toolpath tail, entirely otherwise
+    int dashedFirst = firstPointIndex(list) + 1;
+    int dashedVertex = 0;
 
-        double pixelSize = m_viewParser->getMinLength();
-        QVector3D origin = m_viewParser->getMinimumExtremes();
+    if (last == list->count()) {
+        int i = first - 1;
+        while (i >= dashedFirst && (list->vertexIndex(i) < 0 || !(list->vertexIndex(i) & DASHEDVERTEX))) i--;
 
-        for (int i = 0; i < list->count(); i++) {
-            if (!qIsNaN(list->at(i)->getEnd().length())) {
-                setImagePixelColor(image, (list->at(i)->getEnd().x() - origin.x()) / pixelSize,
-                                   (list->at(i)->getEnd().y() - origin.y()) / pixelSize, getSegmentColor(list->at(i)).rgb());
-            }
+        if (i >= dashedFirst) {
+            dashedVertex = list->vertexIndex(i) & ~DASHEDVERTEX;
+            while (i > dashedFirst && list->vertexIndex(i - 1) == list->vertexIndex(i)) i--;
+            dashedFirst = i;
+        } else {
+            dashedFirst = qMax(dashedFirst, first);
         }
     }
 
-    // Create vertices array
-    // Clear all vertex data
-    m_lines.clear();
-    m_points.clear();
-    m_triangles.clear();
+    m_dashedLines.resize(dashedVertex);
+    m_dashedStarts.resize(dashedVertex);
+    m_dashedLineStates.resize(dashedVertex);
+    appendVectors(list, dashedFirst, list->count(), simplifySegments(list, dashedFirst, list->count()), m_dashedLines,
+                  m_dashedLineStates, 0, &m_dashedStarts);
 
-    if (m_texture) {
-        m_texture->destroy();
-        delete m_texture;
-        m_texture = NULL;
+    // Toolpath end changed
+    if (last == list->count()) {
+        if (m_palettePoints.count() > 1) m_palettePoints.removeLast();
+        appendEndPoint(list);
     }
 
-    QVector<VertexData> vertices;
-    VertexData vertex;
+    updateSegmentIndex();
 
-    // Set color
-    vertex.color = Util::colorToVector(Qt::red);
+    m_geometryUpdated = true;
+    m_indexes.clear();
+    return true;
+}
 
-    // Rect
+// Only segment states change, vertex buffer stays untouched
+bool GcodeDrawer::updateVectors()
+{
+    LineSegmentStore *list = m_viewParser->getLines();
+
+    // Update states for each line segment
+    int vertexIndex;
+    int lastArc = -1;
+    foreach (int i, m_indexes) {
+        if (i < 0 || i > list->count() - 1) continue;
+        vertexIndex = list->vertexIndex(i);
+        if (vertexIndex >= 0 && (vertexIndex & ARCVERTEX)) {
+            // Segments of arc usually come together
+            if (vertexIndex != lastArc) updateArcState(list, i);
+            lastArc = vertexIndex;
+        } else if (vertexIndex >= 0) {
+            setLineState(vertexIndex & ~DASHEDVERTEX, vertexIndex & DASHEDVERTEX, getSegmentState(list, i));
+        }
+    }
+
+    m_indexes.clear();
+    return false;
+}
+
+// Quad of two triangles, texture coordinates are stored in line start
+static void appendQuad(QVector<VertexData> &vertices, const QRectF &rect, VertexData vertex)
+{
     vertex.start = QVector3D(sNan, 0, 0);
-    vertex.position = QVector3D(getMinimumExtremes().x(), getMinimumExtremes().y(), 0);
+    vertex.position = QVector3D(rect.left(), rect.top(), 0);
     vertices.append(vertex);
 
     vertex.start = QVector3D(sNan, 1, 1);
-    vertex.position = QVector3D(getMaximumExtremes().x(), getMaximumExtremes().y(), 0);
+    vertex.position = QVector3D(rect.right(), rect.bottom(), 0);
     vertices.append(vertex);
 
     vertex.start = QVector3D(sNan, 0, 1);
-    vertex.position = QVector3D(getMinimumExtremes().x(), getMaximumExtremes().y(), 0);
+    vertex.position = QVector3D(rect.left(), rect.bottom(), 0);
     vertices.append(vertex);
 
     vertex.start = QVector3D(sNan, 0, 0);
-    vertex.position = QVector3D(getMinimumExtremes().x(), getMinimumExtremes().y(), 0);
+    vertex.position = QVector3D(rect.left(), rect.top(), 0);
     vertices.append(vertex);
 
     vertex.start = QVector3D(sNan, 1, 0);
-    vertex.position = QVector3D(getMaximumExtremes().x(), getMinimumExtremes().y(), 0);
+    vertex.position = QVector3D(rect.right(), rect.top(), 0);
     vertices.append(vertex);
 
     vertex.start = QVector3D(sNan, 1, 1);
-    vertex.position = QVector3D(getMaximumExtremes().x(), getMaximumExtremes().y(), 0);
+    vertex.position = QVector3D(rect.right(), rect.bottom(), 0);
     vertices.append(vertex);
+}
+
+// Raster is split to tiles allocated where pixels are, each tile is drawn as textured quad
+bool GcodeDrawer::prepareRaster()
+{
+    qDebug() << "preparing raster" << this;
+
+    LineSegmentStore *list = m_viewParser->getLines();
+    QVector3D origin = m_viewParser->getMinimumExtremes();
+    double pixelSize = m_viewParser->getMinLength();
+
+    qDebug() << "image info" << m_viewParser->getResolution() << pixelSize;
+    qDebug() << "lines count" << list->count();
+
+    // Clear all vertex data
+    m_lines.clear();
+    m_points.clear();
+    m_triangles.clear();
+    m_paletteLines.clear();
+    m_dashedLines.clear();
+    m_dashedStarts.clear();
+    m_paletteLineStates.clear();
+    m_dashedLineStates.clear();
+    m_palettePoints.clear();
+    m_textures.clear();
+    clearArcs();
+
+    if (m_texture) {
+        m_texture->destroy();
+        delete m_texture;
+        m_texture = NULL;
+    }
+
+    m_rasterTiles.clear();
+
+    if (!qIsNaN(pixelSize) && pixelSize > 0) {
+        // Pixel size is grown only if tiles images don't fit memory limit,
+        // tiles of coarser level are found from keys of finer one
+        QSet<qint64> tiles;
+        for (int i = 0; i < list->count(); i++) {
+            if (!qIsNaN(list->getEnd(i).length())) tiles.insert(RasterTiles::tileKey(list->getEnd(i), origin, pixelSize));
+        }
+
+        while ((qint64)tiles.count() * RASTERTILEBYTES > (qint64)m_rasterMemoryLimit * 1024 * 1024 && tiles.count() > 1) {
+            QSet<qint64> parents;
+            foreach (qint64 key, tiles) parents.insert(RasterTiles::parentKey(key));
+            tiles.swap(parents);
+            pixelSize *= 2;
+        }
+
+        // Textures are uploaded on drawing
+        m_rasterTiles.reset(origin, pixelSize);
+        for (int i = 0; i < list->count(); i++) {
+            if (!qIsNaN(list->getEnd(i).length())) m_rasterTiles.setPixel(list->getEnd(i), getSegmentColor(list, i).rgb());
+        }
+
+        qDebug() << "raster tiles" << m_rasterTiles.count() << "pixel size" << pixelSize;
+    }
+
+    VertexData vertex;
+    vertex.color = Util::colorToVector(Qt::red);
 
-    if (!image.isNull()) {
-        m_texture = new QOpenGLTexture(image);
-        m_triangles += vertices;
-        m_image = image;
+    if (!m_rasterTiles.isEmpty()) {
+        for (int i = 0; i < m_rasterTiles.count(); i++) {
+            appendQuad(m_triangles, m_rasterTiles.rect(i), vertex);
+            m_textures.append(m_rasterTiles.texture(i));
+        }
     } else {
-        for (int i = 0; i < vertices.count(); i++) vertices[i].start = QVector3D(sNan, sNan, sNan);
-        m_lines += vertices;
-        m_image = QImage();
+        // Bounds rect
+        appendQuad(m_lines, QRectF(QPointF(getMinimumExtremes().x(), getMinimumExtremes().y()),
+                                   QPointF(getMaximumExtremes().x(), getMaximumExtremes().y())), vertex);
+        for (int i = 0; i < m_lines.count(); i++) m_lines[i].start = QVector3D(sNan, sNan, sNan);
     }
 
+    updateSegmentIndex();
+
     m_geometryUpdated = true;
     m_indexes.clear();
     return true;
 }
 
+// Changed pixels are uploaded by dirty rows of their tiles on drawing
 bool GcodeDrawer::updateRaster()
 {
-    if (!m_image.isNull()) {
-
-        QList<LineSegment*> *list = m_viewParser->getLines();
-
-        double pixelSize = m_viewParser->getMinLength();
-        QVector3D origin = m_viewParser->getMinimumExtremes();
+    if (!m_rasterTiles.isEmpty()) {
+        LineSegmentStore *list = m_viewParser->getLines();
 
-        foreach (int i, m_indexes) setImagePixelColor(m_image, (list->at(i)->getEnd().x() - origin.x()) / pixelSize,
-                                                      (list->at(i)->getEnd().y() - origin.y()) / pixelSize, getSegmentColor(list->at(i)).rgb());
-
-        if (m_texture) m_texture->setData(QOpenGLTexture::RGB, QOpenGLTexture::UInt8, m_image.bits());
+        foreach (int i, m_indexes) {
+            if (i >= 0 && i < list->count()) m_rasterTiles.setPixel(list->getEnd(i), getSegmentColor(list, i).rgb(), false);
+        }
     }
 
     m_indexes.clear();
     return false;
 }
 
-void GcodeDrawer::setImagePixelColor(QImage &image, double x, double y, QRgb color) const
+// Raster tiles textures follow view
+void GcodeDrawer::updateView()
 {
-    if (qIsNaN(x) || qIsNaN(y)) {
-        qDebug() << "Error updating pixel" << x << y;
-        return;
-    };
-
-    uchar* pixel = image.scanLine((int)y);
+    if (m_drawMode != GcodeDrawer::Raster || m_rasterTiles.isEmpty()) return;
 
-    *(pixel + (int)x * 3) = qRed(color);
-    *(pixel + (int)x * 3 + 1) = qGreen(color);
-    *(pixel + (int)x * 3 + 2) = qBlue(color);
+    if (!m_rasterTiles.updateTextures(m_viewProjection, m_viewport)) requestRedraw();
 }
 
-QVector3D GcodeDrawer::getSegmentColorVector(LineSegment *segment)
+QVector3D GcodeDrawer::getSegmentColorVector(const LineSegmentStore *lines, int index)
 {
-    return Util::colorToVector(getSegmentColor(segment));
+    return Util::colorToVector(getSegmentColor(lines, index));
 }
 
-QColor GcodeDrawer::getSegmentColor(LineSegment *segment)
+QColor GcodeDrawer::getSegmentColor(const LineSegmentStore *lines, int index)
 {
-    if (segment->drawn()) return m_colorDrawn;//QVector3D(0.85, 0.85, 0.85);
-    else if (segment->isHightlight()) return m_colorHighlight;//QVector3D(0.57, 0.51, 0.9);
-    else if (segment->isFastTraverse()) return m_colorNormal;// QVector3D(0.0, 0.0, 0.0);
-    else if (segment->isZMovement()) return m_colorZMovement;//QVector3D(1.0, 0.0, 0.0);
+    if (lines->drawn(index)) return m_colorDrawn;//QVector3D(0.85, 0.85, 0.85);
+    else if (lines->isHightlight(index)) return m_colorHighlight;//QVector3D(0.57, 0.51, 0.9);
+    else if (lines->isFastTraverse(index)) return m_colorNormal;// QVector3D(0.0, 0.0, 0.0);
+    else if (lines->isZMovement(index)) return m_colorZMovement;//QVector3D(1.0, 0.0, 0.0);
     else if (m_grayscaleSegments) switch (m_grayscaleCode) {
     case GrayscaleCode::S:
-        return QColor::fromHsl(0, 0, qBound<int>(0, 255 - 255.0 / (m_grayscaleMax - m_grayscaleMin) * segment->getSpindleSpeed(), 255));
+        return QColor::fromHsl(0, 0, qBound<int>(0, 255 - 255.0 / (m_grayscaleMax - m_grayscaleMin) * lines->getSpindleSpeed(index), 255));
     case GrayscaleCode::Z:
-        return QColor::fromHsl(0, 0, qBound<int>(0, 255 - 255.0 / (m_grayscaleMax - m_grayscaleMin) * segment->getStart().z(), 255));
+        return QColor::fromHsl(0, 0, qBound<int>(0, 255 - 255.0 / (m_grayscaleMax - m_grayscaleMin) * lines->getStart(index).z(), 255));
     }
     return m_colorNormal;//QVector3D(0.0, 0.0, 0.0);
 }
 
-int GcodeDrawer::getSegmentType(LineSegment* segment)
+// Palette color index & brightness of segment by its type, same as getSegmentColor
+void GcodeDrawer::setSegmentPalette(const LineSegmentStore *lines, int index, PaletteVertexData *vertex) const
+{
+    vertex->brightness = 255;
+
+    if (lines->isFastTraverse(index)) vertex->color = NormalColor;
+    else if (lines->isZMovement(index)) vertex->color = ZMovementColor;
+    else if (m_grayscaleSegments) {
+        double value = m_grayscaleCode == GrayscaleCode::S ? lines->getSpindleSpeed(index) : lines->getStart(index).z();
+        vertex->color = GrayscaleColor;
+        vertex->brightness = qBound<int>(0, 255 - 255.0 / (m_grayscaleMax - m_grayscaleMin) * value, 255);
+    }
+    else vertex->color = NormalColor;
+}
+
+// Palette color index overriding segment type color, 0 if none
+quint8 GcodeDrawer::getSegmentState(const LineSegmentStore *lines, int index)
 {
-    return segment->isFastTraverse() + segment->isZMovement() * 2;
+    if (lines->drawn(index)) return DrawnColor;
+    else if (lines->isHightlight(index)) return HighlightColor;
+    return 0;
+}
+
+void GcodeDrawer::updatePalette()
+{
+    m_palette.resize(GrayscaleColor + 1);
+
+    m_palette[NormalColor] = Util::colorToVector(m_colorNormal);
+    m_palette[DrawnColor] = Util::colorToVector(m_colorDrawn);
+    m_palette[HighlightColor] = Util::colorToVector(m_colorHighlight);
+    m_palette[ZMovementColor] = Util::colorToVector(m_colorZMovement);
+    m_palette[StartColor] = Util::colorToVector(m_colorStart);
+    m_palette[EndColor] = Util::colorToVector(m_colorEnd);
+    m_palette[GrayscaleColor] = QVector3D(1.0, 1.0, 1.0);
+
+    // Raster image colors are baked
+    if (m_drawMode == GcodeDrawer::Raster) update();
+}
+
+int GcodeDrawer::getSegmentType(const LineSegmentStore *lines, int index) const
+{
+    return lines->isFastTraverse(index) + lines->isZMovement(index) * 2;
 }
 
 QVector3D GcodeDrawer::getSizes()
@@ -356,7 +889,10 @@ bool GcodeDrawer::simplify() const
 
 void GcodeDrawer::setSimplify(bool simplify)
 {
+    if (m_simplify == simplify) return;
+
     m_simplify = simplify;
+    update();
 }
 double GcodeDrawer::simplifyPrecision() const
 {
@@ -365,7 +901,10 @@ double GcodeDrawer::simplifyPrecision() const
 
 void GcodeDrawer::setSimplifyPrecision(double simplifyPrecision)
 {
+    if (m_simplifyPrecision == simplifyPrecision) return;
+
     m_simplifyPrecision = simplifyPrecision;
+    update();
 }
 
 bool GcodeDrawer::geometryUpdated()
@@ -380,6 +919,7 @@ QColor GcodeDrawer::colorNormal() const
 void GcodeDrawer::setColorNormal(const QColor &colorNormal)
 {
     m_colorNormal = colorNormal;
+    updatePalette();
 }
 
 QColor GcodeDrawer::colorHighlight() const
@@ -390,6 +930,7 @@ QColor GcodeDrawer::colorHighlight() const
 void GcodeDrawer::setColorHighlight(const QColor &colorHighlight)
 {
     m_colorHighlight = colorHighlight;
+    updatePalette();
 }
 QColor GcodeDrawer::colorZMovement() const
 {
@@ -399,6 +940,7 @@ QColor GcodeDrawer::colorZMovement() const
 void GcodeDrawer::setColorZMovement(const QColor &colorZMovement)
 {
     m_colorZMovement = colorZMovement;
+    updatePalette();
 }
 
 QColor GcodeDrawer::colorDrawn() const
@@ -409,6 +951,7 @@ QColor GcodeDrawer::colorDrawn() const
 void GcodeDrawer::setColorDrawn(const QColor &colorDrawn)
 {
     m_colorDrawn = colorDrawn;
+    updatePalette();
 }
 QColor GcodeDrawer::colorStart() const
 {
@@ -418,6 +961,7 @@ QColor GcodeDrawer::colorStart() const
 void GcodeDrawer::setColorStart(const QColor &colorStart)
 {
     m_colorStart = colorStart;
+    updatePalette();
 }
 QColor GcodeDrawer::colorEnd() const
 {
@@ -427,6 +971,7 @@ QColor GcodeDrawer::colorEnd() const
 void GcodeDrawer::setColorEnd(const QColor &colorEnd)
 {
     m_colorEnd = colorEnd;
+    updatePalette();
 }
 
 bool GcodeDrawer::getIgnoreZ() const
@@ -436,7 +981,10 @@ bool GcodeDrawer::getIgnoreZ() const
 
 void GcodeDrawer::setIgnoreZ(bool ignoreZ)
 {
+    if (m_ignoreZ == ignoreZ) return;
+
     m_ignoreZ = ignoreZ;
+    update();
 }
 
 void GcodeDrawer::onTimerVertexUpdate()
@@ -444,6 +992,39 @@ void GcodeDrawer::onTimerVertexUpdate()
     if (!m_indexes.isEmpty()) ShaderDrawable::update();
 }
 
+// Segments are snapshot, changes made while building are picked up by next build
+void GcodeDrawer::updateSegmentIndex()
+{
+    if (m_segmentIndexThread.isRunning()) {
+        m_segmentIndexPending = true;
+        return;
+    }
+
+    LineSegmentStore *list = m_viewParser->getLines();
+    m_segmentIndexThread.setSegments(list->starts(), list->ends(), m_ignoreZ);
+    m_segmentIndexThread.start(QThread::LowPriority);
+}
+
+void GcodeDrawer::onSegmentIndexFinished()
+{
+    m_segmentIndex = m_segmentIndexThread.index();
+
+    if (m_segmentIndexPending) {
+        m_segmentIndexPending = false;
+        updateSegmentIndex();
+    }
+}
+
+int GcodeDrawer::segmentAt(const QPointF &point, double radius) const
+{
+    if (!m_visible || m_segmentIndex.isEmpty()) return -1;
+
+    int index = m_segmentIndex.nearest(m_viewProjection, m_viewport, point, radius);
+
+    // Index may lag behind segments
+    return index < m_viewParser->getLines()->count() ? index : -1;
+}
+
 GcodeDrawer::DrawMode GcodeDrawer::drawMode() const
 {
     return m_drawMode;
@@ -451,7 +1032,23 @@ GcodeDrawer::DrawMode GcodeDrawer::drawMode() const
 
 void GcodeDrawer::setDrawMode(const DrawMode &drawMode)
 {
+    if (m_drawMode == drawMode) return;
+
     m_drawMode = drawMode;
+    update();
+}
+
+int GcodeDrawer::rasterMemoryLimit() const
+{
+    return m_rasterMemoryLimit;
+}
+
+void GcodeDrawer::setRasterMemoryLimit(int megabytes)
+{
+    if (m_rasterMemoryLimit == megabytes) return;
+
+    m_rasterMemoryLimit = megabytes;
+    if (m_drawMode == GcodeDrawer::Raster) update();
 }
 
 int GcodeDrawer::grayscaleMax() const
@@ -461,7 +1058,10 @@ int GcodeDrawer::grayscaleMax() const
 
 void GcodeDrawer::setGrayscaleMax(int grayscaleMax)
 {
+    if (m_grayscaleMax == grayscaleMax) return;
+
     m_grayscaleMax = grayscaleMax;
+    update();
 }
 
 int GcodeDrawer::grayscaleMin() const
@@ -471,7 +1071,10 @@ int GcodeDrawer::grayscaleMin() const
 
 void GcodeDrawer::setGrayscaleMin(int grayscaleMin)
 {
+    if (m_grayscaleMin == grayscaleMin) return;
+
     m_grayscaleMin = grayscaleMin;
+    update();
 }
 
 GcodeDrawer::GrayscaleCode GcodeDrawer::grayscaleCode() const
@@ -481,7 +1084,10 @@ GcodeDrawer::GrayscaleCode GcodeDrawer::grayscaleCode() const
 
 void GcodeDrawer::setGrayscaleCode(const GrayscaleCode &grayscaleCode)
 {
+    if (m_grayscaleCode == grayscaleCode) return;
+
     m_grayscaleCode = grayscaleCode;
+    update();
 }
 
 bool GcodeDrawer::getGrayscaleSegments() const
@@ -491,7 +1097,10 @@ bool GcodeDrawer::getGrayscaleSegments() const
 
 void GcodeDrawer::setGrayscaleSegments(bool grayscaleSegments)
 {
+    if (m_grayscaleSegments == grayscaleSegments) return;
+
     m_grayscaleSegments = grayscaleSegments;
+    update();
 }
 
 
@@ -6,22 +6,29 @@
 
 #include <QObject>
 #include <QVector3D>
-#include "parser/linesegment.h"
+#include "parser/linesegmentstore.h"
 #include "parser/gcodeviewparse.h"
 #include "shaderdrawable.h"
+#include "rastertiles.h"
+#include "segmentindex.h"
 
 class GcodeDrawer : public QObject, public ShaderDrawable
 {
     Q_OBJECT
+    friend class SegmentSimplifyTask;
 public:
     enum GrayscaleCode { S, Z };
     enum DrawMode { Vectors, Raster };
+    enum PaletteColor { NormalColor, DrawnColor, HighlightColor, ZMovementColor, StartColor, EndColor, GrayscaleColor };
 
     explicit GcodeDrawer();
+    ~GcodeDrawer();
 
     void update();
     void update(QList<int> indexes);
+    void update(int first, int removed, int inserted);
     bool updateData();
+    void updateView();
 
     QVector3D getSizes();
     QVector3D getMinimumExtremes();
@@ -30,6 +37,9 @@ public:
     void setViewParser(GcodeViewParse* viewParser);
     GcodeViewParse* viewParser();        
 
+    // View parser segment nearest to viewport point within radius, pixels, -1 if none
+    int segmentAt(const QPointF &point, double radius) const;
+
     bool simplify() const;
     void setSimplify(bool simplify);
 
@@ -74,12 +84,17 @@ public:
     DrawMode drawMode() const;
     void setDrawMode(const DrawMode &drawMode);
 
+    // Memory of raster tiles images, MB
+    int rasterMemoryLimit() const;
+    void setRasterMemoryLimit(int megabytes);
+
 signals:
 
 public slots:
 
 private slots:
     void onTimerVertexUpdate();
+    void onSegmentIndexFinished();
 
 private:
     GcodeViewParse *m_viewParser;
@@ -103,19 +118,46 @@ private:
 
     QTimer m_timerVertexUpdate;
 
-    QImage m_image;
+    RasterTiles m_rasterTiles;
+    int m_rasterMemoryLimit;
+
+    // Index of segments for picking, rebuilt in background after geometry changes
+    SegmentIndex m_segmentIndex;
+    SegmentIndexThread m_segmentIndexThread;
+    bool m_segmentIndexPending;
     QList<int> m_indexes;
     bool m_geometryUpdated;
 
+    // Pending segments splice
+    int m_spliceFirst;
+    int m_spliceInserted;
+
     bool prepareVectors();
     bool updateVectors();
+    bool spliceVectors();
+    void appendVectors(LineSegmentStore *list, int first, int last, const QVector<char> &breaks,
+                       QVector<PaletteVertexData> &vertices, QVector<quint8> &states, int vertexBase,
+                       QVector<QVector3D> *starts = NULL);
+    void appendArcs(LineSegmentStore *list, int first, int last);
+    bool fitArc(const LineSegmentStore *list, int first, int last, ArcVertexData *arc) const;
+    void getArcState(const LineSegmentStore *list, int first, int last, ArcStateData *state);
+    void updateArcState(const LineSegmentStore *list, int index);
+    int arcHandle(const LineSegmentStore *list, int index) const;
+    QVector<char> simplifySegments(const LineSegmentStore *list, int first, int last) const;
+    void simplifyChunk(const LineSegmentStore *list, int first, int last, char *breaks) const;
+    void appendEndPoint(LineSegmentStore *list);
+    int firstPointIndex(const LineSegmentStore *list) const;
+    int solidVertexIndex(const LineSegmentStore *list, int index) const;
     bool prepareRaster();
     bool updateRaster();
-
-    int getSegmentType(LineSegment *segment);
-    QVector3D getSegmentColorVector(LineSegment *segment);
-    QColor getSegmentColor(LineSegment *segment);
-    void setImagePixelColor(QImage &image, double x, double y, QRgb color) const;
+    void updateSegmentIndex();
+
+    int getSegmentType(const LineSegmentStore *lines, int index) const;
+    QVector3D getSegmentColorVector(const LineSegmentStore *lines, int index);
+    QColor getSegmentColor(const LineSegmentStore *lines, int index);
+    void setSegmentPalette(const LineSegmentStore *lines, int index, PaletteVertexData *vertex) const;
+    quint8 getSegmentState(const LineSegmentStore *lines, int index);
+    void updatePalette();
 };
 
 #endif // GCODEDRAWER_H
@@ -0,0 +1,78 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <climits>
+#include "geometrybuffer.h"
+
+// Minimal storage size, bytes
+#define GEOMETRYBUFFERMINSIZE 4096
+
+// Buffers are written in GL context thread only
+static qint64 uploaded = 0;
+
+GeometryBuffer::GeometryBuffer()
+{
+    m_capacity = 0;
+    m_buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+}
+
+bool GeometryBuffer::create()
+{
+    m_capacity = 0;
+    return m_buffer.create();
+}
+
+void GeometryBuffer::destroy()
+{
+    m_buffer.destroy();
+    m_capacity = 0;
+}
+
+bool GeometryBuffer::isCreated() const
+{
+    return m_buffer.isCreated();
+}
+
+bool GeometryBuffer::bind()
+{
+    return m_buffer.bind();
+}
+
+void GeometryBuffer::release()
+{
+    m_buffer.release();
+}
+
+bool GeometryBuffer::reserve(int size)
+{
+    if (size <= m_capacity && size >= m_capacity / 4) return false;
+
+    // Power of two storage, appended data reallocates it on doubling only
+    int capacity = GEOMETRYBUFFERMINSIZE;
+    while (capacity < size && capacity <= INT_MAX / 2) capacity *= 2;
+    capacity = qMax(capacity, size);
+    if (capacity == m_capacity) return false;
+
+    m_buffer.allocate(capacity);
+    m_capacity = capacity;
+
+    return true;
+}
+
+void GeometryBuffer::write(int offset, const void *data, int count)
+{
+    if (count > 0) {
+        m_buffer.write(offset, data, count);
+        uploaded += count;
+    }
+}
+
+int GeometryBuffer::capacity() const
+{
+    return m_capacity;
+}
+
+qint64 GeometryBuffer::uploadedBytes()
+{
+    return uploaded;
+}
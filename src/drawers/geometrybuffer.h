@@ -0,0 +1,38 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GEOMETRYBUFFER_H
+#define GEOMETRYBUFFER_H
+
+#include <QOpenGLBuffer>
+
+// Vertex buffer storage grows by doubling & shrinks on large size decrease,
+// data changes are written by ranges with glBufferSubData.
+class GeometryBuffer
+{
+public:
+    GeometryBuffer();
+
+    bool create();
+    void destroy();
+    bool isCreated() const;
+
+    bool bind();
+    void release();
+
+    // Ensures storage for size bytes on bound buffer.
+    // Returns true if storage was reallocated, all data must be written again then.
+    bool reserve(int size);
+    void write(int offset, const void *data, int count);
+
+    int capacity() const;
+
+    // Bytes written to all buffers, for profiling
+    static qint64 uploadedBytes();
+
+private:
+    QOpenGLBuffer m_buffer;
+    int m_capacity;
+};
+
+#endif // GEOMETRYBUFFER_H
@@ -0,0 +1,310 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include "linetiles.h"
+#include "polylinesimplifier.h"
+
+// Simplified levels of single tile
+struct LineTileLevels
+{
+    QVector3D min;
+    QVector3D max;
+    QVector<PaletteVertexData> vertices[LINETILELEVELS];
+    QVector<quint8> states[LINETILELEVELS];
+    QVector<int> sources[LINETILELEVELS];
+};
+
+// Builds bounds & levels of lines vertices [first, first + count).
+// Polylines are runs of connected segments of same color, each level simplifies previous one.
+static void simplifyTile(const PaletteVertexData *lines, const quint8 *states, int first, int count,
+                         LineTileLevels *levels)
+{
+    QVector<QVector3D> points;
+    QVector<int> kept;
+    PolylineSimplifier simplifier;
+
+    levels->min = levels->max = lines[first].position;
+    for (int i = first + 1; i < first + count; i++) {
+        const QVector3D &p = lines[i].position;
+        levels->min = QVector3D(qMin(levels->min.x(), p.x()), qMin(levels->min.y(), p.y()), qMin(levels->min.z(), p.z()));
+        levels->max = QVector3D(qMax(levels->max.x(), p.x()), qMax(levels->max.y(), p.y()), qMax(levels->max.z(), p.z()));
+    }
+
+    int segments = count / 2;
+    int s = 0;
+
+    while (s < segments) {
+        const PaletteVertexData *runStart = lines + first + s * 2;
+
+        // Find run end
+        int e = s + 1;
+        while (e < segments) {
+            const PaletteVertexData *v = lines + first + e * 2;
+            if (v[0].position != v[-1].position || v[0].color != runStart->color
+                    || v[0].brightness != runStart->brightness) break;
+            e++;
+        }
+
+        points.resize(0);
+        points.append(runStart->position);
+        for (int i = s; i < e; i++) points.append(lines[first + i * 2 + 1].position);
+
+        kept.resize(points.count());
+        for (int i = 0; i < kept.count(); i++) kept[i] = i;
+
+        double tolerance = LINETILETOLERANCE;
+        for (int level = 0; level < LINETILELEVELS; level++) {
+            simplifier.simplify(points.constData(), kept, tolerance);
+
+            // Simplified segment takes palette & state of first covered segment
+            for (int i = 0; i < kept.count() - 1; i++) {
+                int vertex = first + (s + kept.at(i)) * 2;
+                PaletteVertexData data = lines[vertex];
+
+                data.position = points.at(kept.at(i));
+                levels->vertices[level].append(data);
+                data.position = points.at(kept.at(i + 1));
+                levels->vertices[level].append(data);
+
+                levels->states[level].append(states[vertex]);
+                levels->states[level].append(states[vertex]);
+                levels->sources[level].append(vertex);
+            }
+
+            tolerance *= LINETILETOLERANCESTEP;
+        }
+
+        s = e;
+    }
+}
+
+// Simplifies range of tiles
+class LineTileTask : public QRunnable
+{
+public:
+    LineTileTask(const PaletteVertexData *lines, const quint8 *states, int vertices, int first, int last,
+                 int base, LineTileLevels *levels, QSemaphore *done) :
+        m_lines(lines), m_states(states), m_vertices(vertices), m_first(first), m_last(last), m_base(base),
+        m_levels(levels), m_done(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        for (int i = m_first; i < m_last; i++) {
+            int first = i * LINETILEVERTICES;
+            simplifyTile(m_lines, m_states, first, qMin(LINETILEVERTICES, m_vertices - first), m_levels + i - m_base);
+        }
+        if (m_done) m_done->release();
+    }
+
+private:
+    const PaletteVertexData *m_lines;
+    const quint8 *m_states;
+    int m_vertices;
+    int m_first;
+    int m_last;
+    int m_base;
+    LineTileLevels *m_levels;
+    QSemaphore *m_done;
+};
+
+LineTiles::LineTiles()
+{
+    clear();
+}
+
+// Tiles are independent, last part is processed by calling thread
+int LineTiles::build(const QVector<PaletteVertexData> &lines, const QVector<quint8> &states, int first)
+{
+    // Drop changed tiles
+    int tiles = (lines.count() + LINETILEVERTICES - 1) / LINETILEVERTICES;
+    int tileFirst = qBound(0, first / LINETILEVERTICES, qMin(m_tiles.count(), tiles));
+    int lodFirst = tileFirst < m_tiles.count() ? m_tiles.at(tileFirst).levelFirst[0] : m_lodLines.count();
+
+    m_tiles.resize(tileFirst);
+    m_lodLines.resize(lodFirst);
+    m_lodStates.resize(lodFirst);
+    m_lodSources.resize(lodFirst / 2);
+
+    int count = tiles - tileFirst;
+    if (count == 0) return lodFirst;
+
+    QVector<LineTileLevels> levels(count);
+    int threads = qBound(1, count, qMax(QThreadPool::globalInstance()->maxThreadCount(), 1));
+
+    QSemaphore done;
+    QList<LineTileTask*> tasks;
+
+    for (int t = 0; t < threads; t++) {
+        int taskFirst = tileFirst + (qint64)count * t / threads;
+        int taskLast = tileFirst + (qint64)count * (t + 1) / threads;
+
+        if (t < threads - 1) {
+            tasks.append(new LineTileTask(lines.constData(), states.constData(), lines.count(), taskFirst, taskLast,
+                                          tileFirst, levels.data(), &done));
+            QThreadPool::globalInstance()->start(tasks.last());
+        } else {
+            LineTileTask(lines.constData(), states.constData(), lines.count(), taskFirst, taskLast, tileFirst,
+                         levels.data(), NULL).run();
+        }
+    }
+
+    done.acquire(tasks.count());
+    qDeleteAll(tasks);
+
+    // Append tiles levels, tile by tile
+    m_tiles.resize(tileFirst + count);
+    for (int i = 0; i < count; i++) {
+        Tile &tile = m_tiles[tileFirst + i];
+        const LineTileLevels &tileLevels = levels.at(i);
+
+        tile.min = tileLevels.min;
+        tile.max = tileLevels.max;
+        tile.first = (tileFirst + i) * LINETILEVERTICES;
+        tile.count = qMin(LINETILEVERTICES, lines.count() - tile.first);
+
+        for (int level = 0; level < LINETILELEVELS; level++) {
+            tile.levelFirst[level] = m_lodLines.count();
+            tile.levelCount[level] = tileLevels.vertices[level].count();
+            m_lodLines += tileLevels.vertices[level];
+            m_lodStates += tileLevels.states[level];
+            m_lodSources += tileLevels.sources[level];
+        }
+    }
+
+    qDebug() << "line tiles" << count << "of" << m_tiles.count() << "simplified vertices" << m_lodLines.count();
+
+    return lodFirst;
+}
+
+void LineTiles::clear()
+{
+    m_tiles.clear();
+    m_lodLines.clear();
+    m_lodStates.clear();
+    m_lodSources.clear();
+}
+
+bool LineTiles::isEmpty() const
+{
+    return m_tiles.isEmpty();
+}
+
+const QVector<PaletteVertexData> &LineTiles::lodLines() const
+{
+    return m_lodLines;
+}
+
+const QVector<quint8> &LineTiles::lodStates() const
+{
+    return m_lodStates;
+}
+
+void LineTiles::setState(int vertex, quint8 state, int *changed)
+{
+    for (int level = 0; level < LINETILELEVELS; level++) changed[level] = -1;
+
+    int index = vertex / LINETILEVERTICES;
+    if (index < 0 || index >= m_tiles.count()) return;
+
+    const Tile &tile = m_tiles.at(index);
+
+    // Simplified segments of tile level are ordered by first covered segment
+    for (int level = 0; level < LINETILELEVELS; level++) {
+        const int *begin = m_lodSources.constData() + tile.levelFirst[level] / 2;
+        const int *end = begin + tile.levelCount[level] / 2;
+        const int *it = std::upper_bound(begin, end, vertex);
+        if (it == begin) continue;
+
+        int lodVertex = (it - m_lodSources.constData() - 1) * 2;
+        if (m_lodStates.at(lodVertex) == state) continue;
+
+        m_lodStates[lodVertex] = m_lodStates[lodVertex + 1] = state;
+        changed[level] = lodVertex;
+    }
+}
+
+// Frustum culls tiles by bounds, adjacent ranges are merged
+void LineTiles::visibleRanges(const QMatrix4x4 &matrix, const QSize &viewport,
+                              QVector<LineTileRange> &lines, QVector<LineTileRange> &lodLines) const
+{
+    lines.clear();
+    lodLines.clear();
+
+    foreach (const Tile &tile, m_tiles) {
+        // Tile is culled if all corners are outside of same clip plane
+        int outside = 0x3f;
+        for (int i = 0; i < 8 && outside; i++) {
+            QVector4D c = matrix * QVector4D(i & 1 ? tile.max.x() : tile.min.x(), i & 2 ? tile.max.y() : tile.min.y(),
+                                             i & 4 ? tile.max.z() : tile.min.z(), 1.0);
+            outside &= (c.x() < -c.w()) | (c.x() > c.w()) << 1 | (c.y() < -c.w()) << 2 | (c.y() > c.w()) << 3
+                    | (c.z() < -c.w()) << 4 | (c.z() > c.w()) << 5;
+        }
+        if (outside) continue;
+
+        int level = selectLevel(tile, matrix, viewport);
+        LineTileRange range;
+        QVector<LineTileRange> &ranges = level < 0 ? lines : lodLines;
+
+        range.first = level < 0 ? tile.first : tile.levelFirst[level];
+        range.count = level < 0 ? tile.count : tile.levelCount[level];
+        if (range.count == 0) continue;
+
+        if (!ranges.isEmpty() && ranges.last().first + ranges.last().count == range.first) {
+            ranges.last().count += range.count;
+        } else {
+            ranges.append(range);
+        }
+    }
+}
+
+// Coarsest level which error projected at nearest tile corner is within allowed pixels, -1 for source lines
+int LineTiles::selectLevel(const Tile &tile, const QMatrix4x4 &matrix, const QSize &viewport) const
+{
+    double scale = pixelScale(matrix, viewport, tile.min, tile.max);
+    if (scale < 0) return -1;
+
+    // Error of cascaded levels is bounded by geometric series of tolerances
+    double tolerance = LINETILETOLERANCE * LINETILETOLERANCESTEP / (LINETILETOLERANCESTEP - 1);
+    int level = -1;
+
+    for (int i = 0; i < LINETILELEVELS; i++) {
+        if (tolerance * scale > LINETILEPIXELERROR) break;
+        level = i;
+        tolerance *= LINETILETOLERANCESTEP;
+    }
+
+    return level;
+}
+
+double LineTiles::pixelScale(const QMatrix4x4 &matrix, const QSize &viewport, const QVector3D &min, const QVector3D &max)
+{
+    QVector4D nearest;
+    for (int i = 0; i < 8; i++) {
+        QVector4D c = matrix * QVector4D(i & 1 ? max.x() : min.x(), i & 2 ? max.y() : min.y(),
+                                         i & 4 ? max.z() : min.z(), 1.0);
+        if (i == 0 || c.w() < nearest.w()) nearest = c;
+    }
+    if (nearest.w() <= 0) return -1;
+
+    // Max of axes
+    double scale = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        QVector4D c = nearest + matrix.column(axis);
+        if (c.w() <= 0) return -1;
+
+        double dx = (c.x() / c.w() - nearest.x() / nearest.w()) * viewport.width() / 2;
+        double dy = (c.y() / c.w() - nearest.y() / nearest.w()) * viewport.height() / 2;
+        scale = qMax(scale, sqrt(dx * dx + dy * dy));
+    }
+
+    return scale;
+}
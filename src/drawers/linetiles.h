@@ -0,0 +1,76 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef LINETILES_H
+#define LINETILES_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QSize>
+#include "shaderdrawable.h"
+
+// Line vertices per tile, even
+#define LINETILEVERTICES 8192
+// Simplified levels per tile, level tolerance grows by LINETILETOLERANCESTEP
+#define LINETILELEVELS 5
+#define LINETILETOLERANCE 0.01
+#define LINETILETOLERANCESTEP 4.0
+// Allowed simplification error on screen, pixels
+#define LINETILEPIXELERROR 1.0
+
+struct LineTileRange
+{
+    int first;
+    int count;
+};
+
+// Multi-resolution representation of palette lines.
+// Tiles are consecutive vertex ranges of lines, so program order and vertex indexes are kept.
+// Each tile has bounds for culling and precomputed Douglas-Peucker simplified levels.
+class LineTiles
+{
+public:
+    LineTiles();
+
+    // Rebuilds tiles starting from one containing first vertex, preceding tiles are kept.
+    // Returns first changed simplified vertex.
+    int build(const QVector<PaletteVertexData> &lines, const QVector<quint8> &states, int first = 0);
+    void clear();
+    bool isEmpty() const;
+
+    // Simplified vertices of all levels, tile by tile
+    const QVector<PaletteVertexData> &lodLines() const;
+    const QVector<quint8> &lodStates() const;
+
+    // Sets state of lines segment at vertex to segments covering it.
+    // Changed vertex of each level is stored to changed, -1 if none.
+    void setState(int vertex, quint8 state, int *changed);
+
+    // Vertex ranges of lines & simplified lines to draw in view
+    void visibleRanges(const QMatrix4x4 &matrix, const QSize &viewport,
+                       QVector<LineTileRange> &lines, QVector<LineTileRange> &lodLines) const;
+
+    // Projected pixels per unit length at nearest corner of bounds, -1 if undefined
+    static double pixelScale(const QMatrix4x4 &matrix, const QSize &viewport, const QVector3D &min, const QVector3D &max);
+
+private:
+    struct Tile
+    {
+        QVector3D min;
+        QVector3D max;
+        int first;
+        int count;
+        int levelFirst[LINETILELEVELS];
+        int levelCount[LINETILELEVELS];
+    };
+
+    QVector<Tile> m_tiles;
+    QVector<PaletteVertexData> m_lodLines;
+    QVector<quint8> m_lodStates;
+    QVector<int> m_lodSources; // Lines vertex of first covered segment, for each simplified segment
+
+    int selectLevel(const Tile &tile, const QMatrix4x4 &matrix, const QSize &viewport) const;
+};
+
+#endif // LINETILES_H
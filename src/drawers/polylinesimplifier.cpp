@@ -0,0 +1,54 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "polylinesimplifier.h"
+
+void PolylineSimplifier::simplify(const QVector3D *points, QVector<int> &kept, double tolerance)
+{
+    int n = kept.count();
+    if (n <= 2) return;
+
+    float toleranceSquared = tolerance * tolerance;
+
+    m_keep.fill(0, n);
+    m_keep[0] = m_keep[n - 1] = 1;
+    m_stack.clear();
+    m_stack.append(qMakePair(0, n - 1));
+
+    // Split spans at farthest point until all points are within tolerance
+    while (!m_stack.isEmpty()) {
+        QPair<int, int> span = m_stack.takeLast();
+        const QVector3D &a = points[kept.at(span.first)];
+        const QVector3D &b = points[kept.at(span.second)];
+
+        float maxDistance = 0;
+        int index = -1;
+        for (int i = span.first + 1; i < span.second; i++) {
+            float distance = segmentDistanceSquared(points[kept.at(i)], a, b);
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                index = i;
+            }
+        }
+
+        if (maxDistance > toleranceSquared) {
+            m_keep[index] = 1;
+            m_stack.append(qMakePair(span.first, index));
+            m_stack.append(qMakePair(index, span.second));
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < n; i++) if (m_keep.at(i)) kept[count++] = kept.at(i);
+    kept.resize(count);
+}
+
+float PolylineSimplifier::segmentDistanceSquared(const QVector3D &p, const QVector3D &a, const QVector3D &b)
+{
+    QVector3D ab = b - a;
+    QVector3D ap = p - a;
+    float length = QVector3D::dotProduct(ab, ab);
+    float t = length > 0 ? qBound(0.0f, QVector3D::dotProduct(ap, ab) / length, 1.0f) : 0.0f;
+
+    return (ap - ab * t).lengthSquared();
+}
@@ -0,0 +1,27 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef POLYLINESIMPLIFIER_H
+#define POLYLINESIMPLIFIER_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QPair>
+
+// Douglas-Peucker polyline simplification.
+// Work buffers are kept between calls, single instance is used by single thread.
+class PolylineSimplifier
+{
+public:
+    // Filters indexes of polyline points in place. Remaining points are polyline ends
+    // and points deviating more than tolerance from chords of dropped points.
+    void simplify(const QVector3D *points, QVector<int> &kept, double tolerance);
+
+    static float segmentDistanceSquared(const QVector3D &p, const QVector3D &a, const QVector3D &b);
+
+private:
+    QVector<char> m_keep;
+    QVector<QPair<int, int> > m_stack;
+};
+
+#endif // POLYLINESIMPLIFIER_H
@@ -0,0 +1,219 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QVector4D>
+#include <cmath>
+#include "rastertiles.h"
+#include "linetiles.h"
+
+RasterTiles::RasterTiles()
+{
+    m_pixelSize = 1.0;
+}
+
+RasterTiles::~RasterTiles()
+{
+    clear();
+}
+
+void RasterTiles::reset(const QVector3D &origin, double pixelSize)
+{
+    clear();
+
+    m_origin = origin;
+    m_pixelSize = pixelSize;
+}
+
+void RasterTiles::clear()
+{
+    for (int i = 0; i < m_tiles.count(); i++) {
+        m_tiles.at(i).texture->destroy();
+        delete m_tiles.at(i).texture;
+    }
+
+    m_tiles.clear();
+    m_indexes.clear();
+}
+
+bool RasterTiles::isEmpty() const
+{
+    return m_tiles.isEmpty();
+}
+
+int RasterTiles::count() const
+{
+    return m_tiles.count();
+}
+
+double RasterTiles::pixelSize() const
+{
+    return m_pixelSize;
+}
+
+void RasterTiles::setPixel(const QVector3D &point, QRgb color, bool allocate)
+{
+    double x = (point.x() - m_origin.x()) / m_pixelSize;
+    double y = (point.y() - m_origin.y()) / m_pixelSize;
+    if (qIsNaN(x) || qIsNaN(y)) return;
+
+    int column = floor(x);
+    int row = floor(y);
+    int tileX = floor(x / RASTERTILESIZE);
+    int tileY = floor(y / RASTERTILESIZE);
+    qint64 key = (qint64)tileY << 32 | (quint32)tileX;
+
+    int index = m_indexes.value(key, -1);
+    if (index < 0) {
+        if (!allocate) return;
+
+        Tile tile;
+        tile.x = tileX;
+        tile.y = tileY;
+        tile.image = QImage(RASTERTILESIZE, RASTERTILESIZE, QImage::Format_RGB888);
+        tile.image.fill(Qt::white);
+        tile.texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        tile.level = -1;
+        tile.dirtyFirst = 0;
+        tile.dirtyLast = RASTERTILESIZE;
+
+        index = m_tiles.count();
+        m_tiles.append(tile);
+        m_indexes.insert(key, index);
+    }
+
+    Tile &tile = m_tiles[index];
+    int tileRow = row - tileY * RASTERTILESIZE;
+    uchar *pixel = tile.image.scanLine(tileRow) + (column - tileX * RASTERTILESIZE) * 3;
+
+    pixel[0] = qRed(color);
+    pixel[1] = qGreen(color);
+    pixel[2] = qBlue(color);
+
+    if (tile.dirtyFirst >= tile.dirtyLast) {
+        tile.dirtyFirst = tileRow;
+        tile.dirtyLast = tileRow + 1;
+    } else {
+        tile.dirtyFirst = qMin(tile.dirtyFirst, tileRow);
+        tile.dirtyLast = qMax(tile.dirtyLast, tileRow + 1);
+    }
+}
+
+// Tiles changing level or having changed pixels are uploaded, visible ones first, limited count per call
+bool RasterTiles::updateTextures(const QMatrix4x4 &matrix, const QSize &viewport)
+{
+    int uploads = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < m_tiles.count(); i++) {
+            Tile &tile = m_tiles[i];
+
+            bool visible;
+            int level = selectLevel(tile, matrix, viewport, &visible);
+            if (visible == (pass == 1)) continue;
+            if (level == tile.level && tile.dirtyFirst >= tile.dirtyLast) continue;
+            if (uploads >= RASTERUPLOADS) return false;
+
+            upload(tile, level);
+            uploads++;
+        }
+    }
+
+    return true;
+}
+
+QOpenGLTexture *RasterTiles::texture(int index) const
+{
+    return m_tiles.at(index).texture;
+}
+
+// Tile area in toolpath coordinates
+QRectF RasterTiles::rect(int index) const
+{
+    const Tile &tile = m_tiles.at(index);
+    double size = RASTERTILESIZE * m_pixelSize;
+
+    return QRectF(m_origin.x() + tile.x * size, m_origin.y() + tile.y * size, size, size);
+}
+
+qint64 RasterTiles::tileKey(const QVector3D &point, const QVector3D &origin, double pixelSize)
+{
+    int tileX = floor((point.x() - origin.x()) / pixelSize / RASTERTILESIZE);
+    int tileY = floor((point.y() - origin.y()) / pixelSize / RASTERTILESIZE);
+
+    return (qint64)tileY << 32 | (quint32)tileX;
+}
+
+// Shifts round down, as tile indexes do
+qint64 RasterTiles::parentKey(qint64 key)
+{
+    qint32 tileX = (qint32)(quint32)(key & 0xffffffff);
+    qint32 tileY = (qint32)(key >> 32);
+
+    return (qint64)(tileY >> 1) << 32 | (quint32)(tileX >> 1);
+}
+
+// Level at which tile pixel takes at least one screen pixel, coarse one if tile is out of view
+int RasterTiles::selectLevel(const Tile &tile, const QMatrix4x4 &matrix, const QSize &viewport, bool *visible) const
+{
+    *visible = false;
+    if (viewport.isEmpty()) return tile.level >= 0 ? tile.level : RASTERHIDDENLEVEL;
+
+    double size = RASTERTILESIZE * m_pixelSize;
+    QVector3D min(m_origin.x() + tile.x * size, m_origin.y() + tile.y * size, 0);
+    QVector3D max(min.x() + size, min.y() + size, 0);
+
+    // Tile is culled if all corners are outside of same clip plane
+    int outside = 0x3f;
+    for (int i = 0; i < 4 && outside; i++) {
+        QVector4D c = matrix * QVector4D(i & 1 ? max.x() : min.x(), i & 2 ? max.y() : min.y(), 0, 1.0);
+        outside &= (c.x() < -c.w()) | (c.x() > c.w()) << 1 | (c.y() < -c.w()) << 2 | (c.y() > c.w()) << 3
+                | (c.z() < -c.w()) << 4 | (c.z() > c.w()) << 5;
+    }
+    if (outside) return qMax(tile.level, RASTERHIDDENLEVEL);
+
+    *visible = true;
+
+    double scale = LineTiles::pixelScale(matrix, viewport, min, max) * m_pixelSize;
+    if (scale < 0 || scale >= 1) return 0;
+
+    return qMin((int)floor(log2(1 / scale)), RASTERTILELEVELS - 1);
+}
+
+// Whole level is uploaded on level change, changed rows band otherwise
+void RasterTiles::upload(Tile &tile, int level)
+{
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    int size = RASTERTILESIZE >> level;
+
+    if (level != tile.level) {
+        tile.texture->destroy();
+        tile.texture->setSize(size, size);
+        tile.texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+        tile.texture->setMipLevels(RASTERTILELEVELS - level);
+        tile.texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+        tile.texture->setMagnificationFilter(QOpenGLTexture::Nearest);
+        tile.texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+        tile.texture->allocateStorage(QOpenGLTexture::RGB, QOpenGLTexture::UInt8);
+
+        tile.level = level;
+        tile.dirtyFirst = 0;
+        tile.dirtyLast = RASTERTILESIZE;
+    }
+
+    // Rows are 4 bytes aligned in both image & default unpack alignment
+    tile.texture->bind();
+    if (level == 0) {
+        f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, tile.dirtyFirst, size, tile.dirtyLast - tile.dirtyFirst,
+                           GL_RGB, GL_UNSIGNED_BYTE, tile.image.constScanLine(tile.dirtyFirst));
+    } else {
+        QImage image = tile.image.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                .convertToFormat(QImage::Format_RGB888);
+        f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGB, GL_UNSIGNED_BYTE, image.constBits());
+    }
+    tile.texture->generateMipMaps();
+    tile.texture->release();
+
+    tile.dirtyFirst = tile.dirtyLast = 0;
+}
@@ -0,0 +1,81 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef RASTERTILES_H
+#define RASTERTILES_H
+
+#include <QVector>
+#include <QHash>
+#include <QImage>
+#include <QVector3D>
+#include <QRectF>
+#include <QMatrix4x4>
+#include <QSize>
+#include <QOpenGLTexture>
+
+// Tile side, pixels, power of two for mip levels
+#define RASTERTILESIZE 512
+// Tile image size, bytes
+#define RASTERTILEBYTES (RASTERTILESIZE * RASTERTILESIZE * 3)
+// Mip levels of tile, last one is 1x1
+#define RASTERTILELEVELS 10
+// Default limit of tile images memory, MB, pixel size is grown to fit
+#define RASTERMEMORYLIMIT 2048
+// Texture level of tiles out of view, 32x32
+#define RASTERHIDDENLEVEL 4
+// Textures uploaded per frame, rest are uploaded on following frames
+#define RASTERUPLOADS 32
+
+// Raster image split to fixed size tiles, allocated only where pixels are set.
+// Images are kept in full resolution, textures are uploaded from the mip level matching tile's
+// size on screen, so only visible zoomed in tiles take full resolution in GPU memory.
+class RasterTiles
+{
+public:
+    RasterTiles();
+    ~RasterTiles();
+
+    void reset(const QVector3D &origin, double pixelSize);
+    void clear();
+    bool isEmpty() const;
+    int count() const;
+
+    double pixelSize() const;
+
+    // Sets pixel at point, tile is allocated if missing and allocate is set
+    void setPixel(const QVector3D &point, QRgb color, bool allocate = true);
+
+    // Textures levels are selected by view & changed pixels uploaded, in GL context.
+    // Returns false if some textures are left for next call.
+    bool updateTextures(const QMatrix4x4 &matrix, const QSize &viewport);
+    // Texture object is kept while tile exists, it's not created until first upload
+    QOpenGLTexture *texture(int index) const;
+    QRectF rect(int index) const;
+
+    static qint64 tileKey(const QVector3D &point, const QVector3D &origin, double pixelSize);
+    // Key of tile containing given one at doubled pixel size
+    static qint64 parentKey(qint64 key);
+
+private:
+    struct Tile
+    {
+        int x;
+        int y;
+        QImage image;
+        QOpenGLTexture *texture;
+        // Uploaded mip level, -1 if none
+        int level;
+        int dirtyFirst;
+        int dirtyLast;
+    };
+
+    QVector3D m_origin;
+    double m_pixelSize;
+    QVector<Tile> m_tiles;
+    QHash<qint64, int> m_indexes;
+
+    int selectLevel(const Tile &tile, const QMatrix4x4 &matrix, const QSize &viewport, bool *visible) const;
+    void upload(Tile &tile, int level);
+};
+
+#endif // RASTERTILES_H
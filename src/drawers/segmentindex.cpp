@@ -0,0 +1,281 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QVector4D>
+#include <qnumeric.h>
+#include <algorithm>
+#include <cmath>
+#include "segmentindex.h"
+
+static void extendBounds(QVector3D &min, QVector3D &max, const QVector3D &p)
+{
+    min = QVector3D(qMin(min.x(), p.x()), qMin(min.y(), p.y()), qMin(min.z(), p.z()));
+    max = QVector3D(qMax(max.x(), p.x()), qMax(max.y(), p.y()), qMax(max.z(), p.z()));
+}
+
+// Clip coordinates to widget coordinates
+static QPointF viewportPoint(const QVector4D &c, const QSize &viewport)
+{
+    return QPointF((c.x() / c.w() + 1) / 2 * viewport.width(), (1 - c.y() / c.w()) / 2 * viewport.height());
+}
+
+SegmentIndex::SegmentIndex()
+{
+    m_ignoreZ = false;
+}
+
+void SegmentIndex::setSegments(const QVector<QVector3D> &starts, const QVector<QVector3D> &ends, bool ignoreZ)
+{
+    clear();
+
+    m_starts = starts;
+    m_ends = ends;
+    m_ignoreZ = ignoreZ;
+}
+
+// Top-down build, nodes are split at median of segment centers along longest axis
+void SegmentIndex::build()
+{
+    m_nodes.clear();
+    m_segments.clear();
+
+    if (m_ignoreZ) {
+        for (int i = 0; i < m_starts.count(); i++) {
+            m_starts[i].setZ(0);
+            m_ends[i].setZ(0);
+        }
+    }
+
+    // Segments with undefined ends are skipped
+    QVector<QVector3D> centers(m_starts.count());
+    m_segments.reserve(m_starts.count());
+
+    for (int i = 0; i < m_starts.count(); i++) {
+        const QVector3D &s = m_starts.at(i);
+        const QVector3D &e = m_ends.at(i);
+        if (!qIsFinite(s.x() + s.y() + s.z() + e.x() + e.y() + e.z())) continue;
+
+        centers[i] = (s + e) / 2;
+        m_segments.append(i);
+    }
+
+    if (m_segments.isEmpty()) return;
+
+    struct Range
+    {
+        int node;
+        int first;
+        int last;
+    };
+
+    QVector<Range> ranges;
+    Range range;
+    range.node = 0;
+    range.first = 0;
+    range.last = m_segments.count();
+    ranges.append(range);
+
+    m_nodes.reserve(m_segments.count() / SEGMENTINDEXLEAF * 2 + 1);
+    m_nodes.append(Node());
+
+    while (!ranges.isEmpty()) {
+        range = ranges.takeLast();
+
+        int segment = m_segments.at(range.first);
+        QVector3D min = m_starts.at(segment);
+        QVector3D max = min;
+        QVector3D centerMin = centers.at(segment);
+        QVector3D centerMax = centerMin;
+
+        for (int i = range.first; i < range.last; i++) {
+            segment = m_segments.at(i);
+            extendBounds(min, max, m_starts.at(segment));
+            extendBounds(min, max, m_ends.at(segment));
+            extendBounds(centerMin, centerMax, centers.at(segment));
+        }
+
+        Node &node = m_nodes[range.node];
+        node.min = min;
+        node.max = max;
+
+        if (range.last - range.first <= SEGMENTINDEXLEAF) {
+            node.first = range.first;
+            node.count = range.last - range.first;
+            continue;
+        }
+
+        QVector3D extent = centerMax - centerMin;
+        int axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : extent.y() >= extent.z() ? 1 : 2;
+        int middle = (range.first + range.last) / 2;
+
+        std::nth_element(m_segments.begin() + range.first, m_segments.begin() + middle, m_segments.begin() + range.last,
+                         [&centers, axis] (int a, int b) { return centers.at(a)[axis] < centers.at(b)[axis]; });
+
+        int children = m_nodes.count();
+        node.first = children;
+        node.count = 0;
+
+        m_nodes.append(Node());
+        m_nodes.append(Node());
+
+        Range left;
+        left.node = children;
+        left.first = range.first;
+        left.last = middle;
+        ranges.append(left);
+
+        Range right;
+        right.node = children + 1;
+        right.first = middle;
+        right.last = range.last;
+        ranges.append(right);
+    }
+}
+
+void SegmentIndex::clear()
+{
+    m_starts.clear();
+    m_ends.clear();
+    m_nodes.clear();
+    m_segments.clear();
+}
+
+bool SegmentIndex::isEmpty() const
+{
+    return m_nodes.isEmpty();
+}
+
+// Nodes are visited nearest bounds first, subtrees farther than best candidate are skipped
+int SegmentIndex::nearest(const QMatrix4x4 &matrix, const QSize &viewport, const QPointF &point, double radius,
+                          double *distance) const
+{
+    if (m_nodes.isEmpty() || viewport.isEmpty()) return -1;
+
+    int result = -1;
+    double best = radius;
+    double bestDepth = 0;
+
+    QVector<int> nodes;
+    nodes.append(0);
+
+    while (!nodes.isEmpty()) {
+        const Node &node = m_nodes.at(nodes.takeLast());
+        if (nodeDistance(node, matrix, viewport, point) > qMin(radius, best + SEGMENTINDEXTIE)) continue;
+
+        if (node.count == 0) {
+            const Node &left = m_nodes.at(node.first);
+            const Node &right = m_nodes.at(node.first + 1);
+            bool leftFirst = nodeDistance(left, matrix, viewport, point) <= nodeDistance(right, matrix, viewport, point);
+
+            nodes.append(leftFirst ? node.first + 1 : node.first);
+            nodes.append(leftFirst ? node.first : node.first + 1);
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; i++) {
+            int segment = m_segments.at(i);
+            double d, depth;
+
+            if (!segmentDistance(segment, matrix, viewport, point, &d, &depth) || d > radius) continue;
+
+            // Overlapping segments are picked nearest to viewer
+            if (result < 0 || d < best - SEGMENTINDEXTIE || (d < best + SEGMENTINDEXTIE && depth < bestDepth)) {
+                result = segment;
+                best = d;
+                bestDepth = depth;
+            }
+        }
+    }
+
+    if (distance && result >= 0) *distance = best;
+
+    return result;
+}
+
+// Distance to node bounds projection, infinite if node is out of view
+double SegmentIndex::nodeDistance(const Node &node, const QMatrix4x4 &matrix, const QSize &viewport,
+                                  const QPointF &point) const
+{
+    int outside = 0x3f;
+    bool behind = false;
+    bool first = true;
+    QPointF min, max;
+
+    for (int i = 0; i < 8; i++) {
+        QVector4D c = matrix * QVector4D(i & 1 ? node.max.x() : node.min.x(), i & 2 ? node.max.y() : node.min.y(),
+                                         i & 4 ? node.max.z() : node.min.z(), 1.0);
+        outside &= (c.x() < -c.w()) | (c.x() > c.w()) << 1 | (c.y() < -c.w()) << 2 | (c.y() > c.w()) << 3
+                | (c.z() < -c.w()) << 4 | (c.z() > c.w()) << 5;
+
+        if (c.w() <= 0) {
+            behind = true;
+            continue;
+        }
+
+        QPointF p = viewportPoint(c, viewport);
+        if (first) {
+            min = max = p;
+            first = false;
+        } else {
+            min = QPointF(qMin(min.x(), p.x()), qMin(min.y(), p.y()));
+            max = QPointF(qMax(max.x(), p.x()), qMax(max.y(), p.y()));
+        }
+    }
+
+    if (outside) return qInf();
+
+    // Bounds crossing eye plane have unbounded projection
+    if (behind) return 0;
+
+    double dx = qMax(qMax(min.x() - point.x(), point.x() - max.x()), 0.0);
+    double dy = qMax(qMax(min.y() - point.y(), point.y() - max.y()), 0.0);
+
+    return sqrt(dx * dx + dy * dy);
+}
+
+// Distance to segment projection & depth of its nearest point, false if segment is behind viewer
+bool SegmentIndex::segmentDistance(int index, const QMatrix4x4 &matrix, const QSize &viewport, const QPointF &point,
+                                   double *distance, double *depth) const
+{
+    const double nearW = 1e-6;
+
+    QVector4D c0 = matrix * QVector4D(m_starts.at(index), 1.0);
+    QVector4D c1 = matrix * QVector4D(m_ends.at(index), 1.0);
+
+    // Part behind eye plane is clipped
+    if (c0.w() < nearW && c1.w() < nearW) return false;
+    if (c0.w() < nearW) c0 += (c1 - c0) * ((nearW - c0.w()) / (c1.w() - c0.w()));
+    else if (c1.w() < nearW) c1 += (c0 - c1) * ((nearW - c1.w()) / (c0.w() - c1.w()));
+
+    QPointF p0 = viewportPoint(c0, viewport);
+    QPointF p1 = viewportPoint(c1, viewport);
+    QPointF d = p1 - p0;
+
+    double length = QPointF::dotProduct(d, d);
+    double t = length > 0 ? qBound(0.0, QPointF::dotProduct(point - p0, d) / length, 1.0) : 0;
+    QPointF p = p0 + d * t - point;
+
+    *distance = sqrt(QPointF::dotProduct(p, p));
+    *depth = c0.z() / c0.w() + (c1.z() / c1.w() - c0.z() / c0.w()) * t;
+
+    return true;
+}
+
+SegmentIndexThread::SegmentIndexThread(QObject *parent) : QThread(parent)
+{
+}
+
+void SegmentIndexThread::setSegments(const QVector<QVector3D> &starts, const QVector<QVector3D> &ends, bool ignoreZ)
+{
+    m_index.setSegments(starts, ends, ignoreZ);
+}
+
+const SegmentIndex &SegmentIndexThread::index() const
+{
+    return m_index;
+}
+
+void SegmentIndexThread::run()
+{
+    m_index.build();
+}
@@ -0,0 +1,74 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef SEGMENTINDEX_H
+#define SEGMENTINDEX_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QSize>
+#include <QPointF>
+#include <QThread>
+
+// Max segments in leaf node
+#define SEGMENTINDEXLEAF 8
+// Segments closer on screen than tie distance are picked by depth, pixels
+#define SEGMENTINDEXTIE 0.5
+
+// Bounding volume hierarchy over toolpath segments for nearest segment lookup in screen space.
+// Segment ends are implicitly shared snapshots of segment store, index is built once & read only then.
+class SegmentIndex
+{
+public:
+    SegmentIndex();
+
+    void setSegments(const QVector<QVector3D> &starts, const QVector<QVector3D> &ends, bool ignoreZ);
+    void build();
+    void clear();
+    bool isEmpty() const;
+
+    // Segment nearest to viewport point within radius, pixels. Returns -1 if none.
+    int nearest(const QMatrix4x4 &matrix, const QSize &viewport, const QPointF &point, double radius,
+                double *distance = NULL) const;
+
+private:
+    struct Node
+    {
+        QVector3D min;
+        QVector3D max;
+        // Children pair for inner node, leaf segments range of m_segments otherwise
+        int first;
+        int count;
+    };
+
+    QVector<QVector3D> m_starts;
+    QVector<QVector3D> m_ends;
+    bool m_ignoreZ;
+
+    QVector<Node> m_nodes;
+    QVector<int> m_segments;
+
+    double nodeDistance(const Node &node, const QMatrix4x4 &matrix, const QSize &viewport, const QPointF &point) const;
+    bool segmentDistance(int index, const QMatrix4x4 &matrix, const QSize &viewport, const QPointF &point,
+                         double *distance, double *depth) const;
+};
+
+// Builds segment index in background, index is taken on finished()
+class SegmentIndexThread : public QThread
+{
+public:
+    explicit SegmentIndexThread(QObject *parent = 0);
+
+    // Only while thread isn't running
+    void setSegments(const QVector<QVector3D> &starts, const QVector<QVector3D> &ends, bool ignoreZ);
+    const SegmentIndex &index() const;
+
+protected:
+    void run();
+
+private:
+    SegmentIndex m_index;
+};
+
+#endif // SEGMENTINDEX_H
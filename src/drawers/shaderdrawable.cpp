@@ -1,6 +1,11 @@
 ﻿//#define sNan qQNaN();
 
+#include <QOpenGLContext>
+#include <QDebug>
 #include "shaderdrawable.h"
+#include "linetiles.h"
+#include "arcbatches.h"
+#include "widgets/glwidget.h"
 
 #ifdef GLES
 #include <GLES/gl.h>
@@ -13,12 +18,31 @@ ShaderDrawable::ShaderDrawable()
     m_lineWidth = 1.0;
     m_pointSize = 1.0;
     m_texture = NULL;
+    m_lineTiles = NULL;
+    m_arcBatches = new ArcBatches();
+    m_glVertexAttribDivisor = NULL;
+    m_glDrawArraysInstanced = NULL;
+    m_view = NULL;
+    m_linesChangedFirst = -1;
+    m_linesChangedLast = -1;
+
+    for (int i = 0; i < StateRangeCount; i++) m_statesDirtyFirst[i] = m_statesDirtyLast[i] = 0;
 }
 
 ShaderDrawable::~ShaderDrawable()
 {
     if (!m_vao.isCreated()) m_vao.destroy();
     if (!m_vbo.isCreated()) m_vbo.destroy();
+    if (!m_linesVbo.isCreated()) m_linesVbo.destroy();
+    if (!m_lodLinesVbo.isCreated()) m_lodLinesVbo.destroy();
+    for (int i = 0; i < StateRangeCount; i++) if (!m_stateVbos[i].isCreated()) m_stateVbos[i].destroy();
+    for (int i = 0; i < ARCBATCHES; i++) {
+        if (!m_arcVbos[i].isCreated()) m_arcVbos[i].destroy();
+        if (!m_arcStateVbos[i].isCreated()) m_arcStateVbos[i].destroy();
+    }
+    if (!m_arcStripsVbo.isCreated()) m_arcStripsVbo.destroy();
+    delete m_lineTiles;
+    delete m_arcBatches;
 }
 
 void ShaderDrawable::init()
@@ -29,15 +53,68 @@ void ShaderDrawable::init()
     // Create buffers
     m_vao.create();
     m_vbo.create();
+    m_linesVbo.create();
+    m_lodLinesVbo.create();
+    for (int i = 0; i < StateRangeCount; i++) m_stateVbos[i].create();
+
+    // Arc strips parameters are shared by all arcs
+    initInstancing();
+    if (m_glDrawArraysInstanced) {
+        for (int i = 0; i < ARCBATCHES; i++) {
+            m_arcVbos[i].create();
+            m_arcStateVbos[i].create();
+        }
+
+        QVector<float> strips = ArcBatches::strips();
+        m_arcStripsVbo.create();
+        m_arcStripsVbo.bind();
+        m_arcStripsVbo.reserve(strips.count() * sizeof(float));
+        m_arcStripsVbo.write(0, strips.constData(), strips.count() * sizeof(float));
+        m_arcStripsVbo.release();
+    }
+}
+
+// Instanced drawing is core since OpenGL 3.3 & OpenGL ES 3.0, extension otherwise
+void ShaderDrawable::initInstancing()
+{
+    m_glVertexAttribDivisor = NULL;
+    m_glDrawArraysInstanced = NULL;
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context) return;
+
+    const char *suffix = NULL;
+    if (context->isOpenGLES()) {
+        if (context->format().majorVersion() >= 3) suffix = "";
+        else if (context->hasExtension("GL_EXT_instanced_arrays")) suffix = "EXT";
+        else if (context->hasExtension("GL_ANGLE_instanced_arrays")) suffix = "ANGLE";
+    } else {
+        if (context->format().version() >= qMakePair(3, 3)) suffix = "";
+        else if (context->hasExtension("GL_ARB_instanced_arrays")) suffix = "ARB";
+    }
+    if (!suffix) return;
+
+    m_glVertexAttribDivisor = (VertexAttribDivisor)context->getProcAddress(QByteArray("glVertexAttribDivisor") + suffix);
+    m_glDrawArraysInstanced = (DrawArraysInstanced)context->getProcAddress(QByteArray("glDrawArraysInstanced") + suffix);
+
+    if (!m_glVertexAttribDivisor || !m_glDrawArraysInstanced) {
+        m_glVertexAttribDivisor = NULL;
+        m_glDrawArraysInstanced = NULL;
+    }
+
+    qDebug() << "arcs instancing" << (m_glDrawArraysInstanced != NULL);
 }
 
 void ShaderDrawable::update()
 {
     m_needsUpdateGeometry = true;
+    requestRedraw();
 }
 
 void ShaderDrawable::updateGeometry(QOpenGLShaderProgram *shaderProgram)
 {
+    Q_UNUSED(shaderProgram)
+
     // Init in context
     if (!m_vbo.isCreated()) init();
 
@@ -46,54 +123,251 @@ void ShaderDrawable::updateGeometry(QOpenGLShaderProgram *shaderProgram)
         m_vao.bind();
     }
 
-    // Prepare vbo
-    m_vbo.bind();
+    // Update vertex buffers
+    m_linesChangedFirst = m_linesChangedLast = -1;
 
-    // Update vertex buffer
     if (updateData()) {
-        // Fill vertices buffer
+        // Fill small data buffer, attributes are located on drawing as layouts differ
         QVector<VertexData> vertexData(m_triangles);
         vertexData += m_lines;
         vertexData += m_points;
-        m_vbo.allocate(vertexData.constData(), vertexData.count() * sizeof(VertexData));
+
+        m_vbo.bind();
+        m_vbo.reserve(dashedStartsOffset() + m_dashedStarts.count() * sizeof(QVector3D));
+        m_vbo.write(0, vertexData.constData(), vertexData.count() * sizeof(VertexData));
+        m_vbo.write(palettePointsOffset(), m_palettePoints.constData(), m_palettePoints.count() * sizeof(PaletteVertexData));
+        m_vbo.write(dashedLinesOffset(), m_dashedLines.constData(), m_dashedLines.count() * sizeof(PaletteVertexData));
+        m_vbo.write(dashedStartsOffset(), m_dashedStarts.constData(), m_dashedStarts.count() * sizeof(QVector3D));
+        m_vbo.release();
+
+        writeBuffer(m_stateVbos[DashedLineStates], m_dashedLineStates.constData(), 1, m_dashedLineStates.count(),
+                    0, m_dashedLineStates.count());
+
+        // Palette lines are written by changed range
+        int count = m_paletteLines.count();
+        int first = m_linesChangedFirst >= 0 ? qMin(m_linesChangedFirst, count) : 0;
+        int last = m_linesChangedFirst >= 0 && m_linesChangedLast >= 0 ? qMin(m_linesChangedLast, count) : count;
+
+        writeBuffer(m_linesVbo, m_paletteLines.constData(), sizeof(PaletteVertexData), count, first, last);
+        writeBuffer(m_stateVbos[LineStates], m_paletteLineStates.constData(), 1, count, first, last);
+
+        // Tiles are rebuilt from changed lines
+        if (m_lineTiles) {
+            int lodFirst = m_lineTiles->build(m_paletteLines, m_paletteLineStates, first);
+            int lodCount = m_lineTiles->lodLines().count();
+
+            writeBuffer(m_lodLinesVbo, m_lineTiles->lodLines().constData(), sizeof(PaletteVertexData), lodCount,
+                        lodFirst, lodCount);
+            writeBuffer(m_stateVbos[LodLineStates], m_lineTiles->lodStates().constData(), 1, lodCount,
+                        lodFirst, lodCount);
+        }
+    }
+
+    updateStates();
+    if (m_glDrawArraysInstanced) updateArcs();
+
+    if (m_vao.isCreated()) m_vao.release();
+
+    m_needsUpdateGeometry = false;
+}
+
+void ShaderDrawable::invalidatePaletteLines(int first, int last)
+{
+    if (m_linesChangedFirst < 0) {
+        m_linesChangedFirst = first;
+        m_linesChangedLast = last;
     } else {
-        m_vbo.release();        
-        if (m_vao.isCreated()) m_vao.release();
-        m_needsUpdateGeometry = false;
-        return;
+        m_linesChangedFirst = qMin(m_linesChangedFirst, first);
+        m_linesChangedLast = m_linesChangedLast < 0 || last < 0 ? -1 : qMax(m_linesChangedLast, last);
     }
+}
 
-    if (m_vao.isCreated()) {
-        // Offset for position
-        quintptr offset = 0;
+void ShaderDrawable::setLineState(int vertex, bool dashed, quint8 state)
+{
+    QVector<quint8> &states = dashed ? m_dashedLineStates : m_paletteLineStates;
+    if (states.at(vertex) == state) return;
+
+    states[vertex] = states[vertex + 1] = state;
+    invalidateStates(dashed ? DashedLineStates : LineStates, vertex, 2);
+
+    // Simplified segments covering line
+    if (!dashed && m_lineTiles) {
+        int changed[LINETILELEVELS];
+        m_lineTiles->setState(vertex, state, changed);
+        for (int i = 0; i < LINETILELEVELS; i++) if (changed[i] >= 0) invalidateStates(LodLineStates, changed[i], 2);
+    }
+}
 
-        // Tell OpenGL programmable pipeline how to locate vertex position data
-        int vertexLocation = shaderProgram->attributeLocation("a_position");
-        shaderProgram->enableAttributeArray(vertexLocation);
-        shaderProgram->setAttributeBuffer(vertexLocation, GL_FLOAT, offset, 3, sizeof(VertexData));
+bool ShaderDrawable::arcsSupported() const
+{
+    return m_glDrawArraysInstanced != NULL;
+}
 
-        // Offset for color
-        offset = sizeof(QVector3D);
+int ShaderDrawable::appendArc(const ArcVertexData &arc, const ArcStateData &state, int source)
+{
+    return m_arcBatches->append(arc, state, source);
+}
 
-        // Tell OpenGL programmable pipeline how to locate vertex color data
-        int color = shaderProgram->attributeLocation("a_color");
-        shaderProgram->enableAttributeArray(color);
-        shaderProgram->setAttributeBuffer(color, GL_FLOAT, offset, 3, sizeof(VertexData));
+void ShaderDrawable::truncateArcs(int source)
+{
+    m_arcBatches->truncate(source);
+}
 
-        // Offset for line start point
-        offset += sizeof(QVector3D);
+void ShaderDrawable::clearArcs()
+{
+    m_arcBatches->clear();
+}
 
-        // Tell OpenGL programmable pipeline how to locate vertex line start point
-        int start = shaderProgram->attributeLocation("a_start");
-        shaderProgram->enableAttributeArray(start);
-        shaderProgram->setAttributeBuffer(start, GL_FLOAT, offset, 3, sizeof(VertexData));
+void ShaderDrawable::setArcState(int handle, const ArcStateData &state)
+{
+    m_arcBatches->setState(handle, state);
+}
 
-        m_vao.release();
+void ShaderDrawable::setLineTiles(bool enabled)
+{
+    if (enabled == (m_lineTiles != NULL)) return;
+
+    if (enabled) {
+        m_lineTiles = new LineTiles();
+    } else {
+        delete m_lineTiles;
+        m_lineTiles = NULL;
     }
 
-    m_vbo.release();
+    update();
+}
 
-    m_needsUpdateGeometry = false;
+void ShaderDrawable::invalidateStates(StateRange range, int first, int count)
+{
+    if (m_statesDirtyFirst[range] >= m_statesDirtyLast[range]) {
+        m_statesDirtyFirst[range] = first;
+        m_statesDirtyLast[range] = first + count;
+    } else {
+        m_statesDirtyFirst[range] = qMin(m_statesDirtyFirst[range], first);
+        m_statesDirtyLast[range] = qMax(m_statesDirtyLast[range], first + count);
+    }
+}
+
+// Uploads changed states ranges only, vertex buffers aren't touched
+void ShaderDrawable::updateStates()
+{
+    const QVector<quint8> *states[StateRangeCount] = {
+        &m_paletteLineStates, &m_dashedLineStates, m_lineTiles ? &m_lineTiles->lodStates() : NULL
+    };
+
+    for (int i = 0; i < StateRangeCount; i++) {
+        int first = m_statesDirtyFirst[i];
+        int last = states[i] ? qMin(m_statesDirtyLast[i], states[i]->count()) : 0;
+
+        m_statesDirtyFirst[i] = m_statesDirtyLast[i] = 0;
+        if (first >= last) continue;
+
+        m_stateVbos[i].bind();
+        m_stateVbos[i].write(first, states[i]->constData() + first, last - first);
+        m_stateVbos[i].release();
+    }
+}
+
+// Arcs & states are written by changed ranges of batches
+void ShaderDrawable::updateArcs()
+{
+    for (int i = 0; i < ARCBATCHES; i++) {
+        const QVector<ArcVertexData> &arcs = m_arcBatches->arcs(i);
+        const QVector<ArcStateData> &states = m_arcBatches->states(i);
+        int arcsFirst, statesFirst, statesLast;
+
+        m_arcBatches->takeChanges(i, &arcsFirst, &statesFirst, &statesLast);
+        writeBuffer(m_arcVbos[i], arcs.constData(), sizeof(ArcVertexData), arcs.count(), arcsFirst, arcs.count());
+        writeBuffer(m_arcStateVbos[i], states.constData(), sizeof(ArcStateData), states.count(),
+                    statesFirst, qMin(statesLast, states.count()));
+    }
+}
+
+// Writes items [first, last) of array, whole array if buffer storage was reallocated
+void ShaderDrawable::writeBuffer(GeometryBuffer &buffer, const void *data, int size, int count, int first, int last)
+{
+    if (count == 0 && buffer.capacity() == 0) return;
+
+    buffer.bind();
+    if (buffer.reserve(count * size)) {
+        first = 0;
+        last = count;
+    }
+    if (first < last) buffer.write(first * size, (const char*)data + first * size, (last - first) * size);
+    buffer.release();
+}
+
+// Data buffer layout: triangles, lines, points, palette points, dashed lines, dashed lines starts
+quintptr ShaderDrawable::palettePointsOffset() const
+{
+    return (m_triangles.count() + m_lines.count() + m_points.count()) * sizeof(VertexData);
+}
+
+quintptr ShaderDrawable::dashedLinesOffset() const
+{
+    return palettePointsOffset() + m_palettePoints.count() * sizeof(PaletteVertexData);
+}
+
+quintptr ShaderDrawable::dashedStartsOffset() const
+{
+    return dashedLinesOffset() + m_dashedLines.count() * sizeof(PaletteVertexData);
+}
+
+void ShaderDrawable::setVertexAttributes(QOpenGLShaderProgram *shaderProgram, quintptr offset)
+{
+    // Tell OpenGL programmable pipeline how to locate vertex position data
+    int vertexLocation = shaderProgram->attributeLocation("a_position");
+    shaderProgram->enableAttributeArray(vertexLocation);
+    shaderProgram->setAttributeBuffer(vertexLocation, GL_FLOAT, offset, 3, sizeof(VertexData));
+
+    // Tell OpenGL programmable pipeline how to locate vertex color data
+    int color = shaderProgram->attributeLocation("a_color");
+    shaderProgram->enableAttributeArray(color);
+    shaderProgram->setAttributeBuffer(color, GL_FLOAT, offset + sizeof(QVector3D), 3, sizeof(VertexData));
+
+    // Tell OpenGL programmable pipeline how to locate vertex line start point
+    int start = shaderProgram->attributeLocation("a_start");
+    shaderProgram->enableAttributeArray(start);
+    shaderProgram->setAttributeBuffer(start, GL_FLOAT, offset + 2 * sizeof(QVector3D), 3, sizeof(VertexData));
+
+    // No palette
+    int palette = shaderProgram->attributeLocation("a_palette");
+    shaderProgram->disableAttributeArray(palette);
+    shaderProgram->setAttributeValue(palette, 0.0f, 0.0f, 0.0f, 0.0f);
+
+    int state = shaderProgram->attributeLocation("a_state");
+    shaderProgram->disableAttributeArray(state);
+    shaderProgram->setAttributeValue(state, 0.0f);
+}
+
+// Line start point attribute is left to caller, vertex buffer stays bound
+void ShaderDrawable::setPaletteAttributes(QOpenGLShaderProgram *shaderProgram, GeometryBuffer &buffer, quintptr offset,
+                                          GeometryBuffer *states)
+{
+    // Normalized palette index override
+    int state = shaderProgram->attributeLocation("a_state");
+    if (states) {
+        states->bind();
+        shaderProgram->enableAttributeArray(state);
+        shaderProgram->setAttributeBuffer(state, GL_UNSIGNED_BYTE, 0, 1, 1);
+    } else {
+        shaderProgram->disableAttributeArray(state);
+        shaderProgram->setAttributeValue(state, 0.0f);
+    }
+
+    buffer.bind();
+
+    int vertexLocation = shaderProgram->attributeLocation("a_position");
+    shaderProgram->enableAttributeArray(vertexLocation);
+    shaderProgram->setAttributeBuffer(vertexLocation, GL_FLOAT, offset, 3, sizeof(PaletteVertexData));
+
+    // Normalized palette index & brightness, 4th component is 1 for palette vertices
+    int palette = shaderProgram->attributeLocation("a_palette");
+    shaderProgram->enableAttributeArray(palette);
+    shaderProgram->setAttributeBuffer(palette, GL_UNSIGNED_BYTE, offset + sizeof(QVector3D), 2, sizeof(PaletteVertexData));
+
+    int color = shaderProgram->attributeLocation("a_color");
+    shaderProgram->disableAttributeArray(color);
 }
 
 bool ShaderDrawable::updateData()
@@ -111,6 +385,10 @@ bool ShaderDrawable::updateData()
     return true;
 }
 
+void ShaderDrawable::updateView()
+{
+}
+
 bool ShaderDrawable::needsUpdateGeometry() const
 {
     return m_needsUpdateGeometry;
@@ -120,56 +398,149 @@ void ShaderDrawable::draw(QOpenGLShaderProgram *shaderProgram)
 {
     if (!m_visible) return;
 
-    if (m_vao.isCreated()) {
-        // Prepare vao
-        m_vao.bind();
-    } else {
-        // Prepare vbo
-        m_vbo.bind();
+    updateView();
 
-        // Offset for position
-        quintptr offset = 0;
+    // Prepare vao & vbo
+    if (m_vao.isCreated()) m_vao.bind();
+    m_vbo.bind();
+
+    int vertexCount = m_triangles.count() + m_lines.count() + m_points.count();
 
-        // Tell OpenGL programmable pipeline how to locate vertex position data
-        int vertexLocation = shaderProgram->attributeLocation("a_position");
-        shaderProgram->enableAttributeArray(vertexLocation);
-        shaderProgram->setAttributeBuffer(vertexLocation, GL_FLOAT, offset, 3, sizeof(VertexData));
+    if (vertexCount > 0) {
+        setVertexAttributes(shaderProgram, 0);
 
-        // Offset for color
-        offset = sizeof(QVector3D);
+        if (!m_triangles.isEmpty() && !m_textures.isEmpty()) {
+            shaderProgram->setUniformValue("texture", 0);
+            for (int i = 0; i < m_textures.count() && i * 6 < m_triangles.count(); i++) {
+                // Not uploaded yet
+                if (!m_textures.at(i)->isStorageAllocated()) continue;
+                m_textures.at(i)->bind();
+                glDrawArrays(GL_TRIANGLES, i * 6, 6);
+            }
+        } else if (!m_triangles.isEmpty()) {
+            if (m_texture) {
+                m_texture->bind();
+                shaderProgram->setUniformValue("texture", 0);
+            }
+            glDrawArrays(GL_TRIANGLES, 0, m_triangles.count());
+        }
 
-        // Tell OpenGL programmable pipeline how to locate vertex color data
-        int color = shaderProgram->attributeLocation("a_color");
-        shaderProgram->enableAttributeArray(color);
-        shaderProgram->setAttributeBuffer(color, GL_FLOAT, offset, 3, sizeof(VertexData));
+        if (!m_lines.isEmpty()) {
+            glLineWidth(m_lineWidth);
+            glDrawArrays(GL_LINES, m_triangles.count(), m_lines.count());
+        }
 
-        // Offset for line start point
-        offset += sizeof(QVector3D);
+        if (!m_points.isEmpty()) {
+            glDrawArrays(GL_POINTS, m_triangles.count() + m_lines.count(), m_points.count());
+        }
+    }
 
-        // Tell OpenGL programmable pipeline how to locate vertex line start point
+    if (!m_paletteLines.isEmpty() || !m_dashedLines.isEmpty() || !m_palettePoints.isEmpty() || !m_arcBatches->isEmpty()) {
         int start = shaderProgram->attributeLocation("a_start");
-        shaderProgram->enableAttributeArray(start);
-        shaderProgram->setAttributeBuffer(start, GL_FLOAT, offset, 3, sizeof(VertexData));
-    }
 
-    if (!m_triangles.isEmpty()) {
-        if (m_texture) {
-            m_texture->bind();
-            shaderProgram->setUniformValue("texture", 0);
+        // Colors are resolved by shader, geometry isn't rebuilt on colors change
+        shaderProgram->setUniformValueArray("u_palette", m_palette.constData(), qMin(m_palette.count(), PALETTESIZE));
+        glLineWidth(m_lineWidth);
+
+        if (!m_paletteLines.isEmpty() && m_lineTiles && !m_lineTiles->isEmpty() && !m_viewport.isEmpty()) {
+            QVector<LineTileRange> lines;
+            QVector<LineTileRange> lodLines;
+            m_lineTiles->visibleRanges(m_viewProjection, m_viewport, lines, lodLines);
+
+            if (!lines.isEmpty()) {
+                setPaletteAttributes(shaderProgram, m_linesVbo, 0, &m_stateVbos[LineStates]);
+                shaderProgram->disableAttributeArray(start);
+                shaderProgram->setAttributeValue(start, sNan, sNan, sNan);
+                foreach (const LineTileRange &range, lines) glDrawArrays(GL_LINES, range.first, range.count);
+            }
+
+            if (!lodLines.isEmpty()) {
+                setPaletteAttributes(shaderProgram, m_lodLinesVbo, 0, &m_stateVbos[LodLineStates]);
+                shaderProgram->disableAttributeArray(start);
+                shaderProgram->setAttributeValue(start, sNan, sNan, sNan);
+                foreach (const LineTileRange &range, lodLines) glDrawArrays(GL_LINES, range.first, range.count);
+            }
+        } else if (!m_paletteLines.isEmpty()) {
+            setPaletteAttributes(shaderProgram, m_linesVbo, 0, &m_stateVbos[LineStates]);
+            shaderProgram->disableAttributeArray(start);
+            shaderProgram->setAttributeValue(start, sNan, sNan, sNan);
+            glDrawArrays(GL_LINES, 0, m_paletteLines.count());
+        }
+
+        if (!m_arcBatches->isEmpty() && m_glDrawArraysInstanced) drawArcs(shaderProgram);
+
+        if (!m_dashedLines.isEmpty()) {
+            setPaletteAttributes(shaderProgram, m_vbo, dashedLinesOffset(), &m_stateVbos[DashedLineStates]);
+            shaderProgram->enableAttributeArray(start);
+            shaderProgram->setAttributeBuffer(start, GL_FLOAT, dashedStartsOffset(), 3, sizeof(QVector3D));
+            glDrawArrays(GL_LINES, 0, m_dashedLines.count());
+        }
+
+        if (!m_palettePoints.isEmpty()) {
+            setPaletteAttributes(shaderProgram, m_vbo, palettePointsOffset());
+            shaderProgram->disableAttributeArray(start);
+            shaderProgram->setAttributeValue(start, sNan, sNan, m_pointSize);
+            glDrawArrays(GL_POINTS, 0, m_palettePoints.count());
         }
-        glDrawArrays(GL_TRIANGLES, 0, m_triangles.count());
     }
 
-    if (!m_lines.isEmpty()) {
-        glLineWidth(m_lineWidth);
-        glDrawArrays(GL_LINES, m_triangles.count(), m_lines.count());
+    m_vbo.release();
+    if (m_vao.isCreated()) m_vao.release();
+}
+
+// Batches are drawn as instanced strips of level selected by view, arc parameters are instance attributes
+void ShaderDrawable::drawArcs(QOpenGLShaderProgram *shaderProgram)
+{
+    int position = shaderProgram->attributeLocation("a_position");
+    int color = shaderProgram->attributeLocation("a_color");
+    int start = shaderProgram->attributeLocation("a_start");
+    int state = shaderProgram->attributeLocation("a_state");
+    int palette = shaderProgram->attributeLocation("a_palette");
+    int arc = shaderProgram->attributeLocation("a_arc");
+    int sweep = shaderProgram->attributeLocation("a_arcSweep");
+    int arcState = shaderProgram->attributeLocation("a_arcState");
+    int instanced[] = { palette, arc, sweep, arcState };
+
+    shaderProgram->setUniformValue("u_arcs", true);
+    shaderProgram->disableAttributeArray(color);
+    shaderProgram->disableAttributeArray(state);
+    shaderProgram->setAttributeValue(state, 0.0f);
+    shaderProgram->disableAttributeArray(start);
+    shaderProgram->setAttributeValue(start, sNan, sNan, sNan);
+
+    // Strip parameter is passed as position x
+    m_arcStripsVbo.bind();
+    shaderProgram->enableAttributeArray(position);
+    shaderProgram->setAttributeBuffer(position, GL_FLOAT, 0, 1, sizeof(float));
+
+    for (int i = 0; i < 4; i++) {
+        shaderProgram->enableAttributeArray(instanced[i]);
+        m_glVertexAttribDivisor(instanced[i], 1);
     }
 
-    if (!m_points.isEmpty()) {
-        glDrawArrays(GL_POINTS, m_triangles.count() + m_lines.count(), m_points.count());
+    for (int i = 0; i < ARCBATCHES; i++) {
+        int count = m_arcBatches->arcs(i).count();
+        if (count == 0) continue;
+
+        int level = m_arcBatches->level(i, m_viewProjection, m_viewport);
+
+        m_arcVbos[i].bind();
+        shaderProgram->setAttributeBuffer(arc, GL_FLOAT, 0, 4, sizeof(ArcVertexData));
+        shaderProgram->setAttributeBuffer(sweep, GL_FLOAT, 4 * sizeof(float), 3, sizeof(ArcVertexData));
+        shaderProgram->setAttributeBuffer(palette, GL_UNSIGNED_BYTE, 7 * sizeof(float), 3, sizeof(ArcVertexData));
+
+        m_arcStateVbos[i].bind();
+        shaderProgram->setAttributeBuffer(arcState, GL_UNSIGNED_BYTE, 0, 3, sizeof(ArcStateData));
+
+        m_glDrawArraysInstanced(GL_LINE_STRIP, ArcBatches::stripFirst(level), ArcBatches::stripCount(level), count);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        m_glVertexAttribDivisor(instanced[i], 0);
+        shaderProgram->disableAttributeArray(instanced[i]);
     }
 
-    if (m_vao.isCreated()) m_vao.release(); else m_vbo.release();
+    shaderProgram->setUniformValue("u_arcs", false);
 }
 
 QVector3D ShaderDrawable::getSizes()
@@ -189,7 +560,8 @@ QVector3D ShaderDrawable::getMaximumExtremes()
 
 int ShaderDrawable::getVertexCount()
 {
-    return m_lines.count() + m_points.count() + m_triangles.count();
+    return m_lines.count() + m_points.count() + m_triangles.count()
+            + m_paletteLines.count() + m_dashedLines.count() + m_palettePoints.count();
 }
 
 double ShaderDrawable::lineWidth() const
@@ -199,7 +571,10 @@ double ShaderDrawable::lineWidth() const
 
 void ShaderDrawable::setLineWidth(double lineWidth)
 {
+    if (m_lineWidth == lineWidth) return;
+
     m_lineWidth = lineWidth;
+    requestRedraw();
 }
 
 bool ShaderDrawable::visible() const
@@ -209,7 +584,10 @@ bool ShaderDrawable::visible() const
 
 void ShaderDrawable::setVisible(bool visible)
 {
+    if (m_visible == visible) return;
+
     m_visible = visible;
+    requestRedraw();
 }
 
 double ShaderDrawable::pointSize() const
@@ -219,7 +597,26 @@ double ShaderDrawable::pointSize() const
 
 void ShaderDrawable::setPointSize(double pointSize)
 {
+    if (m_pointSize == pointSize) return;
+
     m_pointSize = pointSize;
+    requestRedraw();
+}
+
+void ShaderDrawable::setViewProjection(const QMatrix4x4 &matrix, const QSize &viewport)
+{
+    m_viewProjection = matrix;
+    m_viewport = viewport;
+}
+
+void ShaderDrawable::setView(GLWidget *view)
+{
+    m_view = view;
+}
+
+void ShaderDrawable::requestRedraw()
+{
+    if (m_view) m_view->requestUpdate();
 }
 
 
@@ -7,6 +7,9 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLTexture>
+#include <QMatrix4x4>
+#include <QSize>
+#include "geometrybuffer.h"
 #include "utils/util.h"
 
 #ifndef sNan
@@ -20,6 +23,47 @@ struct VertexData
     QVector3D start;
 };
 
+// Compact vertex, color is resolved by shader from drawable palette
+struct PaletteVertexData
+{
+    QVector3D position;
+    quint8 color;       // Palette index
+    quint8 brightness;  // Palette color multiplier, 255 for unchanged color
+    quint8 reserved[2];
+};
+
+#define PALETTESIZE 8
+
+// Arc primitive, expanded by shader to strip of points at angles start + sweep * t.
+// Arc lies in plane axes (u, v) of center, helix travel dz is along plane normal.
+struct ArcVertexData
+{
+    QVector3D center;
+    float radius;
+    float start;
+    float sweep;
+    float dz;
+    quint8 color;       // Palette index
+    quint8 brightness;
+    quint8 plane;       // PointSegment::planes, axes (u, v, normal) are XYZ, ZXY or YZX
+    quint8 reserved;
+};
+
+// Palette index overrides of arc head [0, split] & tail (split, 1], split is normalized
+struct ArcStateData
+{
+    quint8 head;
+    quint8 tail;
+    quint8 split;
+    quint8 reserved;
+};
+
+#define ARCBATCHES 12
+
+class LineTiles;
+class ArcBatches;
+class GLWidget;
+
 class ShaderDrawable : protected QOpenGLFunctions
 {
 public:
@@ -45,6 +89,12 @@ public:
     double pointSize() const;
     void setPointSize(double pointSize);
 
+    // View used to cull & select detail level of line tiles
+    void setViewProjection(const QMatrix4x4 &matrix, const QSize &viewport);
+
+    // View to request redraw from on changes
+    void setView(GLWidget *view);
+
 signals:
 
 public slots:
@@ -57,16 +107,92 @@ protected:
     QVector<VertexData> m_points;
     QVector<VertexData> m_triangles;
     QOpenGLTexture *m_texture;
+    // Textures of triangles quads (6 vertices each) used instead of m_texture if not empty, not owned
+    QVector<QOpenGLTexture*> m_textures;
 
-    QOpenGLBuffer m_vbo; // Protected for direct vbo access
+    // Compact geometry, dashed lines have start point of line for each vertex
+    QVector<PaletteVertexData> m_paletteLines;
+    QVector<PaletteVertexData> m_dashedLines;
+    QVector<QVector3D> m_dashedStarts;
+    QVector<PaletteVertexData> m_palettePoints;
+    QVector<QVector3D> m_palette;
+
+    // Per vertex palette index overrides of compact lines (0 keeps vertex color),
+    // stored in separate buffers and uploaded by changed ranges
+    QVector<quint8> m_paletteLineStates;
+    QVector<quint8> m_dashedLineStates;
+
+    // View of last frame drawn
+    QMatrix4x4 m_viewProjection;
+    QSize m_viewport;
 
     virtual bool updateData();
+    // Called before drawing in GL context, once view of frame is set
+    virtual void updateView();
     void init();
 
+    // Palette lines [first, last) & their states were changed on data update, -1 last for all following.
+    // If not called, palette lines are uploaded entirely.
+    void invalidatePaletteLines(int first, int last = -1);
+
+    // Sets state of line segment starting at vertex
+    void setLineState(int vertex, bool dashed, quint8 state);
+
+    // Palette lines are drawn by tiles with simplified levels if enabled
+    void setLineTiles(bool enabled);
+
+    // Arcs are drawn instanced, available in GL context if supported
+    bool arcsSupported() const;
+    int appendArc(const ArcVertexData &arc, const ArcStateData &state, int source);
+    void truncateArcs(int source);
+    void clearArcs();
+    void setArcState(int handle, const ArcStateData &state);
+
+    void requestRedraw();
+
 private:
+    enum StateRange { LineStates, DashedLineStates, LodLineStates, StateRangeCount };
+
     QOpenGLVertexArrayObject m_vao;
 
+    // Triangles, lines, points, palette points, dashed lines & starts are small, uploaded entirely
+    GeometryBuffer m_vbo;
+    GeometryBuffer m_linesVbo;
+    GeometryBuffer m_lodLinesVbo;
+    GeometryBuffer m_stateVbos[StateRangeCount];
+    GeometryBuffer m_arcVbos[ARCBATCHES];
+    GeometryBuffer m_arcStateVbos[ARCBATCHES];
+    GeometryBuffer m_arcStripsVbo;
+
+    // Instanced drawing functions, NULL if not supported
+    typedef void (QOPENGLF_APIENTRYP VertexAttribDivisor)(GLuint index, GLuint divisor);
+    typedef void (QOPENGLF_APIENTRYP DrawArraysInstanced)(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+    VertexAttribDivisor m_glVertexAttribDivisor;
+    DrawArraysInstanced m_glDrawArraysInstanced;
+
+    LineTiles *m_lineTiles;
+    ArcBatches *m_arcBatches;
+    GLWidget *m_view;
+
     bool m_needsUpdateGeometry;
+    int m_linesChangedFirst;
+    int m_linesChangedLast;
+
+    int m_statesDirtyFirst[StateRangeCount];
+    int m_statesDirtyLast[StateRangeCount];
+
+    quintptr palettePointsOffset() const;
+    quintptr dashedLinesOffset() const;
+    quintptr dashedStartsOffset() const;
+    void invalidateStates(StateRange range, int first, int count);
+    void setVertexAttributes(QOpenGLShaderProgram *shaderProgram, quintptr offset);
+    void setPaletteAttributes(QOpenGLShaderProgram *shaderProgram, GeometryBuffer &buffer, quintptr offset,
+                              GeometryBuffer *states = NULL);
+    void writeBuffer(GeometryBuffer &buffer, const void *data, int size, int count, int first, int last);
+    void updateStates();
+    void initInstancing();
+    void updateArcs();
+    void drawArcs(QOpenGLShaderProgram *shaderProgram);
 };
 
 #endif // SHADERDRAWABLE_H
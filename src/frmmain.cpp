@@ -6,8 +6,13 @@
 
 #define PROGRESSMINLINES 10000
 #define PROGRESSSTEP     1000
+#define PARSERREFRESH    500
+#define PROGRESSDELAY    500
+#define PICKRADIUS       5
 
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QSaveFile>
 #include <QTextStream>
 #include <QDebug>
 #include <QStringList>
@@ -20,8 +25,13 @@
 #include <QAction>
 #include <QLayout>
 #include <QMimeData>
+#include <QEventLoop>
+#include <QToolTip>
 #include "frmmain.h"
 #include "ui_frmmain.h"
+#include "parser/gcodefilereader.h"
+#include "parser/gcodeparsethread.h"
+#include "parser/gcodeparsecache.h"
 
 #include "GrblMachine.h"
 #include "MarlinMachine.h"
@@ -101,10 +111,10 @@ frmMain::frmMain(QWidget *parent) :
     ui->slbFeedOverride->setSuffix("%");
     connect(ui->slbFeedOverride, SIGNAL(toggled(bool)), this, SLOT(onOverridingToggled(bool)));
     connect(ui->slbFeedOverride, &SliderBox::toggled, [=] {
-        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
+        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLines());
     });
     connect(ui->slbFeedOverride, &SliderBox::valueChanged, [=] {
-        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
+        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLines());
     });
 
     ui->slbRapidOverride->setRatio(50);
@@ -115,10 +125,10 @@ frmMain::frmMain(QWidget *parent) :
     ui->slbRapidOverride->setSuffix("%");
     connect(ui->slbRapidOverride, SIGNAL(toggled(bool)), this, SLOT(onOverridingToggled(bool)));
     connect(ui->slbRapidOverride, &SliderBox::toggled, [=] {
-        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
+        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLines());
     });
     connect(ui->slbRapidOverride, &SliderBox::valueChanged, [=] {
-        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
+        updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLines());
     });
 
     ui->slbSpindleOverride->setRatio(1);
@@ -161,6 +171,8 @@ frmMain::frmMain(QWidget *parent) :
 
     connect(ui->glwVisualizer, SIGNAL(rotationChanged()), this, SLOT(onVisualizatorRotationChanged()));
     connect(ui->glwVisualizer, SIGNAL(resized()), this, SLOT(placeVisualizerButtons()));
+    connect(ui->glwVisualizer, SIGNAL(pointClicked(QPoint)), this, SLOT(onVisualizerPointClicked(QPoint)));
+    connect(ui->glwVisualizer, SIGNAL(pointHovered(QPoint)), this, SLOT(onVisualizerPointHovered(QPoint)));
     connect(&m_programModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(onTableCellChanged(QModelIndex,QModelIndex)));
     connect(&m_programHeightmapModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(onTableCellChanged(QModelIndex,QModelIndex)));
     connect(&m_probeModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(onTableCellChanged(QModelIndex,QModelIndex)));
@@ -192,6 +204,11 @@ frmMain::frmMain(QWidget *parent) :
         connect(button, SIGNAL(clicked(bool)), this, SLOT(onCmdJogFeedClicked()));
     }
 
+    // Machine state display
+    connect(&m_machineState, SIGNAL(positionChanged()), this, SLOT(onMachinePositionChanged()));
+    connect(&m_machineState, SIGNAL(feedSpindleChanged()), this, SLOT(onMachineFeedSpindleChanged()));
+    connect(&m_machineState, SIGNAL(pinsChanged()), this, SLOT(onMachinePinsChanged()));
+
     // Setting up spindle slider box
     ui->slbSpindle->setTitle(tr("Speed:"));
     ui->slbSpindle->setCheckable(false);
@@ -211,7 +228,7 @@ frmMain::frmMain(QWidget *parent) :
  //   connect(&m_connection, SIGNAL(tcpReadyRead()), this, SLOT(onSerialPortReadyRead()), Qt::QueuedConnection);
     m_connection.registerReadHandler(this, SLOT(onCommReadyRead()));
 //    connect(&m_connection, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onSerialPortError(QSerialPort::SerialPortError)));
-    m_connection.registerErrorHandler(this, SLOT(onCommError(QSerialPort::SerialPortError)));
+    m_connection.registerErrorHandler(this, SLOT(onCommError(int)));
 
     this->installEventFilter(this);
     ui->tblProgram->installEventFilter(this);
@@ -293,6 +310,8 @@ void frmMain::loadSettings()
     m_connection.setTcpPort(m_settings->tcpPort());
     m_settings->setIgnoreErrors(set.value("ignoreErrors", false).toBool());
     m_settings->setAutoLine(set.value("autoLine", true).toBool());
+    m_settings->setRxBufferSize(set.value("rxBufferSize", 127).toInt());
+    m_connection.setBufferLength(m_settings->rxBufferSize());
     m_settings->setToolDiameter(set.value("toolDiameter", 3).toDouble());
     m_settings->setToolLength(set.value("toolLength", 15).toDouble());
     m_settings->setAntialiasing(set.value("antialiasing", true).toBool());
@@ -304,6 +323,7 @@ void frmMain::loadSettings()
     m_settings->setGrayscaleSegments(set.value("grayscaleSegments", false).toBool());
     m_settings->setGrayscaleSCode(set.value("grayscaleSCode", true).toBool());
     m_settings->setDrawModeVectors(set.value("drawModeVectors", true).toBool());    
+    m_settings->setRasterMemoryLimit(set.value("rasterMemoryLimit", 2048).toInt());
     m_settings->setMoveOnRestore(set.value("moveOnRestore", false).toBool());
     m_settings->setRestoreMode(set.value("restoreMode", 0).toInt());
     m_settings->setLineWidth(set.value("lineWidth", 1).toDouble());
@@ -447,6 +467,7 @@ void frmMain::saveSettings()
     set.setValue("tcpPort", m_settings->tcpPort());
     set.setValue("ignoreErrors", m_settings->ignoreErrors());
     set.setValue("autoLine", m_settings->autoLine());
+    set.setValue("rxBufferSize", m_settings->rxBufferSize());
     set.setValue("toolDiameter", m_settings->toolDiameter());
     set.setValue("toolLength", m_settings->toolLength());
     set.setValue("antialiasing", m_settings->antialiasing());
@@ -458,6 +479,7 @@ void frmMain::saveSettings()
     set.setValue("grayscaleSegments", m_settings->grayscaleSegments());
     set.setValue("grayscaleSCode", m_settings->grayscaleSCode());
     set.setValue("drawModeVectors", m_settings->drawModeVectors());
+    set.setValue("rasterMemoryLimit", m_settings->rasterMemoryLimit());
 
     set.setValue("spindleSpeed", ui->slbSpindle->value());
     set.setValue("lineWidth", m_settings->lineWidth());
@@ -716,6 +738,47 @@ void frmMain::onCommError(int error)
     m_machine->onCommError(error);
 }
 
+void frmMain::onMachinePositionChanged()
+{
+    int prec = m_settings->units() == 0 ? 3 : 4;
+
+    ui->txtMPosX->setText(QString::number(m_machineState.machinePosition(0), 'f', prec));
+    ui->txtMPosY->setText(QString::number(m_machineState.machinePosition(1), 'f', prec));
+    ui->txtMPosZ->setText(QString::number(m_machineState.machinePosition(2), 'f', prec));
+
+    ui->txtWPosX->setText(QString::number(m_machineState.workPosition(0), 'f', prec));
+    ui->txtWPosY->setText(QString::number(m_machineState.workPosition(1), 'f', prec));
+    ui->txtWPosZ->setText(QString::number(m_machineState.workPosition(2), 'f', prec));
+}
+
+void frmMain::onMachineFeedSpindleChanged()
+{
+    ui->glwVisualizer->setSpeedState(QString(tr("F/S: %1 / %2")).arg(m_machineState.feed()).arg(m_machineState.spindleSpeed()));
+}
+
+void frmMain::onMachinePinsChanged()
+{
+    QString pinState;
+    int accessories = m_machineState.accessories();
+
+    if (!m_machineState.pins().isEmpty()) {
+        pinState.append(QString(tr("PS: %1")).arg(QString::fromLatin1(m_machineState.pins())));
+    }
+
+    if (accessories) {
+        QString state;
+        if (accessories & MachineStatus::SpindleCW) state.append('S');
+        if (accessories & MachineStatus::SpindleCCW) state.append('C');
+        if (accessories & MachineStatus::Flood) state.append('F');
+        if (accessories & MachineStatus::Mist) state.append('M');
+
+        if (!pinState.isEmpty()) pinState.append(" / ");
+        pinState.append(QString(tr("AS: %1")).arg(state));
+    }
+
+    ui->glwVisualizer->setPinState(pinState);
+}
+
 void frmMain::onTimerConnection()
 {
     m_machine->onTimerConnection();
@@ -967,6 +1030,16 @@ void frmMain::resetHeightmap()
 }
 
 void frmMain::loadFile(QList<QString> data)
+{
+    GcodeFileReader *reader = new GcodeFileReader();
+    reader->setData(QStringList(data).join("\n").toUtf8());
+
+    // Load lines
+    loadFile(reader);
+}
+
+// Program model takes ownership of reader, commands are decoded from it on demand
+void frmMain::loadFile(GcodeFileReader *reader)
 {
     QTime time;
     time.start();
@@ -985,7 +1058,7 @@ void frmMain::loadFile(QList<QString> data)
     m_currentDrawer = m_codeDrawer;
     m_codeDrawer->update();
     ui->glwVisualizer->fitDrawable(m_codeDrawer);
-    updateProgramEstimatedTime(QList<LineSegment*>());
+    updateProgramEstimatedTime(NULL);
 
     // Update interface
     ui->chkHeightMapUse->setChecked(false);
@@ -998,9 +1071,12 @@ void frmMain::loadFile(QList<QString> data)
     ui->tblProgram->setModel(NULL);
 
     // Prepare parser
-    GcodeParser gp;
-    gp.setTraverseSpeed(m_settings->rapidSpeed());
-    if (m_codeDrawer->getIgnoreZ()) gp.reset(QVector3D(qQNaN(), qQNaN(), 0));
+    GcodeParseThread parser;
+    parser.setReader(reader);
+    parser.setChunkSize(PROGRESSSTEP);
+    parser.setTraverseSpeed(m_settings->rapidSpeed());
+    parser.setArcPrecision(m_settings->arcPrecision(), m_settings->arcDegreeMode());
+    if (m_codeDrawer->getIgnoreZ()) parser.setInitialPoint(QVector3D(qQNaN(), qQNaN(), 0));
 
     qDebug() << "Prepared to load:" << time.elapsed();
     time.start();
@@ -1008,67 +1084,37 @@ void frmMain::loadFile(QList<QString> data)
     // Block parser updates on table changes
     m_programLoading = true;
 
-    QString command;
-    QString stripped;
-    QString trimmed;
-    QList<QString> args;
-    GCodeItem item;
-
     // Prepare model
-    m_programModel.data().clear();
-    m_programModel.data().reserve(data.count());
-
-    QProgressDialog progress(tr("Opening file..."), tr("Abort"), 0, data.count(), this);
-    progress.setWindowModality(Qt::WindowModal);
-    progress.setFixedSize(progress.sizeHint());
-    if (data.count() > PROGRESSMINLINES) {
-        progress.show();
-        progress.setStyleSheet("QProgressBar {text-align: center; qproperty-format: \"\"}");
-    }
-
-    while (!data.isEmpty())
-    {
-        command = data.takeFirst();
-
-        // Trim command
-        trimmed = command.trimmed();
-
-        if (!trimmed.isEmpty()) {
-            // Split command
-            stripped = GcodePreprocessorUtils::removeComment(command);
-            if(!stripped.isEmpty()) {
-                args = GcodePreprocessorUtils::splitCommand(stripped);
-
-                //            PointSegment *ps = gp.addCommand(args);
-                gp.addCommand(args);
-
-                //        if (ps && (qIsNaN(ps->point()->x()) || qIsNaN(ps->point()->y()) || qIsNaN(ps->point()->z())))
-                //                   qDebug() << "nan point segment added:" << *ps->point();
-
-                item.command = trimmed;
-                item.state = GCodeItem::InQueue;
-                item.line = gp.getCommandNumber();
-                item.args = args;
+    m_programModel.clear();
+    m_programModel.setReader(reader);
+    m_programModel.reserve(reader->lineCount());
+
+    // Large files parsing results are cached
+    bool useCache = !reader->fileName().isEmpty() && reader->lineCount() > PROGRESSMINLINES;
+    GcodeParseCache cache(*reader, m_settings->arcPrecision(), m_settings->arcDegreeMode(), m_settings->rapidSpeed(),
+                          m_codeDrawer->getIgnoreZ());
+    QVector<int> sourceLines;
+    QVector<int> lines;
+
+    if (useCache && cache.load(&sourceLines, &lines, &m_viewParser)) {
+        for (int i = 0; i < sourceLines.count(); i++) m_programModel.appendSourceRow(sourceLines.at(i), lines.at(i));
+        m_codeDrawer->update();
 
-                m_programModel.data().append(item);
-            }
-        }
+        qDebug() << "loaded from cache:" << cache.fileName();
+    } else {
+        if (parseProgram(&parser, &m_programModel, m_codeDrawer, tr("Opening file..."), true) && useCache) {
+            lines.reserve(m_programModel.rowCount());
+            for (int i = 0; i < m_programModel.rowCount(); i++) lines.append(m_programModel.line(i));
 
-        if (progress.isVisible() && (data.count() % PROGRESSSTEP == 0)) {
-            progress.setValue(progress.maximum() - data.count());
-            qApp->processEvents();
-            if (progress.wasCanceled()) break;
+            if (!cache.save(m_programModel.sources(), lines, &m_viewParser)) qDebug() << "can't save cache:" << cache.fileName();
         }
     }
-    progress.close();
 
     m_programModel.insertRow(m_programModel.rowCount());
 
-    qDebug() << "model filled:" << time.elapsed();
-    time.start();
+    qDebug() << "model & view parser filled:" << time.elapsed();
 
-    updateProgramEstimatedTime(m_viewParser.getLinesFromParser(&gp, m_settings->arcPrecision(), m_settings->arcDegreeMode()));
-    qDebug() << "view parser filled:" << time.elapsed();
+    updateProgramEstimatedTime(m_viewParser.getLines());
 
     m_programLoading = false;
 
@@ -1080,8 +1126,7 @@ void frmMain::loadFile(QList<QString> data)
     connect(ui->tblProgram->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(onTableCurrentChanged(QModelIndex,QModelIndex)));
     ui->tblProgram->selectRow(0);
 
-    //  Update code drawer
-    m_codeDrawer->update();
+    //  Code drawer is updated while parsing
     ui->glwVisualizer->fitDrawable(m_codeDrawer);
 
     resetHeightmap();
@@ -1090,9 +1135,10 @@ void frmMain::loadFile(QList<QString> data)
 
 void frmMain::loadFile(QString fileName)
 {
-    QFile file(fileName);
+    GcodeFileReader *reader = new GcodeFileReader();
 
-    if (!file.open(QIODevice::ReadOnly)) {
+    if (!reader->open(fileName)) {
+        delete reader;
         QMessageBox::critical(this, this->windowTitle(), tr("Can't open file:\n") + fileName);
         return;
     }
@@ -1100,31 +1146,24 @@ void frmMain::loadFile(QString fileName)
     // Set filename
     m_programFileName = fileName;
 
-    // Prepare text stream
-    QTextStream textStream(&file);
-
-    // Read lines
-    QList<QString> data;
-    while (!textStream.atEnd()) data.append(textStream.readLine());
-
     // Load lines
-    loadFile(data);
+    loadFile(reader);
 }
 
-QTime frmMain::updateProgramEstimatedTime(QList<LineSegment*> lines)
+QTime frmMain::updateProgramEstimatedTime(const LineSegmentStore *lines)
 {
     double time = 0;
 
-    for (int i = 0; i < lines.count(); i++) {
-        LineSegment *ls = lines[i];
-    //    foreach (LineSegment *ls, lines) {
-        double length = (ls->getEnd() - ls->getStart()).length();
+    for (int i = 0; lines && i < lines->count(); i++) {
+        double length = (lines->getEnd(i) - lines->getStart(i)).length();
+        double speed = lines->getSpeed(i);
+        bool fastTraverse = lines->isFastTraverse(i);
 
-        if (!qIsNaN(length) && !qIsNaN(ls->getSpeed()) && ls->getSpeed() != 0) time +=
-                length / ((ui->slbFeedOverride->isChecked() && !ls->isFastTraverse())
-                          ? (ls->getSpeed() * ui->slbFeedOverride->value() / 100) :
-                            (ui->slbRapidOverride->isChecked() && ls->isFastTraverse())
-                             ? (ls->getSpeed() * ui->slbRapidOverride->value() / 100) : ls->getSpeed());        // TODO: Update for rapid override
+        if (!qIsNaN(length) && !qIsNaN(speed) && speed != 0) time +=
+                length / ((ui->slbFeedOverride->isChecked() && !fastTraverse)
+                          ? (speed * ui->slbFeedOverride->value() / 100) :
+                            (ui->slbRapidOverride->isChecked() && fastTraverse)
+                             ? (speed * ui->slbRapidOverride->value() / 100) : speed);        // TODO: Update for rapid override
 
 //        qDebug() << "length/time:" << length << ((ui->chkFeedOverride->isChecked() && !ls->isFastTraverse())
 //                                                 ? (ls->getSpeed() * ui->txtFeed->value() / 100) : ls->getSpeed())
@@ -1203,36 +1242,35 @@ void frmMain::onActSendFromLineTriggered()
     // Set parser state
     if (m_settings->autoLine()) {
         GcodeViewParse *parser = m_currentDrawer->viewParser();
-        QList<LineSegment*> list = parser->getLineSegmentList();
+        LineSegmentStore *list = parser->getLines();
         QVector<QList<int>> lineIndexes = parser->getLinesIndexes();
 
         int lineNumber = m_currentModel->data(m_currentModel->index(commandIndex, 4)).toInt();
-        LineSegment* firstSegment = list.at(lineIndexes.at(lineNumber).first());
-        LineSegment* lastSegment = list.at(lineIndexes.at(lineNumber).last());
-        LineSegment* feedSegment = lastSegment;
-        int segmentIndex = list.indexOf(feedSegment);
-        while (feedSegment->isFastTraverse() && segmentIndex > 0) feedSegment = list.at(--segmentIndex);
+        int firstSegment = lineIndexes.at(lineNumber).first();
+        int lastSegment = lineIndexes.at(lineNumber).last();
+        int feedSegment = lastSegment;
+        while (list->isFastTraverse(feedSegment) && feedSegment > 0) feedSegment--;
 
         QStringList commands;
 
-        commands.append(QString("M3 S%1").arg(qMax<double>(lastSegment->getSpindleSpeed(), ui->slbSpindle->value())));
+        commands.append(QString("M3 S%1").arg(qMax<double>(list->getSpindleSpeed(lastSegment), ui->slbSpindle->value())));
 
         commands.append(QString("G21 G90 G0 X%1 Y%2")
-                        .arg(firstSegment->getStart().x())
-                        .arg(firstSegment->getStart().y()));
+                        .arg(list->getStart(firstSegment).x())
+                        .arg(list->getStart(firstSegment).y()));
         commands.append(QString("G1 Z%1 F%2")
-                        .arg(firstSegment->getStart().z())
-                        .arg(feedSegment->getSpeed()));
+                        .arg(list->getStart(firstSegment).z())
+                        .arg(list->getSpeed(feedSegment)));
 
         commands.append(QString("%1 %2 %3 F%4")
-                        .arg(lastSegment->isMetric() ? "G21" : "G20")
-                        .arg(lastSegment->isAbsolute() ? "G90" : "G91")
-                        .arg(lastSegment->isFastTraverse() ? "G0" : "G1")
-                        .arg(lastSegment->isMetric() ? feedSegment->getSpeed() : feedSegment->getSpeed() / 25.4));
-
-        if (lastSegment->isArc()) {
-            commands.append(lastSegment->plane() == PointSegment::XY ? "G17"
-            : lastSegment->plane() == PointSegment::ZX ? "G18" : "G19");
+                        .arg(list->isMetric(lastSegment) ? "G21" : "G20")
+                        .arg(list->isAbsolute(lastSegment) ? "G90" : "G91")
+                        .arg(list->isFastTraverse(lastSegment) ? "G0" : "G1")
+                        .arg(list->isMetric(lastSegment) ? list->getSpeed(feedSegment) : list->getSpeed(feedSegment) / 25.4));
+
+        if (list->isArc(lastSegment)) {
+            commands.append(list->plane(lastSegment) == PointSegment::XY ? "G17"
+            : list->plane(lastSegment) == PointSegment::ZX ? "G18" : "G19");
         }
 
         QMessageBox box(this);
@@ -1253,21 +1291,18 @@ void frmMain::onActSendFromLineTriggered()
 
     m_machine->resetFile(commandIndex);
 
-    QList<LineSegment*> list = m_viewParser.getLineSegmentList();
+    LineSegmentStore *list = m_viewParser.getLines();
 
     QList<int> indexes;
-    for (int i = 0; i < list.count(); i++) {
-        list[i]->setDrawn(list.at(i)->getLineNumber() < m_currentModel->data().at(commandIndex).line);
+    for (int i = 0; i < list->count(); i++) {
+        list->setDrawn(i, list->getLineNumber(i) < m_currentModel->line(commandIndex));
         indexes.append(i);
     }
     m_codeDrawer->update(indexes);
 
     ui->tblProgram->setUpdatesEnabled(false);
 
-    for (int i = 0; i < m_currentModel->data().count() - 1; i++) {
-        m_currentModel->data()[i].state = i < commandIndex ? GCodeItem::Skipped : GCodeItem::InQueue;
-        m_currentModel->data()[i].response = QString();
-    }
+    m_currentModel->resetStates(commandIndex);
     ui->tblProgram->setUpdatesEnabled(true);
     ui->glwVisualizer->setSpendTime(QTime(0, 0, 0));
 
@@ -1312,6 +1347,10 @@ void frmMain::onTableCellChanged(QModelIndex i1, QModelIndex i2)
     GCodeTableModel *model = (GCodeTableModel*)sender();
 
     if (i1.column() != 1) return;
+
+    // Edited line was the empty last one
+    bool appended = i1.row() == (model->rowCount() - 1);
+
     // Inserting new line at end
     if (i1.row() == (model->rowCount() - 1) && model->data(model->index(i1.row(), 1)).toString() != "") {
         model->setData(model->index(model->rowCount() - 1, 2), GCodeItem::InQueue);
@@ -1325,19 +1364,16 @@ void frmMain::onTableCellChanged(QModelIndex i1, QModelIndex i2)
 
     if (!m_programLoading) {
 
-        // Clear cached args
-        model->setData(model->index(i1.row(), 5), QVariant());
-
         // Drop heightmap cache
         if (m_currentModel == &m_programModel) m_programHeightmapModel.clear();
 
         // Update visualizer
-        updateParser();
+        updateParser(i1.row(), appended ? 0 : 1, 1);
 
         // Hightlight w/o current cell changed event (double hightlight on current cell changed)
-        QList<LineSegment*> list = m_viewParser.getLineSegmentList();
-        for (int i = 0; i < list.count() && list[i]->getLineNumber() <= m_currentModel->data(m_currentModel->index(i1.row(), 4)).toInt(); i++) {
-            list[i]->setIsHightlight(true);
+        LineSegmentStore *list = m_viewParser.getLines();
+        for (int i = 0; i < list->count() && list->getLineNumber(i) <= m_currentModel->data(m_currentModel->index(i1.row(), 4)).toInt(); i++) {
+            list->setIsHightlight(i, true);
         }
     }
 }
@@ -1349,13 +1385,13 @@ void frmMain::onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2)
     if (idx2.row() > m_currentModel->rowCount() - 2) idx2 = m_currentModel->index(m_currentModel->rowCount() - 2, 0);
 
     GcodeViewParse *parser = m_currentDrawer->viewParser();
-    QList<LineSegment*> list = parser->getLineSegmentList();
+    LineSegmentStore *list = parser->getLines();
     QVector<QList<int>> lineIndexes = parser->getLinesIndexes();
 
     // Update linesegments on cell changed
     if (!m_currentDrawer->geometryUpdated()) {
-        for (int i = 0; i < list.count(); i++) {
-            list.at(i)->setIsHightlight(list.at(i)->getLineNumber() <= m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt());
+        for (int i = 0; i < list->count(); i++) {
+            list->setIsHightlight(i, list->getLineNumber(i) <= m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt());
         }
     // Update vertices on current cell changed
     } else {
@@ -1368,14 +1404,14 @@ void frmMain::onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2)
         QList<int> indexes;
         for (int i = lineFirst + 1; i <= lineLast; i++) {
             foreach (int l, lineIndexes.at(i)) {
-                list.at(l)->setIsHightlight(idx1.row() > idx2.row());
+                list->setIsHightlight(l, idx1.row() > idx2.row());
                 indexes.append(l);
             }
         }
 
         m_selectionDrawer.setEndPosition(indexes.isEmpty() ? QVector3D(sNan, sNan, sNan) :
-            (m_codeDrawer->getIgnoreZ() ? QVector3D(list.at(indexes.last())->getEnd().x(), list.at(indexes.last())->getEnd().y(), 0)
-                                        : list.at(indexes.last())->getEnd()));
+            (m_codeDrawer->getIgnoreZ() ? QVector3D(list->getEnd(indexes.last()).x(), list->getEnd(indexes.last()).y(), 0)
+                                        : list->getEnd(indexes.last())));
         m_selectionDrawer.update();
 
         if (!indexes.isEmpty()) m_currentDrawer->update(indexes);
@@ -1384,7 +1420,7 @@ void frmMain::onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2)
     // Update selection marker
     int line = m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt();
     if (line > 0 && !lineIndexes.at(line).isEmpty()) {
-        QVector3D pos = list.at(lineIndexes.at(line).last())->getEnd();
+        QVector3D pos = list->getEnd(lineIndexes.at(line).last());
         m_selectionDrawer.setEndPosition(m_codeDrawer->getIgnoreZ() ? QVector3D(pos.x(), pos.y(), 0) : pos);
     } else {
         m_selectionDrawer.setEndPosition(QVector3D(sNan, sNan, sNan));
@@ -1392,6 +1428,39 @@ void frmMain::onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2)
     m_selectionDrawer.update();
 }
 
+// Table row of toolpath segment under visualizer point, -1 if none
+int frmMain::visualizerRow(const QPoint &pos)
+{
+    int segment = m_currentDrawer->segmentAt(pos, PICKRADIUS);
+    if (segment < 0) return -1;
+
+    return m_currentModel->rowOfLine(m_currentDrawer->viewParser()->getLines()->getLineNumber(segment));
+}
+
+void frmMain::onVisualizerPointClicked(QPoint pos)
+{
+    if (m_machine->processingFile()) return;
+
+    int row = visualizerRow(pos);
+    if (row < 0) return;
+
+    ui->tblProgram->setCurrentIndex(m_currentModel->index(row, 1));
+    ui->tblProgram->scrollTo(m_currentModel->index(row, 1));
+}
+
+void frmMain::onVisualizerPointHovered(QPoint pos)
+{
+    int row = visualizerRow(pos);
+
+    if (row < 0) {
+        QToolTip::hideText();
+        return;
+    }
+
+    QToolTip::showText(ui->glwVisualizer->mapToGlobal(pos), QString("%1: %2").arg(row + 1).arg(m_currentModel->command(row)),
+                       ui->glwVisualizer);
+}
+
 void frmMain::onTableInsertLine()
 {
     if (ui->tblProgram->selectionModel()->selectedRows().count() == 0 || m_machine->processingFile()) return;
@@ -1401,7 +1470,7 @@ void frmMain::onTableInsertLine()
     m_currentModel->insertRow(row);
     m_currentModel->setData(m_currentModel->index(row, 2), GCodeItem::InQueue);
 
-    updateParser();
+    updateParser(row, 0, 1);
     m_cellChanged = true;
     ui->tblProgram->selectRow(row);
 }
@@ -1424,7 +1493,7 @@ void frmMain::onTableDeleteLines()
     // Drop heightmap cache
     if (m_currentModel == &m_programModel) m_programHeightmapModel.clear();
 
-    updateParser();
+    updateParser(firstRow.row(), rowsCount, 0);
     m_cellChanged = true;
     ui->tblProgram->selectRow(firstRow.row());
 }
@@ -1456,9 +1525,14 @@ void frmMain::on_actServiceSettings_triggered()
             }
 
         m_connection.setConnType(m_settings->connType());
+        // Applied on next connection
+        m_connection.setBufferLength(m_settings->rxBufferSize());
 
         updateControlsState();
         applySettings();
+
+        // Coordinates precision follows units
+        onMachinePositionChanged();
     } else {
         m_settings->undo();
     }
@@ -1519,10 +1593,10 @@ void frmMain::applySettings() {
     m_codeDrawer->setIgnoreZ(m_settings->grayscaleSegments() || !m_settings->drawModeVectors());
     m_codeDrawer->setGrayscaleSegments(m_settings->grayscaleSegments());
     m_codeDrawer->setGrayscaleCode(m_settings->grayscaleSCode() ? GcodeDrawer::S : GcodeDrawer::Z);
+    m_codeDrawer->setRasterMemoryLimit(m_settings->rasterMemoryLimit());
     m_codeDrawer->setDrawMode(m_settings->drawModeVectors() ? GcodeDrawer::Vectors : GcodeDrawer::Raster);
     m_codeDrawer->setGrayscaleMin(m_settings->laserPowerMin());
     m_codeDrawer->setGrayscaleMax(m_settings->laserPowerMax());
-    m_codeDrawer->update();    
 
     m_selectionDrawer.setColor(m_settings->colors("ToolpathHighlight"));
 
@@ -1576,57 +1650,103 @@ void frmMain::updateParser()
 
     GcodeViewParse *parser = m_currentDrawer->viewParser();
 
-    GcodeParser gp;
-    gp.setTraverseSpeed(m_settings->rapidSpeed());
-    if (m_codeDrawer->getIgnoreZ()) gp.reset(QVector3D(qQNaN(), qQNaN(), 0));
+    // Snapshot of command references, last row is always empty
+    QVector<int> sources = m_currentModel->sources();
+    sources.removeLast();
+
+    GcodeParseThread parseThread;
+    parseThread.setRows(m_currentModel->reader(), sources, m_currentModel->editedCommands());
+    parseThread.setChunkSize(PROGRESSSTEP);
+    parseThread.setTraverseSpeed(m_settings->rapidSpeed());
+    parseThread.setArcPrecision(m_settings->arcPrecision(), m_settings->arcDegreeMode());
+    if (m_codeDrawer->getIgnoreZ()) parseThread.setInitialPoint(QVector3D(qQNaN(), qQNaN(), 0));
+
+    parser->reset();
 
     ui->tblProgram->setUpdatesEnabled(false);
+    parseProgram(&parseThread, m_currentModel, m_currentDrawer, tr("Updating..."), false);
+    ui->tblProgram->setUpdatesEnabled(true);
 
-    QString stripped;
-    QList<QString> args;
+    updateProgramEstimatedTime(parser->getLines());
+    ui->glwVisualizer->updateExtremes(m_currentDrawer);
+    updateControlsState();
 
-    QProgressDialog progress(tr("Updating..."), tr("Abort"), 0, m_currentModel->rowCount() - 2, this);
-    progress.setWindowModality(Qt::WindowModal);
-    progress.setFixedSize(progress.sizeHint());
+    if (m_currentModel == &m_programModel) m_fileChanged = true;
 
-    if (m_currentModel->rowCount() > PROGRESSMINLINES) {
-        progress.show();
-        progress.setStyleSheet("QProgressBar {text-align: center; qproperty-format: \"\"}");
-    }
+    qDebug() << "Update parser time: " << time.elapsed();
+}
 
-    for (int i = 0; i < m_currentModel->rowCount() - 1; i++) {
-        // Get stored args
-        args = m_currentModel->data().at(i).args;
+// Re-parses program after rows [row, row + removed) were replaced by 'inserted' rows.
+// Parsing starts from the nearest checkpoint before edited rows and stops as soon as
+// parser state matches previous results, which are spliced then.
+void frmMain::updateParser(int row, int removed, int inserted)
+{
+    QTime time;
 
-        // Store args if none
-        if (args.isEmpty()) {
-            stripped = GcodePreprocessorUtils::removeComment(m_currentModel->data().at(i).command);
-            args = GcodePreprocessorUtils::splitCommand(stripped);
-            m_currentModel->data()[i].args = args;
-        }
+    qDebug() << "updating parser incrementally:" << row << removed << inserted;
+    time.start();
 
-        // Add command to parser
-        gp.addCommand(args);
+    GcodeViewParse *parser = m_currentDrawer->viewParser();
+    const QVector<GcodeParseCheckpoint> &checkpoints = parser->getCheckpoints();
 
-        // Update table model
-        m_currentModel->data()[i].state = GCodeItem::InQueue;
-        m_currentModel->data()[i].response = QString();
-        m_currentModel->data()[i].line = gp.getCommandNumber();
+    // Nearest checkpoint before edited rows
+    int first = checkpoints.count() - 1;
+    while (first > 0 && checkpoints.at(first).row >= row) first--;
 
-        if (progress.isVisible() && (i % PROGRESSSTEP == 0)) {
-            progress.setValue(i);
-            qApp->processEvents();
-            if (progress.wasCanceled()) break;
-        }
+    if (first < 0) {
+        updateParser();
+        return;
     }
-    progress.close();
 
+    // Previous results following edited rows
+    int targetFirst = first + 1;
+    while (targetFirst < checkpoints.count() && checkpoints.at(targetFirst).row < row + removed) targetFirst++;
+
+    QVector<GcodeParseCheckpoint> targets = checkpoints.mid(targetFirst);
+    for (int i = 0; i < targets.count(); i++) targets[i].row += inserted - removed;
+
+    // Snapshot of command references, last row is always empty
+    QVector<int> sources = m_currentModel->sources();
+    sources.removeLast();
+
+    GcodeParseThread parseThread;
+    parseThread.setRows(m_currentModel->reader(), sources, m_currentModel->editedCommands());
+    parseThread.setChunkSize(PROGRESSSTEP);
+    parseThread.setTraverseSpeed(m_settings->rapidSpeed());
+    parseThread.setArcPrecision(m_settings->arcPrecision(), m_settings->arcDegreeMode());
+    if (m_codeDrawer->getIgnoreZ()) parseThread.setInitialPoint(QVector3D(qQNaN(), qQNaN(), 0));
+    parseThread.setStartCheckpoint(checkpoints.at(first));
+    parseThread.setTargetCheckpoints(targets);
+
+    GcodeParseSplice splice;
+
+    ui->tblProgram->setUpdatesEnabled(false);
+    parseProgram(&parseThread, m_currentModel, m_currentDrawer, tr("Updating..."), false, &splice);
     ui->tblProgram->setUpdatesEnabled(true);
 
-    parser->reset();
+    // Find previous results matching re-parsed ones
+    int last = -1;
+    if (splice.converged) {
+        for (int i = 0; i < targets.count(); i++) if (targets.at(i).row == splice.end.row) last = targetFirst + i;
+    }
+
+    int rowFirst = checkpoints.at(first).row;
+    int segmentFirst = checkpoints.at(first).segmentCount;
+    int segmentLast = last >= 0 ? checkpoints.at(last).segmentCount : parser->getLines()->count();
+    int lineDelta = last >= 0 ? splice.end.state.commandNumber - checkpoints.at(last).state.commandNumber : 0;
+
+    parser->spliceLines(first, last, inserted - removed, splice.segments, splice.checkpoints, splice.end);
+
+    // Shift line numbers of rows following re-parsed ones
+    if (lineDelta != 0) {
+        for (int i = splice.end.row; i < m_currentModel->rowCount() - 1; i++) m_currentModel->setLine(i, m_currentModel->line(i) + lineDelta);
+    }
 
-    updateProgramEstimatedTime(parser->getLinesFromParser(&gp, m_settings->arcPrecision(), m_settings->arcDegreeMode()));
-    m_currentDrawer->update();
+    qDebug() << "re-parsed rows:" << rowFirst << (last >= 0 ? splice.end.row : m_currentModel->rowCount() - 1)
+             << "segments:" << segmentLast - segmentFirst << "->" << splice.segments.lines.count();
+
+    updateProgramEstimatedTime(parser->getLines());
+    m_currentDrawer->update(segmentFirst, segmentLast - segmentFirst, splice.segments.lines.count());
     ui->glwVisualizer->updateExtremes(m_currentDrawer);
     updateControlsState();
 
@@ -1635,6 +1755,95 @@ void frmMain::updateParser()
     qDebug() << "Update parser time: " << time.elapsed();
 }
 
+// Runs background parser, applying results to model & drawer as chunks come in.
+// Incremental parsing results are collected to splice instead, it can't be aborted.
+// Returns false if parsing was aborted.
+bool frmMain::parseProgram(GcodeParseThread *thread, GCodeTableModel *model, GcodeDrawer *drawer,
+                           const QString &text, bool fitView, GcodeParseSplice *splice)
+{
+    GcodeViewParse *parser = drawer->viewParser();
+
+    QProgressDialog progress(text, tr("Abort"), thread->firstLine(), thread->progressMaximum(), this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setFixedSize(progress.sizeHint());
+    progress.setStyleSheet("QProgressBar {text-align: center; qproperty-format: \"\"}");
+
+    // Incremental parsing usually stops early, progress is shown if it takes a while.
+    // It can't be aborted, partial results can't be spliced.
+    if (thread->isIncremental()) progress.setCancelButton(NULL);
+    else if (thread->lineCount() > PROGRESSMINLINES) progress.show();
+
+    QTime elapsedTime;
+    elapsedTime.start();
+
+    QTime refreshTime;
+    refreshTime.start();
+
+    QEventLoop loop;
+
+    // Segments shown so far, new ones are appended to drawer geometry
+    int drawnSegments = parser->getLines()->count();
+
+    connect(thread, &GcodeParseThread::chunkReady, &loop, [&] (GcodeParseChunk chunk) {
+        if (chunk.converged) {
+            splice->converged = true;
+            splice->end = chunk.checkpoint;
+            return;
+        }
+
+        // Fill table
+        if (!chunk.sources.isEmpty()) {
+            for (int i = 0; i < chunk.sources.count(); i++) model->appendSourceRow(chunk.sources.at(i), chunk.lines.at(i));
+        // Update table
+        } else {
+            for (int i = 0; i < chunk.lines.count(); i++) {
+                int row = chunk.firstRow + i;
+                model->setState(row, GCodeItem::InQueue);
+                model->setResponse(row, QString());
+                model->setLine(row, chunk.lines.at(i));
+            }
+        }
+
+        if (splice) {
+            splice->segments.append(chunk.segments);
+            splice->checkpoints.append(chunk.checkpoint);
+        } else {
+            parser->appendLines(chunk.segments);
+            parser->appendCheckpoint(chunk.checkpoint);
+
+            // Show toolpath progressively
+            if (refreshTime.elapsed() > PARSERREFRESH) {
+                drawer->update(drawnSegments, 0, parser->getLines()->count() - drawnSegments);
+                drawnSegments = parser->getLines()->count();
+                if (fitView) ui->glwVisualizer->fitDrawable(drawer); else ui->glwVisualizer->updateExtremes(drawer);
+                refreshTime.start();
+            }
+        }
+
+        if (progress.isVisible()) {
+            progress.setValue(chunk.position);
+        } else if (elapsedTime.elapsed() > PROGRESSDELAY) {
+            // Restart event loop to accept user input
+            progress.show();
+            progress.setValue(chunk.position);
+            loop.exit(1);
+        }
+    });
+    connect(thread, &QThread::finished, &loop, &QEventLoop::quit);
+    if (!thread->isIncremental()) connect(&progress, &QProgressDialog::canceled, thread, &GcodeParseThread::cancel, Qt::DirectConnection);
+
+    // User input is left to the modal progress dialog
+    thread->start();
+    while (loop.exec(progress.isVisible() ? QEventLoop::AllEvents : QEventLoop::ExcludeUserInputEvents) == 1);
+    thread->wait();
+
+    if (!splice) drawer->update(drawnSegments, 0, parser->getLines()->count() - drawnSegments);
+
+    progress.close();
+
+    return !thread->isCanceled();
+}
+
 void frmMain::on_cmdCommandSend_clicked()
 {
     m_machine->cmdCommandSend();
@@ -1728,11 +1937,11 @@ void frmMain::on_cmdFileReset_clicked()
 
         time.start();
 
-        QList<LineSegment*> list = m_viewParser.getLineSegmentList();
+        LineSegmentStore *list = m_viewParser.getLines();
 
         QList<int> indexes;
-        for (int i = 0; i < list.count(); i++) {
-            list[i]->setDrawn(false);
+        for (int i = 0; i < list->count(); i++) {
+            list->setDrawn(i, false);
             indexes.append(i);
         }
         m_codeDrawer->update(indexes);
@@ -1743,10 +1952,7 @@ void frmMain::on_cmdFileReset_clicked()
 
         ui->tblProgram->setUpdatesEnabled(false);
 
-        for (int i = 0; i < m_currentModel->data().count() - 1; i++) {
-            m_currentModel->data()[i].state = GCodeItem::InQueue;
-            m_currentModel->data()[i].response = QString();
-        }
+        m_currentModel->resetStates();
         ui->tblProgram->setUpdatesEnabled(true);
 
         qDebug() << "table updated:" << time.elapsed();
@@ -1791,7 +1997,7 @@ void frmMain::on_actFileNew_triggered()
         m_codeDrawer->update();
         m_currentDrawer = m_codeDrawer;
         ui->glwVisualizer->fitDrawable();
-        updateProgramEstimatedTime(QList<LineSegment*>());
+        updateProgramEstimatedTime(NULL);
 
         m_programFileName = "";
         ui->chkHeightMapUse->setChecked(false);
@@ -1838,21 +2044,34 @@ void frmMain::on_cmdClearConsole_clicked()
 
 bool frmMain::saveProgramToFile(QString fileName, GCodeTableModel *model)
 {
-    QFile file(fileName);
-    QDir dir;
+    QSaveFile file(fileName);
 
     qDebug() << "Saving program";
 
-    if (file.exists()) dir.remove(file.fileName());
     if (!file.open(QIODevice::WriteOnly)) return false;
 
     QTextStream textStream(&file);
+    textStream.setCodec("UTF-8");
 
     for (int i = 0; i < model->rowCount() - 1; i++) {
         textStream << model->data(model->index(i, 1)).toString() << "\r\n";
     }
 
-    file.close();
+    textStream.flush();
+
+    // Mapped program file can't be replaced
+    const GcodeFileReader *programReader = m_programModel.reader();
+    if (programReader && !programReader->fileName().isEmpty() && QFileInfo(programReader->fileName()) == QFileInfo(fileName)) {
+        m_programModel.detachReader();
+    }
+
+    if (!file.commit()) return false;
+
+    // Program rows are read from saved file then
+    if (model == &m_programModel) {
+        GcodeFileReader *reader = new GcodeFileReader();
+        if (!reader->open(fileName) || !model->rebase(reader)) delete reader;
+    }
 
     return true;
 }
@@ -2483,17 +2702,17 @@ void frmMain::on_cmdHeightMapMode_toggled(bool checked)
 
             if (!ui->chkHeightMapUse->isChecked()) {
                 ui->glwVisualizer->updateExtremes(m_codeDrawer);
-                updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
+                updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLines());
             }
         }
     }
 
     // Shadow toolpath
-    QList<LineSegment*> list = m_viewParser.getLineSegmentList();
+    LineSegmentStore *list = m_viewParser.getLines();
     QList<int> indexes;
-    for (int i = m_machine->lastDrawnLineIndex(); i < list.count(); i++) {
-        list[i]->setDrawn(checked);
-        list[i]->setIsHightlight(false);
+    for (int i = m_machine->lastDrawnLineIndex(); i < list->count(); i++) {
+        list->setDrawn(i, checked);
+        list->setIsHightlight(i, false);
         indexes.append(i);
     }
     // Update only vertex color.
@@ -2693,7 +2912,7 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
         if (m_programHeightmapModel.rowCount() == 0) {
 
             // Modifying linesegments
-            QList<LineSegment*> *list = m_viewParser.getLines();
+            LineSegmentStore *list = m_viewParser.getLines();
             QRectF borderRect = borderRectFromTextboxes();
             double x, y, z;
             QVector3D point;
@@ -2702,26 +2921,22 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
             progress.setMaximum(list->count() - 1);
             time.start();
 
+            LineSegmentStore subdivided;
+            subdivided.reserve(list->count());
+
             for (int i = 0; i < list->count(); i++) {
-                if (!list->at(i)->isZMovement()) {
-                    QList<LineSegment*> subSegments = subdivideSegment(list->at(i));
-
-                    if (subSegments.count() > 0) {
-                        delete list->at(i);
-                        list->removeAt(i);
-                        foreach (LineSegment* subSegment, subSegments) list->insert(i++, subSegment);
-                        i--;
-                    }
-                }
+                if (list->isZMovement(i)) subdivided.append(*list, i, list->getStart(i), list->getEnd(i));
+                else subdivideSegment(list, i, &subdivided);
 
                 if (progress.isVisible() && (i % PROGRESSSTEP == 0)) {
-                    progress.setMaximum(list->count() - 1);
                     progress.setValue(i);
                     qApp->processEvents();
                     if (progress.wasCanceled()) throw cancel;
                 }
             }
 
+            *list = subdivided;
+
             qDebug() << "Subdivide time: " << time.elapsed();
 
             progress.setLabelText(tr("Updating Z-coordinates..."));
@@ -2730,16 +2945,16 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
 
             for (int i = 0; i < list->count(); i++) {
                 if (i == 0) {
-                    x = list->at(i)->getStart().x();
-                    y = list->at(i)->getStart().y();
-                    z = list->at(i)->getStart().z() + Interpolation::bicubicInterpolate(borderRect, &m_heightMapModel, x, y);
-                    list->at(i)->setStart(QVector3D(x, y, z));
-                } else list->at(i)->setStart(list->at(i - 1)->getEnd());
+                    x = list->getStart(i).x();
+                    y = list->getStart(i).y();
+                    z = list->getStart(i).z() + Interpolation::bicubicInterpolate(borderRect, &m_heightMapModel, x, y);
+                    list->setStart(i, QVector3D(x, y, z));
+                } else list->setStart(i, list->getEnd(i - 1));
 
-                x = list->at(i)->getEnd().x();
-                y = list->at(i)->getEnd().y();
-                z = list->at(i)->getEnd().z() + Interpolation::bicubicInterpolate(borderRect, &m_heightMapModel, x, y);
-                list->at(i)->setEnd(QVector3D(x, y, z));
+                x = list->getEnd(i).x();
+                y = list->getEnd(i).y();
+                z = list->getEnd(i).z() + Interpolation::bicubicInterpolate(borderRect, &m_heightMapModel, x, y);
+                list->setEnd(i, QVector3D(x, y, z));
 
                 if (progress.isVisible() && (i % PROGRESSSTEP == 0)) {
                     progress.setValue(i);
@@ -2756,10 +2971,10 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
 
             // Modifying g-code program
             QString command;
-            QStringList args;
+            GcodeTokenizer words;
+            QString arg;
             int line;
             QString newCommand;
-            GCodeItem item;
             int lastSegmentIndex = 0;
             int lastCommandIndex = -1;
 
@@ -2777,24 +2992,24 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
 
             m_programLoading = true;
             for (int i = 0; i < m_programModel.rowCount() - 1; i++) {
-                command = m_programModel.data().at(i).command;
-                line = m_programModel.data().at(i).line;
+                command = m_programModel.command(i);
+                line = m_programModel.line(i);
                 isLinearMove = false;
                 hasCommand = false;
 
                 if (line < 0 || line == lastCommandIndex || lastSegmentIndex == list->count() - 1) {
-                    item.command = command;
-                    m_programHeightmapModel.data().append(item);
+                    m_programHeightmapModel.appendRow(command);
                 } else {
-                    // Get commands args
-                    args = m_programModel.data().at(i).args;
+                    // Split command to words
+                    words.tokenize(command);
                     newCommand.clear();
 
-                    // Parse command args
-                    foreach (QString arg, args) {                   // arg examples: G1, G2, M3, X100...
-                        codeChar = arg.at(0).toLatin1();            // codeChar: G, M, X...
+                    // Parse command words
+                    for (int k = 0; k < words.count(); k++) {
+                        arg = words.text(k, command);              // arg examples: G1, G2, M3, X100...
+                        codeChar = words.at(k).letter;              // codeChar: G, M, X...
                         if (!coords.contains(codeChar)) {           // Not parameter
-                            codeNum = arg.mid(1).toDouble();
+                            codeNum = words.at(k).value;
                             if (g.contains(codeChar)) {             // 'G'-command
                                 // Store 'G0' & 'G1'
                                 if (codeNum == 0.0f || codeNum == 1.0f) {
@@ -2822,26 +3037,24 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
 
                     // Find first linesegment by command index
                     for (int j = lastSegmentIndex; j < list->count(); j++) {
-                        if (list->at(j)->getLineNumber() == line) {
-                            if (!qIsNaN(list->at(j)->getEnd().length()) && (isLinearMove || (!hasCommand && !lastCode.isEmpty()))) {
+                        if (list->getLineNumber(j) == line) {
+                            if (!qIsNaN(list->getEnd(j).length()) && (isLinearMove || (!hasCommand && !lastCode.isEmpty()))) {
                                 // Create new commands for each linesegment with given command index
-                                while ((j < list->count()) && (list->at(j)->getLineNumber() == line)) {
+                                while ((j < list->count()) && (list->getLineNumber(j) == line)) {
 
-                                    point = list->at(j)->getEnd();
-                                    if (!list->at(j)->isAbsolute()) point -= list->at(j)->getStart();
-                                    if (!list->at(j)->isMetric()) point /= 25.4;
+                                    point = list->getEnd(j);
+                                    if (!list->isAbsolute(j)) point -= list->getStart(j);
+                                    if (!list->isMetric(j)) point /= 25.4;
 
-                                    item.command = newCommand + QString("X%1Y%2Z%3")
-                                            .arg(point.x(), 0, 'f', 3).arg(point.y(), 0, 'f', 3).arg(point.z(), 0, 'f', 3);
-                                    m_programHeightmapModel.data().append(item);
+                                    m_programHeightmapModel.appendRow(newCommand + QString("X%1Y%2Z%3")
+                                            .arg(point.x(), 0, 'f', 3).arg(point.y(), 0, 'f', 3).arg(point.z(), 0, 'f', 3));
 
                                     if (!newCommand.isEmpty()) newCommand.clear();
                                     j++;
                                 }
                             // Copy original command if not G0 or G1
                             } else {
-                                item.command = command;
-                                m_programHeightmapModel.data().append(item);
+                                m_programHeightmapModel.appendRow(command);
                             }
 
                             lastSegmentIndex = j;
@@ -2920,10 +3133,10 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
     ui->actFileSaveTransformedAs->setVisible(checked);
 }
 
-QList<LineSegment*> frmMain::subdivideSegment(LineSegment* segment)
+// Appends segment pieces, sized by heightmap interpolation step, to target.
+// Segment is copied as is if can't be subdivided.
+int frmMain::subdivideSegment(const LineSegmentStore *source, int index, LineSegmentStore *target)
 {
-    QList<LineSegment*> list;
-
     QRectF borderRect = borderRectFromTextboxes();
 
     double interpolationStepX = borderRect.width() / (ui->txtHeightMapInterpolationStepX->value() - 1);
@@ -2931,9 +3144,14 @@ QList<LineSegment*> frmMain::subdivideSegment(LineSegment* segment)
 
     double length;
 
-    QVector3D vec = segment->getEnd() - segment->getStart();
+    QVector3D start = source->getStart(index);
+    QVector3D end = source->getEnd(index);
+    QVector3D vec = end - start;
 
-    if (qIsNaN(vec.length())) return QList<LineSegment*>();
+    if (qIsNaN(vec.length())) {
+        target->append(*source, index, start, end);
+        return 1;
+    }
 
     if (fabs(vec.x()) / fabs(vec.y()) < interpolationStepX / interpolationStepY) length = interpolationStepY / (vec.y() / vec.length());
     else length = interpolationStepX / (vec.x() / vec.length());
@@ -2941,30 +3159,31 @@ QList<LineSegment*> frmMain::subdivideSegment(LineSegment* segment)
     length = fabs(length);
 
     if (qIsNaN(length)) {
-        qDebug() << "ERROR length:" << segment->getStart() << segment->getEnd();
-        return QList<LineSegment*>();
+        qDebug() << "ERROR length:" << start << end;
+        target->append(*source, index, start, end);
+        return 1;
     }
 
     QVector3D seg = vec.normalized() * length;
     int count = trunc(vec.length() / length);
 
-    if (count == 0) return QList<LineSegment*>();
+    if (count == 0) {
+        target->append(*source, index, start, end);
+        return 1;
+    }
 
+    QVector3D point = start;
     for (int i = 0; i < count; i++) {
-        LineSegment* line = new LineSegment(segment);
-        line->setStart(i == 0 ? segment->getStart() : list[i - 1]->getEnd());
-        line->setEnd(line->getStart() + seg);
-        list.append(line);
+        target->append(*source, index, point, point + seg);
+        point += seg;
     }
 
-    if (list.count() > 0 && list.last()->getEnd() != segment->getEnd()) {
-        LineSegment* line = new LineSegment(segment);
-        line->setStart(list.last()->getEnd());
-        line->setEnd(segment->getEnd());
-        list.append(line);
+    if (point != end) {
+        target->append(*source, index, point, end);
+        count++;
     }
 
-    return list;
+    return count;
 }
 
 void frmMain::on_cmdHeightMapCreate_clicked()
@@ -42,6 +42,7 @@
 
 #include "CandleConnection.h"
 #include "Machine.h"
+#include "MachineState.h"
 
 #ifdef WINDOWS
     #include <QtWinExtras/QtWinExtras>
@@ -52,6 +53,10 @@ namespace Ui {
 class frmMain;
 }
 
+class GcodeFileReader;
+class GcodeParseThread;
+struct GcodeParseSplice;
+
 class CancelException : public std::exception {
 public:
 #ifdef Q_OS_MAC
@@ -104,6 +109,8 @@ public:
     {return m_heightMapModel;}
     GCodeTableModel& probeModel()
     {return m_probeModel;}
+    MachineState& machineState()
+    {return m_machineState;}
     bool& heightMapMode()
     {return m_heightMapMode;}
 
@@ -114,6 +121,9 @@ private slots:
 
     void onCommReadyRead();
     void onCommError(int);
+    void onMachinePositionChanged();
+    void onMachineFeedSpindleChanged();
+    void onMachinePinsChanged();
     void onTimerConnection();
     void onTimerStateQuery();
     void onVisualizatorRotationChanged();
@@ -124,6 +134,8 @@ private slots:
     void onActRecentFileTriggered();
     void onCboCommandReturnPressed();
     void onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2);
+    void onVisualizerPointClicked(QPoint pos);
+    void onVisualizerPointHovered(QPoint pos);
     void onConsoleResized(QSize size);
     void onPanelsSizeChanged(QSize size);
     void onCmdUserClicked(bool checked);
@@ -257,6 +269,7 @@ private:
     bool m_settingsLoading;
 
     CandleConnection m_connection;
+    MachineState m_machineState;
 
     frmSettings *m_settings;
     frmAbout m_frmAbout;
@@ -303,6 +316,7 @@ private:
 
     void loadFile(QString fileName);
     void loadFile(QList<QString> data);
+    void loadFile(GcodeFileReader *reader);
     void clearTable();
     void preloadSettings();
     void loadSettings();
@@ -311,11 +325,14 @@ private:
     void openPort();
     void applySettings();
     void updateParser();
+    void updateParser(int row, int removed, int inserted);
+    bool parseProgram(GcodeParseThread *thread, GCodeTableModel *model, GcodeDrawer *drawer, const QString &text, bool fitView,
+                      GcodeParseSplice *splice = NULL);
     bool dataIsFloating(QString data);
     bool dataIsEnd(QString data);
     bool dataIsReset(QString data);
 
-    QTime updateProgramEstimatedTime(QList<LineSegment *> lines);
+    QTime updateProgramEstimatedTime(const LineSegmentStore *lines);
     bool saveProgramToFile(QString fileName, GCodeTableModel *model);
     QString feedOverride(QString command);
 
@@ -335,7 +352,8 @@ private:
     bool saveHeightMap(QString fileName);
 
     GCodeTableModel *m_currentModel;
-    QList<LineSegment *> subdivideSegment(LineSegment *segment);
+    int subdivideSegment(const LineSegmentStore *source, int index, LineSegmentStore *target);
+    int visualizerRow(const QPoint &pos);
     void resizeTableHeightMapSections();
     void updateHeightMapGrid(double arg1);
     void resetHeightmap();
@@ -616,6 +616,26 @@ void frmSettings::setAutoLine(bool value)
     ui->chkAutoLine->setChecked(value);
 }
 
+int frmSettings::rxBufferSize()
+{
+    return ui->txtRxBufferSize->value();
+}
+
+void frmSettings::setRxBufferSize(int size)
+{
+    ui->txtRxBufferSize->setValue(size);
+}
+
+int frmSettings::rasterMemoryLimit()
+{
+    return ui->txtRasterMemoryLimit->value();
+}
+
+void frmSettings::setRasterMemoryLimit(int megabytes)
+{
+    ui->txtRasterMemoryLimit->setValue(megabytes);
+}
+
 void frmSettings::showEvent(QShowEvent *se)
 {
     Q_UNUSED(se)
@@ -663,6 +683,7 @@ void frmSettings::on_cmdDefaults_clicked()
     setBaud(115200);
 
     setIgnoreErrors(false);
+    setRxBufferSize(127);
 
     setQueryStateTime(40);
     setRapidSpeed(2000);
@@ -692,6 +713,7 @@ void frmSettings::on_cmdDefaults_clicked()
     setGrayscaleSegments(false);
     setGrayscaleSCode(true);
     setDrawModeVectors(true);
+    setRasterMemoryLimit(2048);
 
     setToolType(1);
     setToolAngle(15.0);
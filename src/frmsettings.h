@@ -124,6 +124,10 @@ public:
     void setIgnoreErrors(bool value);
     bool autoLine();
     void setAutoLine(bool value);
+    int rxBufferSize();
+    void setRxBufferSize(int size);
+    int rasterMemoryLimit();
+    void setRasterMemoryLimit(int megabytes);
 
 protected:
     void showEvent(QShowEvent *se);
@@ -16,6 +16,7 @@
 #include "parser/gcodeviewparse.h"
 
 #include "frmmain.h"
+#include "benchmark.h"
 
 int main(int argc, char *argv[])
 {
@@ -63,6 +64,10 @@ int main(int argc, char *argv[])
 
     a.setApplicationVersion(APP_VERSION);
 
+    // Headless benchmarks, e.g. --benchmark <file> [--output <file>]
+    int benchmarkResult = Benchmark::exec(a.arguments());
+    if (benchmarkResult >= 0) return benchmarkResult;
+
 #ifdef UNIX
     if (!styleOverrided) foreach (QString str, QStyleFactory::keys()) {
         qDebug() << "style" << str;
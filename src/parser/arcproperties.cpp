@@ -9,6 +9,13 @@
 
 ArcProperties::ArcProperties()
 {
+    isClockwise = false;
     radius = 0;
-    center = NULL;
+}
+
+ArcProperties::ArcProperties(const QVector3D &center, double radius, bool isClockwise)
+{
+    this->center = center;
+    this->radius = radius;
+    this->isClockwise = isClockwise;
 }
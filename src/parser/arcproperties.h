@@ -14,9 +14,12 @@ class ArcProperties
 {
 public:
     explicit ArcProperties();
+    ArcProperties(const QVector3D &center, double radius, bool isClockwise);
     bool isClockwise;
     double radius;
-    QVector3D *center;
+    QVector3D center;
 };
 
+Q_DECLARE_TYPEINFO(ArcProperties, Q_MOVABLE_TYPE);
+
 #endif // ARCPROPERTIES_H
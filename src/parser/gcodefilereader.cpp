@@ -0,0 +1,172 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <cstring>
+#include "gcodefilereader.h"
+
+GcodeFileReader::GcodeFileReader()
+{
+    m_map = NULL;
+    m_data = NULL;
+    m_size = 0;
+}
+
+GcodeFileReader::~GcodeFileReader()
+{
+    close();
+}
+
+bool GcodeFileReader::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+
+    m_size = m_file.size();
+
+    if (m_size > 0) {
+        m_map = m_file.map(0, m_size);
+
+        // Fallback to plain reading if mapping isn't supported
+        if (m_map) {
+            m_data = (const char*)m_map;
+        } else {
+            m_buffer = m_file.readAll();
+            m_data = m_buffer.constData();
+            m_size = m_buffer.size();
+        }
+    }
+
+    scanLines();
+
+    return true;
+}
+
+void GcodeFileReader::setData(const QByteArray &data)
+{
+    close();
+
+    m_buffer = data;
+    m_data = m_buffer.constData();
+    m_size = m_buffer.size();
+
+    scanLines();
+}
+
+void GcodeFileReader::close()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = NULL;
+    }
+    if (m_file.isOpen()) m_file.close();
+
+    m_buffer.clear();
+    m_data = NULL;
+    m_size = 0;
+    m_offsets.clear();
+}
+
+void GcodeFileReader::detach()
+{
+    if (m_map) {
+        m_buffer = QByteArray(m_data, m_size);
+        m_data = m_buffer.constData();
+
+        m_file.unmap(m_map);
+        m_map = NULL;
+    }
+    if (m_file.isOpen()) m_file.close();
+}
+
+bool GcodeFileReader::isOpen() const
+{
+    return m_data != NULL;
+}
+
+QString GcodeFileReader::fileName() const
+{
+    return m_file.fileName();
+}
+
+qint64 GcodeFileReader::size() const
+{
+    return m_size;
+}
+
+const char *GcodeFileReader::data() const
+{
+    return m_data;
+}
+
+int GcodeFileReader::lineCount() const
+{
+    return m_offsets.isEmpty() ? 0 : m_offsets.count() - 1;
+}
+
+const char *GcodeFileReader::lineData(int index) const
+{
+    return m_data + m_offsets.at(index);
+}
+
+int GcodeFileReader::lineLength(int index) const
+{
+    const char *begin = m_data + m_offsets.at(index);
+    const char *end = m_data + m_offsets.at(index + 1);
+
+    // Strip line terminator
+    if (end > begin && end[-1] == '\n') end--;
+    if (end > begin && end[-1] == '\r') end--;
+
+    return end - begin;
+}
+
+qint64 GcodeFileReader::lineOffset(int index) const
+{
+    return m_offsets.at(index);
+}
+
+void GcodeFileReader::trimmedLine(int index, const char **data, int *length) const
+{
+    const char *begin = lineData(index);
+    const char *end = begin + lineLength(index);
+
+    while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '\r' || *begin == '\f' || *begin == '\v')) begin++;
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\f' || end[-1] == '\v')) end--;
+
+    *data = begin;
+    *length = end - begin;
+}
+
+QString GcodeFileReader::trimmedLineString(int index) const
+{
+    const char *data;
+    int length;
+
+    trimmedLine(index, &data, &length);
+
+    return QString::fromUtf8(data, length);
+}
+
+void GcodeFileReader::scanLines()
+{
+    m_offsets.clear();
+    if (m_size == 0) return;
+
+    // Single pass over mapped data, storing line start offsets only
+    const char *begin = m_data;
+    const char *end = m_data + m_size;
+    const char *p = begin;
+
+    m_offsets.reserve(m_size / 24 + 1);
+
+    while (p < end) {
+        m_offsets.append(p - begin);
+        const char *next = (const char*)memchr(p, '\n', end - p);
+        p = next ? next + 1 : end;
+    }
+    m_offsets.append(m_size);
+
+    m_offsets.squeeze();
+}
@@ -0,0 +1,55 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GCODEFILEREADER_H
+#define GCODEFILEREADER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+#include <QString>
+
+// Read-only line view of a g-code program.
+// File contents are memory-mapped and scanned once for line offsets,
+// lines are accessed as raw byte ranges without per-line allocations.
+class GcodeFileReader
+{
+public:
+    GcodeFileReader();
+    ~GcodeFileReader();
+
+    bool open(const QString &fileName);
+    void setData(const QByteArray &data);
+    void close();
+    // Keeps contents in memory & releases file, so it can be replaced
+    void detach();
+
+    bool isOpen() const;
+    QString fileName() const;
+    qint64 size() const;
+    const char *data() const;
+    int lineCount() const;
+
+    // Line bytes w/o line terminator
+    const char *lineData(int index) const;
+    int lineLength(int index) const;
+    qint64 lineOffset(int index) const;
+
+    // Line bytes w/o leading & trailing whitespaces
+    void trimmedLine(int index, const char **data, int *length) const;
+    QString trimmedLineString(int index) const;
+
+private:
+    QFile m_file;
+    uchar *m_map;
+    QByteArray m_buffer;
+    const char *m_data;
+    qint64 m_size;
+
+    // Start offsets of lines, last item is the end of data
+    QVector<qint64> m_offsets;
+
+    void scanLines();
+};
+
+#endif // GCODEFILEREADER_H
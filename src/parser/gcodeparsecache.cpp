@@ -0,0 +1,394 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <cstring>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+#include "gcodeparsecache.h"
+#include "gcodefilereader.h"
+#include "gcodeviewparse.h"
+
+#define CACHEVERSION    1
+#define CACHEMAXFILES   10
+
+static const char cacheMagic[8] = {'C', 'N', 'D', 'L', 'P', 'R', 'S', 'C'};
+
+// Header & arrays are aligned to 8 bytes
+static void writePadding(QSaveFile &file)
+{
+    static const char zeros[8] = {0};
+    int padding = (8 - file.pos() % 8) % 8;
+    if (padding) file.write(zeros, padding);
+}
+
+template <typename T>
+static void writeValue(QSaveFile &file, const T &value)
+{
+    file.write((const char*)&value, sizeof(T));
+}
+
+// Data block is stored with its size
+static void writeBlock(QSaveFile &file, const char *data, qint64 size)
+{
+    writeValue(file, size);
+    file.write(data, size);
+    writePadding(file);
+}
+
+template <typename T>
+static void writeArray(QSaveFile &file, const QVector<T> &array)
+{
+    writeBlock(file, (const char*)array.constData(), array.count() * sizeof(T));
+}
+
+// Bounds-checked reading of mapped cache data
+class CacheDataReader
+{
+public:
+    CacheDataReader(const char *data, qint64 size) : m_begin(data), m_data(data), m_end(data + size), m_ok(true) {}
+
+    bool isOk() const { return m_ok; }
+
+    bool read(void *value, qint64 size)
+    {
+        if (!m_ok || size < 0 || m_end - m_data < size) return m_ok = false;
+        memcpy(value, m_data, size);
+        m_data += size;
+        return true;
+    }
+
+    template <typename T>
+    bool readValue(T *value)
+    {
+        return read(value, sizeof(T));
+    }
+
+    // Returns pointer to mapped block data
+    const char *readBlock(qint64 *size)
+    {
+        if (!readValue(size) || *size < 0 || *size > m_end - m_data) {
+            m_ok = false;
+            return NULL;
+        }
+
+        const char *data = m_data;
+        m_data += *size;
+        align();
+
+        return data;
+    }
+
+    template <typename T>
+    bool readArray(QVector<T> *array)
+    {
+        qint64 size;
+        const char *data = readBlock(&size);
+        if (!data || size % sizeof(T)) return m_ok = false;
+
+        array->resize(size / sizeof(T));
+        memcpy(array->data(), data, size);
+
+        return true;
+    }
+
+    void align()
+    {
+        int padding = (8 - (m_data - m_begin) % 8) % 8;
+        m_data = qMin(m_data + padding, m_end);
+    }
+
+private:
+    const char *m_begin;
+    const char *m_data;
+    const char *m_end;
+    bool m_ok;
+};
+
+static void writeCheckpoints(QDataStream &stream, const QVector<GcodeParseCheckpoint> &checkpoints)
+{
+    stream << checkpoints.count();
+
+    foreach (const GcodeParseCheckpoint &c, checkpoints) {
+        const GcodeParserState &s = c.state;
+
+        stream << c.row << c.currentLine << c.segmentCount;
+        stream << s.currentPoint << s.isMetric << s.inAbsoluteMode << s.inAbsoluteIJKMode << s.lastGcodeCommand
+               << (int)s.currentPlane << s.lastSpeed << s.lastSpindleSpeed << s.commandNumber;
+
+        stream << s.points.count();
+        foreach (const PointSegment &ps, s.points) {
+            stream << ps.point() << ps.getLineNumber() << ps.getSpeed() << ps.getSpindleSpeed() << ps.getDwell()
+                   << ps.arcIndex() << (int)ps.plane() << ps.isMetric() << ps.isZMovement() << ps.isFastTraverse()
+                   << ps.isAbsolute();
+        }
+
+        stream << s.arcs.count();
+        foreach (const ArcProperties &arc, s.arcs) stream << arc.center << arc.radius << arc.isClockwise;
+    }
+}
+
+static bool readCheckpoints(QDataStream &stream, QVector<GcodeParseCheckpoint> *checkpoints)
+{
+    int count;
+    stream >> count;
+    if (stream.status() != QDataStream::Ok || count < 0) return false;
+
+    checkpoints->resize(count);
+
+    for (int i = 0; i < count; i++) {
+        GcodeParseCheckpoint &c = (*checkpoints)[i];
+        GcodeParserState &s = c.state;
+        int plane;
+        int pointsCount;
+        int arcsCount;
+
+        stream >> c.row >> c.currentLine >> c.segmentCount;
+        stream >> s.currentPoint >> s.isMetric >> s.inAbsoluteMode >> s.inAbsoluteIJKMode >> s.lastGcodeCommand
+               >> plane >> s.lastSpeed >> s.lastSpindleSpeed >> s.commandNumber;
+        s.currentPlane = (PointSegment::planes)plane;
+
+        stream >> pointsCount;
+        if (stream.status() != QDataStream::Ok || pointsCount < 0 || pointsCount > 2) return false;
+
+        for (int j = 0; j < pointsCount; j++) {
+            QVector3D point;
+            int lineNumber, arcIndex;
+            double speed, spindleSpeed, dwell;
+            bool isMetric, isZMovement, isFastTraverse, isAbsolute;
+
+            stream >> point >> lineNumber >> speed >> spindleSpeed >> dwell >> arcIndex >> plane
+                   >> isMetric >> isZMovement >> isFastTraverse >> isAbsolute;
+
+            PointSegment ps(point, lineNumber);
+            ps.setSpeed(speed);
+            ps.setSpindleSpeed(spindleSpeed);
+            ps.setDwell(dwell);
+            ps.setArcIndex(arcIndex);
+            ps.setPlane((PointSegment::planes)plane);
+            ps.setIsMetric(isMetric);
+            ps.setIsZMovement(isZMovement);
+            ps.setIsFastTraverse(isFastTraverse);
+            ps.setIsAbsolute(isAbsolute);
+            s.points.append(ps);
+        }
+
+        stream >> arcsCount;
+        if (stream.status() != QDataStream::Ok || arcsCount < 0 || arcsCount > pointsCount) return false;
+
+        for (int j = 0; j < arcsCount; j++) {
+            ArcProperties arc;
+            stream >> arc.center >> arc.radius >> arc.isClockwise;
+            s.arcs.append(arc);
+        }
+
+        if (s.points.isEmpty()) return false;
+        foreach (const PointSegment &ps, s.points) if (ps.arcIndex() >= s.arcs.count()) return false;
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+GcodeParseCache::GcodeParseCache(const GcodeFileReader &reader, double arcPrecision, bool arcDegreeMode,
+                                 double traverseSpeed, bool ignoreZ)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    // Contents hash, data is added in pieces as length is limited to int
+    const qint64 step = 1 << 26;
+    for (qint64 position = 0; position < reader.size(); position += step) {
+        hash.addData(reader.data() + position, qMin(step, reader.size() - position));
+    }
+
+    // Settings affecting parsing results
+    QByteArray settings;
+    QDataStream stream(&settings, QIODevice::WriteOnly);
+    stream << CACHEVERSION << reader.size() << arcPrecision << arcDegreeMode << traverseSpeed << ignoreZ
+           << (int)QSysInfo::ByteOrder << (int)sizeof(void*);
+    hash.addData(settings);
+
+    m_key = hash.result();
+    m_fileName = cachePath() + "/" + m_key.toHex() + ".cache";
+    m_lineCount = reader.lineCount();
+}
+
+QString GcodeParseCache::fileName() const
+{
+    return m_fileName;
+}
+
+bool GcodeParseCache::load(QVector<int> *sourceLines, QVector<int> *lines, GcodeViewParse *parser) const
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    uchar *map = file.map(0, file.size());
+    if (!map) return false;
+
+    CacheDataReader reader((const char*)map, file.size());
+
+    // Header
+    char magic[sizeof(cacheMagic)];
+    qint32 version;
+    QByteArray key(m_key.size(), 0);
+
+    reader.read(magic, sizeof(magic));
+    reader.readValue(&version);
+    reader.read(key.data(), key.size());
+    reader.align();
+
+    if (!reader.isOk() || memcmp(magic, cacheMagic, sizeof(magic)) || version != CACHEVERSION || key != m_key) {
+        file.unmap(map);
+        return false;
+    }
+
+    // Table rows
+    reader.readArray(sourceLines);
+    reader.readArray(lines);
+
+    // Segments
+    LineSegmentStore store;
+    reader.readArray(&store.m_starts);
+    reader.readArray(&store.m_ends);
+    reader.readArray(&store.m_lineNumbers);
+    reader.readArray(&store.m_flags);
+    reader.readArray(&store.m_runs);
+
+    // Segments indexes, stored as offsets to indexes array for each line
+    QVector<qint32> offsets;
+    QVector<qint32> indexes;
+    reader.readArray(&offsets);
+    reader.readArray(&indexes);
+
+    // Extremes
+    QVector3D min, max;
+    double minLength;
+    qint32 currentLine;
+    reader.readValue(&min);
+    reader.readValue(&max);
+    reader.readValue(&minLength);
+    reader.readValue(&currentLine);
+
+    // Checkpoints
+    qint64 checkpointsSize;
+    const char *checkpointsData = reader.readBlock(&checkpointsSize);
+    QVector<GcodeParseCheckpoint> checkpoints;
+
+    bool ok = reader.isOk();
+    if (ok) {
+        QByteArray checkpointsArray = QByteArray::fromRawData(checkpointsData, checkpointsSize);
+        QDataStream stream(checkpointsArray);
+        ok = readCheckpoints(stream, &checkpoints);
+    }
+
+    file.unmap(map);
+
+    int count = store.m_ends.count();
+    if (!ok || sourceLines->count() != lines->count() || store.m_starts.count() != count
+            || store.m_lineNumbers.count() != count || store.m_flags.count() != count
+            || (count > 0 && (store.m_runs.isEmpty() || store.m_runs.first().first != 0)) || offsets.isEmpty()
+            || offsets.first() != 0 || offsets.last() != indexes.count()) return false;
+
+    // Rows refer to source lines lazily
+    for (int i = 0; i < sourceLines->count(); i++) {
+        if (sourceLines->at(i) < 0 || sourceLines->at(i) >= m_lineCount) return false;
+    }
+
+    QVector<QList<int>> lineIndexes(offsets.count() - 1);
+    for (int i = 0; i < lineIndexes.count(); i++) {
+        if (offsets.at(i) > offsets.at(i + 1)) return false;
+        for (int j = offsets.at(i); j < offsets.at(i + 1); j++) {
+            if (indexes.at(j) < 0 || indexes.at(j) >= count) return false;
+            lineIndexes[i].append(indexes.at(j));
+        }
+    }
+
+    // Vertex indexes are drawer specific
+    store.m_vertexIndexes.fill(-1, count);
+
+    parser->reset();
+    parser->m_lines = store;
+    parser->m_lineIndexes = lineIndexes;
+    parser->m_checkpoints = checkpoints;
+    parser->m_min = min;
+    parser->m_max = max;
+    parser->m_minLength = minLength;
+    parser->currentLine = currentLine;
+
+    return true;
+}
+
+bool GcodeParseCache::save(const QVector<int> &sourceLines, const QVector<int> &lines, const GcodeViewParse *parser) const
+{
+    if (!QDir().mkpath(cachePath())) return false;
+
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    // Header
+    file.write(cacheMagic, sizeof(cacheMagic));
+    writeValue(file, (qint32)CACHEVERSION);
+    file.write(m_key);
+    writePadding(file);
+
+    // Table rows
+    writeArray(file, sourceLines);
+    writeArray(file, lines);
+
+    // Segments
+    const LineSegmentStore &store = parser->m_lines;
+    writeArray(file, store.m_starts);
+    writeArray(file, store.m_ends);
+    writeArray(file, store.m_lineNumbers);
+    writeArray(file, store.m_flags);
+    writeArray(file, store.m_runs);
+
+    // Segments indexes
+    QVector<qint32> offsets;
+    QVector<qint32> indexes;
+    offsets.reserve(parser->m_lineIndexes.count() + 1);
+    offsets.append(0);
+    foreach (const QList<int> &list, parser->m_lineIndexes) {
+        foreach (int index, list) indexes.append(index);
+        offsets.append(indexes.count());
+    }
+    writeArray(file, offsets);
+    writeArray(file, indexes);
+
+    // Extremes
+    writeValue(file, parser->m_min);
+    writeValue(file, parser->m_max);
+    writeValue(file, parser->m_minLength);
+    writeValue(file, (qint32)parser->currentLine);
+    writePadding(file);
+
+    // Checkpoints
+    QByteArray checkpointsArray;
+    QDataStream stream(&checkpointsArray, QIODevice::WriteOnly);
+    writeCheckpoints(stream, parser->m_checkpoints);
+    writeBlock(file, checkpointsArray.constData(), checkpointsArray.size());
+
+    if (!file.commit()) return false;
+
+    removeOutdated();
+
+    return true;
+}
+
+QString GcodeParseCache::cachePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/parser";
+}
+
+// Keeps most recent cache files only
+void GcodeParseCache::removeOutdated()
+{
+    QDir dir(cachePath());
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.cache", QDir::Files, QDir::Time);
+
+    for (int i = CACHEMAXFILES; i < files.count(); i++) QFile::remove(files.at(i).absoluteFilePath());
+}
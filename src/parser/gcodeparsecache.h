@@ -0,0 +1,38 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GCODEPARSECACHE_H
+#define GCODEPARSECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+class GcodeFileReader;
+class GcodeViewParse;
+
+// On-disk cache of program parsing results.
+// Keyed by file contents hash & parsing settings, stored in native binary format
+// and memory-mapped on load.
+class GcodeParseCache
+{
+public:
+    GcodeParseCache(const GcodeFileReader &reader, double arcPrecision, bool arcDegreeMode,
+                    double traverseSpeed, bool ignoreZ);
+
+    QString fileName() const;
+
+    // Table rows are returned as source file lines & parser line numbers
+    bool load(QVector<int> *sourceLines, QVector<int> *lines, GcodeViewParse *parser) const;
+    bool save(const QVector<int> &sourceLines, const QVector<int> &lines, const GcodeViewParse *parser) const;
+
+private:
+    QByteArray m_key;
+    QString m_fileName;
+    int m_lineCount;
+
+    static QString cachePath();
+    static void removeOutdated();
+};
+
+#endif // GCODEPARSECACHE_H
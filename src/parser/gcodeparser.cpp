@@ -5,7 +5,6 @@
 
 // Copyright 2015-2016 Hayrullin Denis Ravilevich
 
-#include <QListIterator>
 #include <QDebug>
 #include "gcodeparser.h"
 
@@ -34,7 +33,6 @@ GcodeParser::GcodeParser(QObject *parent) : QObject(parent)
 
 GcodeParser::~GcodeParser()
 {
-    foreach (PointSegment *ps, this->m_points) delete ps;
 }
 
 bool GcodeParser::getConvertArcsToLines() {
@@ -90,33 +88,33 @@ void GcodeParser::reset(const QVector3D &initialPoint)
 {
     qDebug() << "reseting gp" << initialPoint;
 
-    foreach (PointSegment *ps, this->m_points) delete ps;
     this->m_points.clear();
+    this->m_arcs.clear();
     // The unspoken home location.
     m_currentPoint = initialPoint;
     m_currentPlane = PointSegment::XY;
-    this->m_points.append(new PointSegment(&this->m_currentPoint, -1));
+    this->m_points.append(PointSegment(this->m_currentPoint, -1));
 }
 
 /**
 * Add a command to be processed.
+* Returned segment is valid until the next command is added.
 */
 PointSegment* GcodeParser::addCommand(QString command)
 {
-    QString stripped = GcodePreprocessorUtils::removeComment(command);
-    QStringList args = GcodePreprocessorUtils::splitCommand(stripped);
-    return this->addCommand(args);
+    m_tokenizer.tokenize(command);
+    return this->addCommand(m_tokenizer);
 }
 
 /**
-* Add a command which has already been broken up into its arguments.
+* Add a command which has already been broken up into its words.
 */
-PointSegment* GcodeParser::addCommand(const QStringList &args)
+PointSegment* GcodeParser::addCommand(const GcodeTokenizer &words)
 {
-    if (args.isEmpty()) {
+    if (words.count() == 0) {
         return NULL;
     }
-    return processCommand(args);
+    return processCommand(words);
 }
 
 /**
@@ -136,71 +134,61 @@ QVector3D *GcodeParser::getCurrentPoint() {
 
 /**
 * Expands the last point in the list if it is an arc according to the
-* the parsers settings.
+* the parsers settings. Returns the number of segments replacing the arc.
 */
-QList<PointSegment*> GcodeParser::expandArc()
+int GcodeParser::expandArc()
 {
-    PointSegment *startSegment = this->m_points[this->m_points.size() - 2];
-    PointSegment *lastSegment = this->m_points[this->m_points.size() - 1];
-
-    QList<PointSegment*> empty;
+    const PointSegment startSegment = this->m_points.at(this->m_points.size() - 2);
+    const PointSegment lastSegment = this->m_points.last();
 
     // Can only expand arcs.
-    if (!lastSegment->isArc()) {
-        return empty;
+    if (!lastSegment.isArc()) {
+        return 0;
     }
 
     // Get precalculated stuff.
-    QVector3D *start = startSegment->point();
-    QVector3D *end = lastSegment->point();
-    QVector3D *center = lastSegment->center();
-    double radius = lastSegment->getRadius();
-    bool clockwise = lastSegment->isClockwise();
-    PointSegment::planes plane = startSegment->plane();
+    const ArcProperties arc = this->m_arcs.at(lastSegment.arcIndex());
+    PointSegment::planes plane = startSegment.plane();
 
     //
     // Start expansion.
     //
 
-    QList<QVector3D> expandedPoints = GcodePreprocessorUtils::generatePointsAlongArcBDring(plane, *start, *end, *center, clockwise, radius, m_smallArcThreshold, m_smallArcSegmentLength, false);
+    QList<QVector3D> expandedPoints = GcodePreprocessorUtils::generatePointsAlongArcBDring(plane, startSegment.point(), lastSegment.point(), arc.center, arc.isClockwise, arc.radius, m_smallArcThreshold, m_smallArcSegmentLength, false);
 
     // Validate output of expansion.
     if (expandedPoints.length() == 0) {
-        return empty;
+        return 0;
     }
 
     // Remove the last point now that we're about to expand it.
     this->m_points.removeLast();
+    this->m_arcs.removeLast();
     m_commandNumber--;
 
-    // Initialize return value
-    QList<PointSegment*> psl;
-
-    // Create line segments from points.
-    PointSegment *temp;
-
-    QListIterator<QVector3D> psi(expandedPoints);
-    // skip first element.
-    if (psi.hasNext()) psi.next();
-
-    while (psi.hasNext()) {
-        temp = new PointSegment(&psi.next(), m_commandNumber++);
-        temp->setIsMetric(lastSegment->isMetric());
-        this->m_points.append(temp);
-        psl.append(temp);
+    // Create line segments from points, skip first element.
+    for (int i = 1; i < expandedPoints.count(); i++) {
+        PointSegment ps(expandedPoints.at(i), m_commandNumber++);
+        ps.setIsMetric(lastSegment.isMetric());
+        this->m_points.append(ps);
     }
 
     // Update the new endpoint.
-    this->m_currentPoint.setX(this->m_points.last()->point()->x());
-    this->m_currentPoint.setY(this->m_points.last()->point()->y());
-    this->m_currentPoint.setZ(this->m_points.last()->point()->z());
+    this->m_currentPoint = this->m_points.last().point();
 
-    return psl;
+    return expandedPoints.count() - 1;
 }
 
-QList<PointSegment*> GcodeParser::getPointSegmentList() {
+const QVector<PointSegment> &GcodeParser::getPointSegments() const
+{
     return this->m_points;
 }
+
+const ArcProperties &GcodeParser::getArcProperties(const PointSegment &ps) const
+{
+    return this->m_arcs.at(ps.arcIndex());
+}
+
 double GcodeParser::getTraverseSpeed() const
 {
     return m_traverseSpeed;
@@ -216,34 +204,126 @@ int GcodeParser::getCommandNumber() const
     return m_commandNumber - 1;
 }
 
+// Saves modal state with last two point segments, the last one can still be modified by dwell
+GcodeParserState GcodeParser::saveState() const
+{
+    GcodeParserState state;
+
+    state.currentPoint = m_currentPoint;
+    state.isMetric = m_isMetric;
+    state.inAbsoluteMode = m_inAbsoluteMode;
+    state.inAbsoluteIJKMode = m_inAbsoluteIJKMode;
+    state.lastGcodeCommand = m_lastGcodeCommand;
+    state.currentPlane = m_currentPlane;
+    state.lastSpeed = m_lastSpeed;
+    state.lastSpindleSpeed = m_lastSpindleSpeed;
+    state.commandNumber = m_commandNumber;
+
+    for (int i = qMax(m_points.count() - 2, 0); i < m_points.count(); i++) {
+        PointSegment ps = m_points.at(i);
+        if (ps.isArc()) {
+            state.arcs.append(m_arcs.at(ps.arcIndex()));
+            ps.setArcIndex(state.arcs.count() - 1);
+        }
+        state.points.append(ps);
+    }
+
+    return state;
+}
+
+// Continues parsing from saved state, point segments list starts from saved points
+void GcodeParser::restoreState(const GcodeParserState &state)
+{
+    m_currentPoint = state.currentPoint;
+    m_isMetric = state.isMetric;
+    m_inAbsoluteMode = state.inAbsoluteMode;
+    m_inAbsoluteIJKMode = state.inAbsoluteIJKMode;
+    m_lastGcodeCommand = state.lastGcodeCommand;
+    m_currentPlane = state.currentPlane;
+    m_lastSpeed = state.lastSpeed;
+    m_lastSpindleSpeed = state.lastSpindleSpeed;
+    m_commandNumber = state.commandNumber;
 
-PointSegment *GcodeParser::processCommand(const QStringList &args)
+    m_points = state.points;
+    m_arcs = state.arcs;
+}
+
+static inline bool sameValue(double v1, double v2)
+{
+    return v1 == v2 || (qIsNaN(v1) && qIsNaN(v2));
+}
+
+static inline bool samePoint(const QVector3D &p1, const QVector3D &p2)
+{
+    return sameValue(p1.x(), p2.x()) && sameValue(p1.y(), p2.y()) && sameValue(p1.z(), p2.z());
+}
+
+bool GcodeParserState::isEquivalent(const GcodeParserState &other) const
+{
+    if (!samePoint(currentPoint, other.currentPoint) || isMetric != other.isMetric
+            || inAbsoluteMode != other.inAbsoluteMode || inAbsoluteIJKMode != other.inAbsoluteIJKMode
+            || lastGcodeCommand != other.lastGcodeCommand || currentPlane != other.currentPlane
+            || !sameValue(lastSpeed, other.lastSpeed) || !sameValue(lastSpindleSpeed, other.lastSpindleSpeed)
+            || points.count() != other.points.count()) return false;
+
+    for (int i = 0; i < points.count(); i++) {
+        const PointSegment &p1 = points.at(i);
+        const PointSegment &p2 = other.points.at(i);
+
+        if (!samePoint(p1.point(), p2.point()) || p1.isMetric() != p2.isMetric()
+                || p1.isZMovement() != p2.isZMovement() || p1.isFastTraverse() != p2.isFastTraverse()
+                || p1.isAbsolute() != p2.isAbsolute() || p1.plane() != p2.plane() || p1.isArc() != p2.isArc()
+                || !sameValue(p1.getSpeed(), p2.getSpeed()) || !sameValue(p1.getSpindleSpeed(), p2.getSpindleSpeed())
+                || !sameValue(p1.getDwell(), p2.getDwell())) return false;
+
+        if (p1.isArc()) {
+            const ArcProperties &a1 = arcs.at(p1.arcIndex());
+            const ArcProperties &a2 = other.arcs.at(p2.arcIndex());
+            if (!samePoint(a1.center, a2.center) || !sameValue(a1.radius, a2.radius)
+                    || a1.isClockwise != a2.isClockwise) return false;
+        }
+    }
+
+    return true;
+}
+
+void GcodeParserState::shiftCommandNumber(int delta)
+{
+    commandNumber += delta;
+    for (int i = 0; i < points.count(); i++) {
+        if (points.at(i).getLineNumber() >= 0) points[i].setLineNumber(points.at(i).getLineNumber() + delta);
+    }
+}
+
+
+PointSegment *GcodeParser::processCommand(const GcodeTokenizer &words)
 {
-    QList<float> gCodes;
     PointSegment *ps = NULL;
+    bool hasGCode = false;
 
     // Handle F code
-    double speed = GcodePreprocessorUtils::parseCoord(args, 'F');
+    double speed = words.value('F');
     if (!qIsNaN(speed)) this->m_lastSpeed = this->m_isMetric ? speed : speed * 25.4;
 
     // Handle S code
-    double spindleSpeed = GcodePreprocessorUtils::parseCoord(args, 'S');
+    double spindleSpeed = words.value('S');
     if (!qIsNaN(spindleSpeed)) this->m_lastSpindleSpeed = spindleSpeed;
 
     // Handle P code
-    double dwell = GcodePreprocessorUtils::parseCoord(args, 'P');
-    if (!qIsNaN(dwell)) this->m_points.last()->setDwell(dwell);
+    double dwell = words.value('P');
+    if (!qIsNaN(dwell)) this->m_points.last().setDwell(dwell);
 
     // handle G codes.
-    gCodes = GcodePreprocessorUtils::parseCodes(args, 'G');
-
-    // If there was no command, add the implicit one to the party.
-    if (gCodes.isEmpty() && m_lastGcodeCommand != -1) {
-        gCodes.append(m_lastGcodeCommand);
+    for (int i = 0; i < words.count(); i++) {
+        if (words.at(i).letter == 'G') {
+            ps = handleGCode(words.at(i).value, words);
+            hasGCode = true;
+        }
     }
 
-    foreach (float code, gCodes) {
-        ps = handleGCode(code, args);
+    // If there was no command, add the implicit one to the party.
+    if (!hasGCode && m_lastGcodeCommand != -1) {
+        ps = handleGCode(m_lastGcodeCommand, words);
     }
 
     return ps;
@@ -251,7 +331,7 @@ PointSegment *GcodeParser::processCommand(const QStringList &args)
 
 PointSegment *GcodeParser::addLinearPointSegment(const QVector3D &nextPoint, bool fastTraverse)
 {
-    PointSegment *ps = new PointSegment(&nextPoint, m_commandNumber++);
+    PointSegment ps(nextPoint, m_commandNumber++);
 
     bool zOnly = false;
 
@@ -262,26 +342,32 @@ PointSegment *GcodeParser::addLinearPointSegment(const QVector3D &nextPoint, boo
         zOnly = true;
     }
 
-    ps->setIsMetric(this->m_isMetric);
-    ps->setIsZMovement(zOnly);
-    ps->setIsFastTraverse(fastTraverse);
-    ps->setIsAbsolute(this->m_inAbsoluteMode);
-    ps->setSpeed(fastTraverse ? this->m_traverseSpeed : this->m_lastSpeed);
-    ps->setSpindleSpeed(this->m_lastSpindleSpeed);
+    ps.setIsMetric(this->m_isMetric);
+    ps.setIsZMovement(zOnly);
+    ps.setIsFastTraverse(fastTraverse);
+    ps.setIsAbsolute(this->m_inAbsoluteMode);
+    ps.setSpeed(fastTraverse ? this->m_traverseSpeed : this->m_lastSpeed);
+    ps.setSpindleSpeed(this->m_lastSpindleSpeed);
     this->m_points.append(ps);
 
     // Save off the endpoint.
     this->m_currentPoint = nextPoint;
 
-    return ps;
+    return &this->m_points.last();
 }
 
-PointSegment *GcodeParser::addArcPointSegment(const QVector3D &nextPoint, bool clockwise, const QStringList &args)
+PointSegment *GcodeParser::addArcPointSegment(const QVector3D &nextPoint, bool clockwise, const GcodeTokenizer &words)
 {
-    PointSegment *ps = new PointSegment(&nextPoint, m_commandNumber++);
+    PointSegment ps(nextPoint, m_commandNumber++);
+
+    double i = words.value('I');
+    double j = words.value('J');
+    double k = words.value('K');
+    double radius = words.value('R');
 
-    QVector3D center = GcodePreprocessorUtils::updateCenterWithCommand(args, this->m_currentPoint, nextPoint, this->m_inAbsoluteIJKMode, clockwise);
-    double radius = GcodePreprocessorUtils::parseCoord(args, 'R');
+    QVector3D center = (qIsNaN(i) && qIsNaN(j) && qIsNaN(k))
+            ? GcodePreprocessorUtils::convertRToCenter(this->m_currentPoint, nextPoint, radius, this->m_inAbsoluteIJKMode, clockwise)
+            : GcodePreprocessorUtils::updatePointWithCommand(this->m_currentPoint, i, j, k, this->m_inAbsoluteIJKMode);
 
     // Calculate radius if necessary.
     if (qIsNaN(radius)) {
@@ -303,39 +389,40 @@ PointSegment *GcodeParser::addArcPointSegment(const QVector3D &nextPoint, bool c
                         + pow((double)((m * this->m_currentPoint).y() - (m * center).y()), 2.0));
     }
 
-    ps->setIsMetric(this->m_isMetric);
-    ps->setArcCenter(&center);
-    ps->setIsArc(true);
-    ps->setRadius(radius);
-    ps->setIsClockwise(clockwise);
-    ps->setIsAbsolute(this->m_inAbsoluteMode);
-    ps->setSpeed(this->m_lastSpeed);
-    ps->setSpindleSpeed(this->m_lastSpindleSpeed);
-    ps->setPlane(m_currentPlane);
+    ps.setIsMetric(this->m_isMetric);
+    ps.setArcIndex(this->m_arcs.count());
+    ps.setIsAbsolute(this->m_inAbsoluteMode);
+    ps.setSpeed(this->m_lastSpeed);
+    ps.setSpindleSpeed(this->m_lastSpindleSpeed);
+    ps.setPlane(m_currentPlane);
+    this->m_arcs.append(ArcProperties(center, radius, clockwise));
     this->m_points.append(ps);
 
     // Save off the endpoint.
     this->m_currentPoint = nextPoint;
-    return ps;
+    return &this->m_points.last();
 }
 
-void GcodeParser::handleMCode(float code, const QStringList &args)
+void GcodeParser::handleMCode(float code, const GcodeTokenizer &words)
 {
-    double spindleSpeed = GcodePreprocessorUtils::parseCoord(args, 'S');
+    Q_UNUSED(code)
+
+    double spindleSpeed = words.value('S');
     if (!qIsNaN(spindleSpeed)) this->m_lastSpindleSpeed = spindleSpeed;
 }
 
-PointSegment * GcodeParser::handleGCode(float code, const QStringList &args)
+PointSegment * GcodeParser::handleGCode(float code, const GcodeTokenizer &words)
 {
     PointSegment *ps = NULL;
 
-    QVector3D nextPoint = GcodePreprocessorUtils::updatePointWithCommand(args, this->m_currentPoint, this->m_inAbsoluteMode);
+    QVector3D nextPoint = GcodePreprocessorUtils::updatePointWithCommand(this->m_currentPoint,
+        words.value('X'), words.value('Y'), words.value('Z'), this->m_inAbsoluteMode);
 
     if (code == 0.0f) ps = addLinearPointSegment(nextPoint, true);
     else if (code == 1.0f) ps = addLinearPointSegment(nextPoint, false);
     else if (code == 38.2f) ps = addLinearPointSegment(nextPoint, false);
-    else if (code == 2.0f) ps = addArcPointSegment(nextPoint, true, args);
-    else if (code == 3.0f) ps = addArcPointSegment(nextPoint, false, args);
+    else if (code == 2.0f) ps = addArcPointSegment(nextPoint, true, words);
+    else if (code == 3.0f) ps = addArcPointSegment(nextPoint, false, words);
     else if (code == 17.0f) this->m_currentPlane = PointSegment::XY;
     else if (code == 18.0f) this->m_currentPlane = PointSegment::ZX;
     else if (code == 19.0f) this->m_currentPlane = PointSegment::YZ;
@@ -421,19 +508,18 @@ QStringList GcodeParser::convertArcsToLines(QString command) {
         return result;
     }
 
-    QList<PointSegment*> psl = expandArc();
+    int count = expandArc();
 
-    if (psl.length() == 0) {
+    if (count == 0) {
         return result;
     }
 
-    // Create an array of new commands out of the of the segments in psl.
+    // Create an array of new commands out of the of the expanded segments.
     // Don't add them to the gcode parser since it is who expanded them.
-    foreach (PointSegment* segment, psl) {
-        //Point3d end = segment.point();
-        QVector3D end = *segment->point();
+    for (int i = this->m_points.count() - count; i < this->m_points.count(); i++) {
+        QVector3D end = this->m_points.at(i).point();
         result.append(GcodePreprocessorUtils::generateG1FromPoints(start, end, this->m_inAbsoluteMode, m_truncateDecimalLength));
-        start = *segment->point();
+        start = end;
     }
 
     return result;
@@ -10,9 +10,33 @@
 
 #include <QObject>
 #include <QVector3D>
+#include <QVector>
 #include <cmath>
 #include "pointsegment.h"
 #include "gcodepreprocessorutils.h"
+#include "gcodetokenizer.h"
+
+// Modal parser state, enough to continue parsing from any program line
+struct GcodeParserState
+{
+    QVector3D currentPoint;
+    bool isMetric;
+    bool inAbsoluteMode;
+    bool inAbsoluteIJKMode;
+    float lastGcodeCommand;
+    PointSegment::planes currentPlane;
+    double lastSpeed;
+    double lastSpindleSpeed;
+    int commandNumber;
+
+    // Last point segments & their arcs, following commands are built on them
+    QVector<PointSegment> points;
+    QVector<ArcProperties> arcs;
+
+    // States are equivalent if parsing continues the same way, command numbering aside
+    bool isEquivalent(const GcodeParserState &other) const;
+    void shiftCommandNumber(int delta);
+};
 
 class GcodeParser : public QObject
 {
@@ -35,17 +59,21 @@ public:
     void setTruncateDecimalLength(int truncateDecimalLength);
     void reset(const QVector3D &initialPoint = QVector3D(qQNaN(), qQNaN(), qQNaN()));
     PointSegment *addCommand(QString command);
-    PointSegment *addCommand(const QStringList &args);
+    PointSegment *addCommand(const GcodeTokenizer &words);
     QVector3D* getCurrentPoint();
-    QList<PointSegment *> expandArc();
+    int expandArc();
     QStringList preprocessCommands(QStringList commands);
     QStringList preprocessCommand(QString command);
     QStringList convertArcsToLines(QString command);
-    QList<PointSegment *> getPointSegmentList();
+    const QVector<PointSegment> &getPointSegments() const;
+    const ArcProperties &getArcProperties(const PointSegment &ps) const;
     double getTraverseSpeed() const;
     void setTraverseSpeed(double traverseSpeed);
     int getCommandNumber() const;
 
+    GcodeParserState saveState() const;
+    void restoreState(const GcodeParserState &state);
+
 signals:
 
 public slots:
@@ -74,14 +102,17 @@ private:
     double m_traverseSpeed;
     double m_lastSpindleSpeed;
 
-    // The gcode.
-    QList<PointSegment*> m_points;
+    // The gcode. Point segments are stored by value, arcs data in a side table.
+    QVector<PointSegment> m_points;
+    QVector<ArcProperties> m_arcs;
+
+    GcodeTokenizer m_tokenizer;
 
-    PointSegment *processCommand(const QStringList &args);
-    void handleMCode(float code, const QStringList &args);
-    PointSegment *handleGCode(float code, const QStringList &args);
+    PointSegment *processCommand(const GcodeTokenizer &words);
+    void handleMCode(float code, const GcodeTokenizer &words);
+    PointSegment *handleGCode(float code, const GcodeTokenizer &words);
     PointSegment *addLinearPointSegment(const QVector3D &nextPoint, bool fastTraverse);
-    PointSegment *addArcPointSegment(const QVector3D &nextPoint, bool clockwise, const QStringList &args);
+    PointSegment *addArcPointSegment(const QVector3D &nextPoint, bool clockwise, const GcodeTokenizer &words);
     void setLastGcodeCommand(float num);
 };
 
@@ -0,0 +1,204 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "gcodeparsethread.h"
+#include "gcodefilereader.h"
+#include "gcodeparser.h"
+
+GcodeParseThread::GcodeParseThread(QObject *parent) : QThread(parent)
+{
+    qRegisterMetaType<GcodeParseChunk>("GcodeParseChunk");
+
+    m_reader = NULL;
+    m_rowsMode = false;
+    m_traverseSpeed = 300;
+    m_initialPoint = QVector3D(qQNaN(), qQNaN(), qQNaN());
+    m_arcPrecision = 0.1;
+    m_arcDegreeMode = false;
+    m_chunkSize = 1000;
+    m_incremental = false;
+}
+
+void GcodeParseThread::setReader(const GcodeFileReader *reader)
+{
+    m_reader = reader;
+    m_rowsMode = false;
+    m_sources.clear();
+    m_edited.clear();
+}
+
+void GcodeParseThread::setRows(const GcodeFileReader *reader, const QVector<int> &sources, const QStringList &edited)
+{
+    m_reader = reader;
+    m_rowsMode = true;
+    m_sources = sources;
+    m_edited = edited;
+}
+
+void GcodeParseThread::setTraverseSpeed(double traverseSpeed)
+{
+    m_traverseSpeed = traverseSpeed;
+}
+
+void GcodeParseThread::setInitialPoint(const QVector3D &initialPoint)
+{
+    m_initialPoint = initialPoint;
+}
+
+void GcodeParseThread::setArcPrecision(double arcPrecision, bool arcDegreeMode)
+{
+    m_arcPrecision = arcPrecision;
+    m_arcDegreeMode = arcDegreeMode;
+}
+
+void GcodeParseThread::setChunkSize(int chunkSize)
+{
+    m_chunkSize = qMax(chunkSize, 1);
+}
+
+void GcodeParseThread::setStartCheckpoint(const GcodeParseCheckpoint &checkpoint)
+{
+    m_start = checkpoint;
+    m_incremental = true;
+}
+
+void GcodeParseThread::setTargetCheckpoints(const QVector<GcodeParseCheckpoint> &checkpoints)
+{
+    m_targets = checkpoints;
+}
+
+bool GcodeParseThread::isIncremental() const
+{
+    return m_incremental;
+}
+
+int GcodeParseThread::firstLine() const
+{
+    return m_incremental ? m_start.row : 0;
+}
+
+int GcodeParseThread::lineCount() const
+{
+    return m_rowsMode ? m_sources.count() : m_reader->lineCount();
+}
+
+// File parsing progress is measured in kilobytes to fit progress range
+qint64 GcodeParseThread::progressMaximum() const
+{
+    return m_rowsMode ? m_sources.count() : m_reader->size() >> 10;
+}
+
+qint64 GcodeParseThread::progressPosition(int line) const
+{
+    if (!m_rowsMode) return (line < m_reader->lineCount() ? m_reader->lineOffset(line) : m_reader->size()) >> 10;
+    return line;
+}
+
+bool GcodeParseThread::isCanceled() const
+{
+    return m_canceled.load() != 0;
+}
+
+// Thread-safe, parsing stops after current chunk
+void GcodeParseThread::cancel()
+{
+    m_canceled.store(1);
+}
+
+void GcodeParseThread::run()
+{
+    GcodeParser gp;
+    GcodeViewParse vp;
+
+    gp.setTraverseSpeed(m_traverseSpeed);
+    gp.reset(m_initialPoint);
+
+    m_canceled.store(0);
+
+    GcodeTokenizer tokenizer;
+    const char *lineData;
+    int lineLength;
+
+    int count = lineCount();
+    int line = 0;
+    int row = 0;
+    int builtPoints = 0;
+    int segmentCount = 0;
+    int target = 0;
+    bool finished = false;
+
+    // Continue from checkpoint, its points are already built except the last one
+    if (m_incremental) {
+        gp.restoreState(m_start.state);
+        vp.setCurrentLine(m_start.currentLine);
+        line = row = m_start.row;
+        builtPoints = m_start.state.points.count() - 1;
+        segmentCount = m_start.segmentCount;
+    }
+
+    while (!finished) {
+        GcodeParseChunk chunk;
+        chunk.firstRow = row;
+        chunk.checkpoint.row = row;
+        chunk.checkpoint.state = gp.saveState();
+        chunk.checkpoint.currentLine = vp.getCurrentLine();
+        chunk.checkpoint.segmentCount = segmentCount;
+
+        // Stop if state matches previous parsing results, targets rows are the same as lines (commands only)
+        while (target < m_targets.count() && m_targets.at(target).row < row) target++;
+        if (target < m_targets.count() && m_targets.at(target).row == row
+                && chunk.checkpoint.state.isEquivalent(m_targets.at(target).state)) {
+            chunk.converged = true;
+            chunk.position = progressPosition(line);
+            emit chunkReady(chunk);
+            break;
+        }
+
+        // Next chunk ends at target row to check state there
+        if (target < m_targets.count() && m_targets.at(target).row == row) target++;
+
+        int last = qMin(line + m_chunkSize, count);
+        if (target < m_targets.count()) last = qMin(last, m_targets.at(target).row);
+
+        for (; line < last; line++) {
+            // Tokenize line
+            if (!m_rowsMode) {
+                m_reader->trimmedLine(line, &lineData, &lineLength);
+                if (lineLength == 0) continue;
+
+                tokenizer.tokenize(lineData, lineLength);
+                if (!tokenizer.hasCode()) continue;
+
+                chunk.sources.append(line);
+            } else if (m_sources.at(line) >= 0) {
+                m_reader->trimmedLine(m_sources.at(line), &lineData, &lineLength);
+                tokenizer.tokenize(lineData, lineLength);
+            } else {
+                tokenizer.tokenize(m_edited.at(-m_sources.at(line) - 1));
+            }
+
+            // Track parser state
+            gp.addCommand(tokenizer);
+
+            chunk.lines.append(gp.getCommandNumber());
+        }
+
+        finished = line >= count || isCanceled();
+
+        // Expand arcs & build line segments. Last point is held back until the next chunk,
+        // following commands can still modify it (dwell).
+        int pointsCount = gp.getPointSegments().count();
+        int points = finished ? pointsCount : pointsCount - 1;
+
+        if (points > builtPoints) {
+            vp.buildLines(&gp, builtPoints, points, m_arcPrecision, m_arcDegreeMode, &chunk.segments);
+            builtPoints = points;
+        }
+
+        chunk.position = progressPosition(line);
+        row += chunk.lines.count();
+        segmentCount += chunk.segments.lines.count();
+
+        emit chunkReady(chunk);
+    }
+}
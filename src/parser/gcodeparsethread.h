@@ -0,0 +1,108 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GCODEPARSETHREAD_H
+#define GCODEPARSETHREAD_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QStringList>
+#include <QVector>
+#include <QVector3D>
+#include <QMetaType>
+#include "gcodeviewparse.h"
+
+class GcodeFileReader;
+
+// Parsing results of a range of program lines
+struct GcodeParseChunk
+{
+    GcodeParseChunk() : firstRow(0), position(0), converged(false) {}
+
+    // Table row of first parsed line
+    int firstRow;
+    // Parsing state before first row
+    GcodeParseCheckpoint checkpoint;
+    // Source file lines of commands, filled on file parsing only (empty lines & comments are skipped)
+    QVector<int> sources;
+    QVector<int> lines;
+    // Line segments
+    LineSegmentChunk segments;
+    // Progress position
+    qint64 position;
+    // Parsing stopped as state matches target checkpoint at first row
+    bool converged;
+};
+
+Q_DECLARE_METATYPE(GcodeParseChunk)
+
+// Results of incremental parsing, to be spliced into previous ones
+struct GcodeParseSplice
+{
+    GcodeParseSplice() : converged(false) {}
+
+    LineSegmentChunk segments;
+    QVector<GcodeParseCheckpoint> checkpoints;
+    // State at converged row, equivalent to one of target checkpoints
+    bool converged;
+    GcodeParseCheckpoint end;
+};
+
+// Background g-code parser.
+// Program is processed by chunks: lines tokenizing, parser state tracking, arc expansion
+// and line segments building. Chunks are published by chunkReady signal as completed.
+class GcodeParseThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit GcodeParseThread(QObject *parent = 0);
+
+    void setReader(const GcodeFileReader *reader);
+    // Rows refer to reader lines (>= 0) or to edited commands (-index - 1)
+    void setRows(const GcodeFileReader *reader, const QVector<int> &sources, const QStringList &edited);
+    void setTraverseSpeed(double traverseSpeed);
+    void setInitialPoint(const QVector3D &initialPoint);
+    void setArcPrecision(double arcPrecision, bool arcDegreeMode);
+    void setChunkSize(int chunkSize);
+
+    // Continues parsing from checkpoint until state converges to one of targets (commands only)
+    void setStartCheckpoint(const GcodeParseCheckpoint &checkpoint);
+    void setTargetCheckpoints(const QVector<GcodeParseCheckpoint> &checkpoints);
+    bool isIncremental() const;
+    int firstLine() const;
+
+    int lineCount() const;
+    qint64 progressMaximum() const;
+    bool isCanceled() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void chunkReady(GcodeParseChunk chunk);
+
+protected:
+    void run();
+
+private:
+    const GcodeFileReader *m_reader;
+    bool m_rowsMode;
+    QVector<int> m_sources;
+    QStringList m_edited;
+
+    double m_traverseSpeed;
+    QVector3D m_initialPoint;
+    double m_arcPrecision;
+    bool m_arcDegreeMode;
+    int m_chunkSize;
+
+    bool m_incremental;
+    GcodeParseCheckpoint m_start;
+    QVector<GcodeParseCheckpoint> m_targets;
+
+    QAtomicInt m_canceled;
+
+    qint64 progressPosition(int line) const;
+};
+
+#endif // GCODEPARSETHREAD_H
@@ -12,6 +12,19 @@
 #include "limits"
 #include "../tables/gcodetablemodel.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARCKERNELSSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ARCKERNELAVX
+#endif
+
+// Arc points are generated by angle rotation, exact angle is restored after each block of points
+#define ARCBLOCKPOINTS 256
+
 /**
 * Searches the command string for an 'f' and replaces the speed value
 * between the 'f' and the next space with a percentage of that speed.
@@ -415,6 +428,55 @@ double GcodePreprocessorUtils::calculateSweep(double startAngle, double endAngle
 * Generates the points along an arc including the start and end points.
 */
 QList<QVector3D> GcodePreprocessorUtils::generatePointsAlongArcBDring(PointSegment::planes plane, QVector3D start, QVector3D end, QVector3D center, bool clockwise, double R, double minArcLength, double arcPrecision, bool arcDegreeMode)
+{
+    ArcExpansion arc;
+
+    if (!prepareArc(plane, start, end, center, clockwise, R, minArcLength, arcPrecision, arcDegreeMode, &arc)) {
+        return QList<QVector3D>();
+    }
+
+    QVector<QVector3D> points(arc.count);
+    generateArcPoints(arc, (float*)points.data());
+
+    return points.toList();
+}
+
+/**
+* Generates the points along an arc including the start and end points.
+*/
+QList<QVector3D> GcodePreprocessorUtils::generatePointsAlongArcBDring(PointSegment::planes plane, QVector3D p1, QVector3D p2,
+                                                                      QVector3D center, bool isCw,
+                                                                      double radius, double startAngle,
+                                                                      double sweep, int numPoints)
+{
+    ArcExpansion arc;
+    arc.plane = plane;
+    arc.start = p1;
+    arc.end = p2;
+    arc.center = center;
+    arc.clockwise = isCw;
+    arc.radius = radius;
+    arc.startAngle = startAngle;
+    arc.sweep = sweep;
+    arc.numPoints = numPoints;
+    arc.count = qMax(numPoints - 1, 0) + 1;
+
+    // Calculate radius if necessary.
+    if (arc.radius == 0) {
+        arc.radius = sqrt(pow((double)(p1.x() - center.x()), 2.0) + pow((double)(p1.y() - center.y()), 2.0));
+    }
+
+    QVector<QVector3D> points(arc.count);
+    generateArcPoints(arc, (float*)points.data());
+
+    return points.toList();
+}
+
+/**
+* Calculates arc tessellation parameters & points count w/o generating points.
+* Returns false if arc can't be expanded.
+*/
+bool GcodePreprocessorUtils::prepareArc(PointSegment::planes plane, QVector3D start, QVector3D end, QVector3D center, bool clockwise, double R, double minArcLength, double arcPrecision, bool arcDegreeMode, ArcExpansion *arc)
 {
     double radius = R;
 
@@ -436,7 +498,7 @@ QList<QVector3D> GcodePreprocessorUtils::generatePointsAlongArcBDring(PointSegme
     center = m * center;
 
     // Check center
-    if (qIsNaN(center.length())) return QList<QVector3D>();
+    if (qIsNaN(center.length())) return false;
 
     // Calculate radius if necessary.
     if (radius == 0) {
@@ -467,63 +529,183 @@ QList<QVector3D> GcodePreprocessorUtils::generatePointsAlongArcBDring(PointSegme
         numPoints = (int)ceil(arcLength/arcPrecision);
     }
 
-    return generatePointsAlongArcBDring(plane, start, end, center, clockwise, radius, startAngle, sweep, numPoints);
+    // Calculate radius if necessary.
+    if (radius == 0) {
+        radius = sqrt(pow((double)(start.x() - center.x()), 2.0) + pow((double)(start.y() - center.y()), 2.0));
+    }
+
+    arc->plane = plane;
+    arc->start = start;
+    arc->end = end;
+    arc->center = center;
+    arc->clockwise = clockwise;
+    arc->radius = radius;
+    arc->startAngle = startAngle;
+    arc->sweep = sweep;
+    arc->numPoints = numPoints;
+    arc->count = qMax(numPoints - 1, 0) + 1;
+
+    return true;
 }
 
-/**
-* Generates the points along an arc including the start and end points.
-*/
-QList<QVector3D> GcodePreprocessorUtils::generatePointsAlongArcBDring(PointSegment::planes plane, QVector3D p1, QVector3D p2,
-                                                                      QVector3D center, bool isCw,
-                                                                      double radius, double startAngle,
-                                                                      double sweep, int numPoints)
+// Stores arc point rotating it back from XY plane
+static inline void storeArcPoint(PointSegment::planes plane, double x, double y, double z, float *point)
 {
-    // Prepare rotation matrix to restore plane
-    QMatrix4x4 m;
-    m.setToIdentity();
     switch (plane) {
     case PointSegment::XY:
+        point[0] = x; point[1] = y; point[2] = z;
         break;
     case PointSegment::ZX:
-        m.rotate(-90, 1.0, 0.0, 0.0);
+        point[0] = x; point[1] = z; point[2] = -(float)y;
         break;
     case PointSegment::YZ:
-        m.rotate(90, 0.0, 1.0, 0.0);
+        point[0] = z; point[1] = y; point[2] = -(float)x;
         break;
     }
+}
 
-    QVector3D lineEnd(p2.x(), p2.y(), p1.z());
-    QList<QVector3D> segments;
-    double angle;
+// Reference kernel, angle functions for every point starting from 'first' one
+static void generateArcPointsScalar(const ArcExpansion &arc, int first, float *points)
+{
+    double step = (arc.clockwise ? -arc.sweep : arc.sweep) / arc.numPoints;
+    double zIncrement = (arc.end.z() - arc.start.z()) / arc.numPoints;
 
-    // Calculate radius if necessary.
-    if (radius == 0) {
-        radius = sqrt(pow((double)(p1.x() - center.x()), 2.0) + pow((double)(p1.y() - center.y()), 2.0));
+    for (int i = first; i < arc.numPoints; i++, points += 3) {
+        double angle = arc.startAngle + i * step;
+        storeArcPoint(arc.plane, cos(angle) * arc.radius + arc.center.x(), sin(angle) * arc.radius + arc.center.y(),
+                      arc.start.z() + i * zIncrement, points);
     }
 
-    double zIncrement = (p2.z() - p1.z()) / numPoints;
-    for (int i = 1; i < numPoints; i++)
-    {
-        if (isCw) {
-            angle = (startAngle - i * sweep / numPoints);
-        } else {
-            angle = (startAngle + i * sweep / numPoints);
-        }
+    storeArcPoint(arc.plane, arc.end.x(), arc.end.y(), arc.end.z(), points);
+}
 
-        if (angle >= M_PI * 2) {
-            angle = angle - M_PI * 2;
+#ifndef ARCKERNELSSE2
+static void generateArcPointsScalar(const ArcExpansion &arc, float *points)
+{
+    generateArcPointsScalar(arc, 1, points);
+}
+#endif
+
+#ifdef ARCKERNELSSE2
+// Two points per iteration, lanes are rotated by two angle steps
+static void generateArcPointsSse2(const ArcExpansion &arc, float *points)
+{
+    double step = (arc.clockwise ? -arc.sweep : arc.sweep) / arc.numPoints;
+    double zIncrement = (arc.end.z() - arc.start.z()) / arc.numPoints;
+    int last = arc.numPoints - 1;
+    int i = 1;
+
+    if (last >= 2) {
+        const __m128d radius = _mm_set1_pd(arc.radius);
+        const __m128d centerX = _mm_set1_pd(arc.center.x());
+        const __m128d centerY = _mm_set1_pd(arc.center.y());
+        const __m128d startZ = _mm_set1_pd(arc.start.z());
+        const __m128d incrementZ = _mm_set1_pd(zIncrement);
+        const __m128d rotationCos = _mm_set1_pd(cos(2 * step));
+        const __m128d rotationSin = _mm_set1_pd(sin(2 * step));
+        double x[2], y[2], z[2];
+
+        while (i + 1 <= last) {
+            __m128d c = _mm_set_pd(cos(arc.startAngle + (i + 1) * step), cos(arc.startAngle + i * step));
+            __m128d s = _mm_set_pd(sin(arc.startAngle + (i + 1) * step), sin(arc.startAngle + i * step));
+            int blockEnd = qMin(i + ARCBLOCKPOINTS, last + 1);
+
+            for (; i + 1 < blockEnd; i += 2, points += 6) {
+                _mm_storeu_pd(x, _mm_add_pd(_mm_mul_pd(c, radius), centerX));
+                _mm_storeu_pd(y, _mm_add_pd(_mm_mul_pd(s, radius), centerY));
+                _mm_storeu_pd(z, _mm_add_pd(startZ, _mm_mul_pd(_mm_set_pd(i + 1, i), incrementZ)));
+
+                storeArcPoint(arc.plane, x[0], y[0], z[0], points);
+                storeArcPoint(arc.plane, x[1], y[1], z[1], points + 3);
+
+                __m128d cn = _mm_sub_pd(_mm_mul_pd(c, rotationCos), _mm_mul_pd(s, rotationSin));
+                s = _mm_add_pd(_mm_mul_pd(s, rotationCos), _mm_mul_pd(c, rotationSin));
+                c = cn;
+            }
         }
+    }
 
-        lineEnd.setX(cos(angle) * radius + center.x());
-        lineEnd.setY(sin(angle) * radius + center.y());
-        lineEnd.setZ(lineEnd.z() + zIncrement);
+    generateArcPointsScalar(arc, i, points);
+}
+#endif
 
-        segments.append(m * lineEnd);
+#ifdef ARCKERNELAVX
+// Four points per iteration, lanes are rotated by four angle steps
+__attribute__((target("avx")))
+static void generateArcPointsAvx(const ArcExpansion &arc, float *points)
+{
+    double step = (arc.clockwise ? -arc.sweep : arc.sweep) / arc.numPoints;
+    double zIncrement = (arc.end.z() - arc.start.z()) / arc.numPoints;
+    int last = arc.numPoints - 1;
+    int i = 1;
+
+    if (last >= 4) {
+        const __m256d radius = _mm256_set1_pd(arc.radius);
+        const __m256d centerX = _mm256_set1_pd(arc.center.x());
+        const __m256d centerY = _mm256_set1_pd(arc.center.y());
+        const __m256d startZ = _mm256_set1_pd(arc.start.z());
+        const __m256d incrementZ = _mm256_set1_pd(zIncrement);
+        const __m256d rotationCos = _mm256_set1_pd(cos(4 * step));
+        const __m256d rotationSin = _mm256_set1_pd(sin(4 * step));
+        double x[4], y[4], z[4];
+
+        while (i + 3 <= last) {
+            __m256d c = _mm256_set_pd(cos(arc.startAngle + (i + 3) * step), cos(arc.startAngle + (i + 2) * step),
+                                      cos(arc.startAngle + (i + 1) * step), cos(arc.startAngle + i * step));
+            __m256d s = _mm256_set_pd(sin(arc.startAngle + (i + 3) * step), sin(arc.startAngle + (i + 2) * step),
+                                      sin(arc.startAngle + (i + 1) * step), sin(arc.startAngle + i * step));
+            int blockEnd = qMin(i + ARCBLOCKPOINTS, last + 1);
+
+            for (; i + 3 < blockEnd; i += 4, points += 12) {
+                _mm256_storeu_pd(x, _mm256_add_pd(_mm256_mul_pd(c, radius), centerX));
+                _mm256_storeu_pd(y, _mm256_add_pd(_mm256_mul_pd(s, radius), centerY));
+                _mm256_storeu_pd(z, _mm256_add_pd(startZ, _mm256_mul_pd(_mm256_set_pd(i + 3, i + 2, i + 1, i), incrementZ)));
+
+                for (int k = 0; k < 4; k++) storeArcPoint(arc.plane, x[k], y[k], z[k], points + k * 3);
+
+                __m256d cn = _mm256_sub_pd(_mm256_mul_pd(c, rotationCos), _mm256_mul_pd(s, rotationSin));
+                s = _mm256_add_pd(_mm256_mul_pd(s, rotationCos), _mm256_mul_pd(c, rotationSin));
+                c = cn;
+            }
+        }
     }
 
-    segments.append(m * p2);
+    generateArcPointsScalar(arc, i, points);
+}
+#endif
+
+typedef void (*ArcKernel)(const ArcExpansion &arc, float *points);
+
+static ArcKernel selectArcKernel()
+{
+#ifdef ARCKERNELAVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) return generateArcPointsAvx;
+#endif
+#ifdef ARCKERNELSSE2
+    return generateArcPointsSse2;
+#else
+    return generateArcPointsScalar;
+#endif
+}
+
+/**
+* Writes arc points to buffer of arc.count xyz triplets, thread-safe.
+* Vectorized kernel is selected once by CPU features.
+*/
+void GcodePreprocessorUtils::generateArcPoints(const ArcExpansion &arc, float *points)
+{
+    static const ArcKernel kernel = selectArcKernel();
 
-    return segments;
+    kernel(arc, points);
+}
+
+/**
+* Scalar kernel output, vectorized kernels are checked against it.
+*/
+void GcodePreprocessorUtils::generateArcPointsReference(const ArcExpansion &arc, float *points)
+{
+    generateArcPointsScalar(arc, 1, points);
 }
 
 bool GcodePreprocessorUtils::isDigit(char c)
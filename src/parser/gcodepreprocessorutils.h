@@ -13,6 +13,20 @@
 #include <cmath>
 #include "pointsegment.h"
 
+// Arc tessellation parameters, arc plane is rotated to XY.
+// Arc is expanded to 'count' points, last one is the arc end point.
+struct ArcExpansion
+{
+    PointSegment::planes plane;
+    QVector3D start, end, center;
+    bool clockwise;
+    double radius;
+    double startAngle;
+    double sweep;
+    int numPoints;
+    int count;
+};
+
 class GcodePreprocessorUtils : public QObject
 {
     Q_OBJECT
@@ -37,6 +51,9 @@ public:
     static double calculateSweep(double startAngle, double endAngle, bool isCw);
     static QList<QVector3D> generatePointsAlongArcBDring(PointSegment::planes plane, QVector3D start, QVector3D end, QVector3D center, bool clockwise, double R, double minArcLength, double arcPrecision, bool arcDegreeMode);
     static QList<QVector3D> generatePointsAlongArcBDring(PointSegment::planes plane, QVector3D p1, QVector3D p2, QVector3D center, bool isCw, double radius, double startAngle, double sweep, int numPoints);
+    static bool prepareArc(PointSegment::planes plane, QVector3D start, QVector3D end, QVector3D center, bool clockwise, double R, double minArcLength, double arcPrecision, bool arcDegreeMode, ArcExpansion *arc);
+    static void generateArcPoints(const ArcExpansion &arc, float *points);
+    static void generateArcPointsReference(const ArcExpansion &arc, float *points);
     static inline bool isDigit(char c);
     static inline bool isLetter(char c);
     static inline char toUpper(char c);
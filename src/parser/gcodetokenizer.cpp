@@ -0,0 +1,146 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <cmath>
+#include <qnumeric.h>
+#include "gcodetokenizer.h"
+
+static const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+GcodeTokenizer::GcodeTokenizer()
+{
+    m_count = 0;
+    m_hasCode = false;
+    m_words.resize(16);
+}
+
+int GcodeTokenizer::tokenize(const char *data, int length)
+{
+    return tokenize<char>(data, length);
+}
+
+int GcodeTokenizer::tokenize(const QString &line)
+{
+    return tokenize<ushort>(line.utf16(), line.length());
+}
+
+template <typename T>
+int GcodeTokenizer::tokenize(const T *data, int length)
+{
+    const T *p = data;
+    const T *end = data + length;
+
+    m_count = 0;
+    m_hasCode = false;
+
+    while (p < end) {
+        unsigned int c = *p;
+
+        // Comments
+        if (c == ';') break;
+        if (c == '(') {
+            while (p < end && *p != ')') p++;
+            if (p < end) p++;
+            continue;
+        }
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v') {
+            p++;
+            continue;
+        }
+
+        m_hasCode = true;
+
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) {
+            p++;
+            continue;
+        }
+
+        // Word letter
+        char letter = c >= 'a' ? c - 'a' + 'A' : c;
+        p++;
+
+        // Value, spaces are allowed between letter and value
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+        const T *start = p;
+        bool negative = false;
+
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+        quint64 mantissa = 0;
+        int digits = 0;
+        int fraction = 0;
+        bool point = false;
+        double value;
+
+        for (; p < end; p++) {
+            c = *p;
+            if (c >= '0' && c <= '9') {
+                // Ignore digits beyond double precision
+                if (digits < 18) {
+                    mantissa = mantissa * 10 + (c - '0');
+                    if (mantissa) digits++;
+                    if (point) fraction++;
+                } else if (!point) {
+                    fraction--;
+                }
+            } else if (c == '.' && !point) {
+                point = true;
+            } else break;
+        }
+
+        value = (double)mantissa;
+        if (fraction > 0) value /= fraction < 23 ? powersOf10[fraction] : pow(10.0, fraction);
+        else if (fraction < 0) value *= pow(10.0, -fraction);
+        if (negative) value = -value;
+
+        // Store word
+        if (m_count == m_words.size()) m_words.resize(m_count * 2);
+
+        GcodeWord &word = m_words[m_count++];
+        word.letter = letter;
+        word.value = value;
+        word.position = start - data;
+        word.length = p - start;
+    }
+
+    return m_count;
+}
+
+double GcodeTokenizer::value(char letter) const
+{
+    for (int i = 0; i < m_count; i++) {
+        if (m_words.at(i).letter == letter) return m_words.at(i).value;
+    }
+
+    return qQNaN();
+}
+
+bool GcodeTokenizer::contains(char letter) const
+{
+    for (int i = 0; i < m_count; i++) {
+        if (m_words.at(i).letter == letter) return true;
+    }
+
+    return false;
+}
+
+QString GcodeTokenizer::text(int index, const QString &line) const
+{
+    const GcodeWord &word = m_words.at(index);
+
+    return QChar(word.letter) + line.mid(word.position, word.length);
+}
+
+QStringList GcodeTokenizer::texts(const QString &line) const
+{
+    QStringList list;
+
+    for (int i = 0; i < m_count; i++) list.append(text(i, line));
+
+    return list;
+}
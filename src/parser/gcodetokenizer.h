@@ -0,0 +1,54 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GCODETOKENIZER_H
+#define GCODETOKENIZER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Single g-code word, e.g. "X-10.5"
+struct GcodeWord
+{
+    double value;
+    // Value text position & length in source line
+    int position;
+    int length;
+    // Upper case letter
+    char letter;
+};
+
+// Splits g-code line to words in single pass, skipping comments.
+// Words buffer is reused between lines, so no allocations are made in steady state.
+class GcodeTokenizer
+{
+public:
+    GcodeTokenizer();
+
+    int tokenize(const char *data, int length);
+    int tokenize(const QString &line);
+
+    int count() const { return m_count; }
+    const GcodeWord &at(int index) const { return m_words.at(index); }
+
+    // Line has anything except whitespaces & comments
+    bool hasCode() const { return m_hasCode; }
+
+    // Value of first word with given letter, NaN if not found
+    double value(char letter) const;
+    bool contains(char letter) const;
+
+    // Word text, e.g. "G1", for command lines only
+    QString text(int index, const QString &line) const;
+    QStringList texts(const QString &line) const;
+
+private:
+    QVector<GcodeWord> m_words;
+    int m_count;
+    bool m_hasCode;
+
+    template <typename T> int tokenize(const T *data, int length);
+};
+
+#endif // GCODETOKENIZER_H
@@ -6,8 +6,15 @@
 // Copyright 2015-2016 Hayrullin Denis Ravilevich
 
 #include <QDebug>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <algorithm>
 #include "gcodeviewparse.h"
 
+// Minimal count of arc points to expand by a worker thread
+#define ARCTHREADPOINTS 8192
+
 GcodeViewParse::GcodeViewParse(QObject *parent) :
     QObject(parent)
 {
@@ -24,7 +31,6 @@ GcodeViewParse::GcodeViewParse(QObject *parent) :
 
 GcodeViewParse::~GcodeViewParse()
 {
-    foreach (LineSegment *ls, m_lines) delete ls;
 }
 
 QVector3D &GcodeViewParse::getMinimumExtremes()
@@ -59,7 +65,7 @@ void GcodeViewParse::testLength(const QVector3D &start, const QVector3D &end)
     if (!qIsNaN(length) && length != 0) m_minLength = qIsNaN(m_minLength) ? length : qMin<double>(m_minLength, length);
 }
 
-QList<LineSegment*> GcodeViewParse::toObjRedux(QList<QString> gcode, double arcPrecision, bool arcDegreeMode)
+LineSegmentStore *GcodeViewParse::toObjRedux(QList<QString> gcode, double arcPrecision, bool arcDegreeMode)
 {
     GcodeParser gp;
 
@@ -70,16 +76,11 @@ QList<LineSegment*> GcodeViewParse::toObjRedux(QList<QString> gcode, double arcP
     return getLinesFromParser(&gp, arcPrecision, arcDegreeMode);
 }
 
-QList<LineSegment*> GcodeViewParse::getLineSegmentList()
-{
-    return m_lines;
-}
-
 void GcodeViewParse::reset()
 {
-    foreach (LineSegment *ls, m_lines) delete ls;
     m_lines.clear();
     m_lineIndexes.clear();
+    m_checkpoints.clear();
     currentLine = 0;
     m_min = QVector3D(qQNaN(), qQNaN(), qQNaN());
     m_max = QVector3D(qQNaN(), qQNaN(), qQNaN());
@@ -96,83 +97,329 @@ QSize GcodeViewParse::getResolution() const
     return QSize(((m_max.x() - m_min.x()) / m_minLength) + 1, ((m_max.y() - m_min.y()) / m_minLength) + 1);
 }
 
-QList<LineSegment*> GcodeViewParse::getLinesFromParser(GcodeParser *gp, double arcPrecision, bool arcDegreeMode)
+LineSegmentStore *GcodeViewParse::getLinesFromParser(GcodeParser *gp, double arcPrecision, bool arcDegreeMode)
+{
+    LineSegmentChunk chunk;
+
+    currentLine = 0;
+    buildLines(gp, 0, gp->getPointSegments().count(), arcPrecision, arcDegreeMode, &chunk);
+    appendLines(chunk);
+
+    return &m_lines;
+}
+
+static void testChunkExtremes(LineSegmentChunk *chunk, const QVector3D &p)
+{
+    chunk->min.setX(Util::nMin(chunk->min.x(), p.x()));
+    chunk->min.setY(Util::nMin(chunk->min.y(), p.y()));
+    chunk->min.setZ(Util::nMin(chunk->min.z(), p.z()));
+
+    chunk->max.setX(Util::nMax(chunk->max.x(), p.x()));
+    chunk->max.setY(Util::nMax(chunk->max.y(), p.y()));
+    chunk->max.setZ(Util::nMax(chunk->max.z(), p.z()));
+}
+
+static void testChunkLength(LineSegmentChunk *chunk, const QVector3D &start, const QVector3D &end)
+{
+    double length = (start - end).length();
+    if (!qIsNaN(length) && length != 0) chunk->minLength = qIsNaN(chunk->minLength) ? length : qMin<double>(chunk->minLength, length);
+}
+
+// Expands range of arcs to points buffer
+class ArcExpansionTask : public QRunnable
+{
+public:
+    ArcExpansionTask(const ArcExpansion *arcs, const int *offsets, int first, int last, QVector3D *points,
+                     QSemaphore *done) :
+        m_arcs(arcs), m_offsets(offsets), m_first(first), m_last(last), m_points(points), m_done(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        for (int i = m_first; i < m_last; i++) {
+            GcodePreprocessorUtils::generateArcPoints(m_arcs[i], (float*)(m_points + m_offsets[i]));
+        }
+        if (m_done) m_done->release();
+    }
+
+private:
+    const ArcExpansion *m_arcs;
+    const int *m_offsets;
+    int m_first;
+    int m_last;
+    QVector3D *m_points;
+    QSemaphore *m_done;
+};
+
+// Arcs are independent, each one is written to its own points range.
+// Work is split by points count, last part is processed by calling thread.
+static void expandArcs(const QVector<ArcExpansion> &arcs, const QVector<int> &offsets, QVector3D *points)
+{
+    int total = arcs.isEmpty() ? 0 : offsets.last() + arcs.last().count;
+    int threads = qBound(1, total / ARCTHREADPOINTS, qMax(QThreadPool::globalInstance()->maxThreadCount(), 1));
+
+    QSemaphore done;
+    QList<ArcExpansionTask*> tasks;
+    int first = 0;
+
+    for (int t = 1; t <= threads; t++) {
+        // Arcs range ending at t-th part of points
+        int last = t == threads ? arcs.count()
+                                : std::lower_bound(offsets.constBegin() + first, offsets.constEnd(),
+                                                   (qint64)total * t / threads) - offsets.constBegin();
+        if (t < threads) {
+            tasks.append(new ArcExpansionTask(arcs.constData(), offsets.constData(), first, last, points, &done));
+            QThreadPool::globalInstance()->start(tasks.last());
+        } else {
+            ArcExpansionTask(arcs.constData(), offsets.constData(), first, last, points, NULL).run();
+        }
+        first = last;
+    }
+
+    done.acquire(tasks.count());
+    qDeleteAll(tasks);
+}
+
+// Converts point segments [first, last) to line segments.
+// Points before first must be already processed, line numbering continues from previous call.
+void GcodeViewParse::buildLines(const GcodeParser *gp, int first, int last, double arcPrecision,
+                                bool arcDegreeMode, LineSegmentChunk *chunk)
 {
-    QList<PointSegment*> psl = gp->getPointSegmentList();
     // For a line segment list ALL arcs must be converted to lines.
     double minArcLength = 0.1;
-    double length;
 
-    QVector3D *start, *end;
-    start = NULL;
-    end = NULL;
-    LineSegment *ls;
+    // Point segments are walked linearly, parser data stays in program units
+    const QVector<PointSegment> &points = gp->getPointSegments();
+    bool hasStart = first > 0;
+    QVector3D start = hasStart ? points.at(first - 1).metricPoint() : QVector3D();
+    QVector3D end;
+    int flags;
+
+    // Arcs tessellation is planned first, points buffer offsets are prefix sums of arcs points counts.
+    // Arcs are expanded in parallel then, segments are built from buffer in program order.
+    QVector<ArcExpansion> arcs;
+    QVector<int> arcOffsets;
+    QVector<bool> arcExpanded(qMax(last - first, 0));
+    int arcPointsCount = 0;
+
+    for (int i = first; i < last; i++) {
+        const PointSegment &ps = points.at(i);
+
+        end = ps.metricPoint();
+
+        if (hasStart && ps.isArc()) {
+            const ArcProperties &arc = gp->getArcProperties(ps);
+            double scale = ps.isMetric() ? 1.0 : 25.4;
+            ArcExpansion expansion;
+
+            if (GcodePreprocessorUtils::prepareArc(ps.plane(), start, end, arc.center * scale, arc.isClockwise,
+                                                   arc.radius * scale, minArcLength, arcPrecision, arcDegreeMode,
+                                                   &expansion)) {
+                arcs.append(expansion);
+                arcOffsets.append(arcPointsCount);
+                arcPointsCount += expansion.count;
+                arcExpanded[i - first] = true;
+            }
+        }
+        start = end;
+        hasStart = true;
+    }
+
+    QVector<QVector3D> arcPoints(arcPointsCount);
+    expandArcs(arcs, arcOffsets, arcPoints.data());
 
     // Prepare segments indexes
-    m_lineIndexes.resize(psl.count());
-
-    int lineIndex = 0;
-    foreach (PointSegment *segment, psl) {
-        PointSegment *ps = segment;
-        bool isMetric = ps->isMetric();
-        ps->convertToMetric();
-
-        end = ps->point();
-
-        // start is null for the first iteration.
-        if (start != NULL) {           
-            // Expand arc for graphics.            
-            if (ps->isArc()) {
-                QList<QVector3D> points =
-                    GcodePreprocessorUtils::generatePointsAlongArcBDring(ps->plane(),
-                    *start, *end, *ps->center(), ps->isClockwise(), ps->getRadius(), minArcLength, arcPrecision, arcDegreeMode);
+    chunk->firstLineNumber = first < last ? points.at(first).getLineNumber() : first - 1;
+    chunk->lineIndexes.resize(qMax(last - first, 0));
+
+    hasStart = first > 0;
+    start = hasStart ? points.at(first - 1).metricPoint() : QVector3D();
+    int arcIndex = 0;
+
+    for (int i = first; i < last; i++) {
+        const PointSegment &ps = points.at(i);
+
+        end = ps.metricPoint();
+
+        // No start for the first iteration.
+        if (hasStart) {
+            int slot = qMax(ps.getLineNumber() - chunk->firstLineNumber, 0);
+            if (slot >= chunk->lineIndexes.count()) chunk->lineIndexes.resize(slot + 1);
+            QList<int> &indexes = chunk->lineIndexes[slot];
+
+            flags = (ps.isFastTraverse() ? LineSegmentStore::FastTraverse : 0)
+                    | (ps.isZMovement() ? LineSegmentStore::ZMovement : 0)
+                    | (ps.isMetric() ? LineSegmentStore::Metric : 0)
+                    | (ps.isAbsolute() ? LineSegmentStore::Absolute : 0);
+
+            // Expanded arc for graphics.
+            if (ps.isArc()) {
+                const ArcProperties &arc = gp->getArcProperties(ps);
+
+                flags |= LineSegmentStore::Arc | (arc.isClockwise ? LineSegmentStore::Clockwise : 0)
+                        | LineSegmentStore::planeFlags(ps.plane());
+
                 // Create line segments from points.
-                if (points.length() > 0) {
-                    QVector3D startPoint = *start;
-                    foreach (QVector3D nextPoint, points) {
-                        if (nextPoint == startPoint) continue;
-                        ls = new LineSegment(startPoint, nextPoint, lineIndex);
-                        ls->setIsArc(ps->isArc());
-                        ls->setIsClockwise(ps->isClockwise());
-                        ls->setPlane(ps->plane());
-                        ls->setIsFastTraverse(ps->isFastTraverse());
-                        ls->setIsZMovement(ps->isZMovement());
-                        ls->setIsMetric(isMetric);
-                        ls->setIsAbsolute(ps->isAbsolute());
-                        ls->setSpeed(ps->getSpeed());
-                        ls->setSpindleSpeed(ps->getSpindleSpeed());
-                        ls->setDwell(ps->getDwell());
-                        this->testExtremes(nextPoint);
-                        m_lines.append(ls);
-                        m_lineIndexes[ps->getLineNumber()].append(m_lines.count() - 1);
-                        startPoint = nextPoint;
+                if (arcExpanded.at(i - first)) {
+                    const QVector3D *nextPoint = arcPoints.constData() + arcOffsets.at(arcIndex);
+                    const QVector3D *lastPoint = nextPoint + arcs.at(arcIndex).count;
+                    QVector3D startPoint = start;
+
+                    for (; nextPoint < lastPoint; nextPoint++) {
+                        if (*nextPoint == startPoint) continue;
+                        indexes.append(chunk->lines.append(startPoint, *nextPoint, currentLine, flags,
+                                                           ps.getSpeed(), ps.getSpindleSpeed(), ps.getDwell()));
+                        testChunkExtremes(chunk, *nextPoint);
+                        startPoint = *nextPoint;
                     }
-                    lineIndex++;
+                    currentLine++;
+                    arcIndex++;
                 }
             // Line
             } else {
-                ls = new LineSegment(*start, *end, lineIndex++);
-                ls->setIsArc(ps->isArc());
-                ls->setIsFastTraverse(ps->isFastTraverse());
-                ls->setIsZMovement(ps->isZMovement());
-                ls->setIsMetric(isMetric);
-                ls->setIsAbsolute(ps->isAbsolute());
-                ls->setSpeed(ps->getSpeed());
-                ls->setSpindleSpeed(ps->getSpindleSpeed());
-                ls->setDwell(ps->getDwell());
-                this->testExtremes(*end);
-                this->testLength(*start, *end);
-                m_lines.append(ls);
-                m_lineIndexes[ps->getLineNumber()].append(m_lines.count() - 1);
+                indexes.append(chunk->lines.append(start, end, currentLine++, flags,
+                                                   ps.getSpeed(), ps.getSpindleSpeed(), ps.getDwell()));
+                testChunkExtremes(chunk, end);
+                testChunkLength(chunk, start, end);
             }
         }
         start = end;
+        hasStart = true;
+    }
+}
+
+void LineSegmentChunk::append(const LineSegmentChunk &other)
+{
+    if (other.lineIndexes.isEmpty()) return;
+    if (lineIndexes.isEmpty()) firstLineNumber = other.firstLineNumber;
+
+    int base = lines.count();
+    int offset = other.firstLineNumber - firstLineNumber;
+
+    lines.append(other.lines);
+
+    if (lineIndexes.count() < offset + other.lineIndexes.count()) lineIndexes.resize(offset + other.lineIndexes.count());
+    for (int i = 0; i < other.lineIndexes.count(); i++) {
+        foreach (int index, other.lineIndexes.at(i)) lineIndexes[offset + i].append(base + index);
+    }
+
+    min = QVector3D(Util::nMin(min.x(), other.min.x()), Util::nMin(min.y(), other.min.y()), Util::nMin(min.z(), other.min.z()));
+    max = QVector3D(Util::nMax(max.x(), other.max.x()), Util::nMax(max.y(), other.max.y()), Util::nMax(max.z(), other.max.z()));
+    if (!qIsNaN(other.minLength)) minLength = qIsNaN(minLength) ? other.minLength : qMin<double>(minLength, other.minLength);
+}
+
+void GcodeViewParse::appendLines(const LineSegmentChunk &chunk)
+{
+    int base = m_lines.count();
+
+    m_lines.append(chunk.lines);
+
+    // Keep one spare index item as if sized by parser points count
+    int size = chunk.firstLineNumber + chunk.lineIndexes.count() + 1;
+    if (m_lineIndexes.count() < size) m_lineIndexes.resize(size);
+
+    for (int i = 0; i < chunk.lineIndexes.count(); i++) {
+        int lineNumber = chunk.firstLineNumber + i;
+        if (lineNumber < 0) continue;
+        foreach (int index, chunk.lineIndexes.at(i)) m_lineIndexes[lineNumber].append(base + index);
     }
 
-    return m_lines;
+    testExtremes(chunk.min);
+    testExtremes(chunk.max);
+    if (!qIsNaN(chunk.minLength)) m_minLength = qIsNaN(m_minLength) ? chunk.minLength : qMin<double>(m_minLength, chunk.minLength);
+}
+
+int GcodeViewParse::getCurrentLine() const
+{
+    return currentLine;
+}
+
+void GcodeViewParse::setCurrentLine(int currentLine)
+{
+    this->currentLine = currentLine;
+}
+
+void GcodeViewParse::appendCheckpoint(const GcodeParseCheckpoint &checkpoint)
+{
+    m_checkpoints.append(checkpoint);
+}
+
+const QVector<GcodeParseCheckpoint> &GcodeViewParse::getCheckpoints() const
+{
+    return m_checkpoints;
+}
+
+// Replaces results of parsing from 'first' checkpoint to 'last' checkpoint by re-parsed chunk.
+// 'end' is the re-parsing state equivalent to 'last' checkpoint, results following it are shifted.
+// Everything from 'first' checkpoint is replaced if 'last' is negative.
+void GcodeViewParse::spliceLines(int first, int last, int rowDelta, const LineSegmentChunk &chunk,
+                                 const QVector<GcodeParseCheckpoint> &checkpoints, const GcodeParseCheckpoint &end)
+{
+    const GcodeParseCheckpoint start = m_checkpoints.at(first);
+    int segmentLast = last >= 0 ? m_checkpoints.at(last).segmentCount : m_lines.count();
+    int segmentDelta = chunk.lines.count() - (segmentLast - start.segmentCount);
+    int lineDelta = last >= 0 ? end.state.commandNumber - m_checkpoints.at(last).state.commandNumber : 0;
+    int currentLineDelta = last >= 0 ? end.currentLine - m_checkpoints.at(last).currentLine : 0;
+
+    // Segments
+    m_lines.replace(start.segmentCount, segmentLast, chunk.lines);
+    m_lines.shiftLineNumbers(start.segmentCount + chunk.lines.count(), currentLineDelta);
+
+    // Segments indexes
+    int lineFirst = qMax(start.state.points.last().getLineNumber(), 0);
+    int lineLast = last >= 0 ? qMax(m_checkpoints.at(last).state.points.last().getLineNumber(), 0) : m_lineIndexes.count();
+    QVector<QList<int>> lineIndexes = m_lineIndexes.mid(0, lineFirst);
+
+    for (int i = 0; i < chunk.lineIndexes.count(); i++) {
+        int lineNumber = chunk.firstLineNumber + i;
+        if (lineNumber < 0) continue;
+        if (lineIndexes.count() <= lineNumber) lineIndexes.resize(lineNumber + 1);
+        foreach (int index, chunk.lineIndexes.at(i)) lineIndexes[lineNumber].append(start.segmentCount + index);
+    }
+
+    int size = m_lineIndexes.count() + lineDelta;
+    if (lineIndexes.count() < size) lineIndexes.resize(size);
+
+    for (int i = lineLast; i < m_lineIndexes.count(); i++) {
+        QList<int> &indexes = lineIndexes[i + lineDelta];
+        foreach (int index, m_lineIndexes.at(i)) indexes.append(index + segmentDelta);
+    }
+    m_lineIndexes = lineIndexes;
+
+    // Checkpoints
+    QVector<GcodeParseCheckpoint> result = m_checkpoints.mid(0, first);
+    result += checkpoints;
+    for (int i = last; i >= 0 && i < m_checkpoints.count(); i++) {
+        GcodeParseCheckpoint checkpoint = m_checkpoints.at(i);
+        checkpoint.row += rowDelta;
+        checkpoint.state.shiftCommandNumber(lineDelta);
+        checkpoint.currentLine += currentLineDelta;
+        checkpoint.segmentCount += segmentDelta;
+        result.append(checkpoint);
+    }
+    m_checkpoints = result;
+
+    currentLine += currentLineDelta;
+
+    updateExtremes();
+}
+
+// Recalculates extremes of all segments
+void GcodeViewParse::updateExtremes()
+{
+    m_min = QVector3D(qQNaN(), qQNaN(), qQNaN());
+    m_max = QVector3D(qQNaN(), qQNaN(), qQNaN());
+    m_minLength = qQNaN();
+
+    for (int i = 0; i < m_lines.count(); i++) {
+        testExtremes(m_lines.getEnd(i));
+        if (!m_lines.isArc(i)) testLength(m_lines.getStart(i), m_lines.getEnd(i));
+    }
 }
 
-QList<LineSegment*> *GcodeViewParse::getLines()
+LineSegmentStore *GcodeViewParse::getLines()
 {
     return &m_lines;
 }
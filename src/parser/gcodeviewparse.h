@@ -11,10 +11,38 @@
 #include <QObject>
 #include <QVector3D>
 #include <QVector2D>
-#include "linesegment.h"
+#include "linesegmentstore.h"
 #include "gcodeparser.h"
 #include "utils/util.h"
 
+// Line segments built from a range of parser point segments
+struct LineSegmentChunk
+{
+    LineSegmentChunk() : firstLineNumber(0), min(qQNaN(), qQNaN(), qQNaN()), max(qQNaN(), qQNaN(), qQNaN()), minLength(qQNaN()) {}
+
+    // Appends following chunk
+    void append(const LineSegmentChunk &other);
+
+    LineSegmentStore lines;
+    // Segments indexes (relative to chunk) of parser lines starting from firstLineNumber
+    int firstLineNumber;
+    QVector<QList<int>> lineIndexes;
+    QVector3D min, max;
+    double minLength;
+};
+
+// Parsing state before a program row, parsing can be continued from it
+struct GcodeParseCheckpoint
+{
+    GcodeParseCheckpoint() : row(0), currentLine(0), segmentCount(0) {}
+
+    int row;
+    GcodeParserState state;
+    // Segments line counter & count of segments built before the last state point
+    int currentLine;
+    int segmentCount;
+};
+
 class GcodeViewParse : public QObject
 {
     Q_OBJECT
@@ -26,11 +54,23 @@ public:
     QVector3D &getMaximumExtremes();
     double getMinLength() const;
     QSize getResolution() const;
-    QList<LineSegment*> toObjRedux(QList<QString> gcode, double arcPrecision, bool arcDegreeMode);
-    QList<LineSegment*> getLineSegmentList();
-    QList<LineSegment*> getLinesFromParser(GcodeParser *gp, double arcPrecision, bool arcDegreeMode);
+    LineSegmentStore *toObjRedux(QList<QString> gcode, double arcPrecision, bool arcDegreeMode);
+    LineSegmentStore *getLinesFromParser(GcodeParser *gp, double arcPrecision, bool arcDegreeMode);
 
-    QList<LineSegment*> *getLines();
+    // Incremental building
+    void buildLines(const GcodeParser *gp, int first, int last, double arcPrecision, bool arcDegreeMode,
+                    LineSegmentChunk *chunk);
+    void appendLines(const LineSegmentChunk &chunk);
+    int getCurrentLine() const;
+    void setCurrentLine(int currentLine);
+
+    // Incremental re-parsing
+    void appendCheckpoint(const GcodeParseCheckpoint &checkpoint);
+    const QVector<GcodeParseCheckpoint> &getCheckpoints() const;
+    void spliceLines(int first, int last, int rowDelta, const LineSegmentChunk &chunk,
+                     const QVector<GcodeParseCheckpoint> &checkpoints, const GcodeParseCheckpoint &end);
+
+    LineSegmentStore *getLines();
     QVector<QList<int>> &getLinesIndexes();
 
     void reset();
@@ -40,14 +80,17 @@ signals:
 public slots:
 
 private:
+    friend class GcodeParseCache;
+
     bool absoluteMode;
     bool absoluteIJK;
 
     // Parsed object
     QVector3D m_min, m_max;
     double m_minLength;
-    QList<LineSegment*> m_lines;
-    QVector<QList<int>> m_lineIndexes;    
+    LineSegmentStore m_lines;
+    QVector<QList<int>> m_lineIndexes;
+    QVector<GcodeParseCheckpoint> m_checkpoints;
 
     // Parsing state.
     QVector3D lastPoint;
@@ -58,6 +101,7 @@ private:
     void testExtremes(QVector3D p3d);
     void testExtremes(double x, double y, double z);
     void testLength(const QVector3D &start, const QVector3D &end);
+    void updateExtremes();
 };
 
 #endif // GCODEVIEWPARSE_H
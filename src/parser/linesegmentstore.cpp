@@ -0,0 +1,318 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <algorithm>
+#include "linesegmentstore.h"
+
+static inline bool sameValue(double v1, double v2)
+{
+    return v1 == v2 || (qIsNaN(v1) && qIsNaN(v2));
+}
+
+template <typename T>
+static void appendVectorRange(QVector<T> &target, const QVector<T> &source, int first, int last)
+{
+    int base = target.count();
+
+    target.resize(base + last - first);
+    std::copy(source.constBegin() + first, source.constBegin() + last, target.begin() + base);
+}
+
+LineSegmentStore::LineSegmentStore()
+{
+}
+
+int LineSegmentStore::count() const
+{
+    return m_ends.count();
+}
+
+bool LineSegmentStore::isEmpty() const
+{
+    return m_ends.isEmpty();
+}
+
+void LineSegmentStore::clear()
+{
+    m_starts.clear();
+    m_ends.clear();
+    m_lineNumbers.clear();
+    m_vertexIndexes.clear();
+    m_flags.clear();
+    m_runs.clear();
+}
+
+void LineSegmentStore::reserve(int count)
+{
+    m_starts.reserve(count);
+    m_ends.reserve(count);
+    m_lineNumbers.reserve(count);
+    m_vertexIndexes.reserve(count);
+    m_flags.reserve(count);
+}
+
+void LineSegmentStore::squeeze()
+{
+    m_starts.squeeze();
+    m_ends.squeeze();
+    m_lineNumbers.squeeze();
+    m_vertexIndexes.squeeze();
+    m_flags.squeeze();
+    m_runs.squeeze();
+}
+
+int LineSegmentStore::append(const QVector3D &start, const QVector3D &end, int lineNumber, int flags,
+                             double speed, double spindleSpeed, double dwell)
+{
+    int index = m_ends.count();
+
+    m_starts.append(start);
+    m_ends.append(end);
+    m_lineNumbers.append(lineNumber);
+    m_vertexIndexes.append(-1);
+    m_flags.append(flags);
+
+    // Start new run on attributes change
+    if (m_runs.isEmpty() || !sameValue(m_runs.last().speed, speed) || !sameValue(m_runs.last().spindleSpeed, spindleSpeed)
+            || !sameValue(m_runs.last().dwell, dwell)) {
+        Run r;
+        r.first = index;
+        r.speed = speed;
+        r.spindleSpeed = spindleSpeed;
+        r.dwell = dwell;
+        m_runs.append(r);
+    }
+
+    return index;
+}
+
+// Appends copy of other store segment with new positions
+int LineSegmentStore::append(const LineSegmentStore &other, int index, const QVector3D &start, const QVector3D &end)
+{
+    const Run &r = other.run(index);
+
+    return append(start, end, other.getLineNumber(index), other.flags(index), r.speed, r.spindleSpeed, r.dwell);
+}
+
+void LineSegmentStore::append(const LineSegmentStore &other)
+{
+    if (other.isEmpty()) return;
+
+    int base = m_ends.count();
+
+    m_starts += other.m_starts;
+    m_ends += other.m_ends;
+    m_lineNumbers += other.m_lineNumbers;
+    m_flags += other.m_flags;
+
+    // Vertex indexes are drawer specific
+    m_vertexIndexes.resize(m_ends.count());
+    std::fill(m_vertexIndexes.begin() + base, m_vertexIndexes.end(), -1);
+
+    foreach (Run r, other.m_runs) {
+        r.first += base;
+        appendRun(r);
+    }
+}
+
+void LineSegmentStore::replace(int first, int last, const LineSegmentStore &other)
+{
+    LineSegmentStore result;
+
+    result.reserve(count() - (last - first) + other.count());
+    result.appendRange(*this, 0, first);
+    result.append(other);
+    result.appendRange(*this, last, count());
+
+    *this = result;
+}
+
+void LineSegmentStore::shiftLineNumbers(int first, int delta)
+{
+    if (delta == 0) return;
+
+    for (int i = first; i < m_lineNumbers.count(); i++) m_lineNumbers[i] += delta;
+}
+
+// Appends run unless it continues the last one
+void LineSegmentStore::appendRun(const Run &r)
+{
+    if (!m_runs.isEmpty() && sameValue(m_runs.last().speed, r.speed) && sameValue(m_runs.last().spindleSpeed, r.spindleSpeed)
+            && sameValue(m_runs.last().dwell, r.dwell)) return;
+
+    m_runs.append(r);
+}
+
+// Appends segments [first, last) of other store, keeping vertex indexes
+void LineSegmentStore::appendRange(const LineSegmentStore &other, int first, int last)
+{
+    if (first >= last) return;
+
+    int base = m_ends.count();
+
+    appendVectorRange(m_starts, other.m_starts, first, last);
+    appendVectorRange(m_ends, other.m_ends, first, last);
+    appendVectorRange(m_lineNumbers, other.m_lineNumbers, first, last);
+    appendVectorRange(m_vertexIndexes, other.m_vertexIndexes, first, last);
+    appendVectorRange(m_flags, other.m_flags, first, last);
+
+    for (int i = other.runIndex(first); i < other.m_runs.count() && other.m_runs.at(i).first < last; i++) {
+        Run r = other.m_runs.at(i);
+        r.first = base + qMax(r.first, first) - first;
+        appendRun(r);
+    }
+}
+
+int LineSegmentStore::planeFlags(PointSegment::planes plane)
+{
+    return (plane << PlaneShift) & PlaneMask;
+}
+
+int LineSegmentStore::getLineNumber(int index) const
+{
+    return m_lineNumbers.at(index);
+}
+
+int LineSegmentStore::flags(int index) const
+{
+    return m_flags.at(index);
+}
+
+const QVector3D &LineSegmentStore::getStart(int index) const
+{
+    return m_starts.at(index);
+}
+
+void LineSegmentStore::setStart(int index, const QVector3D &start)
+{
+    m_starts[index] = start;
+}
+
+const QVector3D &LineSegmentStore::getEnd(int index) const
+{
+    return m_ends.at(index);
+}
+
+void LineSegmentStore::setEnd(int index, const QVector3D &end)
+{
+    m_ends[index] = end;
+}
+
+const QVector<QVector3D> &LineSegmentStore::starts() const
+{
+    return m_starts;
+}
+
+const QVector<QVector3D> &LineSegmentStore::ends() const
+{
+    return m_ends;
+}
+
+int LineSegmentStore::runIndex(int index) const
+{
+    // Last run starting at or before index
+    QVector<Run>::const_iterator it = std::upper_bound(m_runs.constBegin(), m_runs.constEnd(), index,
+                                                       [] (int i, const Run &r) { return i < r.first; });
+    return it - m_runs.constBegin() - 1;
+}
+
+const LineSegmentStore::Run &LineSegmentStore::run(int index) const
+{
+    return m_runs.at(runIndex(index));
+}
+
+double LineSegmentStore::getSpeed(int index) const
+{
+    return run(index).speed;
+}
+
+double LineSegmentStore::getSpindleSpeed(int index) const
+{
+    return run(index).spindleSpeed;
+}
+
+double LineSegmentStore::getDwell(int index) const
+{
+    return run(index).dwell;
+}
+
+bool LineSegmentStore::isZMovement(int index) const
+{
+    return m_flags.at(index) & ZMovement;
+}
+
+bool LineSegmentStore::isArc(int index) const
+{
+    return m_flags.at(index) & Arc;
+}
+
+bool LineSegmentStore::isClockwise(int index) const
+{
+    return m_flags.at(index) & Clockwise;
+}
+
+bool LineSegmentStore::isFastTraverse(int index) const
+{
+    return m_flags.at(index) & FastTraverse;
+}
+
+bool LineSegmentStore::isMetric(int index) const
+{
+    return m_flags.at(index) & Metric;
+}
+
+bool LineSegmentStore::isAbsolute(int index) const
+{
+    return m_flags.at(index) & Absolute;
+}
+
+PointSegment::planes LineSegmentStore::plane(int index) const
+{
+    return (PointSegment::planes)((m_flags.at(index) & PlaneMask) >> PlaneShift);
+}
+
+bool LineSegmentStore::drawn(int index) const
+{
+    return m_flags.at(index) & Drawn;
+}
+
+void LineSegmentStore::setDrawn(int index, bool drawn)
+{
+    setFlag(index, Drawn, drawn);
+}
+
+bool LineSegmentStore::isHightlight(int index) const
+{
+    return m_flags.at(index) & Hightlight;
+}
+
+void LineSegmentStore::setIsHightlight(int index, bool isHightlight)
+{
+    setFlag(index, Hightlight, isHightlight);
+}
+
+int LineSegmentStore::vertexIndex(int index) const
+{
+    return m_vertexIndexes.at(index);
+}
+
+void LineSegmentStore::setVertexIndex(int index, int vertexIndex)
+{
+    m_vertexIndexes[index] = vertexIndex;
+}
+
+bool LineSegmentStore::contains(int index, const QVector3D &point) const
+{
+    double delta;
+    QVector3D line = m_ends.at(index) - m_starts.at(index);
+    QVector3D pt = point - m_starts.at(index);
+
+    delta = (line - pt).length() - (line.length() - pt.length());
+
+    return delta < 0.01;
+}
+
+void LineSegmentStore::setFlag(int index, int flag, bool on)
+{
+    if (on) m_flags[index] |= flag; else m_flags[index] &= ~flag;
+}
@@ -0,0 +1,107 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef LINESEGMENTSTORE_H
+#define LINESEGMENTSTORE_H
+
+#include <QVector>
+#include <QVector3D>
+#include "pointsegment.h"
+
+// Toolpath line segments, stored as structure of arrays.
+// Segments are addressed by index, speed/spindle speed/dwell are stored
+// once per run of segments with equal values.
+class LineSegmentStore
+{
+public:
+    enum Flag {
+        ZMovement = 0x01,
+        Arc = 0x02,
+        Clockwise = 0x04,
+        FastTraverse = 0x08,
+        Metric = 0x10,
+        Absolute = 0x20,
+        Drawn = 0x40,
+        Hightlight = 0x80,
+        PlaneShift = 8,
+        PlaneMask = 0x300
+    };
+
+    LineSegmentStore();
+
+    int count() const;
+    bool isEmpty() const;
+    void clear();
+    void reserve(int count);
+    void squeeze();
+
+    int append(const QVector3D &start, const QVector3D &end, int lineNumber, int flags,
+               double speed, double spindleSpeed, double dwell);
+    int append(const LineSegmentStore &other, int index, const QVector3D &start, const QVector3D &end);
+    void append(const LineSegmentStore &other);
+
+    // Replaces segments [first, last) with other store segments
+    void replace(int first, int last, const LineSegmentStore &other);
+    void shiftLineNumbers(int first, int delta);
+
+    static int planeFlags(PointSegment::planes plane);
+
+    int getLineNumber(int index) const;
+    int flags(int index) const;
+
+    const QVector3D &getStart(int index) const;
+    void setStart(int index, const QVector3D &start);
+    const QVector3D &getEnd(int index) const;
+    void setEnd(int index, const QVector3D &end);
+
+    // Implicitly shared, copies stay valid while store is changed
+    const QVector<QVector3D> &starts() const;
+    const QVector<QVector3D> &ends() const;
+
+    double getSpeed(int index) const;
+    double getSpindleSpeed(int index) const;
+    double getDwell(int index) const;
+
+    bool isZMovement(int index) const;
+    bool isArc(int index) const;
+    bool isClockwise(int index) const;
+    bool isFastTraverse(int index) const;
+    bool isMetric(int index) const;
+    bool isAbsolute(int index) const;
+    PointSegment::planes plane(int index) const;
+
+    bool drawn(int index) const;
+    void setDrawn(int index, bool drawn);
+    bool isHightlight(int index) const;
+    void setIsHightlight(int index, bool isHightlight);
+
+    int vertexIndex(int index) const;
+    void setVertexIndex(int index, int vertexIndex);
+
+    bool contains(int index, const QVector3D &point) const;
+
+private:
+    friend class GcodeParseCache;
+
+    struct Run {
+        int first;
+        double speed;
+        double spindleSpeed;
+        double dwell;
+    };
+
+    QVector<QVector3D> m_starts;
+    QVector<QVector3D> m_ends;
+    QVector<int> m_lineNumbers;
+    QVector<int> m_vertexIndexes;
+    QVector<quint16> m_flags;
+    QVector<Run> m_runs;
+
+    int runIndex(int index) const;
+    const Run &run(int index) const;
+    void appendRun(const Run &r);
+    void appendRange(const LineSegmentStore &other, int first, int last);
+    void setFlag(int index, int flag, bool on);
+};
+
+#endif // LINESEGMENTSTORE_H
@@ -12,6 +12,8 @@
 
 #include "arcproperties.h"
 
+// Value type, stored contiguously by the parser.
+// Arc data is kept in the parser's side table, referenced by index.
 class PointSegment
 {
 public:
@@ -22,36 +24,26 @@ public:
     };
 
     PointSegment();
-    PointSegment(PointSegment *ps);
-    PointSegment(const QVector3D *b, int num);
-    PointSegment(QVector3D *point, int num, QVector3D *center, double radius, bool clockwise);
-    ~PointSegment();
-    void setPoint(QVector3D m_point);
-    QVector3D* point();
-
-    QVector<double> points();
-    void setToolHead(int head);
-    int getToolhead();
+    PointSegment(const QVector3D &point, int num);
+
+    const QVector3D &point() const;
+    void setPoint(const QVector3D &point);
+    QVector3D metricPoint() const;
+
     void setLineNumber(int num);
-    int getLineNumber();
+    int getLineNumber() const;
     void setSpeed(double s);
-    double getSpeed();
+    double getSpeed() const;
     void setIsZMovement(bool isZ);
-    bool isZMovement();
-    void setIsMetric(bool m_isMetric);
-    bool isMetric();
-    void setIsArc(bool isA);
-    bool isArc();
+    bool isZMovement() const;
+    void setIsMetric(bool isMetric);
+    bool isMetric() const;
     void setIsFastTraverse(bool isF);
-    bool isFastTraverse();
-    void setArcCenter(QVector3D *center);
-    QVector<double> centerPoints();
-    QVector3D *center();
-    void setIsClockwise(bool clockwise);
-    bool isClockwise();
-    void setRadius(double rad);
-    double getRadius();
-    void convertToMetric();
+    bool isFastTraverse() const;
+
+    bool isArc() const;
+    int arcIndex() const;
+    void setArcIndex(int index);
 
     bool isAbsolute() const;
     void setIsAbsolute(bool isAbsolute);
@@ -66,19 +58,19 @@ public:
     void setDwell(double dwell);
 
 private:
-    ArcProperties *m_arcProperties;
-    int m_toolhead;
+    QVector3D m_point;
     double m_speed;
     double m_spindleSpeed;
     double m_dwell;
-    QVector3D *m_point;
+    int m_lineNumber;
+    int m_arcIndex;
+    planes m_plane;
     bool m_isMetric;
     bool m_isZMovement;
-    bool m_isArc;
     bool m_isFastTraverse;
     bool m_isAbsolute;
-    int m_lineNumber;
-    planes m_plane;
 };
 
+Q_DECLARE_TYPEINFO(PointSegment, Q_MOVABLE_TYPE);
+
 #endif // POINTSEGMENT_H
@@ -6,10 +6,19 @@ precision mediump float;
 
 uniform mat4 mvp_matrix;
 uniform mat4 mv_matrix;
+uniform vec3 u_palette[8];
+uniform bool u_arcs;
 
 attribute vec4 a_position;
 attribute vec4 a_color;
 attribute vec4 a_start;
+attribute vec4 a_palette;
+attribute float a_state;
+
+// Arc instance: center & radius, start angle, sweep & helix travel, head & tail states & split
+attribute vec4 a_arc;
+attribute vec3 a_arcSweep;
+attribute vec3 a_arcState;
 
 varying vec4 v_color;
 varying vec2 v_position;
@@ -23,8 +32,22 @@ bool isNan(float val)
 
 void main()
 {
+    vec4 position = a_position;
+    float state = a_state;
+
+    // Arc point at strip parameter, plane axes are swizzled to XYZ
+    if (u_arcs) {
+        float t = a_position.x;
+        float angle = a_arcSweep.x + a_arcSweep.y * t;
+        vec3 local = vec3(a_arc.w * cos(angle), a_arc.w * sin(angle), a_arcSweep.z * t);
+        float plane = a_palette.z * 255.0;
+
+        position = vec4(a_arc.xyz + (plane < 0.5 ? local : plane < 1.5 ? local.yzx : local.zxy), 1.0);
+        state = t <= a_arcState.z ? a_arcState.x : a_arcState.y;
+    }
+
     // Calculate interpolated vertex position & line start point
-    v_position = (mv_matrix * a_position).xy;
+    v_position = (mv_matrix * position).xy;
 
     if (!isNan(a_start.x) && !isNan(a_start.y)) {
         v_start = (mv_matrix * a_start).xy;
@@ -41,7 +64,14 @@ void main()
     }
 
     // Calculate vertex position in screen space
-    gl_Position = mvp_matrix * a_position;
+    gl_Position = mvp_matrix * position;
 
-    v_color = a_color;
+    // Compact vertices are colored by palette index & brightness, state overrides index
+    if (state > 0.0) {
+        v_color = vec4(u_palette[int(state * 255.0 + 0.5)], 1.0);
+    } else if (a_palette.w > 0.5) {
+        v_color = vec4(u_palette[int(a_palette.x * 255.0 + 0.5)] * a_palette.y, 1.0);
+    } else {
+        v_color = a_color;
+    }
 }
@@ -2,13 +2,21 @@
 // Copyright 2015-2016 Hayrullin Denis Ravilevich
 
 #include "gcodetablemodel.h"
+#include "../parser/gcodetokenizer.h"
+#include "../parser/gcodefilereader.h"
 
 GCodeTableModel::GCodeTableModel(QObject *parent) :
     QAbstractTableModel(parent)
 {
+    m_reader = NULL;
     m_headers << tr("#") << tr("Command") << tr("State") << tr("Response") << tr("Line") << tr("Args");
 }
 
+GCodeTableModel::~GCodeTableModel()
+{
+    delete m_reader;
+}
+
 QVariant GCodeTableModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid()) return QVariant();
@@ -19,7 +27,7 @@ QVariant GCodeTableModel::data(const QModelIndex &index, int role) const
         switch (index.column())
         {
         case 0: return index.row() == this->rowCount() - 1 ? QString() : QString::number(index.row() + 1);
-        case 1: return m_data.at(index.row()).command;
+        case 1: return command(index.row());
         case 2:
             if (index.row() == this->rowCount() - 1) return QString();
             switch (m_data.at(index.row()).state) {
@@ -29,9 +37,15 @@ QVariant GCodeTableModel::data(const QModelIndex &index, int role) const
             case GCodeItem::Skipped: return tr("Skipped");
             }
             return tr("Unknown");
-        case 3: return m_data.at(index.row()).response;
+        case 3: return m_responses.value(index.row());
         case 4: return m_data.at(index.row()).line;
-        case 5: return QVariant(m_data.at(index.row()).args);
+        case 5: {
+            // Split on demand, args aren't stored
+            QString command = this->command(index.row());
+            GcodeTokenizer words;
+            words.tokenize(command);
+            return words.texts(command);
+        }
         }
     }
 
@@ -48,14 +62,23 @@ QVariant GCodeTableModel::data(const QModelIndex &index, int role) const
 bool GCodeTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
     if (index.isValid() && role == Qt::EditRole) {
+        GCodeItem &item = m_data[index.row()];
+
         switch (index.column())
         {
         case 0: return false;
-        case 1: m_data[index.row()].command = value.toString(); break;
-        case 2: m_data[index.row()].state = value.toInt(); break;
-        case 3: m_data[index.row()].response = value.toString(); break;
-        case 4: m_data[index.row()].line = value.toInt(); break;
-        case 5: m_data[index.row()].args = value.toStringList(); break;
+        case 1:
+            // Edited command is detached from source file
+            if (item.source >= 0) {
+                item.source = appendEdited(value.toString());
+            } else {
+                m_edited[-item.source - 1] = value.toString();
+            }
+            break;
+        case 2: item.state = value.toInt(); break;
+        case 3: setResponse(index.row(), value.toString()); break;
+        case 4: item.line = value.toInt(); break;
+        case 5: return false;
         }
         emit dataChanged(index, index);
         return true;
@@ -67,8 +90,14 @@ bool GCodeTableModel::insertRow(int row, const QModelIndex &parent)
 {
     if (row > rowCount()) return false;
 
+    GCodeItem item;
+    item.source = appendEdited(QString());
+    item.line = -1;
+    item.state = GCodeItem::InQueue;
+
     beginInsertRows(parent, row, row);
-    m_data.insert(row, GCodeItem());
+    m_data.insert(row, item);
+    shiftResponses(row, 1);
     endInsertRows();
     return true;
 }
@@ -77,16 +106,23 @@ bool GCodeTableModel::removeRow(int row, const QModelIndex &parent)
 {
     //if (!index(row, 0).isValid()) return false;
 
-    beginRemoveRows(parent, row, row);
-    m_data.removeAt(row);
-    endRemoveRows();
-    return true;
+    return removeRows(row, 1, parent);
 }
 
 bool GCodeTableModel::removeRows(int row, int count, const QModelIndex &parent)
 {
     beginRemoveRows(parent, row, row + count - 1);
-    m_data.erase(m_data.begin() + row, m_data.begin() + row + count);
+
+    // Release edited commands of removed rows
+    for (int i = row; i < row + count; i++) {
+        if (m_data.at(i).source < 0) {
+            m_edited[-m_data.at(i).source - 1] = QString();
+            m_freeEdited.append(-m_data.at(i).source - 1);
+        }
+    }
+
+    m_data.remove(row, count);
+    shiftResponses(row, -count);
     endRemoveRows();
     return true;
 }
@@ -95,9 +131,14 @@ void GCodeTableModel::clear()
 {
     beginResetModel();
 
-//    foreach (GCodeItem* item, m_data) delete item;
-
     m_data.clear();
+    m_edited.clear();
+    m_freeEdited.clear();
+    m_responses.clear();
+
+    delete m_reader;
+    m_reader = NULL;
+
     endResetModel();
 }
 
@@ -129,7 +170,175 @@ Qt::ItemFlags GCodeTableModel::flags(const QModelIndex &index) const
     else return QAbstractTableModel::flags(index);
 }
 
-QList<GCodeItem> &GCodeTableModel::data()
+void GCodeTableModel::setReader(GcodeFileReader *reader)
+{
+    if (reader == m_reader) return;
+
+    delete m_reader;
+    m_reader = reader;
+}
+
+const GcodeFileReader *GCodeTableModel::reader() const
+{
+    return m_reader;
+}
+
+void GCodeTableModel::detachReader()
+{
+    if (m_reader) m_reader->detach();
+}
+
+// Saved file has a line per row except trailing blank one
+bool GCodeTableModel::rebase(GcodeFileReader *reader)
+{
+    if (reader->lineCount() < m_data.count() - 1) return false;
+
+    setReader(reader);
+
+    m_edited.clear();
+    m_freeEdited.clear();
+
+    for (int i = 0; i < m_data.count() - 1; i++) m_data[i].source = i;
+    if (!m_data.isEmpty()) m_data.last().source = appendEdited(QString());
+
+    return true;
+}
+
+void GCodeTableModel::reserve(int count)
+{
+    m_data.reserve(count);
+}
+
+// Rows are appended w/o notifications, view should be detached while filling
+void GCodeTableModel::appendSourceRow(int source, int line)
+{
+    GCodeItem item;
+    item.source = source;
+    item.line = line;
+    item.state = GCodeItem::InQueue;
+
+    m_data.append(item);
+}
+
+void GCodeTableModel::appendRow(const QString &command, int line)
+{
+    GCodeItem item;
+    item.source = appendEdited(command);
+    item.line = line;
+    item.state = GCodeItem::InQueue;
+
+    m_data.append(item);
+}
+
+QString GCodeTableModel::command(int row) const
+{
+    int source = m_data.at(row).source;
+
+    return source >= 0 ? m_reader->trimmedLineString(source) : m_edited.at(-source - 1);
+}
+
+int GCodeTableModel::line(int row) const
 {
-    return m_data;
+    return m_data.at(row).line;
+}
+
+void GCodeTableModel::setLine(int row, int line)
+{
+    m_data[row].line = line;
+}
+
+// Lines are ascending by rows, trailing rows w/o line are excluded
+int GCodeTableModel::rowOfLine(int line) const
+{
+    int count = m_data.count();
+    while (count > 0 && m_data.at(count - 1).line < 0) count--;
+
+    int first = 0;
+    int last = count;
+    while (first < last) {
+        int middle = (first + last) / 2;
+        if (m_data.at(middle).line < line) first = middle + 1; else last = middle;
+    }
+
+    return first < count && m_data.at(first).line == line ? first : -1;
+}
+
+char GCodeTableModel::state(int row) const
+{
+    return m_data.at(row).state;
+}
+
+void GCodeTableModel::setState(int row, char state)
+{
+    m_data[row].state = state;
+}
+
+void GCodeTableModel::setStates(int first, int last, char state)
+{
+    if (first >= last) return;
+
+    for (int i = first; i < last; i++) m_data[i].state = state;
+
+    emit dataChanged(index(first, 2), index(last - 1, 2));
+}
+
+QString GCodeTableModel::response(int row) const
+{
+    return m_responses.value(row);
+}
+
+void GCodeTableModel::setResponse(int row, const QString &response)
+{
+    if (response.isEmpty()) m_responses.remove(row);
+    else m_responses.insert(row, response);
+}
+
+void GCodeTableModel::resetStates(int skipped)
+{
+    for (int i = 0; i < m_data.count(); i++) {
+        m_data[i].state = i < skipped ? GCodeItem::Skipped : GCodeItem::InQueue;
+    }
+    m_responses.clear();
+}
+
+QVector<int> GCodeTableModel::sources() const
+{
+    QVector<int> sources(m_data.count());
+    for (int i = 0; i < m_data.count(); i++) sources[i] = m_data.at(i).source;
+
+    return sources;
+}
+
+const QStringList &GCodeTableModel::editedCommands() const
+{
+    return m_edited;
+}
+
+// Returns row source of command
+int GCodeTableModel::appendEdited(const QString &command)
+{
+    if (!m_freeEdited.isEmpty()) {
+        int index = m_freeEdited.takeLast();
+        m_edited[index] = command;
+        return -index - 1;
+    }
+
+    m_edited.append(command);
+    return -m_edited.count();
+}
+
+// Moves responses of rows following 'row' by delta, responses of removed rows are dropped
+void GCodeTableModel::shiftResponses(int row, int delta)
+{
+    if (m_responses.isEmpty()) return;
+
+    QHash<int, QString> responses;
+    QHash<int, QString>::const_iterator i;
+
+    for (i = m_responses.constBegin(); i != m_responses.constEnd(); ++i) {
+        if (i.key() < row) responses.insert(i.key(), i.value());
+        else if (i.key() >= row - qMin(delta, 0)) responses.insert(i.key() + delta, i.value());
+    }
+
+    m_responses = responses;
 }
@@ -6,23 +6,34 @@
 
 #include <QAbstractTableModel>
 #include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
 
+class GcodeFileReader;
+
+// Compact table row, command text isn't stored but referenced
 struct GCodeItem
 {
     enum States { InQueue, Sent, Processed, Skipped };
 
-    QString command;
-    char state;
-    QString response;
+    // Source file line (>= 0) or edited command index (-index - 1)
+    int source;
     int line;
-    QStringList args;
+    char state;
 };
 
+Q_DECLARE_TYPEINFO(GCodeItem, Q_PRIMITIVE_TYPE);
+
+// Program table model.
+// Commands are decoded from source file on demand, only edited and inserted rows
+// keep their text. Responses are stored for rows that have them.
 class GCodeTableModel : public QAbstractTableModel
 {
     Q_OBJECT
 public:
     explicit GCodeTableModel(QObject *parent = 0);
+    ~GCodeTableModel();
 
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
@@ -37,15 +48,53 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     Qt::ItemFlags flags(const QModelIndex &index) const;
 
-    QList<GCodeItem> &data();
+    // Model takes ownership of reader, it's kept until model is cleared
+    void setReader(GcodeFileReader *reader);
+    const GcodeFileReader *reader() const;
+    // Rows are read from memory, program file is released
+    void detachReader();
+    // Rows are made references to lines of file model was saved to, edited commands are released.
+    // Takes ownership of reader, returns false if reader has less lines than rows.
+    bool rebase(GcodeFileReader *reader);
+
+    void reserve(int count);
+    void appendSourceRow(int source, int line);
+    void appendRow(const QString &command, int line = -1);
+
+    QString command(int row) const;
+    int line(int row) const;
+    void setLine(int row, int line);
+    // First row of parser line, -1 if none
+    int rowOfLine(int line) const;
+    char state(int row) const;
+    void setState(int row, char state);
+    // Rows [first, last) with single change notification
+    void setStates(int first, int last, char state);
+    QString response(int row) const;
+    void setResponse(int row, const QString &response);
+
+    // Rows before 'skipped' one are marked as skipped, others are queued. Responses are cleared.
+    void resetStates(int skipped = 0);
+
+    // Row command references, to be resolved by reader & edited commands
+    QVector<int> sources() const;
+    const QStringList &editedCommands() const;
 
 signals:
 
 public slots:
 
 private:
-    QList<GCodeItem> m_data;
+    QVector<GCodeItem> m_data;
+    QStringList m_edited;
+    // Edited commands of removed rows, reused by new ones
+    QVector<int> m_freeEdited;
+    QHash<int, QString> m_responses;
+    GcodeFileReader *m_reader;
     QStringList m_headers;
+
+    void shiftResponses(int row, int delta);
+    int appendEdited(const QString &command);
 };
 
 #endif // GCODETABLEMODEL_H
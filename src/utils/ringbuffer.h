@@ -0,0 +1,71 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QVector>
+
+// Preallocated FIFO of sender's commands. Append, take & indexed access are O(1).
+// Capacity is fixed, append fails if buffer is full.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity)
+    {
+        int size = 2;
+        while (size < capacity) size <<= 1;
+
+        m_items.resize(size);
+        m_head = 0;
+        m_count = 0;
+    }
+
+    bool append(const T &value)
+    {
+        if (m_count == m_items.size()) return false;
+
+        m_items[(m_head + m_count) & (m_items.size() - 1)] = value;
+        m_count++;
+
+        return true;
+    }
+
+    T takeFirst()
+    {
+        T value = m_items.at(m_head);
+
+        m_items[m_head] = T();
+        m_head = (m_head + 1) & (m_items.size() - 1);
+        m_count--;
+
+        return value;
+    }
+
+    T &operator[](int i) {return m_items[(m_head + i) & (m_items.size() - 1)];}
+    const T &at(int i) const {return m_items.at((m_head + i) & (m_items.size() - 1));}
+    T &first() {return (*this)[0];}
+    const T &first() const {return at(0);}
+    T &last() {return (*this)[m_count - 1];}
+    const T &last() const {return at(m_count - 1);}
+
+    int count() const {return m_count;}
+    int length() const {return m_count;}
+    bool isEmpty() const {return m_count == 0;}
+    bool isFull() const {return m_count == m_items.size();}
+    int capacity() const {return m_items.size();}
+
+    void clear()
+    {
+        while (m_count > 0) takeFirst();
+        m_head = 0;
+    }
+
+private:
+    QVector<T> m_items;
+    int m_head;
+    int m_count;
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,73 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QAtomicInt>
+
+// Bounded lock-free queue for exactly one producer thread & one consumer thread.
+// Capacity is rounded up to power of two, one slot is kept free to tell full from empty.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity)
+    {
+        m_size = 2;
+        while (m_size < capacity + 1) m_size <<= 1;
+
+        m_items = new T[m_size];
+        m_head.storeRelaxed(0);
+        m_tail.storeRelaxed(0);
+    }
+
+    ~SpscQueue()
+    {
+        delete[] m_items;
+    }
+
+    // Producer side, returns false if queue is full
+    bool push(const T &value)
+    {
+        int tail = m_tail.loadRelaxed();
+        int next = (tail + 1) & (m_size - 1);
+
+        if (next == m_head.loadAcquire()) return false;
+
+        m_items[tail] = value;
+        m_tail.storeRelease(next);
+
+        return true;
+    }
+
+    // Consumer side, returns false if queue is empty
+    bool pop(T &value)
+    {
+        int head = m_head.loadRelaxed();
+
+        if (head == m_tail.loadAcquire()) return false;
+
+        value = m_items[head];
+        m_items[head] = T();
+        m_head.storeRelease((head + 1) & (m_size - 1));
+
+        return true;
+    }
+
+    // Consumer side
+    bool isEmpty() const
+    {
+        return m_head.loadRelaxed() == m_tail.loadAcquire();
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    T *m_items;
+    int m_size;
+    QAtomicInt m_head;
+    QAtomicInt m_tail;
+};
+
+#endif // SPSCQUEUE_H
@@ -23,6 +23,11 @@ GLWidget::GLWidget(QWidget *parent) : QGLWidget(parent), m_shaderProgram(0)
 {
     m_animateView = false;
     m_updatesEnabled = false;
+    m_needsRedraw = false;
+    m_countingFrames = false;
+
+    m_vsync = false;
+    m_targetFps = 60;
 
     m_xRot = 90;
     m_yRot = 0;
@@ -56,10 +61,8 @@ GLWidget::GLWidget(QWidget *parent) : QGLWidget(parent), m_shaderProgram(0)
     m_spendTime.setHMS(0, 0, 0);
     m_estimatedTime.setHMS(0, 0, 0);
 
-    m_vsync = false;
-    m_targetFps = 60;
-
-    QTimer::singleShot(1000, this, SLOT(onFramesTimer()));
+    // Hover is reported for toolpath lookup
+    setMouseTracking(true);
 }
 
 GLWidget::~GLWidget()
@@ -76,6 +79,8 @@ double GLWidget::calculateVolume(QVector3D size) {
 void GLWidget::addDrawable(ShaderDrawable *drawable)
 {
     m_shaderDrawables.append(drawable);
+    drawable->setView(this);
+    requestUpdate();
 }
 
 void GLWidget::fitDrawable(ShaderDrawable *drawable)
@@ -135,6 +140,8 @@ void GLWidget::updateExtremes(ShaderDrawable *drawable)
     m_xSize = m_xMax - m_xMin;
     m_ySize = m_yMax - m_yMin;
     m_zSize = m_zMax - m_zMin;
+
+    requestUpdate();
 }
 
 bool GLWidget::antialiasing() const
@@ -145,6 +152,7 @@ bool GLWidget::antialiasing() const
 void GLWidget::setAntialiasing(bool antialiasing)
 {
     m_antialiasing = antialiasing;
+    requestUpdate();
 }
 
 void GLWidget::onFramesTimer()
@@ -152,12 +160,19 @@ void GLWidget::onFramesTimer()
     m_fps = m_frames;
     m_frames = 0;
 
-    QTimer::singleShot(1000, this, SLOT(onFramesTimer()));
+    // Counting stops with rendering, restarted by next frame
+    if (m_fps > 0) QTimer::singleShot(1000, this, SLOT(onFramesTimer())); else m_countingFrames = false;
+}
+
+void GLWidget::requestUpdate()
+{
+    m_needsRedraw = true;
+    if (!m_timerPaint.isActive()) m_timerPaint.start(m_vsync ? 0 : 1000 / m_targetFps, Qt::PreciseTimer, this);
 }
 
 void GLWidget::viewAnimation()
 {
-    double t = (double)m_animationFrame++ / (m_fps * 0.2);
+    double t = m_animationTime.elapsed() / 200.0;
 
     if (t >= 1) stopViewAnimation();
 
@@ -177,7 +192,10 @@ QString GLWidget::pinState() const
 
 void GLWidget::setPinState(const QString &pinState)
 {
+    if (m_pinState == pinState) return;
+
     m_pinState = pinState;
+    requestUpdate();
 }
 
 QString GLWidget::speedState() const
@@ -187,7 +205,10 @@ QString GLWidget::speedState() const
 
 void GLWidget::setSpeedState(const QString &additionalStatus)
 {
+    if (m_speedState == additionalStatus) return;
+
     m_speedState = additionalStatus;
+    requestUpdate();
 }
 
 bool GLWidget::vsync() const
@@ -208,6 +229,7 @@ bool GLWidget::msaa() const
 void GLWidget::setMsaa(bool msaa)
 {
     m_msaa = msaa;
+    requestUpdate();
 }
 
 bool GLWidget::updatesEnabled() const
@@ -218,6 +240,7 @@ bool GLWidget::updatesEnabled() const
 void GLWidget::setUpdatesEnabled(bool updatesEnabled)
 {
     m_updatesEnabled = updatesEnabled;
+    if (m_updatesEnabled && m_needsRedraw) requestUpdate();
 }
 
 bool GLWidget::zBuffer() const
@@ -228,6 +251,7 @@ bool GLWidget::zBuffer() const
 void GLWidget::setZBuffer(bool zBuffer)
 {
     m_zBuffer = zBuffer;
+    requestUpdate();
 }
 
 QString GLWidget::bufferState() const
@@ -237,7 +261,10 @@ QString GLWidget::bufferState() const
 
 void GLWidget::setBufferState(const QString &bufferState)
 {
+    if (m_bufferState == bufferState) return;
+
     m_bufferState = bufferState;
+    requestUpdate();
 }
 
 QString GLWidget::parserStatus() const
@@ -247,7 +274,10 @@ QString GLWidget::parserStatus() const
 
 void GLWidget::setParserStatus(const QString &parserStatus)
 {
+    if (m_parserStatus == parserStatus) return;
+
     m_parserStatus = parserStatus;
+    requestUpdate();
 }
 
 
@@ -259,6 +289,7 @@ double GLWidget::lineWidth() const
 void GLWidget::setLineWidth(double lineWidth)
 {
     m_lineWidth = lineWidth;
+    requestUpdate();
 }
 
 void GLWidget::setTopView()
@@ -297,8 +328,9 @@ void GLWidget::setIsometricView()
 void GLWidget::beginViewAnimation() {
     m_xRotStored = m_xRot;
     m_yRotStored = m_yRot;
-    m_animationFrame = 0;
+    m_animationTime.start();
     m_animateView = true;
+    requestUpdate();
 }
 
 void GLWidget::stopViewAnimation() {
@@ -312,6 +344,7 @@ QColor GLWidget::colorText() const
 void GLWidget::setColorText(const QColor &colorText)
 {
     m_colorText = colorText;
+    requestUpdate();
 }
 
 QColor GLWidget::colorBackground() const
@@ -322,6 +355,7 @@ QColor GLWidget::colorBackground() const
 void GLWidget::setColorBackground(const QColor &colorBackground)
 {
     m_colorBackground = colorBackground;
+    requestUpdate();
 }
 
 
@@ -329,8 +363,12 @@ void GLWidget::setFps(int fps)
 {
     if (fps <= 0) return;
     m_targetFps = fps;
-    m_timerPaint.stop();
-    m_timerPaint.start(m_vsync ? 0 : 1000 / fps, Qt::PreciseTimer, this);
+
+    // Timer runs only while redraw is pending
+    if (m_timerPaint.isActive()) {
+        m_timerPaint.stop();
+        requestUpdate();
+    }
 }
 
 QTime GLWidget::estimatedTime() const
@@ -340,7 +378,10 @@ QTime GLWidget::estimatedTime() const
 
 void GLWidget::setEstimatedTime(const QTime &estimatedTime)
 {
+    if (m_estimatedTime == estimatedTime) return;
+
     m_estimatedTime = estimatedTime;
+    requestUpdate();
 }
 
 QTime GLWidget::spendTime() const
@@ -350,7 +391,10 @@ QTime GLWidget::spendTime() const
 
 void GLWidget::setSpendTime(const QTime &spendTime)
 {
+    if (m_spendTime == spendTime) return;
+
     m_spendTime = spendTime;
+    requestUpdate();
 }
 
 void GLWidget::initializeGL()
@@ -388,6 +432,8 @@ void GLWidget::updateProjection()
 
     double asp = (double)width() / height();
     m_projectionMatrix.frustum((-0.5 + m_xPan) * asp, (0.5 + m_xPan) * asp, -0.5 + m_yPan, 0.5 + m_yPan, 2, m_distance * 2);
+
+    requestUpdate();
 }
 
 void GLWidget::updateView()
@@ -410,6 +456,8 @@ void GLWidget::updateView()
     m_viewMatrix.translate(-m_xLookAt, -m_yLookAt, -m_zLookAt);
 
     m_viewMatrix.rotate(-90, 1.0, 0.0, 0.0);
+
+    requestUpdate();
 }
 
 #ifdef GLES
@@ -460,6 +508,7 @@ void GLWidget::paintEvent(QPaintEvent *pe) {
 
         // Draw geometries
         foreach (ShaderDrawable *drawable, m_shaderDrawables) {
+            drawable->setViewProjection(m_projectionMatrix * m_viewMatrix, size());
             drawable->draw(m_shaderProgram);
             if (drawable->visible()) vertices += drawable->getVertexCount();
         }
@@ -504,10 +553,10 @@ void GLWidget::paintEvent(QPaintEvent *pe) {
     painter.drawText(QPoint(this->width() - fm.width(str) - 10, y + 15), str);
 
     m_frames++;
-
-#ifdef GLES
-    update();
-#endif
+    if (!m_countingFrames) {
+        m_countingFrames = true;
+        QTimer::singleShot(1000, this, SLOT(onFramesTimer()));
+    }
 }
 
 void GLWidget::mousePressEvent(QMouseEvent *event)
@@ -521,6 +570,11 @@ void GLWidget::mousePressEvent(QMouseEvent *event)
 
 void GLWidget::mouseMoveEvent(QMouseEvent *event)
 {
+    if (event->buttons() == Qt::NoButton) {
+        emit pointHovered(event->pos());
+        return;
+    }
+
     if ((event->buttons() & Qt::MiddleButton && !(event->modifiers() & Qt::ShiftModifier)) || event->buttons() & Qt::LeftButton) {
 
         stopViewAnimation();
@@ -543,6 +597,14 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event)
     }
 }
 
+void GLWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton
+            && (event->pos() - m_lastPos).manhattanLength() < QApplication::startDragDistance()) {
+        emit pointClicked(event->pos());
+    }
+}
+
 void GLWidget::wheelEvent(QWheelEvent *we)
 {
     if (m_zoom > 0.1 && we->delta() < 0) {
@@ -567,9 +629,15 @@ void GLWidget::timerEvent(QTimerEvent *te)
 {
     if (te->timerId() == m_timerPaint.timerId()) {
         if (m_animateView) viewAnimation();
-#ifndef GLES
-        if (m_updatesEnabled) update();
-#endif
+
+        // Pending redraws are kept while updates are disabled
+        if (m_needsRedraw && m_updatesEnabled) {
+            m_needsRedraw = false;
+            update();
+        }
+
+        // Idle, timer is restarted by next request
+        if (!m_animateView) m_timerPaint.stop();
     } else {
 #ifdef GLES
         QOpenGLWidget::timerEvent(te);
@@ -83,8 +83,14 @@ public:
 signals:
     void rotationChanged();
     void resized();
+    // Left button released w/o dragging
+    void pointClicked(QPoint pos);
+    // Mouse moved w/o buttons pressed
+    void pointHovered(QPoint pos);
 
 public slots:
+    // Schedules redraw, requests are coalesced to one frame per timer interval
+    void requestUpdate();
 
 private slots:
     void onFramesTimer();
@@ -107,7 +113,9 @@ private:
     int m_frames = 0;
     int m_fps = 0;
     int m_targetFps;
-    int m_animationFrame;
+    bool m_countingFrames;
+    bool m_needsRedraw;
+    QTime m_animationTime;
     QTime m_spendTime;
     QTime m_estimatedTime;
     QBasicTimer m_timerPaint;
@@ -146,6 +154,7 @@ protected:
 
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
     void wheelEvent(QWheelEvent *we);
 
     void timerEvent(QTimerEvent *);